@@ -0,0 +1,490 @@
+/*
+	Madd Software Renderer
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "blend.h"
+
+typedef int SRIntVector __attribute__ ((vector_size(16)));
+
+SRKernels *srKernels = &srKernelsScalar;
+
+/**
+ * Scalar kernels. These define the exact results that the vector implementations must reproduce.
+ */
+static void srBlendScalar(uint32_t *put32, const uint32_t *scan32, size_t count, int alphaShift)
+{
+	register int alphaIndex = alphaShift / 8;
+	register uint8_t *put = (uint8_t*) put32;
+	register const uint8_t *scan = (const uint8_t*) scan32;
+	
+	while (count--)
+	{
+		register int srcAlpha = (int) scan[alphaIndex];
+		register int dstAlpha = (int) put[alphaIndex];
+		register int outAlpha = srcAlpha + (int) dstAlpha * (255 - srcAlpha) / 255;
+
+		if (outAlpha == 0)
+		{
+			*((uint32_t*)put) = 0;
+		}
+		else
+		{
+			SRIntVector vdst = {put[0], put[1], put[2], put[3]};
+			SRIntVector vsrc = {scan[0], scan[1], scan[2], scan[3]};
+			SRIntVector result = (
+				(vsrc * srcAlpha)/255
+				+ (vdst * dstAlpha * (255-srcAlpha))/(255*255)
+			)*255/outAlpha;
+			
+			put[0] = (uint8_t) result[0];
+			put[1] = (uint8_t) result[1];
+			put[2] = (uint8_t) result[2];
+			put[3] = (uint8_t) result[3];
+			put[alphaIndex] = outAlpha;
+		};
+
+		scan += 4;
+		put += 4;
+	};
+};
+
+static void srCopyScalar(void *put, const void *scan, size_t size)
+{
+	memcpy(put, scan, size);
+};
+
+static void srFillScalar(uint32_t *put, uint32_t pixel, size_t count)
+{
+	while (count--) *put++ = pixel;
+};
+
+SRKernels srKernelsScalar = {
+	.name = "scalar",
+	.blend = srBlendScalar,
+	.copy = srCopyScalar,
+	.fill = srFillScalar,
+};
+
+/**
+ * SSE2 kernels.
+ *
+ * Blending has three cases, chosen per group of 4 pixels:
+ *  - All sources opaque: the result is exactly the source.
+ *  - All destinations opaque: the output alpha is 255 and the equation reduces to the premultiplied form
+ *    src*srcAlpha/255 + dst*(255-srcAlpha)/255, which we compute in 16-bit lanes.
+ *  - Otherwise, the full equation is evaluated in single-precision floats. Every intermediate product
+ *    is below 2^24, so it is exact, and each quotient is at least 1/65025 away from the next integer,
+ *    which is more than the rounding error of a division; so truncating each quotient gives the same
+ *    result as the integer division in the scalar code.
+ */
+static inline __m128i srDiv255SSE2(__m128i x)
+{
+	// exact x/255 for 16-bit x <= 65534
+	return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+};
+
+static inline __m128 srTruncSSE2(__m128 x)
+{
+	return _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+};
+
+static inline __m128i srBlendOpaqueSSE2(__m128i src, __m128i dst, __m128i alphaCount, __m128i alphaBits)
+{
+	// broadcast the source alpha of each pixel to all of its bytes
+	__m128i alpha = _mm_srl_epi32(_mm_and_si128(src, alphaBits), alphaCount);
+	alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+	alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+	
+	__m128i zero = _mm_setzero_si128();
+	__m128i max = _mm_set1_epi16(255);
+	
+	__m128i alphaLo = _mm_unpacklo_epi8(alpha, zero);
+	__m128i alphaHi = _mm_unpackhi_epi8(alpha, zero);
+	
+	__m128i lo = _mm_add_epi16(
+		srDiv255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), alphaLo)),
+		srDiv255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(max, alphaLo)))
+	);
+	
+	__m128i hi = _mm_add_epi16(
+		srDiv255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), alphaHi)),
+		srDiv255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(max, alphaHi)))
+	);
+	
+	return _mm_or_si128(_mm_packus_epi16(lo, hi), alphaBits);
+};
+
+static inline __m128i srBlendGenericSSE2(__m128i src, __m128i dst, int alphaShift)
+{
+	__m128i byteMask = _mm_set1_epi32(0xFF);
+	__m128i alphaCount = _mm_cvtsi32_si128(alphaShift);
+	__m128 f255 = _mm_set1_ps(255.0f);
+	__m128 f65025 = _mm_set1_ps(65025.0f);
+	
+	__m128 srcAlpha = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(src, alphaCount), byteMask));
+	__m128 dstAlpha = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(dst, alphaCount), byteMask));
+	__m128 dstWeight = _mm_mul_ps(dstAlpha, _mm_sub_ps(f255, srcAlpha));
+	__m128i outAlpha = _mm_cvttps_epi32(_mm_add_ps(srcAlpha, srTruncSSE2(_mm_div_ps(dstWeight, f255))));
+	__m128 divisor = _mm_max_ps(_mm_cvtepi32_ps(outAlpha), _mm_set1_ps(1.0f));
+	
+	__m128i result = _mm_sll_epi32(outAlpha, alphaCount);
+	int shift;
+	for (shift=0; shift<32; shift+=8)
+	{
+		if (shift == alphaShift) continue;
+		
+		__m128i count = _mm_cvtsi32_si128(shift);
+		__m128 s = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(src, count), byteMask));
+		__m128 d = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(dst, count), byteMask));
+		
+		__m128 a = srTruncSSE2(_mm_div_ps(_mm_mul_ps(s, srcAlpha), f255));
+		__m128 b = srTruncSSE2(_mm_div_ps(_mm_mul_ps(d, dstWeight), f65025));
+		__m128i c = _mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(_mm_add_ps(a, b), f255), divisor));
+		
+		result = _mm_or_si128(result, _mm_sll_epi32(c, count));
+	};
+	
+	// pixels whose output alpha is zero become all zero
+	return _mm_andnot_si128(_mm_cmpeq_epi32(outAlpha, _mm_setzero_si128()), result);
+};
+
+static void srBlendSSE2(uint32_t *put, const uint32_t *scan, size_t count, int alphaShift)
+{
+	__m128i alphaCount = _mm_cvtsi32_si128(alphaShift);
+	__m128i alphaBits = _mm_sll_epi32(_mm_set1_epi32(0xFF), alphaCount);
+	
+	for (; count >= 4; count -= 4)
+	{
+		__m128i src = _mm_loadu_si128((const __m128i*) scan);
+		__m128i dst = _mm_loadu_si128((const __m128i*) put);
+		
+		int srcOpaque = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(src, alphaBits), alphaBits));
+		int dstOpaque = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(dst, alphaBits), alphaBits));
+		
+		if (srcOpaque == 0xFFFF)
+		{
+			_mm_storeu_si128((__m128i*) put, src);
+		}
+		else if (dstOpaque == 0xFFFF)
+		{
+			_mm_storeu_si128((__m128i*) put, srBlendOpaqueSSE2(src, dst, alphaCount, alphaBits));
+		}
+		else
+		{
+			_mm_storeu_si128((__m128i*) put, srBlendGenericSSE2(src, dst, alphaShift));
+		};
+		
+		scan += 4;
+		put += 4;
+	};
+	
+	srBlendScalar(put, scan, count, alphaShift);
+};
+
+static void srCopySSE2(void *put_, const void *scan_, size_t size)
+{
+	register char *destChar = (char*) put_;
+	register const char *srcChar = (const char*) scan_;
+	
+	// align the destination; the source may stay unaligned
+	while (((uint64_t)destChar & 0xF) && size) {*destChar++ = *srcChar++; size--;};
+	
+	while (size >= 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*) srcChar);
+		__m128i b = _mm_loadu_si128((const __m128i*) (srcChar + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*) (srcChar + 32));
+		__m128i d = _mm_loadu_si128((const __m128i*) (srcChar + 48));
+		_mm_store_si128((__m128i*) destChar, a);
+		_mm_store_si128((__m128i*) (destChar + 16), b);
+		_mm_store_si128((__m128i*) (destChar + 32), c);
+		_mm_store_si128((__m128i*) (destChar + 48), d);
+		srcChar += 64;
+		destChar += 64;
+		size -= 64;
+	};
+	
+	while (size >= 16)
+	{
+		_mm_store_si128((__m128i*) destChar, _mm_loadu_si128((const __m128i*) srcChar));
+		srcChar += 16;
+		destChar += 16;
+		size -= 16;
+	};
+	
+	while (size--) *destChar++ = *srcChar++;
+};
+
+static void srFillSSE2(uint32_t *put, uint32_t pixel, size_t count)
+{
+	while (((uint64_t)put & 0xF) && count)
+	{
+		*put++ = pixel;
+		count--;
+	};
+	
+	__m128i value = _mm_set1_epi32(pixel);
+	while (count >= 4)
+	{
+		_mm_store_si128((__m128i*) put, value);
+		put += 4;
+		count -= 4;
+	};
+	
+	while (count--) *put++ = pixel;
+};
+
+SRKernels srKernelsSSE2 = {
+	.name = "sse2",
+	.blend = srBlendSSE2,
+	.copy = srCopySSE2,
+	.fill = srFillSSE2,
+};
+
+/**
+ * AVX2 kernels; the same algorithms as SSE2, on 8 pixels at a time.
+ */
+#define	SR_AVX2		__attribute__ ((target("avx2")))
+
+static inline SR_AVX2 __m256i srDiv255AVX2(__m256i x)
+{
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8);
+};
+
+static inline SR_AVX2 __m256 srTruncAVX2(__m256 x)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(x));
+};
+
+static inline SR_AVX2 __m256i srBlendOpaqueAVX2(__m256i src, __m256i dst, __m128i alphaCount, __m256i alphaBits)
+{
+	__m256i alpha = _mm256_srl_epi32(_mm256_and_si256(src, alphaBits), alphaCount);
+	alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 8));
+	alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 16));
+	
+	__m256i zero = _mm256_setzero_si256();
+	__m256i max = _mm256_set1_epi16(255);
+	
+	__m256i alphaLo = _mm256_unpacklo_epi8(alpha, zero);
+	__m256i alphaHi = _mm256_unpackhi_epi8(alpha, zero);
+	
+	__m256i lo = _mm256_add_epi16(
+		srDiv255AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(src, zero), alphaLo)),
+		srDiv255AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), _mm256_sub_epi16(max, alphaLo)))
+	);
+	
+	__m256i hi = _mm256_add_epi16(
+		srDiv255AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(src, zero), alphaHi)),
+		srDiv255AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), _mm256_sub_epi16(max, alphaHi)))
+	);
+	
+	// unpack and pack both work within 128-bit lanes, so the pixel order is preserved
+	return _mm256_or_si256(_mm256_packus_epi16(lo, hi), alphaBits);
+};
+
+static inline SR_AVX2 __m256i srBlendGenericAVX2(__m256i src, __m256i dst, int alphaShift)
+{
+	__m256i byteMask = _mm256_set1_epi32(0xFF);
+	__m128i alphaCount = _mm_cvtsi32_si128(alphaShift);
+	__m256 f255 = _mm256_set1_ps(255.0f);
+	__m256 f65025 = _mm256_set1_ps(65025.0f);
+	
+	__m256 srcAlpha = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(src, alphaCount), byteMask));
+	__m256 dstAlpha = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(dst, alphaCount), byteMask));
+	__m256 dstWeight = _mm256_mul_ps(dstAlpha, _mm256_sub_ps(f255, srcAlpha));
+	__m256i outAlpha = _mm256_cvttps_epi32(_mm256_add_ps(srcAlpha, srTruncAVX2(_mm256_div_ps(dstWeight, f255))));
+	__m256 divisor = _mm256_max_ps(_mm256_cvtepi32_ps(outAlpha), _mm256_set1_ps(1.0f));
+	
+	__m256i result = _mm256_sll_epi32(outAlpha, alphaCount);
+	int shift;
+	for (shift=0; shift<32; shift+=8)
+	{
+		if (shift == alphaShift) continue;
+		
+		__m128i count = _mm_cvtsi32_si128(shift);
+		__m256 s = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(src, count), byteMask));
+		__m256 d = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(dst, count), byteMask));
+		
+		__m256 a = srTruncAVX2(_mm256_div_ps(_mm256_mul_ps(s, srcAlpha), f255));
+		__m256 b = srTruncAVX2(_mm256_div_ps(_mm256_mul_ps(d, dstWeight), f65025));
+		__m256i c = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_mul_ps(_mm256_add_ps(a, b), f255), divisor));
+		
+		result = _mm256_or_si256(result, _mm256_sll_epi32(c, count));
+	};
+	
+	return _mm256_andnot_si256(_mm256_cmpeq_epi32(outAlpha, _mm256_setzero_si256()), result);
+};
+
+static SR_AVX2 void srBlendAVX2(uint32_t *put, const uint32_t *scan, size_t count, int alphaShift)
+{
+	__m128i alphaCount = _mm_cvtsi32_si128(alphaShift);
+	__m256i alphaBits = _mm256_sll_epi32(_mm256_set1_epi32(0xFF), alphaCount);
+	
+	for (; count >= 8; count -= 8)
+	{
+		__m256i src = _mm256_loadu_si256((const __m256i*) scan);
+		__m256i dst = _mm256_loadu_si256((const __m256i*) put);
+		
+		int srcOpaque = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(src, alphaBits), alphaBits));
+		int dstOpaque = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(dst, alphaBits), alphaBits));
+		
+		if (srcOpaque == -1)
+		{
+			_mm256_storeu_si256((__m256i*) put, src);
+		}
+		else if (dstOpaque == -1)
+		{
+			_mm256_storeu_si256((__m256i*) put, srBlendOpaqueAVX2(src, dst, alphaCount, alphaBits));
+		}
+		else
+		{
+			_mm256_storeu_si256((__m256i*) put, srBlendGenericAVX2(src, dst, alphaShift));
+		};
+		
+		scan += 8;
+		put += 8;
+	};
+	
+	srBlendSSE2(put, scan, count, alphaShift);
+};
+
+static SR_AVX2 void srCopyAVX2(void *put_, const void *scan_, size_t size)
+{
+	register char *destChar = (char*) put_;
+	register const char *srcChar = (const char*) scan_;
+	
+	while (((uint64_t)destChar & 0x1F) && size) {*destChar++ = *srcChar++; size--;};
+	
+	while (size >= 128)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*) srcChar);
+		__m256i b = _mm256_loadu_si256((const __m256i*) (srcChar + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*) (srcChar + 64));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (srcChar + 96));
+		_mm256_store_si256((__m256i*) destChar, a);
+		_mm256_store_si256((__m256i*) (destChar + 32), b);
+		_mm256_store_si256((__m256i*) (destChar + 64), c);
+		_mm256_store_si256((__m256i*) (destChar + 96), d);
+		srcChar += 128;
+		destChar += 128;
+		size -= 128;
+	};
+	
+	while (size >= 32)
+	{
+		_mm256_store_si256((__m256i*) destChar, _mm256_loadu_si256((const __m256i*) srcChar));
+		srcChar += 32;
+		destChar += 32;
+		size -= 32;
+	};
+	
+	while (size--) *destChar++ = *srcChar++;
+};
+
+static SR_AVX2 void srFillAVX2(uint32_t *put, uint32_t pixel, size_t count)
+{
+	while (((uint64_t)put & 0x1F) && count)
+	{
+		*put++ = pixel;
+		count--;
+	};
+	
+	__m256i value = _mm256_set1_epi32(pixel);
+	while (count >= 8)
+	{
+		_mm256_store_si256((__m256i*) put, value);
+		put += 8;
+		count -= 8;
+	};
+	
+	while (count--) *put++ = pixel;
+};
+
+SRKernels srKernelsAVX2 = {
+	.name = "avx2",
+	.blend = srBlendAVX2,
+	.copy = srCopyAVX2,
+	.fill = srFillAVX2,
+};
+
+int srKernelsSupported(SRKernels *kernels)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (kernels == &srKernelsScalar) return 1;
+	
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+	if (kernels == &srKernelsSSE2) return (edx & bit_SSE2) != 0;
+	
+	if (kernels == &srKernelsAVX2)
+	{
+		if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0) return 0;
+		
+		// the OS must have enabled saving of the YMM registers
+		uint32_t xcr0, xcr0hi;
+		__asm__ volatile ("xgetbv" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+		if ((xcr0 & 6) != 6) return 0;
+		
+		if (__get_cpuid_max(0, NULL) < 7) return 0;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		return (ebx & bit_AVX2) != 0;
+	};
+	
+	return 0;
+};
+
+void srInitKernels()
+{
+	static SRKernels *all[] = {&srKernelsAVX2, &srKernelsSSE2, &srKernelsScalar};
+	const char *override = getenv("SOFTRENDER_KERNELS");
+	
+	int i;
+	for (i=0; i<3; i++)
+	{
+		if (override != NULL && strcmp(all[i]->name, override) != 0) continue;
+		if (srKernelsSupported(all[i]))
+		{
+			srKernels = all[i];
+			return;
+		};
+	};
+	
+	// the override was not usable; pick the best one
+	for (i=0; i<3; i++)
+	{
+		if (srKernelsSupported(all[i]))
+		{
+			srKernels = all[i];
+			return;
+		};
+	};
+};
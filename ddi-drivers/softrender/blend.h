@@ -0,0 +1,87 @@
+/*
+	Madd Software Renderer
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SOFTRENDER_BLEND_H_
+#define SOFTRENDER_BLEND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Pixel kernels used by the surface operations. They work on rows of 32-bit pixels (4 bytes per pixel,
+ * no pixel spacing); 'alphaShift' is the bit position of the alpha channel within a pixel. Every
+ * implementation must produce exactly the same pixels as the scalar one.
+ */
+typedef struct
+{
+	/**
+	 * Name of the implementation ("scalar", "sse2" or "avx2").
+	 */
+	const char *name;
+	
+	/**
+	 * Alpha-blend 'count' pixels from 'scan' onto 'put' (straight, i.e. non-premultiplied, alpha).
+	 */
+	void (*blend)(uint32_t *put, const uint32_t *scan, size_t count, int alphaShift);
+	
+	/**
+	 * Copy 'size' bytes from 'scan' to 'put'. The areas do not overlap.
+	 */
+	void (*copy)(void *put, const void *scan, size_t size);
+	
+	/**
+	 * Set 'count' pixels starting at 'put' to 'pixel'.
+	 */
+	void (*fill)(uint32_t *put, uint32_t pixel, size_t count);
+} SRKernels;
+
+/**
+ * All the implementations. The SSE2 and AVX2 ones may only be used if the CPU (and, for AVX2, the OS)
+ * supports them.
+ */
+extern SRKernels srKernelsScalar;
+extern SRKernels srKernelsSSE2;
+extern SRKernels srKernelsAVX2;
+
+/**
+ * The implementation selected by srInitKernels().
+ */
+extern SRKernels *srKernels;
+
+/**
+ * Returns nonzero if the given implementation can run on this machine.
+ */
+int srKernelsSupported(SRKernels *kernels);
+
+/**
+ * Select the fastest implementation supported by this machine. The SOFTRENDER_KERNELS environment
+ * variable may be set to the name of an implementation to override the choice (if supported).
+ */
+void srInitKernels();
+
+#endif
@@ -172,6 +172,33 @@ static void srViewport(DDIGL_Context *ctx, GLint x, GLint y, GLsizei w, GLsizei
 	srctx->viewH = h;
 };
 
+static GLenum srSetCapability(DDIGL_Context *ctx, GLenum cap, GLboolean enable)
+{
+	SRContext *srctx = (SRContext*) ctx->drvdata;
+	
+	switch (cap)
+	{
+	case GL_DEPTH_TEST:
+		srctx->depthTest = !!enable;
+		return GL_NO_ERROR;
+	default:
+		return GL_INVALID_ENUM;
+	};
+};
+
+static GLenum srDepthFunc(DDIGL_Context *ctx, GLenum func)
+{
+	SRContext *srctx = (SRContext*) ctx->drvdata;
+	srctx->depthFunc = func;
+	return GL_NO_ERROR;
+};
+
+static void srDepthMask(DDIGL_Context *ctx, GLboolean flag)
+{
+	SRContext *srctx = (SRContext*) ctx->drvdata;
+	srctx->depthWrite = !!flag;
+};
+
 int srInitGL(void *drvctx, DDIPixelFormat *format, DDIGL_ContextParams *params, DDIGL_Context *ctx)
 {
 	// make sure the pixel format is suitable
@@ -226,6 +253,9 @@ int srInitGL(void *drvctx, DDIPixelFormat *format, DDIGL_ContextParams *params,
 	srctx->clearColor = 0;
 	srctx->clearDepth = 0xFFFF;
 	srctx->clearStencil = 0;
+	srctx->depthTest = 0;
+	srctx->depthFunc = GL_LESS;
+	srctx->depthWrite = 1;
 
 	// finalize our work
 	ctx->drvdata = srctx;
@@ -244,7 +274,11 @@ int srInitGL(void *drvctx, DDIPixelFormat *format, DDIGL_ContextParams *params,
 	ctx->setAttribEnable = srSetAttribEnable;
 	ctx->attribPointer = srAttribPointer;
 	ctx->drawArrays = srDrawArrays;
+	ctx->drawElements = srDrawElements;
 	ctx->viewport = srViewport;
+	ctx->setCapability = srSetCapability;
+	ctx->depthFunc = srDepthFunc;
+	ctx->depthMask = srDepthMask;
 	
 	// OK
 	return GL_NO_ERROR;
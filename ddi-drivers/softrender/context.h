@@ -126,6 +126,19 @@ typedef struct
 	 */
 	int						viewX, viewY;
 	int						viewW, viewH;
+	
+	/**
+	 * Depth test state: whether GL_DEPTH_TEST is enabled, the comparison function (GL_LESS
+	 * by default) and whether the depth buffer is written to (glDepthMask()).
+	 */
+	int						depthTest;
+	GLenum						depthFunc;
+	int						depthWrite;
+	
+	/**
+	 * Rasterizer state (bins, vertex arena, etc), allocated by draw.c on first draw.
+	 */
+	struct __sr_rasterizer*				raster;
 } SRContext;
 
 int srInitGL(void *drvctx, DDIPixelFormat *format, DDIGL_ContextParams *params, DDIGL_Context *ctx);
@@ -29,219 +29,836 @@
 #include "context.h"
 #include "draw.h"
 #include "vao.h"
+#include "buffer.h"
+#include "specialize.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 
-static int srMin3(int a, int b, int c)
+/**
+ * Tile size (in pixels, power of 2). The framebuffer is split into tiles of this size, each
+ * triangle is binned into every tile it touches, and then tiles are shaded independently
+ * (possibly in parallel).
+ */
+#define	SR_TILE_SHIFT					5
+#define	SR_TILE_SIZE					(1 << SR_TILE_SHIFT)
+
+/**
+ * Number of subpixel bits in the fixed-point vertex coordinates.
+ */
+#define	SR_SUBPIXEL_BITS				4
+#define	SR_SUBPIXEL_ONE					(1 << SR_SUBPIXEL_BITS)
+
+/**
+ * Triangles with all vertices within this many pixels of the framebuffer are set up in fixed
+ * point, which keeps the edge function products within 64 bits; others go through the slower
+ * floating-point setup in srSetupLarge().
+ */
+#define	SR_GUARD_BAND					(1 << 20)
+
+/**
+ * Maximum number of triangles binned before the bins are flushed (shaded).
+ */
+#define	SR_BATCH_SIZE					4096
+
+/**
+ * Size of the post-transform vertex cache used by indexed draws (power of 2).
+ */
+#define	SR_VERTEX_CACHE_SIZE				64
+
+/**
+ * Maximum number of worker threads.
+ */
+#define	SR_MAX_WORKERS					31
+
+/**
+ * Set in a bin entry if the triangle covers the whole tile, so edge functions need not be
+ * tested for its pixels.
+ */
+#define	SR_BIN_FULL					1
+
+/**
+ * A triangle after setup. Edge function 'i' is zero on the edge opposite vertex 'i', and at
+ * pixel (x, y) its value is e0[i] + x*dx[i] + y*dy[i] (with the top-left fill rule bias
+ * already included in e0). A pixel is inside if all 3 are non-negative.
+ */
+typedef struct
+{
+	/**
+	 * Indices of the vertices in the vertex arena.
+	 */
+	uint32_t					v[3];
+	
+	/**
+	 * Edge functions.
+	 */
+	int64_t						e0[3];
+	int64_t						dx[3];
+	int64_t						dy[3];
+	
+	/**
+	 * Reciprocal of the sum of the edge functions (twice the area in fixed point units).
+	 */
+	float						invArea;
+	
+	/**
+	 * Window-space depth (0.0-1.0) at each vertex.
+	 */
+	float						z[3];
+	
+	/**
+	 * Bounding box in pixels, clipped to the framebuffer, inclusive.
+	 */
+	int						minX, minY;
+	int						maxX, maxY;
+} SRTriangle;
+
+/**
+ * A tile bin: list of triangles touching the tile, in submission order. Each entry is the
+ * triangle index shifted left by one, OR'ed with SR_BIN_FULL if appropriate.
+ */
+typedef struct
+{
+	uint32_t*					tris;
+	int						count;
+	int						cap;
+} SRBin;
+
+/**
+ * Rasterizer state of a context.
+ */
+typedef struct __sr_rasterizer
+{
+	/**
+	 * The context we belong to.
+	 */
+	SRContext*					srctx;
+	
+	/**
+	 * Vertex arena. Each slot is 'vertexStride' bytes and holds an SRVertex followed by the
+	 * vertex shader outputs. Slots are reused after every flush.
+	 */
+	char*						arenaBase;
+	char*						arena;
+	size_t						arenaCap;
+	size_t						vertexStride;
+	uint32_t					numVertices;
+	
+	/**
+	 * Post-transform vertex cache for indexed draws: maps vertex index to arena slot.
+	 */
+	GLint						cacheIndex[SR_VERTEX_CACHE_SIZE];
+	uint32_t					cacheSlot[SR_VERTEX_CACHE_SIZE];
+	
+	/**
+	 * Triangles waiting to be shaded.
+	 */
+	SRTriangle					tris[SR_BATCH_SIZE];
+	int						numTris;
+	
+	/**
+	 * The tile grid and its bins.
+	 */
+	int						tilesX, tilesY;
+	SRBin*						bins;
+	
+	/**
+	 * List of non-empty tiles, and the next one to be taken by a thread.
+	 */
+	int*						activeTiles;
+	int						numActive;
+	volatile int					nextActive;
+	
+	/**
+	 * Pipeline (specialized for the current draw) and framebuffer the batch was binned for.
+	 */
+	SRProgram					prog;
+	SRFramebuffer*					fbuf;
+	unsigned int					width, height;
+} SRRasterizer;
+
+/**
+ * The worker pool, shared by all contexts in the process; 'srPoolLock' is held while a batch
+ * is being shaded. 'srPoolWorkers' is -1 until the pool is started.
+ */
+static pthread_mutex_t srPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static int srPoolWorkers = -1;
+static sem_t srPoolStart;
+static sem_t srPoolDone;
+static SRRasterizer* volatile srPoolJob;
+
+static int64_t srMin3(int64_t a, int64_t b, int64_t c)
 {
 	if (a > b) a = b;
 	if (a > c) a = c;
 	return a;
 };
 
-static int srMax3(int a, int b, int c)
+static int64_t srMax3(int64_t a, int64_t b, int64_t c)
 {
 	if (a < b) a = b;
 	if (a < c) a = c;
 	return a;
 };
 
-static void srDrawTriangle(SRContext *srctx, SRVertex *a, SRVertex *b, SRVertex *c)
+static int srDepthPass(GLenum func, uint32_t z, uint32_t current)
 {
-	// convert to framebuffer coordinates
-	int ax = srctx->viewX + srctx->viewW * (0.5f * (a->pos[0] + 1.0f));
-	int bx = srctx->viewX + srctx->viewW * (0.5f * (b->pos[0] + 1.0f));
-	int cx = srctx->viewX + srctx->viewW * (0.5f * (c->pos[0] + 1.0f));
-	
-	int ay = srctx->viewY + srctx->viewH * (0.5f * (a->pos[1] + 1.0f));
-	int by = srctx->viewY + srctx->viewH * (0.5f * (b->pos[1] + 1.0f));
-	int cy = srctx->viewY + srctx->viewH * (0.5f * (c->pos[1] + 1.0f));
-	
-	// calculate the bounding box
-	int minX = srMin3(ax, bx, cx);
-	int maxX = srMax3(ax, bx, cx);
-	int minY = srMin3(ay, by, cy);
-	int maxY = srMax3(ay, by, cy);
-	
-	// create vectors
-	SRVec2D posA = {ax, ay};
-	SRVec2D posB = {bx, by};
-	SRVec2D posC = {cx, by};
-	
-	// 2 times the area of the triangle
-	SRVec2D edge1 = posB - posA;
-	SRVec2D edge2 = posC - posA;
-	int areaTotal = edge1[0] * edge2[1] - edge1[1] * edge2[0];
-	
-	// rasterize
+	switch (func)
+	{
+	case GL_NEVER:		return 0;
+	case GL_LESS:		return z < current;
+	case GL_EQUAL:		return z == current;
+	case GL_LEQUAL:		return z <= current;
+	case GL_GREATER:	return z > current;
+	case GL_NOTEQUAL:	return z != current;
+	case GL_GEQUAL:		return z >= current;
+	default:		return 1;
+	};
+};
+
+static SRVertex* srGetVertex(SRRasterizer *rast, uint32_t slot)
+{
+	return (SRVertex*) (rast->arena + rast->vertexStride * slot);
+};
+
+/**
+ * Shade all pixels of a triangle within the specified rectangle (inclusive) of a tile. Fragments
+ * which pass the coverage and depth tests are collected into spans of up to SR_SPAN_SIZE, which
+ * are then shaded and packed together.
+ */
+static void srShadeTriangle(SRRasterizer *rast, SRTriangle *tri, int full, int x0, int y0, int x1, int y1)
+{
+	SRContext *srctx = rast->srctx;
+	SRFramebuffer *fbuf = rast->fbuf;
+	
+	SRVertex *a = srGetVertex(rast, tri->v[0]);
+	SRVertex *b = srGetVertex(rast, tri->v[1]);
+	SRVertex *c = srGetVertex(rast, tri->v[2]);
+	
+	SRDepthStencilBuffer *depth = fbuf->depth;
+	int depthTest = srctx->depthTest && depth != NULL && depth->data != NULL;
+	int depthWrite = depthTest && srctx->depthWrite;
+	uint32_t depthMax = 0;
+	if (depthTest) depthMax = (depth->bits == 8) ? 0xFF : 0xFFFF;
+	
+	SRVector bary[SR_SPAN_SIZE];
+	int xs[SR_SPAN_SIZE];
+	int spanSize;
+	
+	int64_t rowW0 = tri->e0[0] + x0 * tri->dx[0] + y0 * tri->dy[0];
+	int64_t rowW1 = tri->e0[1] + x0 * tri->dx[1] + y0 * tri->dy[1];
+	int64_t rowW2 = tri->e0[2] + x0 * tri->dx[2] + y0 * tri->dy[2];
+	
 	int x, y;
-	for (y=minY; y<maxY; y++)
+	for (y=y0; y<=y1; y++)
 	{
-		if (y < 0 || y > srctx->currentBuffer->color[0]->height) continue;
+		int64_t w0 = rowW0;
+		int64_t w1 = rowW1;
+		int64_t w2 = rowW2;
+		size_t rowOffset = (size_t) (rast->height - y - 1) * rast->width;
+		spanSize = 0;
 		
-		for (x=minX; x<maxX; x++)
+		for (x=x0; x<=x1; x++)
 		{
-			if (x < 0 || x > srctx->currentBuffer->color[0]->width) continue;
-			
-			SRVec2D posFrag = {x, y};
-			
-			edge1 = posB - posFrag;
-			edge2 = posC - posFrag;
-			int areaA = edge1[0] * edge2[1] - edge1[1] * edge2[0];
-			
-			edge1 = posC - posFrag;
-			edge2 = posA - posFrag;
-			int areaB = edge1[0] * edge2[1] - edge1[1] * edge2[0];
-			
-			edge1 = posA - posFrag;
-			edge2 = posB - posFrag;
-			int areaC = edge1[0] * edge2[1] - edge1[1] * edge2[0];
-			
-			// barycentric coordinates
-			float baryA = (float) areaA / (float) areaTotal;
-			float baryB = (float) areaB / (float) areaTotal;
-			float baryC = (float) areaC / (float) areaTotal;
-			
-			// make sure the point lies inside the triangle, else continue
-			if (baryA < 0.0 || baryB < 0.0 || baryC < 0.0) continue;
-			
-			// form the bary vector
-			SRVector bary = {baryA, baryB, baryC, 0.0};
-			
-			// ask the fragment shader for colors
-			// TODO: uniforms
-			SRVector colors[8];
-			srctx->currentPipeline->fragmentShader(NULL, a->data, b->data, c->data, colors, bary);
-			
-			// write to color buffers
-			// TODO: all the other processing of fragments
-			int i;
-			for (i=0; i<8; i++)
+			if (full || (w0 | w1 | w2) >= 0)
 			{
-				SRColorBuffer *cbuf = srctx->currentBuffer->color[i];
-				if (cbuf != NULL)
+				float baryA = (float) w0 * tri->invArea;
+				float baryB = (float) w1 * tri->invArea;
+				float baryC = (float) w2 * tri->invArea;
+				
+				int visible = 1;
+				if (depthTest)
+				{
+					// the fragment shader cannot change the depth, so test before shading
+					float z = baryA * tri->z[0] + baryB * tri->z[1] + baryC * tri->z[2];
+					if (z < 0.0f || z > 1.0f)
+					{
+						visible = 0;
+					}
+					else
+					{
+						uint32_t zval = (uint32_t) (z * depthMax);
+						uint32_t current;
+						if (depth->bits == 8) current = ((uint8_t*) depth->data)[rowOffset + x];
+						else current = ((uint16_t*) depth->data)[rowOffset + x];
+						visible = srDepthPass(srctx->depthFunc, zval, current);
+						
+						if (visible && depthWrite)
+						{
+							if (depth->bits == 8) ((uint8_t*) depth->data)[rowOffset + x] = (uint8_t) zval;
+							else ((uint16_t*) depth->data)[rowOffset + x] = (uint16_t) zval;
+						};
+					};
+				};
+				
+				if (visible)
 				{
-					// calculate pixel value
-					uint32_t redPart = (uint32_t) (255 * colors[i][0]) << srctx->redShift;
-					uint32_t greenPart = (uint32_t) (255 * colors[i][1]) << srctx->greenShift;
-					uint32_t bluePart = (uint32_t) (255 * colors[i][2]) << srctx->blueShift;
-					uint32_t alphaPart = (uint32_t) (255 * colors[i][3]) << srctx->alphaShift;
-					uint32_t pixel = redPart | greenPart | bluePart | alphaPart;
+					SRVector fragBary = {baryA, baryB, baryC, 0.0};
+					bary[spanSize] = fragBary;
+					xs[spanSize] = x;
 					
-					// store it
-					uint32_t *put = (uint32_t*) cbuf->data;
-					put[(cbuf->height-y-1) * cbuf->width + x] = pixel;
+					if (++spanSize == SR_SPAN_SIZE)
+					{
+						srShadeSpan(&rast->prog, srctx, a, b, c, bary, xs, spanSize, rowOffset);
+						spanSize = 0;
+					};
 				};
 			};
+			
+			w0 += tri->dx[0];
+			w1 += tri->dx[1];
+			w2 += tri->dx[2];
 		};
+		
+		if (spanSize != 0) srShadeSpan(&rast->prog, srctx, a, b, c, bary, xs, spanSize, rowOffset);
+		
+		rowW0 += tri->dy[0];
+		rowW1 += tri->dy[1];
+		rowW2 += tri->dy[2];
+	};
+};
+
+/**
+ * Shade all triangles in a tile, in submission order.
+ */
+static void srShadeTile(SRRasterizer *rast, int tile)
+{
+	SRBin *bin = &rast->bins[tile];
+	int tileX0 = (tile % rast->tilesX) << SR_TILE_SHIFT;
+	int tileY0 = (tile / rast->tilesX) << SR_TILE_SHIFT;
+	int tileX1 = tileX0 + SR_TILE_SIZE - 1;
+	int tileY1 = tileY0 + SR_TILE_SIZE - 1;
+	
+	int i;
+	for (i=0; i<bin->count; i++)
+	{
+		SRTriangle *tri = &rast->tris[bin->tris[i] >> 1];
+		
+		int x0 = tileX0 > tri->minX ? tileX0 : tri->minX;
+		int y0 = tileY0 > tri->minY ? tileY0 : tri->minY;
+		int x1 = tileX1 < tri->maxX ? tileX1 : tri->maxX;
+		int y1 = tileY1 < tri->maxY ? tileY1 : tri->maxY;
+		
+		srShadeTriangle(rast, tri, bin->tris[i] & SR_BIN_FULL, x0, y0, x1, y1);
+	};
+	
+	bin->count = 0;
+};
+
+/**
+ * Take tiles off the active list and shade them until none are left. Called concurrently by
+ * the drawing thread and the workers.
+ */
+static void srShadeTiles(SRRasterizer *rast)
+{
+	while (1)
+	{
+		int index = __sync_fetch_and_add(&rast->nextActive, 1);
+		if (index >= rast->numActive) break;
+		srShadeTile(rast, rast->activeTiles[index]);
+	};
+};
+
+static void* srWorkerThread(void *context)
+{
+	while (1)
+	{
+		while (sem_wait(&srPoolStart) != 0);
+		srShadeTiles(srPoolJob);
+		sem_post(&srPoolDone);
+	};
+	
+	return NULL;
+};
+
+/**
+ * Start the worker pool if not yet started. By default we use one worker per CPU besides the
+ * drawing thread; the SOFTRENDER_THREADS environment variable can override the total number of
+ * threads. Called with 'srPoolLock' held.
+ */
+static void srStartPool()
+{
+	if (srPoolWorkers != -1) return;
+	srPoolWorkers = 0;
+	
+	long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *env = getenv("SOFTRENDER_THREADS");
+	if (env != NULL) numThreads = strtol(env, NULL, 10);
+	
+	long numWorkers = numThreads - 1;
+	if (numWorkers < 0) numWorkers = 0;
+	if (numWorkers > SR_MAX_WORKERS) numWorkers = SR_MAX_WORKERS;
+	if (numWorkers == 0) return;
+	
+	sem_init(&srPoolStart, 0, 0);
+	sem_init(&srPoolDone, 0, 0);
+	
+	while (srPoolWorkers < numWorkers)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, srWorkerThread, NULL) != 0) break;
+		pthread_detach(thread);
+		srPoolWorkers++;
 	};
 };
 
-static float srFetchFloat(GLenum typeFetch, const void **fetch)
+/**
+ * Shade all binned triangles and reset the batch.
+ */
+static void srFlush(SRRasterizer *rast)
 {
-	switch (typeFetch)
+	if (rast->numTris != 0)
 	{
-	// TODO: other types
-	case GL_FLOAT:
+		// compact the list of non-empty tiles
+		int numTiles = rast->tilesX * rast->tilesY;
+		int tile;
+		rast->numActive = 0;
+		for (tile=0; tile<numTiles; tile++)
 		{
-			const float *ffetch = (const float*) (*fetch);
-			*fetch = (ffetch+1);
-			return *ffetch;
+			if (rast->bins[tile].count != 0) rast->activeTiles[rast->numActive++] = tile;
 		};
-	default:
-		return 0.0f;
+		rast->nextActive = 0;
+		
+		pthread_mutex_lock(&srPoolLock);
+		srStartPool();
+		
+		int numWorkers = srPoolWorkers;
+		if (numWorkers > rast->numActive-1) numWorkers = rast->numActive-1;
+		
+		srPoolJob = rast;
+		int i;
+		for (i=0; i<numWorkers; i++) sem_post(&srPoolStart);
+		srShadeTiles(rast);
+		for (i=0; i<numWorkers; i++) while (sem_wait(&srPoolDone) != 0);
+		
+		pthread_mutex_unlock(&srPoolLock);
 	};
+	
+	rast->numTris = 0;
+	rast->numVertices = 0;
+	memset(rast->cacheIndex, 0xFF, sizeof(rast->cacheIndex));
 };
 
-static void srFetchData(GLenum typePut, void **put, GLenum typeFetch, const void **fetch)
+/**
+ * Prepare the rasterizer of a context for drawing 'count' vertices from the given vertex array with
+ * the current pipeline and framebuffer. Returns NULL and sets '*error' on error.
+ */
+static SRRasterizer* srBeginDraw(SRContext *srctx, DDIGL_VertexArray *vao, GLsizei count, GLenum *error)
 {
-	switch (typePut)
+	*error = GL_OUT_OF_MEMORY;
+
+	SRRasterizer *rast = srctx->raster;
+	if (rast == NULL)
+	{
+		rast = (SRRasterizer*) malloc(sizeof(SRRasterizer));
+		if (rast == NULL) return NULL;
+		memset(rast, 0, sizeof(SRRasterizer));
+		memset(rast->cacheIndex, 0xFF, sizeof(rast->cacheIndex));
+		rast->srctx = srctx;
+		srctx->raster = rast;
+	};
+	
+	DDIGL_Pipeline *pl = srctx->currentPipeline;
+	SRFramebuffer *fbuf = srctx->currentBuffer;
+	SRColorBuffer *cbuf = fbuf->color[0];
+	
+	// (re)allocate the tile grid if the framebuffer size changed
+	if (rast->width != cbuf->width || rast->height != cbuf->height)
 	{
-	// TODO: other types
-	case GL_FLOAT:
+		int tilesX = (cbuf->width + SR_TILE_SIZE - 1) >> SR_TILE_SHIFT;
+		int tilesY = (cbuf->height + SR_TILE_SIZE - 1) >> SR_TILE_SHIFT;
+		
+		int i;
+		for (i=0; i<rast->tilesX*rast->tilesY; i++) free(rast->bins[i].tris);
+		free(rast->bins);
+		free(rast->activeTiles);
+		
+		rast->tilesX = 0;
+		rast->tilesY = 0;
+		rast->width = 0;
+		rast->height = 0;
+		rast->bins = (SRBin*) calloc(tilesX * tilesY, sizeof(SRBin));
+		rast->activeTiles = (int*) malloc(sizeof(int) * tilesX * tilesY);
+		if (rast->bins == NULL || rast->activeTiles == NULL) return NULL;
+		
+		rast->tilesX = tilesX;
+		rast->tilesY = tilesY;
+		rast->width = cbuf->width;
+		rast->height = cbuf->height;
+	};
+	
+	// grow the vertex arena if needed; a batch never holds more than 3 vertices per triangle
+	size_t stride = (sizeof(SRVertex) + pl->szVertexFragment + 15) & ~(size_t)15;
+	size_t maxVertices = 3 * SR_BATCH_SIZE;
+	if ((size_t) count < maxVertices) maxVertices = count;
+	if (stride * maxVertices > rast->arenaCap || stride != rast->vertexStride)
+	{
+		if (stride * maxVertices > rast->arenaCap)
 		{
-			float *fput = (float*) (*put);
-			*put = (fput+1);
-			*fput = srFetchFloat(typeFetch, fetch);
+			free(rast->arenaBase);
+			rast->arenaCap = 0;
+			rast->arenaBase = (char*) malloc(stride * maxVertices + 15);
+			if (rast->arenaBase == NULL) return NULL;
+			rast->arena = (char*) (((uintptr_t) rast->arenaBase + 15) & ~(uintptr_t)15);
+			rast->arenaCap = stride * maxVertices;
 		};
+		
+		rast->vertexStride = stride;
+	};
+	
+	*error = srSpecialize(&rast->prog, srctx, vao);
+	if (*error != GL_NO_ERROR) return NULL;
+	
+	rast->fbuf = fbuf;
+	rast->numTris = 0;
+	rast->numVertices = 0;
+	memset(rast->cacheIndex, 0xFF, sizeof(rast->cacheIndex));
+	return rast;
+};
+
+/**
+ * Run the vertex shader on a vertex and store the result in a new arena slot. Returns the slot
+ * index.
+ */
+static uint32_t srFetchVertex(SRRasterizer *rast, GLint vertexIndex)
+{
+	uint32_t slot = rast->numVertices++;
+	srRunVertexShader(&rast->prog, vertexIndex, srGetVertex(rast, slot));
+	return slot;
+};
+
+/**
+ * Get the arena slot for a vertex, going through the vertex cache for indexed draws.
+ */
+static uint32_t srFetchVertexEx(SRRasterizer *rast, GLint vertexIndex, const void *indices, GLenum indexType)
+{
+	if (indices == NULL) return srFetchVertex(rast, vertexIndex);
+	
+	GLint index;
+	switch (indexType)
+	{
+	case GL_UNSIGNED_BYTE:
+		index = ((const GLubyte*) indices)[vertexIndex];
+		break;
+	case GL_UNSIGNED_SHORT:
+		index = ((const GLushort*) indices)[vertexIndex];
+		break;
+	default:
+		index = (GLint) ((const GLuint*) indices)[vertexIndex];
 		break;
 	};
+	
+	int entry = index & (SR_VERTEX_CACHE_SIZE-1);
+	if (rast->cacheIndex[entry] == index) return rast->cacheSlot[entry];
+	
+	uint32_t slot = srFetchVertex(rast, index);
+	rast->cacheIndex[entry] = index;
+	rast->cacheSlot[entry] = slot;
+	return slot;
+};
+
+/**
+ * Convert a normalized device coordinate to a fixed-point framebuffer coordinate.
+ */
+static int64_t srToFixed(int viewPos, int viewSize, float coord)
+{
+	float pixels = viewPos + viewSize * (0.5f * (coord + 1.0f));
+	return (int64_t) (pixels * SR_SUBPIXEL_ONE + (pixels < 0.0f ? -0.5f : 0.5f));
+};
+
+/**
+ * Set up a triangle which has a vertex outside the guard band, where the fixed-point edge functions could
+ * overflow. The edge functions are computed in floating point instead, relative to the vertices, and scaled
+ * (which leaves the barycentric coordinates unchanged) so that their values over the whole framebuffer fit
+ * comfortably in 64 bits. 'fx' and 'fy' are the vertex positions in pixels. Returns 0 if the triangle is
+ * degenerate or does not cover any pixel of the framebuffer.
+ */
+static int srSetupLarge(SRRasterizer *rast, SRTriangle *tri, uint32_t *slots, double *fx, double *fy)
+{
+	double area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+	if (area == 0.0 || area != area) return 0;
+	if (area < 0.0)
+	{
+		double tmp;
+		tmp = fx[1]; fx[1] = fx[2]; fx[2] = tmp;
+		tmp = fy[1]; fy[1] = fy[2]; fy[2] = tmp;
+		uint32_t tmpSlot = slots[1]; slots[1] = slots[2]; slots[2] = tmpSlot;
+		area = -area;
+	};
+	
+	// bounding box in pixels (whose centers are at +0.5), clipped to the framebuffer before
+	// converting to integers
+	double minX = fx[0], maxX = fx[0], minY = fy[0], maxY = fy[0];
+	int i;
+	for (i=1; i<3; i++)
+	{
+		if (fx[i] < minX) minX = fx[i];
+		if (fx[i] > maxX) maxX = fx[i];
+		if (fy[i] < minY) minY = fy[i];
+		if (fy[i] > maxY) maxY = fy[i];
+	};
+	
+	minX -= 0.5;
+	minY -= 0.5;
+	maxX -= 0.5;
+	maxY -= 0.5;
+	if (minX < 0.0) minX = 0.0;
+	if (minY < 0.0) minY = 0.0;
+	if (maxX > rast->width - 1) maxX = rast->width - 1;
+	if (maxY > rast->height - 1) maxY = rast->height - 1;
+	if (minX > maxX || minY > maxY) return 0;
+	
+	tri->minX = (int) minX + ((double) (int) minX < minX);
+	tri->minY = (int) minY + ((double) (int) minY < minY);
+	tri->maxX = (int) maxX;
+	tri->maxY = (int) maxY;
+	if (tri->minX > tri->maxX || tri->minY > tri->maxY) return 0;
+	
+	// edge functions at the center of pixel (0, 0), and their steps per pixel; find the largest
+	// magnitude they reach over the framebuffer, including the parts of edge tiles beyond it
+	double e0[3], dx[3], dy[3];
+	double bound = area;
+	for (i=0; i<3; i++)
+	{
+		int from = (i+1) % 3;
+		int to = (i+2) % 3;
+		dx[i] = fy[from] - fy[to];
+		dy[i] = fx[to] - fx[from];
+		e0[i] = dx[i] * (0.5 - fx[from]) + dy[i] * (0.5 - fy[from]);
+		
+		double reach = (e0[i] < 0.0 ? -e0[i] : e0[i])
+			+ (dx[i] < 0.0 ? -dx[i] : dx[i]) * (rast->width + SR_TILE_SIZE)
+			+ (dy[i] < 0.0 ? -dy[i] : dy[i]) * (rast->height + SR_TILE_SIZE);
+		if (reach > bound) bound = reach;
+	};
+	
+	if (bound != bound || bound > 1e300) return 0;
+	double scale = 2305843009213693952.0 / bound;		/* 2^61 */
+	
+	for (i=0; i<3; i++)
+	{
+		int from = (i+1) % 3;
+		int to = (i+2) % 3;
+		double edgeX = fx[to] - fx[from];
+		double edgeY = fy[to] - fy[from];
+		
+		double v;
+		v = e0[i] * scale;
+		tri->e0[i] = (int64_t) (v + (v < 0.0 ? -0.5 : 0.5));
+		v = dx[i] * scale;
+		tri->dx[i] = (int64_t) (v + (v < 0.0 ? -0.5 : 0.5));
+		v = dy[i] * scale;
+		tri->dy[i] = (int64_t) (v + (v < 0.0 ? -0.5 : 0.5));
+		
+		// same fill rule as the fixed-point setup
+		if (!(edgeY < 0.0 || (edgeY == 0.0 && edgeX < 0.0))) tri->e0[i]--;
+	};
+	
+	tri->invArea = (float) (1.0 / (area * scale));
+	return 1;
 };
 
-static SRVertex* srFetchVertex(DDIGL_Pipeline *pl, DDIGL_VertexArray *vao, GLint vertexIndex)
+/**
+ * Set up a triangle from the given arena slots and bin it into all tiles whose area it covers.
+ */
+static void srBinTriangle(SRRasterizer *rast, uint32_t ia, uint32_t ib, uint32_t ic)
 {
-	// load the vertex input structure
-	char vin[pl->szVertex];
-	memset(vin, 0, pl->szVertex);
+	SRContext *srctx = rast->srctx;
+	uint32_t slots[3] = {ia, ib, ic};
+	int64_t px[3], py[3];
+	double fx[3], fy[3];
+	int large = 0;
+	SRTriangle setup;
 	
 	int i;
-	for (i=0; i<64; i++)
+	for (i=0; i<3; i++)
 	{
-		if (pl->attribs[i].type != 0 && (vao->enable & (1UL << i)))
+		SRVertex *vert = srGetVertex(rast, slots[i]);
+		if (vert->pos[0] != vert->pos[0] || vert->pos[1] != vert->pos[1]) return;
+		
+		fx[i] = srctx->viewX + srctx->viewW * (0.5 * ((double) vert->pos[0] + 1.0));
+		fy[i] = srctx->viewY + srctx->viewH * (0.5 * ((double) vert->pos[1] + 1.0));
+		
+		if (fx[i] < -(double) SR_GUARD_BAND || fx[i] > (double) (rast->width + SR_GUARD_BAND)
+			|| fy[i] < -(double) SR_GUARD_BAND || fy[i] > (double) (rast->height + SR_GUARD_BAND))
+		{
+			large = 1;
+		}
+		else
 		{
-			// TODO: handle GL_BGRA properly
+			px[i] = srToFixed(srctx->viewX, srctx->viewW, vert->pos[0]);
+			py[i] = srToFixed(srctx->viewY, srctx->viewH, vert->pos[1]);
+		};
+	};
+	
+	if (large)
+	{
+		if (!srSetupLarge(rast, &setup, slots, fx, fy)) return;
+	}
+	else
+	{
+		// make the winding counter-clockwise so that all edge functions are positive inside
+		int64_t area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+		if (area == 0) return;
+		if (area < 0)
+		{
+			int64_t tmp;
+			tmp = px[1]; px[1] = px[2]; px[2] = tmp;
+			tmp = py[1]; py[1] = py[2]; py[2] = tmp;
+			uint32_t tmpSlot = slots[1]; slots[1] = slots[2]; slots[2] = tmpSlot;
+			area = -area;
+		};
+		
+		// bounding box in pixels, clipped to the framebuffer
+		int minX = (int) ((srMin3(px[0], px[1], px[2]) + SR_SUBPIXEL_ONE/2 - 1) >> SR_SUBPIXEL_BITS);
+		int maxX = (int) ((srMax3(px[0], px[1], px[2]) - SR_SUBPIXEL_ONE/2) >> SR_SUBPIXEL_BITS);
+		int minY = (int) ((srMin3(py[0], py[1], py[2]) + SR_SUBPIXEL_ONE/2 - 1) >> SR_SUBPIXEL_BITS);
+		int maxY = (int) ((srMax3(py[0], py[1], py[2]) - SR_SUBPIXEL_ONE/2) >> SR_SUBPIXEL_BITS);
+		if (minX < 0) minX = 0;
+		if (minY < 0) minY = 0;
+		if (maxX > (int) rast->width - 1) maxX = rast->width - 1;
+		if (maxY > (int) rast->height - 1) maxY = rast->height - 1;
+		if (minX > maxX || minY > maxY) return;
+		
+		for (i=0; i<3; i++)
+		{
+			// edge opposite vertex 'i', from vertex i+1 to vertex i+2
+			int from = (i+1) % 3;
+			int to = (i+2) % 3;
+			int64_t edgeX = px[to] - px[from];
+			int64_t edgeY = py[to] - py[from];
 			
-			SRVarDef *def = &pl->attribs[i];
-			SRVertexAttrib *attr = &vao->attribs[i];
+			// value at the center of pixel (0, 0), and steps per pixel
+			int64_t a = -edgeY;
+			int64_t b = edgeX;
+			int64_t c = edgeY * px[from] - edgeX * py[from];
+			setup.e0[i] = a * (SR_SUBPIXEL_ONE/2) + b * (SR_SUBPIXEL_ONE/2) + c;
+			setup.dx[i] = a * SR_SUBPIXEL_ONE;
+			setup.dy[i] = b * SR_SUBPIXEL_ONE;
 			
-			void *put = vin + def->offset;
-			const void *fetch = (const char*) attr->buffer->data
-				+ attr->stride * vertexIndex
-				+ attr->offset;
+			// top-left fill rule: pixels exactly on an edge belong to only one of the two
+			// triangles sharing it
+			if (!(edgeY < 0 || (edgeY == 0 && edgeX < 0))) setup.e0[i]--;
+		};
+		
+		setup.invArea = 1.0f / (float) area;
+		setup.minX = minX;
+		setup.minY = minY;
+		setup.maxX = maxX;
+		setup.maxY = maxY;
+	};
+	
+	for (i=0; i<3; i++)
+	{
+		setup.v[i] = slots[i];
+		setup.z[i] = 0.5f * srGetVertex(rast, slots[i])->pos[2] + 0.5f;
+	};
+	
+	int triIndex = rast->numTris++;
+	SRTriangle *tri = &rast->tris[triIndex];
+	*tri = setup;
+	
+	int minX = tri->minX;
+	int minY = tri->minY;
+	int maxX = tri->maxX;
+	int maxY = tri->maxY;
+	
+	// bin into tiles, rejecting those the triangle does not touch
+	int tileMinX = minX >> SR_TILE_SHIFT;
+	int tileMaxX = maxX >> SR_TILE_SHIFT;
+	int tileMinY = minY >> SR_TILE_SHIFT;
+	int tileMaxY = maxY >> SR_TILE_SHIFT;
+	int single = (tileMinX == tileMaxX && tileMinY == tileMaxY);
+	
+	int tx, ty;
+	for (ty=tileMinY; ty<=tileMaxY; ty++)
+	{
+		for (tx=tileMinX; tx<=tileMaxX; tx++)
+		{
+			int x0 = tx << SR_TILE_SHIFT;
+			int y0 = ty << SR_TILE_SHIFT;
+			int x1 = x0 + SR_TILE_SIZE - 1;
+			int y1 = y0 + SR_TILE_SIZE - 1;
 			
-			size_t num = def->size;
-			if (num > attr->size) num = attr->size;
+			uint32_t entry = ((uint32_t) triIndex << 1) | SR_BIN_FULL;
+			if (!single)
+			{
+				// the edge functions are linear, so their extremes over the tile are
+				// at the corners
+				for (i=0; i<3; i++)
+				{
+					int64_t maxVal = tri->e0[i]
+						+ (tri->dx[i] > 0 ? x1 : x0) * tri->dx[i]
+						+ (tri->dy[i] > 0 ? y1 : y0) * tri->dy[i];
+					if (maxVal < 0) break;
+					
+					int64_t minVal = tri->e0[i]
+						+ (tri->dx[i] > 0 ? x0 : x1) * tri->dx[i]
+						+ (tri->dy[i] > 0 ? y0 : y1) * tri->dy[i];
+					if (minVal < 0) entry &= ~SR_BIN_FULL;
+				};
+				
+				if (i != 3) continue;
+			}
+			else
+			{
+				entry &= ~SR_BIN_FULL;
+			};
 			
-			while (num--)
+			SRBin *bin = &rast->bins[ty * rast->tilesX + tx];
+			if (bin->count == bin->cap)
 			{
-				srFetchData(def->type, &put, attr->type, &fetch);
+				int newCap = bin->cap ? 2 * bin->cap : 64;
+				uint32_t *newTris = (uint32_t*) realloc(bin->tris, sizeof(uint32_t) * newCap);
+				if (newTris == NULL) continue;
+				bin->tris = newTris;
+				bin->cap = newCap;
 			};
+			
+			bin->tris[bin->count++] = entry;
 		};
 	};
-	
-	// allocate output structure
-	SRVertex *vout = (SRVertex*) malloc(sizeof(SRVertex) + pl->szVertexFragment);
-	memset(vout->data, 0, pl->szVertexFragment);
-	
-	// execute vertex shader
-	// TODO: uniforms
-	vout->pos = pl->vertexShader(NULL, vin, vout->data);
-	
-	// thanks
-	return vout;
-};
-
-static SRVertex *srFetchVertexEx(DDIGL_Pipeline *pl, DDIGL_VertexArray *vao, GLint vertexIndex, GLint *indices)
-{
-	if (indices == NULL) return srFetchVertex(pl, vao, vertexIndex);
-	else return srFetchVertex(pl, vao, indices[vertexIndex]);
 };
 
-static GLenum srDrawGeneric(DDIGL_Context *ctx, GLenum mode, GLint first, GLsizei count, GLint *indices)
+static GLenum srDrawGeneric(DDIGL_Context *ctx, GLenum mode, GLint first, GLsizei count, const void *indices, GLenum indexType)
 {
 	SRContext *srctx = (SRContext*) ctx->drvdata;
-	DDIGL_Pipeline *pl = srctx->currentPipeline;
 	DDIGL_VertexArray *vao = ctx->vaoCurrent;
 	
 	GLint i;
-	//SRVertex *ref;
-	SRVertex *a;
-	SRVertex *b;
-	SRVertex *c;
+	uint32_t a, b, c;
+	GLenum error;
 	
 	switch (mode)
 	{
 	case GL_TRIANGLES:
 		count -= (count % 3);
+		if (count == 0) break;
+		
+		SRRasterizer *rast = srBeginDraw(srctx, vao, count, &error);
+		if (rast == NULL) return error;
 		
 		for (i=first; i<first+count; i+=3)
 		{
-			a = srFetchVertexEx(pl, vao, i, indices);
-			b = srFetchVertexEx(pl, vao, i+1, indices);
-			c = srFetchVertexEx(pl, vao, i+2, indices);
-			srDrawTriangle(srctx, a, b, c);
+			// make sure the batch has room for the triangle and its vertices
+			if (rast->numTris == SR_BATCH_SIZE
+				|| rast->numVertices + 3 > rast->arenaCap / rast->vertexStride)
+			{
+				srFlush(rast);
+			};
+			
+			a = srFetchVertexEx(rast, i, indices, indexType);
+			b = srFetchVertexEx(rast, i+1, indices, indexType);
+			c = srFetchVertexEx(rast, i+2, indices, indexType);
+			srBinTriangle(rast, a, b, c);
 		};
 		
+		srFlush(rast);
 		break;
 	// TODO: the other modes
 	default:
@@ -253,5 +870,22 @@ static GLenum srDrawGeneric(DDIGL_Context *ctx, GLenum mode, GLint first, GLsize
 
 GLenum srDrawArrays(DDIGL_Context *ctx, GLenum mode, GLint first, GLsizei count)
 {
-	return srDrawGeneric(ctx, mode, first, count, NULL);
+	return srDrawGeneric(ctx, mode, first, count, NULL, 0);
+};
+
+GLenum srDrawElements(DDIGL_Context *ctx, GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	if (ctx->elementArrayBuffer != NULL)
+	{
+		// 'indices' is an offset into the element array buffer
+		DDIGL_Buffer *buffer = ctx->elementArrayBuffer;
+		size_t offset = (size_t) indices;
+		
+		size_t indexSize = (type == GL_UNSIGNED_BYTE) ? 1 : (type == GL_UNSIGNED_SHORT) ? 2 : 4;
+		if (buffer->data == NULL || offset + indexSize * count > buffer->size) return GL_INVALID_OPERATION;
+		indices = (const char*) buffer->data + offset;
+	};
+	
+	if (indices == NULL) return GL_INVALID_OPERATION;
+	return srDrawGeneric(ctx, mode, 0, count, indices, type);
 };
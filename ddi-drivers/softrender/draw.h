@@ -54,4 +54,9 @@ typedef struct
  */
 GLenum srDrawArrays(DDIGL_Context *ctx, GLenum mode, GLint first, GLsizei count);
 
+/**
+ * Draw primitives from a vertex array using an index list.
+ */
+GLenum srDrawElements(DDIGL_Context *ctx, GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+
 #endif
@@ -45,6 +45,15 @@ static void srDefaultFragmentShader(const void *uniforms, const void *inputs1, c
 	outputs[0] = white;
 };
 
+/**
+ * Span version of the default fragment shader.
+ */
+static void srDefaultFragmentSpanShader(const void *uniforms, const void *inputs1, const void *inputs2, const void *inputs3, SRVector *outputs, const SRVector *bary, int count)
+{
+	static SRVector white = {1.0, 1.0, 1.0, 1.0};
+	while (count--) *outputs++ = white;
+};
+
 /**
  * Default pipeline. This is used if no shader program was set yet.
  */
@@ -60,6 +69,7 @@ DDIGL_Pipeline srDefaultPipeline = {
 	// shaders
 	.vertexShader = srDefaultVertexShader,
 	.fragmentShader = srDefaultFragmentShader,
+	.fragmentSpanShader = srDefaultFragmentSpanShader,
 	
 	// one input attribute: the vertex position itself (vec4)
 	.attribs = {
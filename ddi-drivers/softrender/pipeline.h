@@ -80,6 +80,19 @@ typedef SRVector (*SRVertexShader)(const void *uniforms, const void *inputs, voi
  */
 typedef void (*SRFragmentShader)(const void *uniforms, const void *inputs1, const void *inputs2, const void *inputs3, SRVector *outputs, SRVector bary);
 
+/**
+ * Maximum number of fragments passed to a span fragment shader at once.
+ */
+#define	SR_SPAN_SIZE					8
+
+/**
+ * Span fragment shader. Like SRFragmentShader, but shades 'count' (at most SR_SPAN_SIZE) fragments of
+ * the same triangle at once, with 'bary' pointing to their barycentric coordinates. The output for
+ * fragment 'i' and color buffer 'buf' goes into outputs[buf * SR_SPAN_SIZE + i]. This is optional;
+ * pipelines without it have SRFragmentShader called for each fragment instead.
+ */
+typedef void (*SRFragmentSpanShader)(const void *uniforms, const void *inputs1, const void *inputs2, const void *inputs3, SRVector *outputs, const SRVector *bary, int count);
+
 /**
  * Pipeline variable attribute definition, used to define uniforms and inputs.
  */
@@ -137,6 +150,11 @@ struct __ddigl_pipeline
 	SRVertexShader vertexShader;
 	SRFragmentShader fragmentShader;
 	
+	/**
+	 * Span version of the fragment shader; may be NULL.
+	 */
+	SRFragmentSpanShader fragmentSpanShader;
+	
 	/**
 	 * Definitions of uniform variables.
 	 */
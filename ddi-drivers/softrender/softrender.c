@@ -30,13 +30,15 @@
 
 #include "surface.h"
 #include "context.h"
+#include "blend.h"
 
 /**
- * Initialize softrender. We don't need to do anything.
+ * Initialize softrender. We only need to pick the pixel kernels for this CPU.
  */
 void* srInit(int fd)
 {
 	(void)fd;
+	srInitKernels();
 	return NULL;
 };
 
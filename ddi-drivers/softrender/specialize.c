@@ -0,0 +1,290 @@
+/*
+	Madd Software Renderer
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "specialize.h"
+#include "buffer.h"
+
+/**
+ * Define fetch functions for an integer type; the normalized variant maps the full range of the
+ * type onto 0.0-1.0 (unsigned) or -1.0-1.0 (signed).
+ */
+#define	SR_FETCH_INT(name, type, scale) \
+	static void srFetch##name(float *put, const void *fetch, int count) \
+	{ \
+		const type *scan = (const type*) fetch; \
+		while (count--) *put++ = (float) *scan++; \
+	}; \
+	static void srFetch##name##Norm(float *put, const void *fetch, int count) \
+	{ \
+		const type *scan = (const type*) fetch; \
+		while (count--) \
+		{ \
+			float value = (float) *scan++ * (1.0f / (scale)); \
+			*put++ = value < -1.0f ? -1.0f : value; \
+		}; \
+	}
+
+SR_FETCH_INT(Byte, int8_t, 127.0f)
+SR_FETCH_INT(UnsignedByte, uint8_t, 255.0f)
+SR_FETCH_INT(Short, int16_t, 32767.0f)
+SR_FETCH_INT(UnsignedShort, uint16_t, 65535.0f)
+SR_FETCH_INT(Int, int32_t, 2147483647.0f)
+SR_FETCH_INT(UnsignedInt, uint32_t, 4294967295.0f)
+
+static void srFetchFloat(float *put, const void *fetch, int count)
+{
+	memcpy(put, fetch, 4 * count);
+};
+
+static void srFetchFloat4(float *put, const void *fetch, int count)
+{
+	_mm_store_ps(put, _mm_loadu_ps((const float*) fetch));
+};
+
+static void srFetchDouble(float *put, const void *fetch, int count)
+{
+	const double *scan = (const double*) fetch;
+	while (count--) *put++ = (float) *scan++;
+};
+
+static size_t srGetTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_INT:
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:
+		return 4;
+	case GL_DOUBLE:
+		return 8;
+	default:
+		return 0;
+	};
+};
+
+static SRFetchFunc srGetFetchFunc(GLenum type, GLboolean normalized, int count, size_t offset)
+{
+	switch (type)
+	{
+	case GL_BYTE:			return normalized ? srFetchByteNorm : srFetchByte;
+	case GL_UNSIGNED_BYTE:		return normalized ? srFetchUnsignedByteNorm : srFetchUnsignedByte;
+	case GL_SHORT:			return normalized ? srFetchShortNorm : srFetchShort;
+	case GL_UNSIGNED_SHORT:		return normalized ? srFetchUnsignedShortNorm : srFetchUnsignedShort;
+	case GL_INT:			return normalized ? srFetchIntNorm : srFetchInt;
+	case GL_UNSIGNED_INT:		return normalized ? srFetchUnsignedIntNorm : srFetchUnsignedInt;
+	case GL_FLOAT:
+		if (count == 4 && (offset & 15) == 0) return srFetchFloat4;
+		else return srFetchFloat;
+	case GL_DOUBLE:			return srFetchDouble;
+	default:			return NULL;
+	};
+};
+
+static uint32_t srPackChannel(float value, int shift)
+{
+	if (value <= 0.0f) return 0;
+	if (value >= 1.0f) return 0xFF << shift;
+	return (uint32_t) (255 * value) << shift;
+};
+
+void srPackScalar(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx)
+{
+	while (count--)
+	{
+		SRVector color = *colors++;
+		*pixels++ = srPackChannel(color[0], srctx->redShift)
+			| srPackChannel(color[1], srctx->greenShift)
+			| srPackChannel(color[2], srctx->blueShift)
+			| srPackChannel(color[3], srctx->alphaShift);
+	};
+};
+
+/**
+ * Convert a color to 4 integers 0-255, truncating like srPackChannel(), and reorder them as specified
+ * by the _MM_SHUFFLE() constant 'order'.
+ */
+#define	SR_PACK_LANES(color, order) \
+	_mm_shuffle_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps((__m128) (color), \
+		_mm_setzero_ps()), _mm_set1_ps(1.0f)), _mm_set1_ps(255.0f))), order)
+
+/**
+ * Define an SSE2 pack function which places the red, green, blue and alpha channels in the bytes
+ * specified by 'order'.
+ */
+#define	SR_PACK_SSE2(name, order) \
+	void name(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx) \
+	{ \
+		for (; count >= 4; count -= 4) \
+		{ \
+			__m128i low = _mm_packs_epi32(SR_PACK_LANES(colors[0], order), SR_PACK_LANES(colors[1], order)); \
+			__m128i high = _mm_packs_epi32(SR_PACK_LANES(colors[2], order), SR_PACK_LANES(colors[3], order)); \
+			_mm_storeu_si128((__m128i*) pixels, _mm_packus_epi16(low, high)); \
+			pixels += 4; \
+			colors += 4; \
+		}; \
+		while (count--) \
+		{ \
+			__m128i words = _mm_packs_epi32(SR_PACK_LANES(*colors, order), _mm_setzero_si128()); \
+			*pixels++ = (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(words, words)); \
+			colors++; \
+		}; \
+	}
+
+SR_PACK_SSE2(srPackBGRA, _MM_SHUFFLE(3, 0, 1, 2));
+SR_PACK_SSE2(srPackRGBA, _MM_SHUFFLE(3, 2, 1, 0));
+
+SRPackFunc srGetPackFunc(const SRContext *srctx)
+{
+	if (srctx->alphaShift == 24 && srctx->greenShift == 8)
+	{
+		if (srctx->redShift == 16 && srctx->blueShift == 0) return srPackBGRA;
+		if (srctx->redShift == 0 && srctx->blueShift == 16) return srPackRGBA;
+	};
+	
+	return srPackScalar;
+};
+
+GLenum srSpecialize(SRProgram *prog, SRContext *srctx, DDIGL_VertexArray *vao)
+{
+	DDIGL_Pipeline *pl = srctx->currentPipeline;
+	prog->pl = pl;
+	prog->numSteps = 0;
+	
+	int i;
+	for (i=0; i<64; i++)
+	{
+		SRVarDef *def = &pl->attribs[i];
+		
+		// TODO: non-float shader inputs
+		if (def->type != GL_FLOAT) continue;
+		if (vao == NULL || (vao->enable & (1UL << i)) == 0) continue;
+		
+		// TODO: handle GL_BGRA properly
+		SRVertexAttrib *attr = &vao->attribs[i];
+		size_t typeSize = srGetTypeSize(attr->type);
+		if (attr->buffer == NULL || attr->buffer->data == NULL || typeSize == 0) return GL_INVALID_OPERATION;
+		
+		SRFetchStep *step = &prog->steps[prog->numSteps++];
+		step->count = def->size < attr->size ? def->size : attr->size;
+		step->size = def->size;
+		step->offset = def->offset;
+		step->base = (const char*) attr->buffer->data + attr->offset;
+		step->stride = attr->stride != 0 ? (size_t) attr->stride : typeSize * attr->size;
+		step->fetch = srGetFetchFunc(attr->type, attr->normalized, step->count, def->offset);
+	};
+	
+	prog->pack = srGetPackFunc(srctx);
+	
+	prog->numColor = 0;
+	for (i=0; i<8; i++)
+	{
+		SRColorBuffer *cbuf = srctx->currentBuffer->color[i];
+		if (cbuf != NULL && cbuf->data != NULL)
+		{
+			prog->color[prog->numColor] = cbuf;
+			prog->colorIndex[prog->numColor] = i;
+			prog->numColor++;
+		};
+	};
+	
+	return GL_NO_ERROR;
+};
+
+void srRunVertexShader(SRProgram *prog, GLint vertexIndex, SRVertex *vout)
+{
+	DDIGL_Pipeline *pl = prog->pl;
+	static const float defaults[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	
+	// load the vertex input structure
+	char vin[pl->szVertex] __attribute__ ((aligned(16)));
+	memset(vin, 0, pl->szVertex);
+	
+	int i;
+	for (i=0; i<prog->numSteps; i++)
+	{
+		SRFetchStep *step = &prog->steps[i];
+		float *put = (float*) (vin + step->offset);
+		step->fetch(put, step->base + step->stride * vertexIndex, step->count);
+		
+		int j;
+		for (j=step->count; j<step->size; j++) put[j] = defaults[j];
+	};
+	
+	memset(vout->data, 0, pl->szVertexFragment);
+	
+	// TODO: uniforms
+	vout->pos = pl->vertexShader(NULL, vin, vout->data);
+};
+
+void srShadeSpan(SRProgram *prog, const SRContext *srctx, SRVertex *a, SRVertex *b, SRVertex *c,
+			const SRVector *bary, const int *xs, int count, size_t rowOffset)
+{
+	DDIGL_Pipeline *pl = prog->pl;
+	SRVector outputs[8 * SR_SPAN_SIZE];
+	int i;
+	
+	// TODO: uniforms
+	if (pl->fragmentSpanShader != NULL)
+	{
+		pl->fragmentSpanShader(NULL, a->data, b->data, c->data, outputs, bary, count);
+	}
+	else
+	{
+		for (i=0; i<count; i++)
+		{
+			SRVector colors[8];
+			pl->fragmentShader(NULL, a->data, b->data, c->data, colors, bary[i]);
+			
+			int j;
+			for (j=0; j<prog->numColor; j++)
+			{
+				outputs[prog->colorIndex[j] * SR_SPAN_SIZE + i] = colors[prog->colorIndex[j]];
+			};
+		};
+	};
+	
+	for (i=0; i<prog->numColor; i++)
+	{
+		uint32_t pixels[SR_SPAN_SIZE];
+		prog->pack(pixels, &outputs[prog->colorIndex[i] * SR_SPAN_SIZE], count, srctx);
+		
+		uint32_t *put = (uint32_t*) prog->color[i]->data + rowOffset;
+		int j;
+		for (j=0; j<count; j++) put[xs[j]] = pixels[j];
+	};
+};
@@ -0,0 +1,141 @@
+/*
+	Madd Software Renderer
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPECIALIZE_H_
+#define SPECIALIZE_H_
+
+#include <GL/ddigl.h>
+
+#include "context.h"
+#include "draw.h"
+#include "pipeline.h"
+#include "vao.h"
+
+/**
+ * Converts 'count' components of a vertex attribute, in the array's format, to floats.
+ */
+typedef void (*SRFetchFunc)(float *put, const void *fetch, int count);
+
+/**
+ * Converts 'count' fragment colors to pixels of the context's format.
+ */
+typedef void (*SRPackFunc)(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx);
+
+/**
+ * Fetch step: loads one vertex attribute into the vertex shader input structure.
+ */
+typedef struct
+{
+	/**
+	 * Address of the attribute for vertex 0, and distance between vertices.
+	 */
+	const char*					base;
+	size_t						stride;
+	
+	/**
+	 * Offset into the vertex shader input structure.
+	 */
+	size_t						offset;
+	
+	/**
+	 * Number of components fetched from the array, and the number the shader expects; the
+	 * missing ones are set to the defaults (0, 0, 0, 1).
+	 */
+	int						count;
+	int						size;
+	
+	/**
+	 * Conversion function.
+	 */
+	SRFetchFunc					fetch;
+} SRFetchStep;
+
+/**
+ * A pipeline specialized for the current vertex array and framebuffer configuration. This is built
+ * once per draw call, so that the per-vertex and per-fragment work does not have to look at the
+ * configuration again.
+ */
+typedef struct
+{
+	/**
+	 * The pipeline.
+	 */
+	DDIGL_Pipeline*					pl;
+	
+	/**
+	 * Attribute fetch steps, for enabled attributes used by the pipeline only.
+	 */
+	SRFetchStep					steps[64];
+	int						numSteps;
+	
+	/**
+	 * Pixel packing function for the context's color format.
+	 */
+	SRPackFunc					pack;
+	
+	/**
+	 * The bound color buffers.
+	 */
+	SRColorBuffer*					color[8];
+	int						colorIndex[8];
+	int						numColor;
+} SRProgram;
+
+/**
+ * Pack functions. srPackScalar() handles any format; the others are used for the formats they are
+ * named after (byte order in memory).
+ */
+void srPackScalar(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx);
+void srPackBGRA(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx);
+void srPackRGBA(uint32_t *pixels, const SRVector *colors, int count, const SRContext *srctx);
+
+/**
+ * Return the best pack function for the context's format.
+ */
+SRPackFunc srGetPackFunc(const SRContext *srctx);
+
+/**
+ * Specialize the current pipeline of a context for drawing from the given vertex array into the
+ * current framebuffer. Returns GL_NO_ERROR, or GL_INVALID_OPERATION if an enabled attribute has no
+ * buffer or uses an unsupported type.
+ */
+GLenum srSpecialize(SRProgram *prog, SRContext *srctx, DDIGL_VertexArray *vao);
+
+/**
+ * Fetch the specified vertex and run the vertex shader on it.
+ */
+void srRunVertexShader(SRProgram *prog, GLint vertexIndex, SRVertex *vout);
+
+/**
+ * Run the fragment shader on a span of fragments of the triangle (a, b, c), and write the results
+ * into the row of pixels at 'rowOffset' in each bound color buffer, at the specified X coordinates.
+ */
+void srShadeSpan(SRProgram *prog, const SRContext *srctx, SRVertex *a, SRVertex *b, SRVertex *c,
+			const SRVector *bary, const int *xs, int count, size_t rowOffset);
+
+#endif
@@ -32,6 +32,7 @@
 #include <errno.h>
 
 #include "surface.h"
+#include "blend.h"
 
 typedef struct
 {
@@ -39,32 +40,7 @@ typedef struct
 	DDIPixelFormat format;
 } SharedSurfaceMeta;
 
-typedef uint8_t	DDIByteVector __attribute__ ((vector_size(4)));
 typedef int DDIIntVector __attribute__ ((vector_size(16)));
-typedef uint32_t DDIU32Vector __attribute__ ((vector_size(16)));
-
-static void fastCopy(void *dest_, const void *src_, size_t sz)
-{
-	// align, and fall back to memcpy if impossible
-	if (((uint64_t)dest_ & 0xF) != ((uint64_t)src_ & 0xF))
-	{
-		memcpy(dest_, src_, sz);
-		return;
-	};
-	
-	register char *destChar = (char*) dest_;
-	register const char *srcChar = (const char*) src_;
-	
-	while (((uint64_t)destChar & 0xF) && sz) {*destChar++ = *srcChar++; sz--;};
-	
-	register DDIIntVector *destVec = (DDIIntVector*) destChar;
-	register const DDIIntVector *srcVec = (const DDIIntVector*) srcChar;
-	while (sz >= 16) {*destVec++ = *srcVec++; sz -= 16;};
-	
-	destChar = (char*) destVec;
-	srcChar = (const char*) srcVec;
-	while (sz--) *destChar++ = *srcChar++;
-};
 
 static uint8_t* srCreateSharedFile(uint32_t *idOut, DDISurface *target)
 {	
@@ -176,6 +152,7 @@ void srBlit(void *drvctx, DDISurface *src, int srcX, int srcY, DDISurface *dest,
 	if (src->format.alphaMask == 0)
 	{
 		ddiOverlay(src, srcX, srcY, dest, destX, destY, width, height);
+		return;
 	};
 	
 	int alphaIndex = ddiGetIndexForMask(src->format.alphaMask);
@@ -276,6 +253,18 @@ void srBlit(void *drvctx, DDISurface *src, int srcX, int srcY, DDISurface *dest,
 	register uint8_t *scan = (uint8_t*) src->data + pixelSize * srcX + srcScanlineSize * srcY;
 	register uint8_t *put = (uint8_t*) dest->data + pixelSize * destX + destScanlineSize * destY;
 	
+	if (pixelSize == 4)
+	{
+		for (; height; height--)
+		{
+			srKernels->blend((uint32_t*) put, (const uint32_t*) scan, width, 8 * alphaIndex);
+			scan += srcScanlineSize;
+			put += destScanlineSize;
+		};
+		
+		return;
+	};
+	
 	for (; height; height--)
 	{
 		register size_t count = width;
@@ -419,7 +408,7 @@ void srOverlay(void *drvctx, DDISurface *src, int srcX, int srcY, DDISurface *de
 	
 	for (; height; height--)
 	{
-		fastCopy(put, scan, pixelSize * width);
+		srKernels->copy(put, scan, pixelSize * width);
 		scan += srcScanlineSize;
 		put += destScanlineSize;
 	};
@@ -427,37 +416,15 @@ void srOverlay(void *drvctx, DDISurface *src, int srcX, int srcY, DDISurface *de
 
 static void srFill(void *dest, void *src, uint64_t unit, uint64_t count)
 {
-	// what else can we do, but optimise for the most obvious case?
 	if (unit == 4)
 	{
-		register uint32_t *dest32 = (uint32_t*) dest;
-		register uint32_t val32 = *((uint32_t*) src);
-		
-		while ((uint64_t)dest32 & 0xF)
-		{
-			if (count--) *dest32++ = val32;
-			else return;
-		};
-		
-		if (count >= 4)
-		{
-			DDIU32Vector *destVec = (DDIU32Vector*) dest32;
-			DDIU32Vector valVec = {val32, val32, val32, val32};
-			
-			while (count >= 4) {*destVec++ = valVec; count -= 4;};
-			dest32 = (uint32_t*) destVec;
-		};
-		
-		while (count--)
-		{
-			*dest32++ = val32;
-		};
+		srKernels->fill((uint32_t*) dest, *((uint32_t*) src), count);
 	}
 	else
 	{
 		while (count--)
 		{
-			fastCopy(dest, src, unit);
+			memcpy(dest, src, unit);
 			dest += unit;
 		};
 	};
@@ -59,11 +59,11 @@ GLenum srSetAttribEnable(DDIGL_Context *ctx, GLuint index, GLboolean enable)
 	
 	if (enable)
 	{
-		ctx->vaoCurrent->enable |= (1 << index);
+		ctx->vaoCurrent->enable |= (1UL << index);
 	}
 	else
 	{
-		ctx->vaoCurrent->enable &= ~(1 << index);
+		ctx->vaoCurrent->enable &= ~(1UL << index);
 	};
 	
 	return GL_NO_ERROR;
@@ -173,3 +173,28 @@ dynld_getpid:
 	syscall
 	ret
 
+
+global geteuid
+geteuid:
+	mov rax, 8
+	syscall
+	ret
+
+global dynld_mv
+dynld_mv:
+	mov r10, rcx
+	mov rax, 150
+	syscall
+	ret
+
+global dynld_unlink
+dynld_unlink:
+	mov rax, 45
+	syscall
+	ret
+
+global dynld_nanotime
+dynld_nanotime:
+	mov rax, 51
+	syscall
+	ret
@@ -37,6 +37,7 @@ const char *libraryPath = "";
 int debugMode = 0;
 int bindNow = 0;
 int dynld_errno;
+int relocCache = 1;
 
 void dynld_enter(void *retstack, Elf64_Addr entry);
 int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
@@ -64,6 +65,11 @@ int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
 		{
 			bindNow = 1;
 		};
+		
+		if (strcmp(*envscan, "LD_RELOC_CACHE=0") == 0)
+		{
+			relocCache = 0;
+		};
 	};
 	
 	// get the auxiliary vector
@@ -113,6 +119,7 @@ int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
 			};
 			
 			libraryPath = "";
+			relocCache = 0;
 		};
 		
 		if (st.st_oxperm != 0)
@@ -123,12 +130,20 @@ int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
 			};
 			
 			libraryPath = "";
+			relocCache = 0;
+		};
+		
+		if (relocCache)
+		{
+			dynld_rcache_open(&st);
 		};
 	};
 	
+	uint64_t startTime = 0;
 	if (debugMode)
 	{
 		dynld_printf("dynld: invoked with pid %d\n", dynld_getpid());
+		startTime = dynld_nanotime();
 	};
 	
 	char exepath[256];
@@ -141,6 +156,8 @@ int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
 		return 1;
 	};
 	
+	dynld_rcache_done();
+	
 	Elf64_Ehdr elfHeader;
 	if (pread(execfd, &elfHeader, sizeof(Elf64_Ehdr), 0) != sizeof(Elf64_Ehdr))
 	{
@@ -154,6 +171,11 @@ int dynld_main(int argc, char *argv[], char *envp[], void *retstack)
 	
 	if (debugMode)
 	{
+		uint64_t totalTime = dynld_nanotime() - startTime;
+		dynld_printf("dynld: %d relocations, %d PLT entries bound, %d left for lazy binding\n",
+				(int) numRelocs, (int) numPltBound, (int) numPltLazy);
+		dynld_printf("dynld: relocation took %d us, linking took %d us in total\n",
+				(int) (relocTime / 1000), (int) (totalTime / 1000));
 		dynld_printf("dynld: passing control to program\n");
 	};
 	
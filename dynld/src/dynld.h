@@ -30,6 +30,7 @@
 #define DYNLD_H_
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include <inttypes.h>
 #include <dlfcn.h>		/* RTLD_* */
@@ -127,4 +128,65 @@ void dynld_initlib(Dl_Library *lib);
  */
 int dynld_getpid();
 
+/**
+ * Rename and unlink files (the mv and unlink system calls).
+ */
+int dynld_mv(int olddirfd, const char *oldpath, int newdirfd, const char *newpath, int flags);
+int dynld_unlink(const char *path);
+
+/**
+ * Get the system time in nanoseconds (the nanotime system call).
+ */
+uint64_t dynld_nanotime();
+
+/**
+ * Relocation statistics (see mapobj.c): relocations performed, PLT entries bound (immediately,
+ * by the relocation cache or lazily), PLT entries left for lazy binding, and nanoseconds spent
+ * relocating. Only the time is conditional on debug mode.
+ */
+extern uint64_t numRelocs;
+extern uint64_t numPltBound;
+extern uint64_t numPltLazy;
+extern uint64_t relocTime;
+
+/**
+ * Compute the GNU-style and SysV-style hash of a symbol name.
+ */
+uint32_t dynld_gnuhash(const char *name);
+uint32_t dynld_sysvhash(const char *name);
+
+/**
+ * Return the number of entries in the dynamic symbol table, as determined from a GNU hash table.
+ */
+size_t dynld_gnusymcount(Elf64_Word *gnuHash);
+
+/**
+ * Look up a defined symbol in the hash table of the specified library. 'gnuhash' and 'sysvhash' are
+ * the hashes of 'symname' (computed by the caller, as it usually searches many libraries). Returns
+ * NULL if the library does not define the symbol; the binding is not checked.
+ */
+Elf64_Sym* dynld_findsym(Dl_Library *lib, const char *symname, uint32_t gnuhash, uint32_t sysvhash);
+
+/**
+ * The global symbol resolution cache, keyed by GNU hash. It must be flushed whenever the global
+ * namespace changes (libraries added or removed).
+ */
+void dynld_cacheflush();
+void* dynld_cacheget(const char *symname, uint32_t hash);
+void dynld_cacheput(const char *symname, uint32_t hash, void *addr);
+
+/**
+ * The relocation cache (see rcache.c). dynld_rcache_open() enables it for the executable with the
+ * given status; every object loaded at startup is then registered with dynld_rcache_addobj(), which
+ * returns its cache index (or -1). dynld_rcache_get() returns the cached values of an object's
+ * relocations (RELA first, then PLT), or NULL if they are not valid; in which case dynld_rcache_record()
+ * returns a buffer into which the values should be stored (or NULL). dynld_rcache_done() is called once
+ * the startup objects are relocated, and writes out a new cache if needed.
+ */
+void dynld_rcache_open(struct stat *exest);
+int dynld_rcache_addobj(Dl_Library *lib, int fd);
+uint64_t* dynld_rcache_get(int index, size_t numRela, size_t numPltRela);
+uint64_t* dynld_rcache_record(int index, size_t numRela, size_t numPltRela);
+void dynld_rcache_done();
+
 #endif
@@ -0,0 +1,240 @@
+/*
+	Glidix dynamic linker
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include "dynld.h"
+
+/**
+ * Size of the symbol resolution cache (must be a power of 2).
+ */
+#define	SYMCACHE_SIZE			4096
+
+/**
+ * Generation value of an entry which is being filled in.
+ */
+#define	SYMCACHE_BUSY			0xFFFFFFFF
+
+/**
+ * An entry in the resolution cache. 'gen' is the value of 'cacheGen' when the entry was added;
+ * entries from older generations are treated as empty.
+ */
+typedef struct
+{
+	const char*				name;
+	uint32_t				hash;
+	uint32_t				gen;
+	void*					addr;
+} SymCacheEntry;
+
+static SymCacheEntry *symCache;
+static uint32_t numEntries;
+static uint32_t numEntriesGen;
+static uint32_t cacheGen = 1;
+
+uint32_t dynld_gnuhash(const char *name)
+{
+	uint32_t h = 5381;
+	for (; *name!=0; name++)
+	{
+		h = (h << 5) + h + (unsigned char) *name;
+	};
+	
+	return h;
+};
+
+uint32_t dynld_sysvhash(const char *name)
+{
+	uint32_t h = 0;
+	for (; *name!=0; name++)
+	{
+		h = (h << 4) + (unsigned char) *name;
+		uint32_t g = h & 0xF0000000;
+		if (g != 0) h ^= g >> 24;
+		h &= ~g;
+	};
+	
+	return h;
+};
+
+size_t dynld_gnusymcount(Elf64_Word *gnuHash)
+{
+	uint32_t nbuckets = gnuHash[0];
+	uint32_t symoffset = gnuHash[1];
+	uint32_t bloomSize = gnuHash[2];
+	const Elf64_Word *buckets = (const Elf64_Word*) ((const uint64_t*) &gnuHash[4] + bloomSize);
+	const Elf64_Word *chain = &buckets[nbuckets];
+	
+	// the symbols after 'symoffset' are sorted by bucket; the last chain ends at the last symbol
+	uint32_t last = 0;
+	uint32_t i;
+	for (i=0; i<nbuckets; i++)
+	{
+		if (buckets[i] > last) last = buckets[i];
+	};
+	
+	if (last < symoffset)
+	{
+		return symoffset;
+	};
+	
+	while ((chain[last - symoffset] & 1) == 0)
+	{
+		last++;
+	};
+	
+	return last + 1;
+};
+
+Elf64_Sym* dynld_findsym(Dl_Library *lib, const char *symname, uint32_t gnuhash, uint32_t sysvhash)
+{
+	if (lib->gnuHash != NULL)
+	{
+		Elf64_Word *gh = lib->gnuHash;
+		uint32_t nbuckets = gh[0];
+		uint32_t symoffset = gh[1];
+		uint32_t bloomSize = gh[2];
+		uint32_t bloomShift = gh[3];
+		const uint64_t *bloom = (const uint64_t*) &gh[4];
+		const Elf64_Word *buckets = (const Elf64_Word*) &bloom[bloomSize];
+		const Elf64_Word *chain = &buckets[nbuckets];
+		
+		// the bloom filter rejects most names that are not in this object without touching the table
+		uint64_t word = bloom[(gnuhash / 64) % bloomSize];
+		uint64_t mask = (1UL << (gnuhash % 64)) | (1UL << ((gnuhash >> bloomShift) % 64));
+		if ((word & mask) != mask)
+		{
+			return NULL;
+		};
+		
+		uint32_t symidx = buckets[gnuhash % nbuckets];
+		if (symidx < symoffset)
+		{
+			return NULL;
+		};
+		
+		while (1)
+		{
+			uint32_t h = chain[symidx - symoffset];
+			if ((h | 1) == (gnuhash | 1))
+			{
+				Elf64_Sym *sym = &lib->symtab[symidx];
+				if (sym->st_shndx != 0 && strcmp(symname, &lib->strtab[sym->st_name]) == 0)
+				{
+					return sym;
+				};
+			};
+			
+			if (h & 1) break;
+			symidx++;
+		};
+		
+		return NULL;
+	}
+	else if (lib->hashtab != NULL)
+	{
+		uint32_t nbucket = lib->hashtab[0];
+		const Elf64_Word *bucket = &lib->hashtab[2];
+		const Elf64_Word *chain = &bucket[nbucket];
+		
+		uint32_t symidx;
+		for (symidx=bucket[sysvhash % nbucket]; symidx!=0; symidx=chain[symidx])
+		{
+			Elf64_Sym *sym = &lib->symtab[symidx];
+			if (sym->st_shndx != 0 && strcmp(symname, &lib->strtab[sym->st_name]) == 0)
+			{
+				return sym;
+			};
+		};
+		
+		return NULL;
+	};
+	
+	return NULL;
+};
+
+void dynld_cacheflush()
+{
+	// bumping the generation empties the cache without touching it
+	cacheGen++;
+};
+
+void* dynld_cacheget(const char *symname, uint32_t hash)
+{
+	if (symCache == NULL) return NULL;
+	
+	uint32_t i;
+	for (i=hash; ; i++)
+	{
+		SymCacheEntry *ent = &symCache[i & (SYMCACHE_SIZE-1)];
+		if (ent->gen != cacheGen) return NULL;
+		if (ent->hash == hash && strcmp(ent->name, symname) == 0) return ent->addr;
+	};
+};
+
+void dynld_cacheput(const char *symname, uint32_t hash, void *addr)
+{
+	if (symCache == NULL)
+	{
+		symCache = (SymCacheEntry*) mmap(NULL, sizeof(SymCacheEntry) * SYMCACHE_SIZE, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (symCache == MAP_FAILED)
+		{
+			symCache = NULL;
+			return;
+		};
+	};
+	
+	if (numEntriesGen != cacheGen)
+	{
+		numEntriesGen = cacheGen;
+		numEntries = 0;
+	};
+	
+	// keep the table at most 3/4 full so that probe sequences stay short
+	if (numEntries >= (SYMCACHE_SIZE / 4) * 3) return;
+	
+	uint32_t i;
+	for (i=hash; ; i++)
+	{
+		SymCacheEntry *ent = &symCache[i & (SYMCACHE_SIZE-1)];
+		uint32_t gen = ent->gen;
+		if (gen != cacheGen && gen != SYMCACHE_BUSY)
+		{
+			// lazy binding may run on several threads at once; claim the slot by marking
+			// it busy, fill it, then publish it
+			if (!__sync_bool_compare_and_swap(&ent->gen, gen, SYMCACHE_BUSY)) continue;
+			ent->name = symname;
+			ent->hash = hash;
+			ent->addr = addr;
+			__sync_synchronize();
+			ent->gen = cacheGen;
+			numEntries++;
+			return;
+		};
+	};
+};
@@ -34,6 +34,14 @@
 extern Dl_Library chainHead;
 uint64_t addrPlacement;
 
+/**
+ * Relocation statistics, reported in debug mode.
+ */
+uint64_t numRelocs;
+uint64_t numPltBound;
+uint64_t numPltLazy;
+uint64_t relocTime;
+
 void dynld_diag(void *ptr);
 
 Dl_Library* dynld_getlib(const char *soname)
@@ -95,19 +103,10 @@ size_t dynld_addrinfo(void *ptr, Dl_AddrInfo *infoOut, size_t infoSize)
 
 void* dynld_libsym(Dl_Library *lib, const char *symname, unsigned char binding)
 {
-	size_t i;
-	for (i=0; i<lib->numSymbols; i++)
+	Elf64_Sym *symbol = dynld_findsym(lib, symname, dynld_gnuhash(symname), dynld_sysvhash(symname));
+	if (symbol != NULL && ELF64_S_BINDING(symbol->st_info) == binding)
 	{
-		Elf64_Sym *symbol = &lib->symtab[i];
-		const char *name = &lib->strtab[symbol->st_name];
-		
-		if ((ELF64_S_BINDING(symbol->st_info) == binding) && (symbol->st_shndx != 0))
-		{
-			if (strcmp(symname, name) == 0)
-			{
-				return (void*) (lib->base + symbol->st_value);
-			};
-		};
+		return (void*) (lib->base + symbol->st_value);
 	};
 	
 	return NULL;
@@ -148,13 +147,14 @@ Dl_Library* dynld_dlopen(const char *soname, int mode)
 			dep->next = NULL;
 			last->next = dep;
 			dep->prev = last;
+			dynld_cacheflush();
 		}
 		else
 		{
 			dep->prev = dep->next = NULL;
 		};
 		
-		if (dynld_mapobj(dep, depfd, addrPlacement, soname, RTLD_LAZY | RTLD_GLOBAL, path) == 0)
+		if (dynld_mapobj(dep, depfd, addrPlacement, soname, mode, path) == 0)
 		{
 			// leave dynld_errmsg as is; we forward the error from the recursive
 			// invocation
@@ -163,6 +163,7 @@ Dl_Library* dynld_dlopen(const char *soname, int mode)
 			if (dep->prev != NULL)
 			{
 				dep->prev->next = NULL;
+				dynld_cacheflush();
 			};
 			
 			munmap(dep, 0x1000);
@@ -179,10 +180,14 @@ Dl_Library* dynld_dlopen(const char *soname, int mode)
 
 void* dynld_dlsym(Dl_Library *lib, const char *symname)
 {
-	void *val = dynld_libsym(lib, symname, STB_GLOBAL);
-	if (val != NULL) return val;
+	// a library defines each name at most once, so one lookup covers both global and weak symbols
+	Elf64_Sym *symbol = dynld_findsym(lib, symname, dynld_gnuhash(symname), dynld_sysvhash(symname));
+	if (symbol == NULL) return NULL;
+	
+	unsigned char binding = ELF64_S_BINDING(symbol->st_info);
+	if (binding != STB_GLOBAL && binding != STB_WEAK) return NULL;
 	
-	return dynld_libsym(lib, symname, STB_WEAK);
+	return (void*) (lib->base + symbol->st_value);
 };
 
 char* dynld_dlerror()
@@ -193,12 +198,31 @@ char* dynld_dlerror()
 void* dynld_globsym(const char *symname, Dl_Library *lastLib)
 {
 	Dl_Library *lib;
+	uint32_t gnuhash = dynld_gnuhash(symname);
+	uint32_t sysvhash = dynld_sysvhash(symname);
 	
-	// try global symbols first
+	void *val = dynld_cacheget(symname, gnuhash);
+	if (val != NULL) return val;
+	
+	// try global symbols first, remembering the first weak definition on the way
+	void *weakval = NULL;
 	for (lib=&chainHead; lib!=NULL; lib=lib->next)
 	{
-		void *val = dynld_libsym(lib, symname, STB_GLOBAL);
-		if (val != NULL) return val;
+		Elf64_Sym *symbol = dynld_findsym(lib, symname, gnuhash, sysvhash);
+		if (symbol != NULL)
+		{
+			unsigned char binding = ELF64_S_BINDING(symbol->st_info);
+			if (binding == STB_GLOBAL)
+			{
+				val = (void*) (lib->base + symbol->st_value);
+				dynld_cacheput(symname, gnuhash, val);
+				return val;
+			}
+			else if (binding == STB_WEAK && weakval == NULL)
+			{
+				weakval = (void*) (lib->base + symbol->st_value);
+			};
+		};
 	};
 
 	// now internal symbols
@@ -228,24 +252,31 @@ void* dynld_globsym(const char *symname, Dl_Library *lastLib)
 	};
 
 	// now try the weak symbols
-	for (lib=&chainHead; lib!=NULL; lib=lib->next)
-	{
-		void *val = dynld_libsym(lib, symname, STB_WEAK);
-		if (val != NULL) return val;
-	};
+	if (weakval != NULL) return weakval;
 	
 	// now the library itself (in case it was RTLD_LOCAL)
-	void *val = dynld_libsym(lastLib, symname, STB_GLOBAL);
-	if (val != NULL) return val;
-
-	val = dynld_libsym(lastLib, symname, STB_WEAK);
-	if (val != NULL) return val;
+	Elf64_Sym *symbol = dynld_findsym(lastLib, symname, gnuhash, sysvhash);
+	if (symbol != NULL)
+	{
+		unsigned char binding = ELF64_S_BINDING(symbol->st_info);
+		if (binding == STB_GLOBAL || binding == STB_WEAK)
+		{
+			return (void*) (lastLib->base + symbol->st_value);
+		};
+	};
 
 	return NULL;
 };
 
 void* dynld_globdat(const char *name)
 {
+	// the executable can only have a COPY relocation for a symbol it defines, so the hash table
+	// rejects almost every name without scanning the relocations
+	if (dynld_findsym(&chainHead, name, dynld_gnuhash(name), dynld_sysvhash(name)) == NULL)
+	{
+		return NULL;
+	};
+	
 	size_t i;
 	for (i=0; i<chainHead.numRela; i++)
 	{
@@ -271,22 +302,29 @@ void* dynld_globdat(const char *name)
 void* dynld_globdef(const char *name)
 {
 	Dl_Library *lib;
+	uint32_t gnuhash = dynld_gnuhash(name);
+	uint32_t sysvhash = dynld_sysvhash(name);
 	
-	// try global symbols first
+	// global symbols take precedence over the first weak one
+	void *weakval = NULL;
 	for (lib=chainHead.next; lib!=NULL; lib=lib->next)
 	{
-		void *val = dynld_libsym(lib, name, STB_GLOBAL);
-		if (val != NULL) return val;
-	};
-	
-	// now try the weak symbols
-	for (lib=chainHead.next; lib!=NULL; lib=lib->next)
-	{
-		void *val = dynld_libsym(lib, name, STB_WEAK);
-		if (val != NULL) return val;
+		Elf64_Sym *symbol = dynld_findsym(lib, name, gnuhash, sysvhash);
+		if (symbol != NULL)
+		{
+			unsigned char binding = ELF64_S_BINDING(symbol->st_info);
+			if (binding == STB_GLOBAL)
+			{
+				return (void*) (lib->base + symbol->st_value);
+			}
+			else if (binding == STB_WEAK && weakval == NULL)
+			{
+				weakval = (void*) (lib->base + symbol->st_value);
+			};
+		};
 	};
 	
-	return NULL;
+	return weakval;
 };
 
 // perform a PLT relocation with the given index on the given library, and return the resulting
@@ -310,6 +348,7 @@ void* dynld_pltreloc(Dl_Library *lib, uint64_t index)
 	};
 	
 	void **relput = (void**) (lib->base + rela->r_offset);
+	numPltBound++;
 
 	if (debugMode)
 	{
@@ -440,6 +479,7 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 	lib->numRela = 0;
 	lib->pltRela = NULL;
 	lib->hashtab = NULL;
+	lib->gnuHash = NULL;
 	lib->pltgot = NULL;
 	lib->initFunc = NULL;
 	lib->numInit = 0;
@@ -492,8 +532,17 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 				prot |= PROT_EXEC;
 			};
 			
+			// segments we never write to (text and read-only data) are mapped shared, so that
+			// every process uses the page cache frames directly and fork() has nothing to
+			// copy-on-write; the file is open read-only, so they can never be made writable
+			int mapType = MAP_PRIVATE;
+			if ((prot & PROT_WRITE) == 0)
+			{
+				mapType = MAP_SHARED;
+			};
+			
 			if (mmap(lib->segs[index].base, lib->segs[index].size,
-					prot, MAP_PRIVATE | MAP_FIXED,
+					prot, mapType | MAP_FIXED,
 					fd, phdr.p_offset & ~0xFFF) == MAP_FAILED)
 			{
 				strcpy(dynld_errmsg, "failed to map segment into memory");
@@ -549,6 +598,8 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 	// memory-align the top address
 	topAddr = (topAddr + 0xFFF) & ~0xFFF;
 	
+	int rcIndex = dynld_rcache_addobj(lib, fd);
+	
 	if (base == 0)
 	{
 		addrPlacement = 0x200000000;	/* 8GB */
@@ -589,6 +640,9 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		case DT_HASH:
 			lib->hashtab = (Elf64_Word*) (base + dyn->d_un.d_ptr);
 			break;
+		case DT_GNU_HASH:
+			lib->gnuHash = (Elf64_Word*) (base + dyn->d_un.d_ptr);
+			break;
 		case DT_PLTGOT:
 			lib->pltgot = (void**) (base + dyn->d_un.d_ptr);
 			break;
@@ -616,13 +670,17 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		};
 	};
 	
-	if (lib->hashtab == NULL)
+	if (lib->hashtab != NULL)
 	{
-		lib->numSymbols = 0;
+		lib->numSymbols = lib->hashtab[1];
+	}
+	else if (lib->gnuHash != NULL)
+	{
+		lib->numSymbols = dynld_gnusymcount(lib->gnuHash);
 	}
 	else
 	{
-		lib->numSymbols = lib->hashtab[1];
+		lib->numSymbols = 0;
 	};
 	
 	// additional library paths
@@ -727,8 +785,11 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 				dep->prev = lib;
 				lib->next = dep;
 				addrPlacement += 0x1000;
+				dynld_cacheflush();
 				
-				if (dynld_mapobj(dep, depfd, addrPlacement, depname, RTLD_LAZY | RTLD_GLOBAL, deppath) == 0)
+				// dependencies of an RTLD_NOW library are bound immediately too
+				int depflags = (flags & (RTLD_LAZY | RTLD_NOW)) | RTLD_GLOBAL;
+				if (dynld_mapobj(dep, depfd, addrPlacement, depname, depflags, deppath) == 0)
 				{
 					char temp[2048];
 					strcpy(temp, dynld_errmsg);
@@ -748,6 +809,7 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 					};
 					
 					lib->next = dep->next;
+					dynld_cacheflush();
 					munmap(dep, 0x1000);
 					
 					return 0;
@@ -766,6 +828,22 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		dynld_printf("dynld: performing relocations on object `%s' (0x%p relocations)\n", name, lib->numRela);
 	};
 	
+	uint64_t relocStart = 0;
+	if (debugMode) relocStart = dynld_nanotime();
+	
+	// if the relocation cache knows the values, we don't need to look up any symbols; otherwise,
+	// maybe remember the values we find
+	uint64_t *cachedValues = dynld_rcache_get(rcIndex, lib->numRela, numPltRela);
+	uint64_t *recordValues = NULL;
+	if (cachedValues == NULL)
+	{
+		recordValues = dynld_rcache_record(rcIndex, lib->numRela, numPltRela);
+	}
+	else if (debugMode)
+	{
+		dynld_printf("dynld: using cached relocations for `%s'\n", name);
+	};
+	
 	for (i=0; i<lib->numRela; i++)
 	{
 		Elf64_Rela *rela = &lib->rela[i];
@@ -777,7 +855,11 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		if (symbol->st_name == 0) symname = "<noname>";
 		
 		void *symaddr = NULL;
-		if (((symbol->st_shndx == 0) && (type != R_X86_64_RELATIVE)) && (type != R_X86_64_COPY))
+		if (cachedValues != NULL)
+		{
+			symaddr = (void*) cachedValues[i];
+		}
+		else if (((symbol->st_shndx == 0) && (type != R_X86_64_RELATIVE)) && (type != R_X86_64_COPY))
 		{
 			symaddr = dynld_globsym(symname, lib);
 			if (symaddr == NULL)
@@ -811,7 +893,7 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		
 		// for R_X86_64_GLOB_DAT relocations, use the normal symbol value unless the executable contained
 		// an R_X86_64_COPY relocation for this symbol, in which case use that instead.
-		if (type == R_X86_64_GLOB_DAT)
+		if (type == R_X86_64_GLOB_DAT && cachedValues == NULL)
 		{
 			void *globaddr = dynld_globdat(symname);
 			if (globaddr != NULL)
@@ -820,7 +902,13 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 			};
 		};
 		
+		if (recordValues != NULL)
+		{
+			recordValues[i] = (uint64_t) symaddr;
+		};
+		
 		// fill in the resulting value
+		numRelocs++;
 		uint64_t *relput = (uint64_t*) (lib->base + rela->r_offset);
 		switch (type)
 		{
@@ -876,7 +964,17 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		{			
 			for (i=0; i<numPltRela; i++)
 			{
-				lib->pltgot[i+3] += lib->base;
+				if (cachedValues != NULL && cachedValues[lib->numRela+i] != 0)
+				{
+					// prebound by the relocation cache
+					*((uint64_t*) (lib->base + lib->pltRela[i].r_offset)) = cachedValues[lib->numRela+i];
+					numPltBound++;
+				}
+				else
+				{
+					lib->pltgot[i+3] += lib->base;
+					numPltLazy++;
+				};
 			};
 			
 			lib->pltgot[1] = lib;
@@ -884,6 +982,11 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 		};
 	};
 	
+	if (debugMode)
+	{
+		relocTime += dynld_nanotime() - relocStart;
+	};
+	
 	return topAddr;
 };
 
@@ -900,6 +1003,8 @@ int dynld_libclose(Dl_Library *lib)
 		{
 			lib->next->prev = lib->prev;
 		};
+		
+		dynld_cacheflush();
 
 		// call destructors
 		if (lib->finiFunc != NULL) lib->finiFunc();
@@ -0,0 +1,353 @@
+/*
+	Glidix dynamic linker
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "dynld.h"
+
+/**
+ * The relocation cache remembers, for a given executable, the value that each symbolic
+ * relocation of each startup object resolved to. Objects are always loaded at the same
+ * addresses in the same order, so as long as every object is the same file as last
+ * time, the values are still correct and symbol lookup can be skipped entirely.
+ *
+ * Cache files live in RCACHE_DIR, named after the device and inode of the executable.
+ * The cache is only used if that directory exists; nothing is created otherwise.
+ */
+#define	RCACHE_DIR				"/var/cache/dynld/"
+#define	RCACHE_MAGIC				0x4548434143434C52UL	/* "RLCCACHE" */
+#define	RCACHE_VERSION				1
+#define	RCACHE_MAX_OBJS				64
+
+typedef struct
+{
+	uint64_t				magic;
+	uint32_t				version;
+	uint32_t				numObjs;
+	uint64_t				size;
+} RCacheHeader;
+
+typedef struct
+{
+	uint64_t				dev;
+	uint64_t				ino;
+	uint64_t				size;
+	int64_t					mtime;
+	uint64_t				base;
+	uint64_t				numRela;
+	uint64_t				numPltRela;
+	uint64_t				offset;		/* of the values, from start of file */
+} RCacheObject;
+
+/**
+ * Objects loaded at startup, in load order.
+ */
+typedef struct
+{
+	RCacheObject				info;
+	Dl_Library*				lib;
+	uint64_t*				values;
+	int					ownValues;	/* 'values' was allocated by us (else it's in the cache file) */
+} RCacheSlot;
+
+static RCacheSlot slots[RCACHE_MAX_OBJS];
+static int numSlots;
+
+/**
+ * Set while the executable and its dependencies are being loaded.
+ */
+static int startup;
+
+/**
+ * Path of the cache file, and the mapped contents of an existing one (or NULL).
+ */
+static char cachePath[128];
+static RCacheHeader *cacheFile;
+static size_t cacheFileSize;
+
+/**
+ * Set once a loaded object is found not to match the cache, or the cache cannot be used at all.
+ */
+static int cacheMiss;
+
+static char* putHex(char *put, uint64_t val)
+{
+	static const char hexd[16] = "0123456789abcdef";
+	int i;
+	for (i=15; i>=0; i--)
+	{
+		*put++ = hexd[(val >> (4*i)) & 0xF];
+	};
+	
+	*put = 0;
+	return put;
+};
+
+void dynld_rcache_open(struct stat *exest)
+{
+	// don't bother recording anything if there is nowhere to put it
+	int dirfd = open(RCACHE_DIR, O_RDONLY);
+	if (dirfd == -1) return;
+	close(dirfd);
+	
+	startup = 1;
+	cacheMiss = 1;
+	
+	strcpy(cachePath, RCACHE_DIR);
+	char *put = putHex(&cachePath[strlen(cachePath)], exest->st_dev);
+	*put++ = '-';
+	putHex(put, exest->st_ino);
+	
+	int fd = open(cachePath, O_RDONLY);
+	if (fd == -1) return;
+	
+	// the cache decides where code jumps, so only trust files that nobody else could have written
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (st.st_uid != 0 && st.st_uid != geteuid()) || (st.st_mode & 022) != 0
+		|| st.st_size < sizeof(RCacheHeader))
+	{
+		close(fd);
+		return;
+	};
+	
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return;
+	
+	RCacheHeader *header = (RCacheHeader*) data;
+	if (header->magic != RCACHE_MAGIC || header->version != RCACHE_VERSION || header->size != st.st_size
+		|| header->numObjs > RCACHE_MAX_OBJS
+		|| sizeof(RCacheHeader) + sizeof(RCacheObject) * header->numObjs > st.st_size)
+	{
+		munmap(data, st.st_size);
+		return;
+	};
+	
+	cacheFile = header;
+	cacheFileSize = st.st_size;
+	cacheMiss = 0;
+	
+	if (debugMode)
+	{
+		dynld_printf("dynld: using relocation cache %s\n", cachePath);
+	};
+};
+
+int dynld_rcache_addobj(Dl_Library *lib, int fd)
+{
+	if (!startup || numSlots == RCACHE_MAX_OBJS)
+	{
+		cacheMiss = 1;
+		return -1;
+	};
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		cacheMiss = 1;
+		return -1;
+	};
+	
+	int index = numSlots++;
+	RCacheSlot *slot = &slots[index];
+	slot->info.dev = st.st_dev;
+	slot->info.ino = st.st_ino;
+	slot->info.size = st.st_size;
+	slot->info.mtime = st.st_mtime;
+	slot->info.base = lib->base;
+	slot->lib = lib;
+	slot->values = NULL;
+	slot->ownValues = 0;
+	
+	if (!cacheMiss)
+	{
+		RCacheObject *obj = (RCacheObject*) &cacheFile[1] + index;
+		if (index >= cacheFile->numObjs || obj->dev != slot->info.dev || obj->ino != slot->info.ino
+			|| obj->size != slot->info.size || obj->mtime != slot->info.mtime || obj->base != slot->info.base)
+		{
+			if (debugMode)
+			{
+				dynld_printf("dynld: relocation cache is stale at %s\n", lib->path);
+			};
+			
+			cacheMiss = 1;
+		};
+	};
+	
+	return index;
+};
+
+uint64_t* dynld_rcache_get(int index, size_t numRela, size_t numPltRela)
+{
+	if (index == -1 || cacheMiss) return NULL;
+	
+	RCacheObject *obj = (RCacheObject*) &cacheFile[1] + index;
+	size_t count = numRela + numPltRela;
+	if (obj->numRela != numRela || obj->numPltRela != numPltRela
+		|| obj->offset > cacheFileSize || (cacheFileSize - obj->offset) / 8 < count)
+	{
+		cacheMiss = 1;
+		return NULL;
+	};
+	
+	RCacheSlot *slot = &slots[index];
+	slot->info.numRela = numRela;
+	slot->info.numPltRela = numPltRela;
+	slot->values = (uint64_t*) ((char*) cacheFile + obj->offset);
+	return slot->values;
+};
+
+uint64_t* dynld_rcache_record(int index, size_t numRela, size_t numPltRela)
+{
+	if (index == -1) return NULL;
+	
+	RCacheSlot *slot = &slots[index];
+	slot->info.numRela = numRela;
+	slot->info.numPltRela = numPltRela;
+	
+	size_t count = numRela + numPltRela;
+	if (count == 0) return NULL;
+	
+	void *buf = mmap(NULL, count * 8, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (buf == MAP_FAILED) return NULL;
+	
+	slot->values = (uint64_t*) buf;
+	slot->ownValues = 1;
+	return slot->values;
+};
+
+static int writeAll(int fd, const void *buf, size_t size)
+{
+	const char *scan = (const char*) buf;
+	while (size != 0)
+	{
+		ssize_t ret = write(fd, scan, size);
+		if (ret <= 0) return -1;
+		scan += ret;
+		size -= ret;
+	};
+	
+	return 0;
+};
+
+void dynld_rcache_done()
+{
+	startup = 0;
+	
+	int i;
+	if (cacheMiss && numSlots != 0)
+	{
+		// every object must have been recorded for the cache to be complete
+		uint64_t offset = sizeof(RCacheHeader) + sizeof(RCacheObject) * numSlots;
+		for (i=0; i<numSlots; i++)
+		{
+			RCacheSlot *slot = &slots[i];
+			size_t count = slot->info.numRela + slot->info.numPltRela;
+			if (count != 0 && slot->values == NULL) break;
+			
+			if (count != 0 && !slot->ownValues)
+			{
+				// came from the old cache; the RELA values are still right, but take a
+				// private copy as the PLT values are recomputed below
+				void *buf = mmap(NULL, count * 8, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+				if (buf == MAP_FAILED) break;
+				memcpy(buf, slot->values, count * 8);
+				slot->values = (uint64_t*) buf;
+				slot->ownValues = 1;
+			};
+			
+			// PLT entries are resolved the way lazy binding would resolve them now
+			size_t j;
+			for (j=0; j<slot->info.numPltRela; j++)
+			{
+				Dl_Library *lib = slot->lib;
+				Elf64_Sym *symbol = &lib->symtab[ELF64_R_SYM(lib->pltRela[j].r_info)];
+				slot->values[slot->info.numRela + j] = (uint64_t) dynld_globsym(&lib->strtab[symbol->st_name], lib);
+			};
+			
+			slot->info.offset = offset;
+			offset += count * 8;
+		};
+		
+		if (i == numSlots)
+		{
+			RCacheHeader header;
+			header.magic = RCACHE_MAGIC;
+			header.version = RCACHE_VERSION;
+			header.numObjs = numSlots;
+			header.size = offset;
+			
+			// write to a private name first, so other processes never see a partial file
+			char tmpPath[160];
+			strcpy(tmpPath, cachePath);
+			char *put = &tmpPath[strlen(tmpPath)];
+			*put++ = '.';
+			putHex(put, dynld_getpid());
+			
+			int fd = open(tmpPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if (fd != -1)
+			{
+				int ok = writeAll(fd, &header, sizeof(RCacheHeader)) == 0;
+				for (i=0; i<numSlots && ok; i++)
+				{
+					ok = writeAll(fd, &slots[i].info, sizeof(RCacheObject)) == 0;
+				};
+				
+				for (i=0; i<numSlots && ok; i++)
+				{
+					size_t count = slots[i].info.numRela + slots[i].info.numPltRela;
+					if (count != 0) ok = writeAll(fd, slots[i].values, count * 8) == 0;
+				};
+				
+				close(fd);
+				if (!ok || dynld_mv(AT_FDCWD, tmpPath, AT_FDCWD, cachePath, 0) != 0)
+				{
+					dynld_unlink(tmpPath);
+				}
+				else if (debugMode)
+				{
+					dynld_printf("dynld: wrote relocation cache %s\n", cachePath);
+				};
+			};
+		};
+	};
+	
+	for (i=0; i<numSlots; i++)
+	{
+		size_t count = slots[i].info.numRela + slots[i].info.numPltRela;
+		if (slots[i].ownValues) munmap(slots[i].values, count * 8);
+	};
+	
+	if (cacheFile != NULL)
+	{
+		munmap(cacheFile, cacheFileSize);
+		cacheFile = NULL;
+	};
+};
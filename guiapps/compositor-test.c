@@ -0,0 +1,131 @@
+/*
+	Glidix GUI
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <libgwm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * A test for how fast the window manager can composite a stack of overlapping windows. Each frame,
+ * every window redraws its whole canvas and commits it, and we wait for all the GWM_EVENT_FRAME_DONE
+ * events before starting the next frame. Run with "-a" to make the windows translucent (which
+ * disables occlusion culling), to compare against the default opaque case.
+ */
+#define	DEFAULT_WINDOWS		8
+#define	FRAME_COUNT		200
+#define	WINDOW_WIDTH		400
+#define	WINDOW_HEIGHT		300
+#define	WINDOW_STEP		24
+
+int main(int argc, char *argv[])
+{
+	int numWindows = DEFAULT_WINDOWS;
+	int translucent = 0;
+	
+	int i;
+	for (i=1; i<argc; i++)
+	{
+		if (strcmp(argv[i], "-a") == 0)
+		{
+			translucent = 1;
+		}
+		else
+		{
+			numWindows = atoi(argv[i]);
+			if (numWindows < 1)
+			{
+				fprintf(stderr, "USAGE:\t%s [-a] [num-windows]\n", argv[0]);
+				return 1;
+			};
+		};
+	};
+	
+	if (gwmInit() != 0)
+	{
+		fprintf(stderr, "compositor-test: failed to initialize GWM!\n");
+		return 1;
+	};
+	
+	int flags = GWM_WINDOW_NODECORATE | GWM_WINDOW_NOTASKBAR | GWM_WINDOW_DOUBLE_BUFFER;
+	if (!translucent) flags |= GWM_WINDOW_OPAQUE;
+	
+	GWMWindow **windows = (GWMWindow**) malloc(sizeof(GWMWindow*) * numWindows);
+	for (i=0; i<numWindows; i++)
+	{
+		windows[i] = gwmCreateWindow(NULL, "Compositor test", 50 + i * WINDOW_STEP, 50 + i * WINDOW_STEP,
+						WINDOW_WIDTH, WINDOW_HEIGHT, flags);
+		if (windows[i] == NULL)
+		{
+			fprintf(stderr, "compositor-test: failed to create window %d\n", i);
+			return 1;
+		};
+	};
+	
+	DDIColor color;
+	color.alpha = translucent ? 0x80 : 0xFF;
+	
+	int frame;
+	clock_t start = clock();
+	for (frame=0; frame<FRAME_COUNT; frame++)
+	{
+		for (i=0; i<numWindows; i++)
+		{
+			color.red = (uint8_t) (frame * 3 + i * 40);
+			color.green = (uint8_t) (frame * 5);
+			color.blue = (uint8_t) (255 - i * 20);
+			
+			DDISurface *canvas = gwmGetWindowCanvas(windows[i]);
+			ddiFillRect(canvas, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, &color);
+			gwmPostDirty(windows[i]);
+		};
+		
+		int pending = numWindows;
+		while (pending > 0)
+		{
+			GWMEvent ev;
+			gwmWaitEvent(&ev);
+			if (ev.type == GWM_EVENT_FRAME_DONE) pending--;
+		};
+	};
+	clock_t end = clock();
+	
+	printf("Compositing %d %s %dx%d windows for %d frames took %ld ms (%ld us/frame)\n",
+		numWindows, translucent ? "translucent" : "opaque", WINDOW_WIDTH, WINDOW_HEIGHT, FRAME_COUNT,
+		(long) ((end-start)*1000/CLOCKS_PER_SEC), (long) ((end-start)*1000000/CLOCKS_PER_SEC/FRAME_COUNT));
+	
+	for (i=0; i<numWindows; i++)
+	{
+		gwmDestroyWindow(windows[i]);
+	};
+	free(windows);
+	
+	gwmQuit();
+	return 0;
+};
@@ -0,0 +1,173 @@
+/*
+	Glidix GUI
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/glidix.h>
+#include <libgwm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * Measures how long it takes for a mouse motion to reach a client as a GWM_EVENT_MOTION. We move the
+ * pointer by writing to /dev/ptr (so this must run as root), exactly like the mouse driver would, and
+ * time how long it takes for the motion event to come out of gwmWaitEvent(). Then we move the pointer
+ * BURST_SIZE times in a row and count how many motion events actually get delivered, to see the
+ * motion compression at work.
+ */
+#define	SAMPLE_COUNT		1000
+#define	BURST_COUNT		100
+#define	BURST_SIZE		64
+#define	WINDOW_X		100
+#define	WINDOW_Y		100
+#define	WINDOW_SIZE		200
+
+static int ptrFD;
+static int screenWidth, screenHeight;
+
+static void movePointer(int x, int y)
+{
+	_glidix_ptrstate state;
+	state.width = screenWidth;
+	state.height = screenHeight;
+	state.posX = x;
+	state.posY = y;
+	
+	if (write(ptrFD, &state, sizeof(_glidix_ptrstate)) != sizeof(_glidix_ptrstate))
+	{
+		perror("event-latency-test: write /dev/ptr");
+		exit(1);
+	};
+};
+
+/**
+ * Wait for a motion event reporting the pointer at the specified position (relative to the window).
+ * Returns the number of motion events received in the process.
+ */
+static int waitForMotion(int relX, int relY)
+{
+	int count = 0;
+	while (1)
+	{
+		GWMEvent ev;
+		gwmWaitEvent(&ev);
+		
+		if (ev.type == GWM_EVENT_MOTION)
+		{
+			count++;
+			if (ev.x == relX && ev.y == relY) return count;
+		};
+	};
+};
+
+static int compareTimes(const void *a, const void *b)
+{
+	uint64_t x = *((const uint64_t*) a);
+	uint64_t y = *((const uint64_t*) b);
+	
+	if (x < y) return -1;
+	if (x > y) return 1;
+	return 0;
+};
+
+int main(int argc, char *argv[])
+{
+	ptrFD = open("/dev/ptr", O_RDWR);
+	if (ptrFD == -1)
+	{
+		fprintf(stderr, "event-latency-test: cannot open /dev/ptr: %s\n", strerror(errno));
+		return 1;
+	};
+	
+	if (gwmInit() != 0)
+	{
+		fprintf(stderr, "event-latency-test: failed to initialize GWM!\n");
+		return 1;
+	};
+	
+	gwmScreenSize(&screenWidth, &screenHeight);
+	
+	GWMWindow *win = gwmCreateWindow(NULL, "Event latency test", WINDOW_X, WINDOW_Y, WINDOW_SIZE, WINDOW_SIZE,
+						GWM_WINDOW_NODECORATE | GWM_WINDOW_NOTASKBAR);
+	if (win == NULL)
+	{
+		fprintf(stderr, "event-latency-test: failed to create window\n");
+		return 1;
+	};
+	
+	// make sure the pointer is in the window before we start timing
+	movePointer(WINDOW_X + WINDOW_SIZE/2 + 1, WINDOW_Y + WINDOW_SIZE/2);
+	waitForMotion(WINDOW_SIZE/2 + 1, WINDOW_SIZE/2);
+	
+	uint64_t *samples = (uint64_t*) malloc(sizeof(uint64_t) * SAMPLE_COUNT);
+	uint64_t total = 0;
+	
+	int i;
+	for (i=0; i<SAMPLE_COUNT; i++)
+	{
+		int relX = WINDOW_SIZE/2 + (i & 1);
+		
+		uint64_t start = _glidix_nanotime();
+		movePointer(WINDOW_X + relX, WINDOW_Y + WINDOW_SIZE/2);
+		waitForMotion(relX, WINDOW_SIZE/2);
+		samples[i] = _glidix_nanotime() - start;
+		total += samples[i];
+	};
+	
+	qsort(samples, SAMPLE_COUNT, sizeof(uint64_t), compareTimes);
+	printf("Motion-to-client latency over %d moves: min %lu us, median %lu us, avg %lu us, 99%% %lu us, max %lu us\n",
+		SAMPLE_COUNT, samples[0]/1000, samples[SAMPLE_COUNT/2]/1000, total/SAMPLE_COUNT/1000,
+		samples[SAMPLE_COUNT*99/100]/1000, samples[SAMPLE_COUNT-1]/1000);
+	
+	// bursts: the last position must always arrive, but most of the ones before it should be merged
+	int delivered = 0;
+	uint64_t start = _glidix_nanotime();
+	for (i=0; i<BURST_COUNT; i++)
+	{
+		int j;
+		for (j=0; j<BURST_SIZE; j++)
+		{
+			movePointer(WINDOW_X + j, WINDOW_Y + i % WINDOW_SIZE);
+		};
+		
+		delivered += waitForMotion(BURST_SIZE - 1, i % WINDOW_SIZE);
+	};
+	uint64_t burstTime = _glidix_nanotime() - start;
+	
+	printf("%d bursts of %d moves: %d motion events delivered, %lu us per burst\n",
+		BURST_COUNT, BURST_SIZE, delivered, burstTime/BURST_COUNT/1000);
+	
+	free(samples);
+	movePointer(screenWidth/2, screenHeight/2);
+	gwmDestroyWindow(win);
+	gwmQuit();
+	return 0;
+};
@@ -216,7 +216,7 @@ void renderGame()
 		ddiBlit(imgGameOver, 0, 0, canvas, x, y, imgGameOver->width, imgGameOver->height);
 	};
 	
-	gwmPostDirty(win);
+	gwmPostDirtyRect(win, 0, 20, CELL_WIDTH*MAZE_WIDTH, CELL_HEIGHT*MAZE_HEIGHT);
 };
 
 int snakeHandler(GWMEvent *ev, GWMWindow *win, void *context)
@@ -275,7 +275,7 @@ int onReset(void *ignore)
 {
 	resetGame();
 	renderGame();
-	gwmSetWindowFlags(win, GWM_WINDOW_MKFOCUSED);
+	gwmSetWindowFlags(win, GWM_WINDOW_MKFOCUSED | GWM_WINDOW_OPAQUE);
 	return 0;
 };
 
@@ -317,7 +317,7 @@ int main()
 	win = gwmCreateWindow(NULL, "Snake",
 			GWM_POS_UNSPEC, GWM_POS_UNSPEC,
 			CELL_WIDTH*MAZE_WIDTH, 20+CELL_HEIGHT*MAZE_HEIGHT,
-			GWM_WINDOW_NOTASKBAR | GWM_WINDOW_HIDDEN);
+			GWM_WINDOW_NOTASKBAR | GWM_WINDOW_HIDDEN | GWM_WINDOW_DOUBLE_BUFFER | GWM_WINDOW_OPAQUE);
 			
 	if (win == NULL)
 	{
@@ -354,7 +354,7 @@ int main()
 	pthread_create(&thread, NULL, timerThread, NULL);
 	
 	gwmPushEventHandler(win, snakeHandler, NULL);
-	gwmSetWindowFlags(win, GWM_WINDOW_MKFOCUSED);
+	gwmSetWindowFlags(win, GWM_WINDOW_MKFOCUSED | GWM_WINDOW_OPAQUE);
 	gwmMainLoop();
 	gwmQuit();
 	return 0;
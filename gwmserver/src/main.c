@@ -91,9 +91,10 @@ int main(int argc, char *argv[])
 		return 1;
 	};
 	
-	// make sure the clipboard and shared surface directories actually exist
+	// make sure the clipboard, shared surface and ring directories actually exist
 	mkdir("/run/clipboard", 0777);
 	mkdir("/run/shsurf", 01777);
+	mkdir("/run/gwmring", 01777);
 	mkdir("/run/gwmserver-wd", 0777);
 	mkdir("/var", 0755);
 	mkdir("/var/log", 0755);
@@ -45,6 +45,7 @@
 
 #include "window.h"
 #include "screen.h"
+#include "server.h"
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -154,598 +155,987 @@ static void dispatchRethemeEvent(Window *win)
 	};
 };
 
-void* clientThreadFunc(void *context)
+/**
+ * Server-side state of a connected client.
+ */
+typedef struct Client_
 {
-	int sockfd = (int) (uintptr_t) context;
+	struct Client_*			next;
+	int				fd;
 	
 	/**
-	 * A hashtable of windows. The hashkey is the bottom 8 bits of a window ID
-	 * and it points to a linked list of WndLookup structures with IDs ending
-	 * in that hashkey.
+	 * Protects the event side of the ring and 'nextSerial'; events for a client may be sent
+	 * from any thread.
 	 */
-	WndLookup* wlt[256];
-	memset(wlt, 0, sizeof(void*) * 256);
-	wltPut(wlt, 0, desktopWindow);
+	pthread_mutex_t			lock;
 	
-	while (1)
+	/**
+	 * The shared ring, or NULL if the client hasn't attached one (in which case all events go
+	 * over the socket). Only set by the client's own thread.
+	 */
+	GWMRing*			ring;
+	
+	/**
+	 * Our own copies of the indices we write, so that the client can't make us write outside the ring.
+	 */
+	uint32_t			evTail;
+	uint32_t			cmdHead;
+	
+	/**
+	 * Serial number of the next event.
+	 */
+	uint32_t			nextSerial;
+} Client;
+
+/**
+ * Clients by socket descriptor; windows only know the descriptor of their client.
+ */
+#define	CLIENT_BUCKETS			64
+static pthread_mutex_t clientTableLock = PTHREAD_MUTEX_INITIALIZER;
+static Client* clientTable[CLIENT_BUCKETS];
+
+static Client* srvAddClient(int fd)
+{
+	Client *client = (Client*) malloc(sizeof(Client));
+	memset(client, 0, sizeof(Client));
+	client->fd = fd;
+	pthread_mutex_init(&client->lock, NULL);
+	
+	pthread_mutex_lock(&clientTableLock);
+	client->next = clientTable[fd % CLIENT_BUCKETS];
+	clientTable[fd % CLIENT_BUCKETS] = client;
+	pthread_mutex_unlock(&clientTableLock);
+	
+	return client;
+};
+
+static void srvRemoveClient(Client *client)
+{
+	pthread_mutex_lock(&clientTableLock);
+	Client **link;
+	for (link=&clientTable[client->fd % CLIENT_BUCKETS]; *link!=client; link=&(*link)->next);
+	*link = client->next;
+	pthread_mutex_unlock(&clientTableLock);
+	
+	// wait for anyone still sending an event to this client
+	pthread_mutex_lock(&client->lock);
+	pthread_mutex_unlock(&client->lock);
+	
+	if (client->ring != NULL) munmap(client->ring, sizeof(GWMRing));
+	pthread_mutex_destroy(&client->lock);
+	free(client);
+};
+
+/**
+ * Send an event over the socket. Used when the client has no ring or its ring is full.
+ */
+static void srvSendEventMessage(Client *client, GWMEvent *ev)
+{
+	GWMMessage msg;
+	memset(&msg, 0, sizeof(GWMMessage));
+	msg.event.type = GWM_MSG_EVENT;
+	msg.event.seq = 0;
+	memcpy(&msg.event.payload, ev, sizeof(GWMEvent));
+	msg.event.serial = client->nextSerial++;
+	
+	write(client->fd, &msg, sizeof(GWMMessage));
+};
+
+/**
+ * Push an event into the client's ring; called with the client locked.
+ */
+static void srvPushEvent(Client *client, GWMEvent *ev)
+{
+	GWMRing *ring = client->ring;
+	if (ring == NULL)
 	{
-		GWMCommand cmd;
-		
-		ssize_t sz = read(sockfd, &cmd, sizeof(GWMCommand));
-		if (sz == -1)
+		srvSendEventMessage(client, ev);
+		return;
+	};
+	
+	uint32_t tail = client->evTail;
+	uint32_t used = tail - ring->evHead;
+	
+	// compress motion (and resize requests): if the newest unread event is of the same kind and for
+	// the same window, just replace it. If the client is reading that slot right now, we append instead.
+	if ((ev->type == GWM_EVENT_MOTION || ev->type == GWM_EVENT_RESIZE_REQUEST) && used != 0 && used <= GWM_RING_EVENTS)
+	{
+		GWMEventSlot *slot = &ring->events[(tail - 1) % GWM_RING_EVENTS];
+		if (__sync_bool_compare_and_swap(&slot->claim, GWM_SLOT_FREE, GWM_SLOT_WRITER))
 		{
-			printf("[gwmserver] read from client socket: %s\n", strerror(errno));
-			break;
+			int unread = (int32_t) (tail - 1 - ring->evHead) >= 0;
+			if (unread && slot->ev.type == ev->type && slot->ev.win == ev->win)
+			{
+				memcpy(&slot->ev, ev, sizeof(GWMEvent));
+				__sync_lock_release(&slot->claim);
+				return;
+			};
+			
+			__sync_lock_release(&slot->claim);
 		};
-		
-		if (sz == 0)
+	};
+	
+	if (used >= GWM_RING_EVENTS)
+	{
+		// full (or the client wrote garbage into evHead); the serial number tells the client
+		// where this event goes
+		srvSendEventMessage(client, ev);
+		return;
+	};
+	
+	GWMEventSlot *slot = &ring->events[tail % GWM_RING_EVENTS];
+	slot->serial = client->nextSerial++;
+	memcpy(&slot->ev, ev, sizeof(GWMEvent));
+	__sync_synchronize();
+	ring->evTail = client->evTail = tail + 1;
+	__sync_synchronize();
+	
+	if (__sync_bool_compare_and_swap(&ring->clientSleeping, 1, 0))
+	{
+		GWMMessage msg;
+		msg.wakeup.type = GWM_MSG_WAKEUP;
+		msg.wakeup.seq = 0;
+		write(client->fd, &msg, sizeof(msg.wakeup));
+	};
+};
+
+void srvSendEvent(int fd, GWMEvent *ev)
+{
+	pthread_mutex_lock(&clientTableLock);
+	Client *client;
+	for (client=clientTable[fd % CLIENT_BUCKETS]; client!=NULL; client=client->next)
+	{
+		if (client->fd == fd) break;
+	};
+	
+	if (client == NULL)
+	{
+		// the client has disconnected
+		pthread_mutex_unlock(&clientTableLock);
+		return;
+	};
+	
+	pthread_mutex_lock(&client->lock);
+	pthread_mutex_unlock(&clientTableLock);
+	
+	srvPushEvent(client, ev);
+	pthread_mutex_unlock(&client->lock);
+};
+
+/**
+ * Attach the ring with the specified ID (created by the client in /run/gwmring) to a client.
+ * Returns 0 on success, or a GWM error code.
+ */
+static int srvAttachRing(Client *client, uint32_t ringID)
+{
+	if (client->ring != NULL)
+	{
+		return GWM_ERR_INVAL;
+	};
+	
+	char path[256];
+	sprintf(path, "/run/gwmring/%08X", ringID);
+	
+	int fd = open(path, O_RDWR);
+	if (fd == -1)
+	{
+		return GWM_ERR_NOENT;
+	};
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(GWMRing))
+	{
+		close(fd);
+		return GWM_ERR_INVAL;
+	};
+	
+	void *mem = mmap(NULL, sizeof(GWMRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (mem == MAP_FAILED)
+	{
+		return GWM_ERR_NORC;
+	};
+	
+	GWMRing *ring = (GWMRing*) mem;
+	
+	pthread_mutex_lock(&client->lock);
+	client->evTail = ring->evTail;
+	client->cmdHead = ring->cmdHead;
+	client->ring = ring;
+	pthread_mutex_unlock(&client->lock);
+	
+	return 0;
+};
+
+/**
+ * Handle a command from a client, received over the socket or from its command ring. 'sz' is the size
+ * of the command. Returns 0 on success, or -1 if the client sent something invalid and must be
+ * disconnected.
+ */
+static int srvHandleCommand(int sockfd, WndLookup **wlt, Client *client, GWMCommand *cmd, ssize_t sz)
+{
+	// NOTE: Please keep the following in numeric order of commands as given in libgwm.h
+	if (cmd->cmd == GWM_CMD_CREATE_WINDOW)
+	{
+		if (sz < sizeof(cmd->createWindow))
 		{
-			// client disconnected
-			break;
+			printf("[gwmserver] GWM_CMD_CREATE_WINDOW command too small\n");
+			return -1;
 		};
 		
-		if (sz < sizeof(int))
+		if (cmd->createWindow.pars.x == GWM_POS_UNSPEC)
 		{
-			// too small to even store a command
-			printf("[gwmserver] application sent command structure smaller than command ID (%ld bytes)\n", sz);
-			break;
+			cmd->createWindow.pars.x = (screen->width - cmd->createWindow.pars.width)/2;
 		};
 		
-		// NOTE: Please keep the following in numeric order of commands as given in libgwm.h
-		if (cmd.cmd == GWM_CMD_CREATE_WINDOW)
+		if (cmd->createWindow.pars.y == GWM_POS_UNSPEC)
 		{
-			if (sz < sizeof(cmd.createWindow))
-			{
-				printf("[gwmserver] GWM_CMD_CREATE_WINDOW command too small\n");
-				break;
-			};
-			
-			if (cmd.createWindow.pars.x == GWM_POS_UNSPEC)
-			{
-				cmd.createWindow.pars.x = (screen->width - cmd.createWindow.pars.width)/2;
-			};
-			
-			if (cmd.createWindow.pars.y == GWM_POS_UNSPEC)
-			{
-				cmd.createWindow.pars.y = (screen->height - cmd.createWindow.pars.height)/2;
-			};
+			cmd->createWindow.pars.y = (screen->height - cmd->createWindow.pars.height)/2;
+		};
 
-			GWMMessage resp;
-			resp.createWindowResp.type = GWM_MSG_CREATE_WINDOW_RESP;
-			resp.createWindowResp.seq = cmd.createWindow.seq;
-			memcpy(&resp.createWindowResp.format, &screen->format, sizeof(DDIPixelFormat));
-			resp.createWindowResp.width = cmd.createWindow.pars.width;
-			resp.createWindowResp.height = cmd.createWindow.pars.height;
+		GWMMessage resp;
+		resp.createWindowResp.type = GWM_MSG_CREATE_WINDOW_RESP;
+		resp.createWindowResp.seq = cmd->createWindow.seq;
+		memcpy(&resp.createWindowResp.format, &screen->format, sizeof(DDIPixelFormat));
+		resp.createWindowResp.width = cmd->createWindow.pars.width;
+		resp.createWindowResp.height = cmd->createWindow.pars.height;
 
-			Window *check = wltGet(wlt, cmd.createWindow.id);
-			if (check != NULL)
+		Window *check = wltGet(wlt, cmd->createWindow.id);
+		if (check != NULL)
+		{
+			wndDown(check);
+			resp.createWindowResp.status = GWM_ERR_INVAL;
+			write(sockfd, &resp, sizeof(GWMMessage));
+		}
+		else
+		{
+			DDISurface *canvas = ddiOpenSurface(cmd->createWindow.surfID);
+			if (canvas == NULL)
 			{
-				wndDown(check);
-				resp.createWindowResp.status = GWM_ERR_INVAL;
+				resp.createWindowResp.status = GWM_ERR_NOSURF;
 				write(sockfd, &resp, sizeof(GWMMessage));
 			}
 			else
 			{
-				DDISurface *canvas = ddiOpenSurface(cmd.createWindow.surfID);
-				if (canvas == NULL)
+				Window *parent = wltGet(wlt, cmd->createWindow.parent);
+				if (parent == NULL)
 				{
-					resp.createWindowResp.status = GWM_ERR_NOSURF;
+					resp.createWindowResp.status = GWM_ERR_NOWND;
 					write(sockfd, &resp, sizeof(GWMMessage));
 				}
 				else
 				{
-					Window *parent = wltGet(wlt, cmd.createWindow.parent);
-					if (parent == NULL)
+					Window *win = wndCreate(parent, &cmd->createWindow.pars, cmd->createWindow.id,
+									sockfd, canvas);
+					wndDown(parent);
+					if (win == NULL)
 					{
 						resp.createWindowResp.status = GWM_ERR_NOWND;
 						write(sockfd, &resp, sizeof(GWMMessage));
 					}
 					else
 					{
-						Window *win = wndCreate(parent, &cmd.createWindow.pars, cmd.createWindow.id,
-										sockfd, canvas);
-						wndDown(parent);
-						if (win == NULL)
-						{
-							resp.createWindowResp.status = GWM_ERR_NOWND;
-							write(sockfd, &resp, sizeof(GWMMessage));
-						}
-						else
-						{
-							wltPut(wlt, cmd.createWindow.id, win);
-							wndDown(win);
-							resp.createWindowResp.status = 0;
-							write(sockfd, &resp, sizeof(GWMMessage));
-							wndDirty(win);
-							wndDrawScreen();
-						};
+						wltPut(wlt, cmd->createWindow.id, win);
+						wndDown(win);
+						resp.createWindowResp.status = 0;
+						write(sockfd, &resp, sizeof(GWMMessage));
+						wndDirty(win);
+						wndDrawScreen();
 					};
 				};
 			};
-		}
-		else if (cmd.cmd == GWM_CMD_POST_DIRTY)
+		};
+	}
+	else if (cmd->cmd == GWM_CMD_POST_DIRTY)
+	{
+		if (sz < sizeof(cmd->postDirty))
 		{
-			if (sz < sizeof(cmd.postDirty))
-			{
-				printf("[gwmserver] GWM_CMD_POST_DIRTY command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.postDirtyResp.type = GWM_MSG_POST_DIRTY_RESP;
-			resp.postDirtyResp.seq = cmd.postDirty.seq;
-			
-			Window *win = wltGet(wlt, cmd.postDirty.id);
-			if (win == NULL)
-			{
-				resp.postDirtyResp.status = GWM_ERR_NOWND;
-				write(sockfd, &resp, sizeof(GWMMessage));
-			}
-			else
-			{
-				pthread_mutex_lock(&win->lock);
-				ddiOverlay(win->canvas, 0, 0, win->front, 0, 0, win->canvas->width, win->canvas->height);
-				pthread_mutex_unlock(&win->lock);
-				
-				resp.postDirtyResp.status = 0;
-				write(sockfd, &resp, sizeof(GWMMessage));
-				
-				int status = wndDirty(win);
-				wndDown(win);
-				if (status == 0) wndDrawScreen();
-			};
-		}
-		else if (cmd.cmd == GWM_CMD_DESTROY_WINDOW)
+			printf("[gwmserver] GWM_CMD_POST_DIRTY command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.postDirtyResp.type = GWM_MSG_POST_DIRTY_RESP;
+		resp.postDirtyResp.seq = cmd->postDirty.seq;
+		
+		Window *win = wltGet(wlt, cmd->postDirty.id);
+		if (win == NULL)
 		{
-			if (sz < sizeof(cmd.destroyWindow))
-			{
-				printf("[gwmserver] GWM_CMD_DESTROY_WINDOW command too small\n");
-				break;
-			};
-			
-			Window *win = wltRemove(wlt, cmd.destroyWindow.id);
-			wndDestroy(win);	// also decrefs
+			resp.postDirtyResp.status = GWM_ERR_NOWND;
+			write(sockfd, &resp, sizeof(GWMMessage));
 		}
-		else if (cmd.cmd == GWM_CMD_RETHEME)
+		else
 		{
-			pthread_mutex_lock(&desktopWindow->lock);
-			Window *win = desktopWindow->children;
-			if (win != NULL) wndUp(win);
-			pthread_mutex_unlock(&desktopWindow->lock);
+			int numRects = cmd->postDirty.numRects;
+			if (numRects < 0 || numRects > GWM_MAX_DAMAGE_RECTS) numRects = 0;
 			
-			while (win != NULL)
+			// only copy the damaged parts of the canvas to the front buffer
+			// (unless the front buffer is a client buffer, which we must never write into)
+			int i;
+			pthread_mutex_lock(&win->lock);
+			if (numRects == 0 && !win->frontShared)
 			{
-				if (win->isDecoration)
+				ddiOverlay(win->canvas, 0, 0, win->front, 0, 0, win->canvas->width, win->canvas->height);
+			}
+			else if (!win->frontShared)
+			{
+				for (i=0; i<numRects; i++)
 				{
-					if (win->children != NULL)
+					GWMDamageRect *rect = &cmd->postDirty.rects[i];
+					int left = MAX(rect->x, 0);
+					int top = MAX(rect->y, 0);
+					int right = MIN(rect->x + rect->width, win->canvas->width);
+					int bottom = MIN(rect->y + rect->height, win->canvas->height);
+					
+					if (left < right && top < bottom)
 					{
-						wndDecorate(win, win->children);
+						ddiOverlay(win->canvas, left, top, win->front, left, top, right - left, bottom - top);
 					};
 				};
-				
-				pthread_mutex_lock(&desktopWindow->lock);
-				Window *next = win->next;
-				if (next != NULL) wndUp(next);
-				wndDown(win);
-				win = next;
-				pthread_mutex_unlock(&desktopWindow->lock);
-			};
-			
-			pthread_mutex_lock(&desktopWindow->lock);
-			win = desktopWindow->children;
-			if (win != NULL) wndUp(win);
-			pthread_mutex_unlock(&desktopWindow->lock);
-			
-			if (win != NULL) dispatchRethemeEvent(win);
-		}
-		else if (cmd.cmd == GWM_CMD_SCREEN_SIZE)
-		{
-			if (sz < sizeof(cmd.screenSize))
-			{
-				printf("[gwmserver] GWM_CMD_SCREEN_SIZE command too small\n");
-				break;
 			};
+			pthread_mutex_unlock(&win->lock);
 			
-			GWMMessage resp;
-			resp.screenSizeResp.type = GWM_MSG_SCREEN_SIZE_RESP;
-			resp.screenSizeResp.seq = cmd.screenSize.seq;
-			resp.screenSizeResp.width = (int) screen->width;
-			resp.screenSizeResp.height = (int) screen->height;
+			resp.postDirtyResp.status = 0;
 			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_SET_FLAGS)
-		{
-			if (sz < sizeof(cmd.setFlags))
-			{
-				printf("[gwmserver] GWM_CMD_SET_FLAGS command too small\n");
-				break;
-			};
 			
-			GWMMessage resp;
-			resp.setFlagsResp.type = GWM_MSG_SET_FLAGS_RESP;
-			resp.setFlagsResp.seq = cmd.setFlags.seq;
-			
-			Window *wnd = wltGet(wlt, cmd.setFlags.win);
-			if (wnd == NULL)
+			int status;
+			if (numRects == 0)
 			{
-				resp.setFlagsResp.status = GWM_ERR_NOWND;
+				status = wndDirty(win);
 			}
 			else
 			{
-				wndSetFlags(wnd, cmd.setFlags.flags);
-				wndDrawScreen();
-				resp.setFlagsResp.status = 0;
+				status = -1;
+				for (i=0; i<numRects; i++)
+				{
+					GWMDamageRect *rect = &cmd->postDirty.rects[i];
+					if (wndDirtyRect(win, rect->x, rect->y, rect->width, rect->height) == 0) status = 0;
+				};
 			};
 			
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_SET_CURSOR)
+			wndDown(win);
+			if (status == 0) wndDrawScreen();
+		};
+	}
+	else if (cmd->cmd == GWM_CMD_COMMIT)
+	{
+		if (sz < sizeof(cmd->commit))
 		{
-			if (sz < sizeof(cmd.setCursor))
-			{
-				printf("[gwmserver] GWM_CMD_SET_CURSOR command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.setCursorResp.type = GWM_MSG_SET_CURSOR_RESP;
-			resp.setCursorResp.seq = cmd.setCursor.seq;
+			printf("[gwmserver] GWM_CMD_COMMIT command too small\n");
+			return -1;
+		};
+		
+		Window *win = wltGet(wlt, cmd->commit.id);
+		if (win != NULL)
+		{
+			int numRects = cmd->commit.numRects;
+			if (numRects < 0 || numRects > GWM_MAX_DAMAGE_RECTS) numRects = 0;
 			
-			if ((cmd.setCursor.cursor < 0) || (cmd.setCursor.cursor >= GWM_CURSOR_COUNT))
+			// on failure, keep displaying the old front buffer but still report the frame
+			// as done, so that the client doesn't wait for it forever
+			int present = wndPresent(win, cmd->commit.surfID);
+			int status = -1;
+			if (present == 1 || (present == 0 && numRects == 0))
 			{
-				resp.setCursorResp.status = GWM_ERR_INVAL;
+				status = wndDirty(win);
 			}
-			else
+			else if (present == 0)
 			{
-				Window *win = wltGet(wlt, cmd.setCursor.win);
-				if (win == NULL)
-				{
-					resp.setCursorResp.status = GWM_ERR_NOWND;
-				}
-				else
+				int i;
+				for (i=0; i<numRects; i++)
 				{
-					win->cursor = cmd.setCursor.cursor;
-					wndDown(win);
-					wndDrawScreen();
-					resp.setCursorResp.status = 0;
+					GWMDamageRect *rect = &cmd->commit.rects[i];
+					if (wndDirtyRect(win, rect->x, rect->y, rect->width, rect->height) == 0) status = 0;
 				};
 			};
 			
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_SET_ICON)
-		{
-			if (sz < sizeof(cmd.setIcon))
-			{
-				printf("[gwmserver] GWM_CMD_SET_ICON command too small\n");
-				break;
-			};
+			if (status == 0) wndDrawScreen();
 			
-			GWMMessage resp;
-			resp.setIconResp.type = GWM_MSG_SET_ICON_RESP;
-			resp.setIconResp.seq = cmd.setIcon.seq;
-			
-			Window *win = wltGet(wlt, cmd.setIcon.win);
-			if (win == NULL)
-			{
-				resp.setIconResp.status = GWM_ERR_NOWND;
-			}
-			else
-			{
-				resp.setIconResp.status = wndSetIcon(win, cmd.setIcon.surfID);
-				wndDown(win);
-			};
+			GWMEvent ev;
+			memset(&ev, 0, sizeof(GWMEvent));
+			ev.type = GWM_EVENT_FRAME_DONE;
+			ev.win = win->id;
+			ev.value = (int) cmd->commit.serial;
+			wndSendEvent(win, &ev);
 			
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_GET_FORMAT)
+			wndDown(win);
+		};
+	}
+	else if (cmd->cmd == GWM_CMD_DESTROY_WINDOW)
+	{
+		if (sz < sizeof(cmd->destroyWindow))
 		{
-			if (sz < sizeof(cmd.getFormat))
-			{
-				printf("[gwmserver] GWM_CMD_GET_FORMAT command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.getFormatResp.type = GWM_MSG_GET_FORMAT_RESP;
-			resp.getFormatResp.seq = cmd.getFormat.seq;
-			memcpy(&resp.getFormatResp.format, &screen->format, sizeof(DDIPixelFormat));
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_GET_WINDOW_LIST)
+			printf("[gwmserver] GWM_CMD_DESTROY_WINDOW command too small\n");
+			return -1;
+		};
+		
+		Window *win = wltRemove(wlt, cmd->destroyWindow.id);
+		wndDestroy(win);	// also decrefs
+	}
+	else if (cmd->cmd == GWM_CMD_RETHEME)
+	{
+		pthread_mutex_lock(&desktopWindow->lock);
+		Window *win = desktopWindow->children;
+		if (win != NULL) wndUp(win);
+		pthread_mutex_unlock(&desktopWindow->lock);
+		
+		while (win != NULL)
 		{
-			if (sz < sizeof(cmd.getWindowList))
+			if (win->isDecoration)
 			{
-				printf("[gwmserver] GWM_CMD_GET_WINDOW_LIST command too small\n");
-				break;
+				if (win->children != NULL)
+				{
+					wndDecorate(win, win->children);
+				};
 			};
 			
-			GWMMessage resp;
-			resp.getWindowListResp.type = GWM_MSG_GET_WINDOW_LIST_RESP;
-			resp.getWindowListResp.seq = cmd.getWindowList.seq;
-			wndGetWindowList(&resp.getWindowListResp.focused, resp.getWindowListResp.wins, &resp.getWindowListResp.count);
-			write(sockfd, &resp, sizeof(GWMMessage));
+			pthread_mutex_lock(&desktopWindow->lock);
+			Window *next = win->next;
+			if (next != NULL) wndUp(next);
+			wndDown(win);
+			win = next;
+			pthread_mutex_unlock(&desktopWindow->lock);
+		};
+		
+		pthread_mutex_lock(&desktopWindow->lock);
+		win = desktopWindow->children;
+		if (win != NULL) wndUp(win);
+		pthread_mutex_unlock(&desktopWindow->lock);
+		
+		if (win != NULL) dispatchRethemeEvent(win);
+	}
+	else if (cmd->cmd == GWM_CMD_SCREEN_SIZE)
+	{
+		if (sz < sizeof(cmd->screenSize))
+		{
+			printf("[gwmserver] GWM_CMD_SCREEN_SIZE command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.screenSizeResp.type = GWM_MSG_SCREEN_SIZE_RESP;
+		resp.screenSizeResp.seq = cmd->screenSize.seq;
+		resp.screenSizeResp.width = (int) screen->width;
+		resp.screenSizeResp.height = (int) screen->height;
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_SET_FLAGS)
+	{
+		if (sz < sizeof(cmd->setFlags))
+		{
+			printf("[gwmserver] GWM_CMD_SET_FLAGS command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.setFlagsResp.type = GWM_MSG_SET_FLAGS_RESP;
+		resp.setFlagsResp.seq = cmd->setFlags.seq;
+		
+		Window *wnd = wltGet(wlt, cmd->setFlags.win);
+		if (wnd == NULL)
+		{
+			resp.setFlagsResp.status = GWM_ERR_NOWND;
 		}
-		else if (cmd.cmd == GWM_CMD_GET_WINDOW_PARAMS)
+		else
 		{
-			if (sz < sizeof(cmd.getWindowParams))
-			{
-				printf("[gwmserver] GWM_CMD_GET_WINDOW_PARAMS command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.getWindowParamsResp.type = GWM_MSG_GET_WINDOW_PARAMS_RESP;
-			resp.getWindowParamsResp.seq = cmd.getWindowParams.seq;
-			resp.getWindowParamsResp.status = wndGetWindowParams(&cmd.getWindowParams.ref, &resp.getWindowParamsResp.params);
-			write(sockfd, &resp, sizeof(GWMMessage));
+			wndSetFlags(wnd, cmd->setFlags.flags);
+			wndDrawScreen();
+			resp.setFlagsResp.status = 0;
+		};
+		
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_SET_CURSOR)
+	{
+		if (sz < sizeof(cmd->setCursor))
+		{
+			printf("[gwmserver] GWM_CMD_SET_CURSOR command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.setCursorResp.type = GWM_MSG_SET_CURSOR_RESP;
+		resp.setCursorResp.seq = cmd->setCursor.seq;
+		
+		if ((cmd->setCursor.cursor < 0) || (cmd->setCursor.cursor >= GWM_CURSOR_COUNT))
+		{
+			resp.setCursorResp.status = GWM_ERR_INVAL;
 		}
-		else if (cmd.cmd == GWM_CMD_SET_LISTEN_WINDOW)
+		else
 		{
-			if (sz < sizeof(cmd.setListenWindow))
+			Window *win = wltGet(wlt, cmd->setCursor.win);
+			if (win == NULL)
 			{
-				printf("[gwmserver] GWM_CMD_SET_LISTEN_WINDOW command too small\n");
-				break;
-			};
-			
-			Window *win = wltGet(wlt, cmd.setListenWindow.win);
-			if (win != NULL)
+				resp.setCursorResp.status = GWM_ERR_NOWND;
+			}
+			else
 			{
-				wndSetListenWindow(win);
+				win->cursor = cmd->setCursor.cursor;
 				wndDown(win);
+				wndDrawScreen();
+				resp.setCursorResp.status = 0;
 			};
-		}
-		else if (cmd.cmd == GWM_CMD_TOGGLE_WINDOW)
+		};
+		
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_SET_ICON)
+	{
+		if (sz < sizeof(cmd->setIcon))
 		{
-			if (sz < sizeof(cmd.toggleWindow))
-			{
-				printf("[gwmserver] GWM_CMD_TOGGLE_WINDOW command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.toggleWindowResp.type = GWM_MSG_TOGGLE_WINDOW_RESP;
-			resp.toggleWindowResp.seq = cmd.toggleWindow.seq;
-			resp.toggleWindowResp.status = wndToggle(&cmd.toggleWindow.ref);
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_GET_GLOB_REF)
+			printf("[gwmserver] GWM_CMD_SET_ICON command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.setIconResp.type = GWM_MSG_SET_ICON_RESP;
+		resp.setIconResp.seq = cmd->setIcon.seq;
+		
+		Window *win = wltGet(wlt, cmd->setIcon.win);
+		if (win == NULL)
 		{
-			if (sz < sizeof(cmd.getGlobRef))
-			{
-				printf("[gwmserver] GWM_CMD_GET_GLOB_REF command too small\n");
-				break;
-			};
-			
-			GWMMessage resp;
-			resp.getGlobRefResp.type = GWM_MSG_GET_GLOB_REF_RESP;
-			resp.getGlobRefResp.seq = cmd.getGlobRef.seq;
-			resp.getGlobRefResp.ref.id = cmd.getGlobRef.win;
-			resp.getGlobRefResp.ref.fd = sockfd;
-			write(sockfd, &resp, sizeof(GWMMessage));
+			resp.setIconResp.status = GWM_ERR_NOWND;
 		}
-		else if (cmd.cmd == GWM_CMD_ATOMIC_CONFIG)
+		else
 		{
-			if (sz < sizeof(cmd.atomicConfig))
-			{
-				printf("[gwmserver] GWM_CMD_ATOMIC_CONFIG command too small\n");
-				break;
-			};
+			resp.setIconResp.status = wndSetIcon(win, cmd->setIcon.surfID);
+			wndDown(win);
+		};
+		
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_GET_FORMAT)
+	{
+		if (sz < sizeof(cmd->getFormat))
+		{
+			printf("[gwmserver] GWM_CMD_GET_FORMAT command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.getFormatResp.type = GWM_MSG_GET_FORMAT_RESP;
+		resp.getFormatResp.seq = cmd->getFormat.seq;
+		memcpy(&resp.getFormatResp.format, &screen->format, sizeof(DDIPixelFormat));
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_GET_WINDOW_LIST)
+	{
+		if (sz < sizeof(cmd->getWindowList))
+		{
+			printf("[gwmserver] GWM_CMD_GET_WINDOW_LIST command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.getWindowListResp.type = GWM_MSG_GET_WINDOW_LIST_RESP;
+		resp.getWindowListResp.seq = cmd->getWindowList.seq;
+		wndGetWindowList(&resp.getWindowListResp.focused, resp.getWindowListResp.wins, &resp.getWindowListResp.count);
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_GET_WINDOW_PARAMS)
+	{
+		if (sz < sizeof(cmd->getWindowParams))
+		{
+			printf("[gwmserver] GWM_CMD_GET_WINDOW_PARAMS command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.getWindowParamsResp.type = GWM_MSG_GET_WINDOW_PARAMS_RESP;
+		resp.getWindowParamsResp.seq = cmd->getWindowParams.seq;
+		resp.getWindowParamsResp.status = wndGetWindowParams(&cmd->getWindowParams.ref, &resp.getWindowParamsResp.params);
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_SET_LISTEN_WINDOW)
+	{
+		if (sz < sizeof(cmd->setListenWindow))
+		{
+			printf("[gwmserver] GWM_CMD_SET_LISTEN_WINDOW command too small\n");
+			return -1;
+		};
+		
+		Window *win = wltGet(wlt, cmd->setListenWindow.win);
+		if (win != NULL)
+		{
+			wndSetListenWindow(win);
+			wndDown(win);
+		};
+	}
+	else if (cmd->cmd == GWM_CMD_TOGGLE_WINDOW)
+	{
+		if (sz < sizeof(cmd->toggleWindow))
+		{
+			printf("[gwmserver] GWM_CMD_TOGGLE_WINDOW command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.toggleWindowResp.type = GWM_MSG_TOGGLE_WINDOW_RESP;
+		resp.toggleWindowResp.seq = cmd->toggleWindow.seq;
+		resp.toggleWindowResp.status = wndToggle(&cmd->toggleWindow.ref);
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_GET_GLOB_REF)
+	{
+		if (sz < sizeof(cmd->getGlobRef))
+		{
+			printf("[gwmserver] GWM_CMD_GET_GLOB_REF command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.getGlobRefResp.type = GWM_MSG_GET_GLOB_REF_RESP;
+		resp.getGlobRefResp.seq = cmd->getGlobRef.seq;
+		resp.getGlobRefResp.ref.id = cmd->getGlobRef.win;
+		resp.getGlobRefResp.ref.fd = sockfd;
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_ATOMIC_CONFIG)
+	{
+		if (sz < sizeof(cmd->atomicConfig))
+		{
+			printf("[gwmserver] GWM_CMD_ATOMIC_CONFIG command too small\n");
+			return -1;
+		};
+		
+		Window *win = wltGet(wlt, cmd->atomicConfig.win);
+		if (win != NULL)
+		{
+			int which = cmd->atomicConfig.which;
+			int oldX, oldY, newX, newY;
+			int shouldInvalidate = 1;
+			int oldEndX, oldEndY, newEndX, newEndY;
 			
-			Window *win = wltGet(wlt, cmd.atomicConfig.win);
-			if (win != NULL)
+			if (win->decorated)
 			{
-				int which = cmd.atomicConfig.which;
-				int oldX, oldY, newX, newY;
-				int shouldInvalidate = 1;
-				int oldEndX, oldEndY, newEndX, newEndY;
+				pthread_mutex_lock(&win->parent->lock);
+				
+				oldX = win->parent->params.x;
+				oldY = win->parent->params.y;
 				
-				if (win->decorated)
+				if (which & GWM_AC_X)
 				{
-					pthread_mutex_lock(&win->parent->lock);
-					
-					oldX = win->parent->params.x;
-					oldY = win->parent->params.y;
-					
-					if (which & GWM_AC_X)
-					{
-						win->parent->params.x = newX = cmd.atomicConfig.x;
-					}
-					else
-					{
-						newX = oldX;
-					};
-					
-					if (which & GWM_AC_Y)
-					{
-						win->parent->params.y = newY = cmd.atomicConfig.y;
-					}
-					else
-					{
-						newY = oldY;
-					};
-					
-					pthread_mutex_unlock(&win->parent->lock);
+					win->parent->params.x = newX = cmd->atomicConfig.x;
 				}
 				else
 				{
-					shouldInvalidate = !wndRelToAbs(win, 0, 0, &oldX, &oldY);
-					pthread_mutex_lock(&win->lock);
-					
-					if (which & GWM_AC_X) win->params.x = cmd.atomicConfig.x;
-					if (which & GWM_AC_Y) win->params.y = cmd.atomicConfig.y;
-					
-					pthread_mutex_unlock(&win->lock);
-					wndRelToAbs(win, 0, 0, &newX, &newY);
-				};
-				
-				// changing of width, height and canvas is independent of decoration
-				// scroll is independent too of course
-				pthread_mutex_lock(&win->lock);
-				
-				oldEndX = oldX + win->params.width;
-				oldEndY = oldY + win->params.height;
-				
-				if (win->decorated)
-				{
-					oldEndX = oldX + win->parent->params.width;
-					oldEndY = oldY + win->parent->params.height;
+					newX = oldX;
 				};
 				
-				if (which & GWM_AC_WIDTH) win->params.width = cmd.atomicConfig.width;
-				if (which & GWM_AC_HEIGHT) win->params.height = cmd.atomicConfig.height;
-				
-				if (which & GWM_AC_CAPTION)
+				if (which & GWM_AC_Y)
 				{
-					memcpy(win->params.caption, cmd.atomicConfig.caption, 256);
-				};
-				
-				newEndX = newX + win->params.width;
-				newEndY = newY + win->params.height;
-				
-				if (win->decorated)
+					win->parent->params.y = newY = cmd->atomicConfig.y;
+				}
+				else
 				{
-					newEndX = newX + win->parent->params.width;
-					newEndY = newY + win->parent->params.height;
+					newY = oldY;
 				};
 				
-				if (which & GWM_AC_SCROLL_X) win->scrollX = cmd.atomicConfig.scrollX;
-				if (which & GWM_AC_SCROLL_Y) win->scrollY = cmd.atomicConfig.scrollY;
+				pthread_mutex_unlock(&win->parent->lock);
+			}
+			else
+			{
+				shouldInvalidate = !wndRelToAbs(win, 0, 0, &oldX, &oldY);
+				pthread_mutex_lock(&win->lock);
 				
-				if (which & GWM_AC_CANVAS)
-				{
-					DDISurface *newCanvas = ddiOpenSurface(cmd.atomicConfig.canvasID);
-					if (newCanvas != NULL)
-					{
-						ddiDeleteSurface(win->front);
-						ddiDeleteSurface(win->canvas);
-						win->canvas = newCanvas;
-						win->front = ddiCreateSurface(&screen->format, win->canvas->width,
-										win->canvas->height, (char*)newCanvas->data,
-										0);
-					};
-				};
+				if (which & GWM_AC_X) win->params.x = cmd->atomicConfig.x;
+				if (which & GWM_AC_Y) win->params.y = cmd->atomicConfig.y;
 				
 				pthread_mutex_unlock(&win->lock);
-				
-				// update the decoration if needed
-				if (win->decorated)
-				{
-					if (which & (GWM_AC_WIDTH | GWM_AC_HEIGHT | GWM_AC_CAPTION))
-					{
-						pthread_mutex_lock(&win->parent->lock);
-						
-						oldEndX = oldX + win->parent->params.width;
-						oldEndY = oldY + win->parent->params.height;
-						
-						if (which & GWM_AC_WIDTH)
-							win->parent->params.width = cmd.atomicConfig.width + 2 * WINDOW_BORDER_WIDTH;
-						if (which & GWM_AC_HEIGHT)
-							win->parent->params.height = cmd.atomicConfig.height + WINDOW_CAPTION_HEIGHT + WINDOW_BORDER_WIDTH;
-						
-						newEndX = newX + win->parent->params.width;
-						newEndY = newY + win->parent->params.height;
-						
-						ddiDeleteSurface(win->parent->canvas);
-						ddiDeleteSurface(win->parent->front);
-						
-						win->parent->canvas = ddiCreateSurface(&screen->format, win->parent->params.width, win->parent->params.height, NULL, 0);
-						win->parent->front = ddiCreateSurface(&screen->format, win->parent->params.width, win->parent->params.height, NULL, 0);
-						pthread_mutex_unlock(&win->parent->lock);
-						
-						wndDecorate(win->parent, win);
-					};
-				};
-				
-				if (shouldInvalidate)
-				{
-					int invX = MIN(oldX, newX);
-					int invY = MIN(oldY, newY);
-					int endX = MAX(oldEndX, newEndX);
-					int endY = MAX(oldEndY, newEndY);
-					
-					wndInvalidate(invX, invY, endX - invX, endY - invY);
-				};
-
-				wndDown(win);
-				wndDrawScreen();
+				wndRelToAbs(win, 0, 0, &newX, &newY);
 			};
-		}
-		else if (cmd.cmd == GWM_CMD_REL_TO_ABS)
-		{
-			if (sz < sizeof(cmd.relToAbs))
+			
+			// changing of width, height and canvas is independent of decoration
+			// scroll is independent too of course
+			pthread_mutex_lock(&win->lock);
+			
+			oldEndX = oldX + win->params.width;
+			oldEndY = oldY + win->params.height;
+			
+			if (win->decorated)
 			{
-				printf("[gwmserver] GWM_CMD_REL_TO_ABS command too small\n");
-				break;
+				oldEndX = oldX + win->parent->params.width;
+				oldEndY = oldY + win->parent->params.height;
 			};
 			
-			int absX = 0, absY = 0;
-			Window *win = wltGet(wlt, cmd.relToAbs.win);
-			if (win != NULL)
+			if (which & GWM_AC_WIDTH) win->params.width = cmd->atomicConfig.width;
+			if (which & GWM_AC_HEIGHT) win->params.height = cmd->atomicConfig.height;
+			
+			if (which & GWM_AC_CAPTION)
 			{
-				wndRelToAbs(win, cmd.relToAbs.relX, cmd.relToAbs.relY, &absX, &absY);
-				wndDown(win);
+				memcpy(win->params.caption, cmd->atomicConfig.caption, 256);
 			};
 			
-			GWMMessage resp;
-			resp.relToAbsResp.type = GWM_MSG_REL_TO_ABS_RESP;
-			resp.relToAbsResp.seq = cmd.relToAbs.seq;
-			resp.relToAbsResp.absX = absX;
-			resp.relToAbsResp.absY = absY;
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else if (cmd.cmd == GWM_CMD_REDRAW_SCREEN)
-		{
-			wndInvalidate(0, 0, screen->width, screen->height);
-			wndDrawScreen();
-		}
-		else if (cmd.cmd == GWM_CMD_SCREENSHOT_WINDOW)
-		{
-			if (sz < sizeof(cmd.screenshotWindow))
+			newEndX = newX + win->params.width;
+			newEndY = newY + win->params.height;
+			
+			if (win->decorated)
 			{
-				printf("[gwmserver] GWM_CMD_SCREENSHOT_WINDOW command too small\n");
-				break;
+				newEndX = newX + win->parent->params.width;
+				newEndY = newY + win->parent->params.height;
 			};
 			
-			GWMMessage resp;
-			resp.screenshotWindowResp.type = GWM_MSG_SCREENSHOT_WINDOW_RESP;
-			resp.screenshotWindowResp.seq = cmd.screenshotWindow.seq;
+			if (which & GWM_AC_SCROLL_X) win->scrollX = cmd->atomicConfig.scrollX;
+			if (which & GWM_AC_SCROLL_Y) win->scrollY = cmd->atomicConfig.scrollY;
 			
-			DDISurface *target = ddiOpenSurface(cmd.screenshotWindow.surfID);
-			if (target == NULL)
+			if (which & GWM_AC_CANVAS)
 			{
-				resp.screenshotWindowResp.status = GWM_ERR_NOSURF;
-			}
-			else
+				DDISurface *newCanvas = ddiOpenSurface(cmd->atomicConfig.canvasID);
+				if (newCanvas != NULL)
+				{
+					wndDropFront(win);
+					ddiDeleteSurface(win->canvas);
+					win->canvas = newCanvas;
+					win->front = ddiCreateSurface(&screen->format, win->canvas->width,
+									win->canvas->height, (char*)newCanvas->data,
+									0);
+				};
+			};
+			
+			pthread_mutex_unlock(&win->lock);
+			
+			// update the decoration if needed
+			int redecorate = win->decorated && (which & (GWM_AC_WIDTH | GWM_AC_HEIGHT | GWM_AC_CAPTION));
+			if (redecorate)
 			{
-				resp.screenshotWindowResp.status =
-					wndScreenshot(target, &cmd.screenshotWindow.ref,
-						&resp.screenshotWindowResp.width, &resp.screenshotWindowResp.height);
-				ddiDeleteSurface(target);
+				pthread_mutex_lock(&win->parent->lock);
+				
+				oldEndX = oldX + win->parent->params.width;
+				oldEndY = oldY + win->parent->params.height;
+				
+				if (which & GWM_AC_WIDTH)
+					win->parent->params.width = cmd->atomicConfig.width + 2 * WINDOW_BORDER_WIDTH;
+				if (which & GWM_AC_HEIGHT)
+					win->parent->params.height = cmd->atomicConfig.height + WINDOW_CAPTION_HEIGHT + WINDOW_BORDER_WIDTH;
+				
+				newEndX = newX + win->parent->params.width;
+				newEndY = newY + win->parent->params.height;
+				
+				ddiDeleteSurface(win->parent->canvas);
+				ddiDeleteSurface(win->parent->front);
+				
+				win->parent->canvas = ddiCreateSurface(&screen->format, win->parent->params.width, win->parent->params.height, NULL, 0);
+				win->parent->front = ddiCreateSurface(&screen->format, win->parent->params.width, win->parent->params.height, NULL, 0);
+				pthread_mutex_unlock(&win->parent->lock);
 			};
 			
-			write(sockfd, &resp, sizeof(GWMMessage));
+			// the frame has its final size now, so visible regions computed from here on are
+			// up to date; this must happen before anything is invalidated
+			wndGeometryChanged();
+			if (redecorate) wndDecorate(win->parent, win);
+			
+			if (shouldInvalidate)
+			{
+				int invX = MIN(oldX, newX);
+				int invY = MIN(oldY, newY);
+				int endX = MAX(oldEndX, newEndX);
+				int endY = MAX(oldEndY, newEndY);
+				
+				wndInvalidate(invX, invY, endX - invX, endY - invY);
+			};
+
+			wndDown(win);
+			wndDrawScreen();
+		};
+	}
+	else if (cmd->cmd == GWM_CMD_REL_TO_ABS)
+	{
+		if (sz < sizeof(cmd->relToAbs))
+		{
+			printf("[gwmserver] GWM_CMD_REL_TO_ABS command too small\n");
+			return -1;
+		};
+		
+		int absX = 0, absY = 0;
+		Window *win = wltGet(wlt, cmd->relToAbs.win);
+		if (win != NULL)
+		{
+			wndRelToAbs(win, cmd->relToAbs.relX, cmd->relToAbs.relY, &absX, &absY);
+			wndDown(win);
+		};
+		
+		GWMMessage resp;
+		resp.relToAbsResp.type = GWM_MSG_REL_TO_ABS_RESP;
+		resp.relToAbsResp.seq = cmd->relToAbs.seq;
+		resp.relToAbsResp.absX = absX;
+		resp.relToAbsResp.absY = absY;
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_REDRAW_SCREEN)
+	{
+		wndInvalidate(0, 0, screen->width, screen->height);
+		wndDrawScreen();
+	}
+	else if (cmd->cmd == GWM_CMD_SCREENSHOT_WINDOW)
+	{
+		if (sz < sizeof(cmd->screenshotWindow))
+		{
+			printf("[gwmserver] GWM_CMD_SCREENSHOT_WINDOW command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.screenshotWindowResp.type = GWM_MSG_SCREENSHOT_WINDOW_RESP;
+		resp.screenshotWindowResp.seq = cmd->screenshotWindow.seq;
+		
+		DDISurface *target = ddiOpenSurface(cmd->screenshotWindow.surfID);
+		if (target == NULL)
+		{
+			resp.screenshotWindowResp.status = GWM_ERR_NOSURF;
 		}
-		else if (cmd.cmd == GWM_CMD_GET_GLOB_ICON)
+		else
+		{
+			resp.screenshotWindowResp.status =
+				wndScreenshot(target, &cmd->screenshotWindow.ref,
+					&resp.screenshotWindowResp.width, &resp.screenshotWindowResp.height);
+			ddiDeleteSurface(target);
+		};
+		
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_GET_GLOB_ICON)
+	{
+		if (sz < sizeof(cmd->getGlobIcon))
 		{
-			if (sz < sizeof(cmd.getGlobIcon))
+			printf("[gwmserver] GWM_CMD_GET_GLOB_ICON command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.getGlobIconResp.type = GWM_MSG_GET_GLOB_ICON_RESP;
+		resp.getGlobIconResp.seq = cmd->getGlobIcon.seq;
+		resp.getGlobIconResp.status = wndGetGlobIcon(&cmd->getGlobIcon.ref, &resp.getGlobIconResp.surfID);
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_ATTACH_RING)
+	{
+		if (sz < sizeof(cmd->attachRing))
+		{
+			printf("[gwmserver] GWM_CMD_ATTACH_RING command too small\n");
+			return -1;
+		};
+		
+		GWMMessage resp;
+		resp.attachRingResp.type = GWM_MSG_ATTACH_RING_RESP;
+		resp.attachRingResp.seq = cmd->attachRing.seq;
+		resp.attachRingResp.status = srvAttachRing(client, cmd->attachRing.ringID);
+		write(sockfd, &resp, sizeof(GWMMessage));
+	}
+	else if (cmd->cmd == GWM_CMD_WAKEUP)
+	{
+		// nothing to do; the caller drains the command ring
+	}
+	else
+	{
+		printf("[gwmserver] received unknown command, %ld bytes (cmd=%d)\n", sz, cmd->cmd);
+	};
+	
+	return 0;
+};
+
+/**
+ * Run all commands waiting in the client's command ring. Returns 0 on success, or -1 if the client
+ * must be disconnected.
+ */
+static int srvDrainCommands(int sockfd, WndLookup **wlt, Client *client)
+{
+	GWMRing *ring = client->ring;
+	GWMCommand cmd;
+	
+	while (1)
+	{
+		uint32_t avail = ring->cmdTail - client->cmdHead;
+		if (avail == 0)
+		{
+			return 0;
+		};
+		
+		if (avail > GWM_RING_COMMANDS)
+		{
+			printf("[gwmserver] client corrupted its command ring\n");
+			return -1;
+		};
+		
+		// copy the command out before looking at it, since the client could change it under us
+		__sync_synchronize();
+		memcpy(&cmd, &ring->commands[client->cmdHead % GWM_RING_COMMANDS], sizeof(GWMCommand));
+		__sync_synchronize();
+		ring->cmdHead = ++client->cmdHead;
+		
+		if (srvHandleCommand(sockfd, wlt, client, &cmd, sizeof(GWMCommand)) != 0)
+		{
+			return -1;
+		};
+	};
+};
+
+void* clientThreadFunc(void *context)
+{
+	int sockfd = (int) (uintptr_t) context;
+	Client *client = srvAddClient(sockfd);
+	
+	/**
+	 * A hashtable of windows. The hashkey is the bottom 8 bits of a window ID
+	 * and it points to a linked list of WndLookup structures with IDs ending
+	 * in that hashkey.
+	 */
+	WndLookup* wlt[256];
+	memset(wlt, 0, sizeof(void*) * 256);
+	wltPut(wlt, 0, desktopWindow);
+	
+	while (1)
+	{
+		GWMCommand cmd;
+		GWMRing *ring = client->ring;
+		
+		if (ring != NULL)
+		{
+			if (srvDrainCommands(sockfd, wlt, client) != 0)
 			{
-				printf("[gwmserver] GWM_CMD_GET_GLOB_ICON command too small\n");
 				break;
 			};
 			
-			GWMMessage resp;
-			resp.getGlobIconResp.type = GWM_MSG_GET_GLOB_ICON_RESP;
-			resp.getGlobIconResp.seq = cmd.getGlobIcon.seq;
-			resp.getGlobIconResp.status = wndGetGlobIcon(&cmd.getGlobIcon.ref, &resp.getGlobIconResp.surfID);
-			write(sockfd, &resp, sizeof(GWMMessage));
-		}
-		else
+			// ask for a wakeup, unless more commands arrived in the meantime
+			ring->serverSleeping = 1;
+			__sync_synchronize();
+			if (ring->cmdTail != client->cmdHead)
+			{
+				ring->serverSleeping = 0;
+				continue;
+			};
+		};
+		
+		ssize_t sz = read(sockfd, &cmd, sizeof(GWMCommand));
+		if (ring != NULL) ring->serverSleeping = 0;
+		
+		if (sz == -1)
 		{
-			printf("[gwmserver] received unknown command, %ld bytes (cmd=%d)\n", sz, cmd.cmd);
+			printf("[gwmserver] read from client socket: %s\n", strerror(errno));
+			break;
+		};
+		
+		if (sz == 0)
+		{
+			// client disconnected
+			break;
+		};
+		
+		if (sz < sizeof(int))
+		{
+			// too small to even store a command
+			printf("[gwmserver] application sent command structure smaller than command ID (%ld bytes)\n", sz);
+			break;
+		};
+		
+		if (srvHandleCommand(sockfd, wlt, client, &cmd, sz) != 0)
+		{
+			break;
 		};
 	};
 	
+	// stop sending events before closing the socket, as the descriptor may be reused
+	srvRemoveClient(client);
 	close(sockfd);
 	
 	// destory any windows belonging to this application
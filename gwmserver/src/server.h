@@ -29,9 +29,17 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <libgwm.h>
+
 /**
  * The server which accepts connections and handles clients.
  */
 void runServer(int sockfd);
 
+/**
+ * Send an event to the client connected on the specified socket. Does nothing if that client has
+ * disconnected.
+ */
+void srvSendEvent(int fd, GWMEvent *ev);
+
 #endif
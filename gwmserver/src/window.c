@@ -32,10 +32,13 @@
 #include <assert.h>
 #include <time.h>
 #include <poll.h>
+#include <errno.h>
+#include <string.h>
 
 #include "window.h"
 #include "screen.h"
 #include "kblayout.h"
+#include "server.h"
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -82,12 +85,53 @@ int decResizing;
 int decDragWidth, decDragHeight;
 int decDragCursor;
 
+/**
+ * Visible regions are recalculated when 'geometryGen' differs from 'visibleGen'. The latter, as well as
+ * the opaque region list used during the calculation, are protected by the invalidate lock.
+ */
+static int geometryGen = 1;
+static int visibleGen = 0;
+static ClipRect *opaqueRects;
+static int numOpaqueRects;
+static int opaqueCapacity;
+
+/**
+ * Upper limit on the number of rectangles in a visible region. If subtracting an opaque window would
+ * fragment it further, the window is instead considered visible there (which is always safe, since
+ * everything is still painted back to front).
+ */
+#define	MAX_VISIBLE_RECTS			256
+
 /**
  * A semaphore which is signalled whenever the back buffer is updated, to let the swapping thread
  * do its job.
  */
 sem_t semSwap;
 
+/**
+ * Upper limit on the number of rectangles of damage between swaps. If more are added, they are merged
+ * into their bounding box.
+ */
+#define	MAX_SWAP_RECTS				32
+
+/**
+ * Parts of 'screen' which were modified since the last swap (protected by the invalidate lock), so that
+ * the swap thread only has to copy those.
+ */
+static ClipRect swapDamage[MAX_SWAP_RECTS];
+static int numSwapDamage;
+
+/**
+ * Page flipping state, only accessed by the swap thread (after wndInit()). If the display can flip, we
+ * draw into 'presentable[backIndex]' and then flip to it. The other buffer has not yet received the damage
+ * of the last swap, so that is remembered in 'backDamage'.
+ */
+static int flipEnabled;
+static DDISurface *presentable[2];
+static int backIndex;
+static ClipRect backDamage[MAX_SWAP_RECTS];
+static int numBackDamage;
+
 /**
  * Resize request queue. Un-processed requests on the same window are coalesced into one for
  * optimisation. The semaphore is signalled every time the queue changed.
@@ -122,8 +166,64 @@ static Cursor cursors[GWM_CURSOR_COUNT] = {
 
 int currentCursor = 0;
 
+/**
+ * Record that the specified part of 'screen' was modified and must be copied by the next swap. Call with
+ * the invalidate lock held.
+ */
+static void wndAddSwapDamage(int left, int top, int right, int bottom)
+{
+	left = MAX(left, 0);
+	top = MAX(top, 0);
+	right = MIN(right, screen->width);
+	bottom = MIN(bottom, screen->height);
+	if (left >= right || top >= bottom) return;
+	
+	int i;
+	for (i=0; i<numSwapDamage; i++)
+	{
+		ClipRect *rect = &swapDamage[i];
+		if (rect->left <= left && rect->top <= top && rect->right >= right && rect->bottom >= bottom)
+		{
+			// already covered
+			return;
+		};
+	};
+	
+	if (numSwapDamage == MAX_SWAP_RECTS)
+	{
+		for (i=0; i<numSwapDamage; i++)
+		{
+			left = MIN(left, swapDamage[i].left);
+			top = MIN(top, swapDamage[i].top);
+			right = MAX(right, swapDamage[i].right);
+			bottom = MAX(bottom, swapDamage[i].bottom);
+		};
+		
+		numSwapDamage = 0;
+	};
+	
+	ClipRect *rect = &swapDamage[numSwapDamage++];
+	rect->left = left;
+	rect->top = top;
+	rect->right = right;
+	rect->bottom = bottom;
+};
+
+static void wndCopyDamage(DDISurface *target, ClipRect *rects, int count)
+{
+	int i;
+	for (i=0; i<count; i++)
+	{
+		ClipRect *rect = &rects[i];
+		ddiOverlay(screen, rect->left, rect->top, target, rect->left, rect->top,
+				rect->right - rect->left, rect->bottom - rect->top);
+	};
+};
+
 void* swapThread(void *ignore)
 {
+	ClipRect damage[MAX_SWAP_RECTS];
+	
 	while (1)
 	{
 		sem_wait(&semSwap);
@@ -136,8 +236,48 @@ void* swapThread(void *ignore)
 		// draw
 		clock_t start = clock();
 		pthread_mutex_lock(&invalidateLock);
-		ddiOverlay(screen, 0, 0, frontBuffer, 0, 0, screen->width, screen->height);
+		int count = numSwapDamage;
+		memcpy(damage, swapDamage, sizeof(ClipRect) * count);
+		numSwapDamage = 0;
+		
+		if (count == 0)
+		{
+			pthread_mutex_unlock(&invalidateLock);
+			continue;
+		};
+		
+		if (flipEnabled)
+		{
+			// bring the back buffer up to date, then add the new damage
+			wndCopyDamage(presentable[backIndex], backDamage, numBackDamage);
+			wndCopyDamage(presentable[backIndex], damage, count);
+		}
+		else
+		{
+			wndCopyDamage(frontBuffer, damage, count);
+		};
 		pthread_mutex_unlock(&invalidateLock);
+		
+		if (flipEnabled)
+		{
+			if (ddiFlip(backIndex) == 0)
+			{
+				backIndex ^= 1;
+				memcpy(backDamage, damage, sizeof(ClipRect) * count);
+				numBackDamage = count;
+			}
+			else
+			{
+				// fall back to copying into whichever buffer is currently displayed
+				fprintf(stderr, "[gwmserver] page flip failed, disabling: %s\n", strerror(errno));
+				flipEnabled = 0;
+				frontBuffer = presentable[backIndex ^ 1];
+				
+				pthread_mutex_lock(&invalidateLock);
+				ddiOverlay(screen, 0, 0, frontBuffer, 0, 0, screen->width, screen->height);
+				pthread_mutex_unlock(&invalidateLock);
+			};
+		};
 		clock_t end = clock();
 		
 		// cap the framerate
@@ -237,6 +377,20 @@ void wndInit()
 	pthread_mutex_init(&wincacheLock, &attr);
 	pthread_mutex_init(&invalidateLock, &attr);
 	
+	// use page flipping if the display supports it
+	if ((ddiDisplayInfo.features & DDI_FEATURE_FLIP) && ddiDisplayInfo.numPresentable >= 2)
+	{
+		presentable[0] = frontBuffer;
+		presentable[1] = ddiGetPresentable(1);
+		
+		if (presentable[1] != NULL)
+		{
+			ddiOverlay(screen, 0, 0, presentable[1], 0, 0, screen->width, screen->height);
+			backIndex = 1;
+			flipEnabled = 1;
+		};
+	};
+	
 	sem_init(&semSwap, 0, 0);
 	pthread_t thread;
 	if (pthread_create(&thread, NULL, swapThread, NULL) != 0)
@@ -406,7 +560,7 @@ Window* wndCreate(Window *parent, GWMWindowParams *pars, uint64_t id, int fd, DD
 		
 		GWMWindowParams decPars;
 		memset(&decPars, 0, sizeof(GWMWindowParams));
-		decPars.flags = pars->flags | GWM_WINDOW_NODECORATE;
+		decPars.flags = (pars->flags | GWM_WINDOW_NODECORATE) & ~GWM_WINDOW_OPAQUE;
 		decPars.width = pars->width + 2 * WINDOW_BORDER_WIDTH;
 		decPars.height = pars->height + WINDOW_BORDER_WIDTH + WINDOW_CAPTION_HEIGHT;
 		decPars.x = pars->x;
@@ -459,6 +613,7 @@ Window* wndCreate(Window *parent, GWMWindowParams *pars, uint64_t id, int fd, DD
 	};
 	wnd->parent = parent;
 	pthread_mutex_unlock(&parent->lock);
+	wndGeometryChanged();
 	
 	if (pars->flags & GWM_WINDOW_MKFOCUSED)
 	{
@@ -493,11 +648,85 @@ void wndDown(Window *wnd)
 	if (__sync_add_and_fetch(&wnd->refcount, -1) == 0)
 	{
 		ddiDeleteSurface(wnd->canvas);
-		ddiDeleteSurface(wnd->front);
+		wndDropFront(wnd);
+		free(wnd->visible);
 		free(wnd);
 	};
 };
 
+void wndDropFront(Window *wnd)
+{
+	if (!wnd->frontShared && wnd->front != NULL) ddiDeleteSurface(wnd->front);
+	
+	int i;
+	for (i=0; i<GWM_MAX_BUFFERS; i++)
+	{
+		if (wnd->buffers[i] != NULL) ddiDeleteSurface(wnd->buffers[i]);
+		wnd->buffers[i] = NULL;
+	};
+	
+	wnd->front = NULL;
+	wnd->frontShared = 0;
+};
+
+int wndPresent(Window *wnd, uint32_t surfID)
+{
+	pthread_mutex_lock(&wnd->lock);
+	
+	DDISurface *buffer = NULL;
+	int i;
+	for (i=0; i<GWM_MAX_BUFFERS; i++)
+	{
+		if (wnd->buffers[i] != NULL && wnd->buffers[i]->id == surfID)
+		{
+			buffer = wnd->buffers[i];
+			break;
+		};
+	};
+	
+	if (buffer == NULL)
+	{
+		// first time we see this buffer; find a slot which is not currently displayed
+		int slot = -1;
+		for (i=0; i<GWM_MAX_BUFFERS; i++)
+		{
+			if (wnd->buffers[i] == NULL)
+			{
+				slot = i;
+				break;
+			};
+			
+			if (wnd->buffers[i] != wnd->front) slot = i;
+		};
+		
+		buffer = ddiOpenSurface(surfID);
+		if (buffer == NULL || slot == -1)
+		{
+			if (buffer != NULL) ddiDeleteSurface(buffer);
+			pthread_mutex_unlock(&wnd->lock);
+			return -1;
+		};
+		
+		if (buffer->width != wnd->canvas->width || buffer->height != wnd->canvas->height)
+		{
+			ddiDeleteSurface(buffer);
+			pthread_mutex_unlock(&wnd->lock);
+			return -1;
+		};
+		
+		if (wnd->buffers[slot] != NULL) ddiDeleteSurface(wnd->buffers[slot]);
+		wnd->buffers[slot] = buffer;
+	};
+	
+	int wasShared = wnd->frontShared;
+	if (!wnd->frontShared) ddiDeleteSurface(wnd->front);
+	wnd->front = buffer;
+	wnd->frontShared = 1;
+	
+	pthread_mutex_unlock(&wnd->lock);
+	return !wasShared;
+};
+
 int wndDestroy(Window *wnd)
 {
 	// get the parent and set it to NULL.
@@ -533,6 +762,7 @@ int wndDestroy(Window *wnd)
 			wnd->next->prev = wnd->prev;
 		};
 		pthread_mutex_unlock(&parent->lock);
+		wndGeometryChanged();
 		wndDirty(parent);
 		wndDown(parent);
 	};
@@ -575,6 +805,234 @@ int wndDestroy(Window *wnd)
 	return 0;
 };
 
+void wndGeometryChanged()
+{
+	__sync_fetch_and_add(&geometryGen, 1);
+};
+
+static int wndIsOpaque(Window *wnd)
+{
+	// decorations have transparent corners and client areas, so they are never opaque
+	return (wnd->params.flags & GWM_WINDOW_OPAQUE) && !wnd->isDecoration;
+};
+
+/**
+ * Set the visible region of 'wnd' to 'rect' minus all opaque rectangles found so far.
+ */
+static void wndSetVisible(Window *wnd, ClipRect *rect)
+{
+	static ClipRect pieces[2][MAX_VISIBLE_RECTS];
+	int numPieces = 0;
+	int which = 0;
+	
+	if (rect->left < rect->right && rect->top < rect->bottom)
+	{
+		pieces[0][0] = *rect;
+		numPieces = 1;
+	};
+	
+	int i;
+	for (i=0; i<numOpaqueRects && numPieces != 0; i++)
+	{
+		ClipRect *cover = &opaqueRects[i];
+		ClipRect *in = pieces[which];
+		ClipRect *out = pieces[!which];
+		int numOut = 0;
+		int overflow = 0;
+		
+		int j;
+		for (j=0; j<numPieces; j++)
+		{
+			ClipRect *r = &in[j];
+			if (cover->left >= r->right || cover->right <= r->left || cover->top >= r->bottom || cover->bottom <= r->top)
+			{
+				// not covered at all
+				if (numOut == MAX_VISIBLE_RECTS)
+				{
+					overflow = 1;
+					break;
+				};
+				
+				out[numOut++] = *r;
+				continue;
+			};
+			
+			// split into up to 4 pieces: above, below, left and right of the cover
+			ClipRect split[4];
+			int numSplit = 0;
+			int midTop = MAX(r->top, cover->top);
+			int midBottom = MIN(r->bottom, cover->bottom);
+			
+			if (r->top < cover->top)
+			{
+				ClipRect above = {r->left, r->top, r->right, cover->top};
+				split[numSplit++] = above;
+			};
+			
+			if (r->bottom > cover->bottom)
+			{
+				ClipRect below = {r->left, cover->bottom, r->right, r->bottom};
+				split[numSplit++] = below;
+			};
+			
+			if (r->left < cover->left)
+			{
+				ClipRect left = {r->left, midTop, cover->left, midBottom};
+				split[numSplit++] = left;
+			};
+			
+			if (r->right > cover->right)
+			{
+				ClipRect right = {cover->right, midTop, r->right, midBottom};
+				split[numSplit++] = right;
+			};
+			
+			if (numOut + numSplit > MAX_VISIBLE_RECTS)
+			{
+				overflow = 1;
+				break;
+			};
+			
+			memcpy(&out[numOut], split, sizeof(ClipRect) * numSplit);
+			numOut += numSplit;
+		};
+		
+		// too fragmented; ignore this cover
+		if (overflow) continue;
+		
+		numPieces = numOut;
+		which = !which;
+	};
+	
+	if (numPieces > wnd->visibleCapacity)
+	{
+		wnd->visibleCapacity = numPieces;
+		wnd->visible = (ClipRect*) realloc(wnd->visible, sizeof(ClipRect) * numPieces);
+	};
+	
+	memcpy(wnd->visible, pieces[which], sizeof(ClipRect) * numPieces);
+	wnd->numVisible = numPieces;
+};
+
+static void wndAddOpaque(ClipRect *rect)
+{
+	if (rect->left >= rect->right || rect->top >= rect->bottom) return;
+	
+	if (numOpaqueRects == opaqueCapacity)
+	{
+		opaqueCapacity = 2 * opaqueCapacity + 16;
+		opaqueRects = (ClipRect*) realloc(opaqueRects, sizeof(ClipRect) * opaqueCapacity);
+	};
+	
+	opaqueRects[numOpaqueRects++] = *rect;
+};
+
+/**
+ * Calculate the visible regions of the children of 'wnd', front to back. 'clip' is the part of the
+ * screen covered by 'wnd' itself (children are clipped to it). Call with the invalidate lock held.
+ */
+static void wndUpdateVisibleWalk(Window *wnd, int cornerX, int cornerY, ClipRect *clip)
+{
+	pthread_mutex_lock(&wnd->lock);
+	int scrollX = wnd->scrollX;
+	int scrollY = wnd->scrollY;
+	
+	Window *child = wnd->children;
+	while (child != NULL && child->next != NULL) child = child->next;
+	
+	while (child != NULL)
+	{
+		wndUp(child);
+		pthread_mutex_unlock(&wnd->lock);
+		
+		pthread_mutex_lock(&child->lock);
+		if (child->params.flags & GWM_WINDOW_HIDDEN)
+		{
+			child->numVisible = 0;
+			pthread_mutex_unlock(&child->lock);
+		}
+		else
+		{
+			int wndScreenX = cornerX + child->params.x - scrollX;
+			int wndScreenY = cornerY + child->params.y - scrollY;
+			
+			ClipRect rect;
+			rect.left = MAX(wndScreenX, clip->left);
+			rect.top = MAX(wndScreenY, clip->top);
+			rect.right = MIN(wndScreenX + child->params.width, clip->right);
+			rect.bottom = MIN(wndScreenY + child->params.height, clip->bottom);
+			int opaque = wndIsOpaque(child);
+			pthread_mutex_unlock(&child->lock);
+			
+			if (rect.left < rect.right && rect.top < rect.bottom)
+			{
+				// the children are in front of us
+				wndUpdateVisibleWalk(child, wndScreenX, wndScreenY, &rect);
+			};
+			
+			wndSetVisible(child, &rect);
+			if (opaque) wndAddOpaque(&rect);
+		};
+		
+		pthread_mutex_lock(&wnd->lock);
+		Window *prev = child->prev;
+		wndDown(child);
+		child = prev;
+	};
+	
+	pthread_mutex_unlock(&wnd->lock);
+};
+
+static void wndUpdateVisible()
+{
+	int gen = geometryGen;
+	if (gen == visibleGen) return;
+	
+	numOpaqueRects = 0;
+	
+	ClipRect screenRect = {0, 0, screen->width, screen->height};
+	wndUpdateVisibleWalk(desktopWindow, 0, 0, &screenRect);
+	wndSetVisible(desktopWindow, &screenRect);
+	
+	// if the geometry changed during the calculation, we'll do it again next time
+	visibleGen = gen;
+};
+
+/**
+ * Paint the visible parts of a window which fall within the given rectangle. Call with the window
+ * and invalidate locks held.
+ */
+static void wndPaintVisible(Window *wnd, int wndScreenX, int wndScreenY, int invX, int invY, int invEndX, int invEndY)
+{
+	int opaque = wndIsOpaque(wnd);
+	
+	int i;
+	for (i=0; i<wnd->numVisible; i++)
+	{
+		ClipRect *vis = &wnd->visible[i];
+		int left = MAX(vis->left, invX);
+		int top = MAX(vis->top, invY);
+		int right = MIN(vis->right, invEndX);
+		int bottom = MIN(vis->bottom, invEndY);
+		
+		if (left < right && top < bottom)
+		{
+			// find the pixel on this window's front canvas
+			int srcX = left - wndScreenX - wnd->scrollX;
+			int srcY = top - wndScreenY - wnd->scrollY;
+			
+			if (opaque)
+			{
+				ddiOverlay(wnd->front, srcX, srcY, screen, left, top, right - left, bottom - top);
+			}
+			else
+			{
+				ddiBlit(wnd->front, srcX, srcY, screen, left, top, right - left, bottom - top);
+			};
+		};
+	};
+};
+
 static void wndInvalidateWalk(Window *wnd, int cornerX, int cornerY, int invX, int invY, int width, int height)
 {
 	pthread_mutex_lock(&wnd->lock);
@@ -599,7 +1057,7 @@ static void wndInvalidateWalk(Window *wnd, int cornerX, int cornerY, int invX, i
 			continue;
 		};
 		
-		// blit if the child overlaps the invalidated area
+		// paint if the child overlaps the invalidated area
 		int invEndX = invX + width;
 		int invEndY = invY + height;
 		
@@ -617,12 +1075,8 @@ static void wndInvalidateWalk(Window *wnd, int cornerX, int cornerY, int invX, i
 		
 		if ((overlapX < overlapEndX) && (overlapY < overlapEndY))
 		{
-			// find the pixel on this window's front canvas
-			int srcX = overlapX + scrollX - child->params.x - cornerX - child->scrollX;
-			int srcY = overlapY + scrollY - child->params.y - cornerY - child->scrollY;
-			
-			// blit
-			ddiBlit(child->front, srcX, srcY, screen, overlapX, overlapY, overlapEndX - overlapX, overlapEndY - overlapY);
+			// only the parts not covered by opaque windows in front
+			wndPaintVisible(child, wndScreenX, wndScreenY, overlapX, overlapY, overlapEndX, overlapEndY);
 			
 			// do it to all children
 			pthread_mutex_unlock(&child->lock);
@@ -673,9 +1127,24 @@ void wndInvalidate(int x, int y, int width, int height)
 	pthread_mutex_unlock(&mouseLock);
 
 	pthread_mutex_lock(&invalidateLock);
+	wndUpdateVisible();
+	wndAddSwapDamage(x, y, x+width, y+height);
 	
-	// first overlay the correct background fragment onto the screen
-	ddiOverlay(desktopBackground, x, y, screen, x, y, width, height);
+	// first overlay the visible parts of the background onto the screen
+	int i;
+	for (i=0; i<desktopWindow->numVisible; i++)
+	{
+		ClipRect *vis = &desktopWindow->visible[i];
+		int left = MAX(vis->left, x);
+		int top = MAX(vis->top, y);
+		int right = MIN(vis->right, x+width);
+		int bottom = MIN(vis->bottom, y+height);
+		
+		if (left < right && top < bottom)
+		{
+			ddiOverlay(desktopBackground, left, top, screen, left, top, right - left, bottom - top);
+		};
+	};
 	
 	// now draw whatever windows are on top of it
 	wndInvalidateWalk(desktopWindow, 0, 0, x, y, width, height);
@@ -718,6 +1187,39 @@ int wndDirty(Window *wnd)
 	return 0;
 };
 
+int wndDirtyRect(Window *wnd, int x, int y, int width, int height)
+{
+	// the rectangle is in canvas coordinates; clip it to the part of the canvas currently
+	// visible in the window first, so that we never redraw anything outside of it
+	pthread_mutex_lock(&wnd->lock);
+	int left = wnd->scrollX;
+	int top = wnd->scrollY;
+	int right = left + wnd->params.width;
+	int bottom = top + wnd->params.height;
+	pthread_mutex_unlock(&wnd->lock);
+	
+	if (x < left)
+	{
+		width -= left - x;
+		x = left;
+	};
+	
+	if (y < top)
+	{
+		height -= top - y;
+		y = top;
+	};
+	
+	if ((x+width) > right) width = right - x;
+	if ((y+height) > bottom) height = bottom - y;
+	
+	int absX, absY;
+	if (wndRelToAbs(wnd, x, y, &absX, &absY) != 0) return -1;
+	
+	if (width > 0 && height > 0) wndInvalidate(absX, absY, width, height);
+	return 0;
+};
+
 void wndDrawScreen()
 {
 	sem_post(&semSwap);
@@ -735,6 +1237,9 @@ void wndMouseMove(int x, int y)
 	int oldCursor = currentCursor;
 	
 	ddiOverlay(cursors[oldCursor].back, 0, 0, screen, cursorX - cursors[oldCursor].hotX, cursorY - cursors[oldCursor].hotY, cursors[oldCursor].back->width, cursors[oldCursor].back->height);
+	wndAddSwapDamage(cursorX - cursors[oldCursor].hotX, cursorY - cursors[oldCursor].hotY,
+		cursorX - cursors[oldCursor].hotX + cursors[oldCursor].back->width,
+		cursorY - cursors[oldCursor].hotY + cursors[oldCursor].back->height);
 	cursorX = x;
 	cursorY = y;
 	
@@ -766,6 +1271,7 @@ void wndMouseMove(int x, int y)
 				int oldY = wndActive->params.y;
 				wndActive->params.x = x - decDragX;
 				wndActive->params.y = y - decDragY;
+				wndGeometryChanged();
 			
 				mustInvalidate = 1;
 				invX = MIN(oldX, wndActive->params.x);
@@ -912,6 +1418,9 @@ void wndMouseMove(int x, int y)
 	};
 	ddiOverlay(screen, cursorX - cursors[newCursor].hotX, cursorY - cursors[newCursor].hotY, cursors[newCursor].back, 0, 0, cursors[newCursor].back->width, cursors[newCursor].back->height);
 	ddiBlit(cursors[newCursor].sprite, 0, 0, screen, cursorX - cursors[newCursor].hotX, cursorY - cursors[newCursor].hotY, cursors[newCursor].sprite->width, cursors[newCursor].sprite->height);
+	wndAddSwapDamage(cursorX - cursors[newCursor].hotX, cursorY - cursors[newCursor].hotY,
+		cursorX - cursors[newCursor].hotX + cursors[newCursor].sprite->width,
+		cursorY - cursors[newCursor].hotY + cursors[newCursor].sprite->height);
 
 	currentCursor = newCursor;
 	
@@ -1069,12 +1578,7 @@ Window* wndAbsToRel(int absX, int absY, int *relX, int *relY)
 
 void wndSendEvent(Window *win, GWMEvent *ev)
 {
-	GWMMessage msg;
-	msg.event.type = GWM_MSG_EVENT;
-	msg.event.seq = 0;
-	memcpy(&msg.event.payload, ev, sizeof(GWMEvent));
-	
-	if (win->fd != 0) write(win->fd, &msg, sizeof(GWMMessage));
+	if (win->fd != 0) srvSendEvent(win->fd, ev);
 };
 
 void wndSetFocused(Window *wnd)
@@ -1161,6 +1665,7 @@ void wndSetFocused(Window *wnd)
 				};
 			};
 			pthread_mutex_unlock(&wnd->parent->lock);
+			wndGeometryChanged();
 			
 			wndDirty(desktopWindow);
 			wndDrawScreen();
@@ -1348,6 +1853,7 @@ void wndOnLeftUp()
 						wndActive->children->params.flags |= GWM_WINDOW_HIDDEN;
 						wndActive->params.flags |= GWM_WINDOW_HIDDEN;
 						pthread_mutex_unlock(&wndActive->children->lock);
+						wndGeometryChanged();
 						if (wndFocused != NULL)
 						{
 							wndDown(wndFocused);
@@ -1415,6 +1921,7 @@ void wndSetFlags(Window *wnd, int flags)
 		wnd->parent->params.flags = flags | GWM_WINDOW_NODECORATE;
 	};
 	pthread_mutex_unlock(&wnd->lock);
+	wndGeometryChanged();
 	
 	if (flags & GWM_WINDOW_MKFOCUSED)
 	{
@@ -1653,6 +2160,7 @@ int wndToggle(GWMGlobWinRef *ref)
 			wndSetFocused(chosenWindow);
 		};
 		pthread_mutex_unlock(&wincacheLock);
+		wndGeometryChanged();
 
 		if (chosenWindow->decorated)
 		{
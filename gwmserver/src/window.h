@@ -39,6 +39,17 @@
 #define WINDOW_CAPTION_HEIGHT			20
 #define	WINDOW_BORDER_WIDTH			5
 
+/**
+ * A rectangle on the screen, used to describe the visible regions of windows.
+ */
+typedef struct
+{
+	int						left;
+	int						top;
+	int						right;
+	int						bottom;
+} ClipRect;
+
 /**
  * Describes a window.
  */
@@ -77,6 +88,14 @@ typedef struct Window_
 	 */
 	DDISurface*					canvas;
 	DDISurface*					front;
+	
+	/**
+	 * Client buffers of a double- or triple-buffered window, opened when first committed (unused
+	 * slots are NULL). If 'frontShared' is set, 'front' is one of these buffers rather than a private
+	 * copy of the canvas. Protected by the window lock.
+	 */
+	DDISurface*					buffers[GWM_MAX_BUFFERS];
+	int						frontShared;
 
 	/**
 	 * The icon (or NULL).
@@ -111,6 +130,15 @@ typedef struct Window_
 	 * 0 if this window is a decoration.
 	 */
 	int						isDecoration;
+	
+	/**
+	 * The parts of the screen where this window is not covered by opaque windows in front of it
+	 * (a list of non-overlapping rectangles). Recalculated by wndInvalidate() whenever the window
+	 * geometry changed; protected by the invalidate lock.
+	 */
+	ClipRect*					visible;
+	int						numVisible;
+	int						visibleCapacity;
 } Window;
 
 extern Window* desktopWindow;
@@ -143,6 +171,13 @@ void wndDown(Window *wnd);
  */
 int wndDestroy(Window *wnd);
 
+/**
+ * Mark the visible regions of all windows as out of date. Must be called after changing the position,
+ * size, scroll position, stacking order, visibility or opacity of any window, and before invalidating the
+ * affected part of the screen.
+ */
+void wndGeometryChanged();
+
 /**
  * Re-render a specific region of the screen.
  */
@@ -154,6 +189,25 @@ void wndInvalidate(int x, int y, int width, int height);
  */
 int wndDirty(Window *wnd);
 
+/**
+ * Like wndDirty(), but only re-render the specified rectangle of the window (in canvas coordinates).
+ */
+int wndDirtyRect(Window *wnd, int x, int y, int width, int height);
+
+/**
+ * Make the client buffer with the specified surface ID the front buffer of the window, replacing whatever was
+ * displayed before; no copy is made. Returns -1 if the buffer cannot be opened or does not match the canvas, 0 if
+ * only the regions damaged by the client need re-rendering, or 1 if the whole window must be re-rendered (the
+ * previous front buffer was not a client buffer).
+ */
+int wndPresent(Window *wnd, uint32_t surfID);
+
+/**
+ * Delete the front buffer (unless it's a client buffer), and close all client buffers. 'front' is set to NULL.
+ * The caller must hold the window lock, or hold the last reference to it.
+ */
+void wndDropFront(Window *wnd);
+
 /**
  * Draw the screen (call after wndDirty()).
  */
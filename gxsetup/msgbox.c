@@ -55,6 +55,7 @@ void msgbox(const char *caption, const char *text)
 	while (1)
 	{
 		char c;
+		fflush(stdout);
 		if (read(0, &c, 1) != 1) continue;
 		
 		if (c == '\n') break;
@@ -602,6 +602,7 @@ static int getDriveAction()
 		while (1)
 		{
 			uint8_t c;
+			fflush(stdout);
 			if (read(0, &c, 1) != 1) continue;
 			
 			if (c == 0x8B)
@@ -728,6 +729,7 @@ static int newPartDialog(size_t *sizeptr)
 		while (1)
 		{
 			uint8_t c;
+			fflush(stdout);
 			if (read(0, &c, 1) != 1) continue;
 			
 			if (c == 0x8B)
@@ -829,6 +831,7 @@ void partEdit()
 		while (1)
 		{
 			uint8_t c;
+			fflush(stdout);
 			if (read(0, &c, 1) != 1) continue;
 			
 			if (c == 0x8B)
@@ -1038,6 +1041,7 @@ void partEditor()
 		while (1)
 		{
 			uint8_t c;
+			fflush(stdout);
 			if (read(0, &c, 1) != 1) continue;
 			
 			if (c == 0x8B)
@@ -130,6 +130,7 @@ void pkgSelection()
 		setCursor(79, 24);
 		
 		uint8_t c;
+		fflush(stdout);
 		if (read(0, &c, 1) != 1) continue;
 		
 		if (c == 0x8B)
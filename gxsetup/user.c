@@ -80,6 +80,7 @@ static void displayPrompt(const char *prompt, char *buffer, char mask)
 		setCursor((uint8_t)(startX+strlen(buffer)), (uint8_t)(startY+3));
 		
 		uint8_t c;
+		fflush(stdout);
 		if (read(0, &c, 1) != 1) continue;
 		
 		if (c == '\b')
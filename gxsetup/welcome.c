@@ -85,6 +85,7 @@ int displayWelcome()
 	while (1)
 	{
 		uint8_t c;
+		fflush(stdout);
 		if (read(0, &c, 1) != 1) continue;
 		
 		if (c == 0x8B)
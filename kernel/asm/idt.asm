@@ -148,6 +148,7 @@ ISR_NOERRCODE 64
 ISR_NOERRCODE 65
 ISR_NOERRCODE 112		; 0x70 - I_IPI_HALT
 ISR_NOERRCODE 113		; 0x71 - I_IPI_SCHED_HINT
+ISR_NOERRCODE 114		; 0x72 - I_IPI_TLB
 
 IRQ	0,	32
 IRQ	1,	33
@@ -29,9 +29,67 @@ bits 64
 
 [global refreshAddrSpace]
 refreshAddrSpace:
+	mov	rax,	cr4
+	test	rax,	(1 << 17)	; CR4.PCIDE
+	jnz	.allPCID
+	
 	mov	rax,	cr3
 	mov	cr3,	rax
 	ret
+
+.allPCID:
+	; reloading CR3 would only flush the current PCID; toggling CR4.PGE flushes
+	; everything, for every PCID, including global pages
+	mov	rdx,	rax
+	xor	rdx,	(1 << 7)
+	mov	cr4,	rdx
+	mov	cr4,	rax
+	ret
+
+[global getCR3]
+getCR3:
+	mov	rax,	cr3
+	ret
+
+[global setCR3]
+setCR3:
+	mov	cr3,	rdi
+	ret
+
+[global getCR4]
+getCR4:
+	mov	rax,	cr4
+	ret
+
+[global setCR4]
+setCR4:
+	mov	cr4,	rdi
+	ret
+
+[global invpcid]
+invpcid:
+	; the descriptor is the PCID followed by the linear address
+	sub	rsp,	16
+	mov	[rsp],	rsi
+	mov	[rsp+8],	rdx
+	invpcid	rdi,	[rsp]
+	add	rsp,	16
+	ret
+
+[global cpuid]
+cpuid:
+	; cpuid(leaf, subleaf, regs[4]) - EAX, EBX, ECX, EDX in that order
+	push	rbx
+	mov	r8,	rdx
+	mov	eax,	edi
+	mov	ecx,	esi
+	cpuid
+	mov	[r8],	eax
+	mov	[r8+4],	ebx
+	mov	[r8+8],	ecx
+	mov	[r8+12],	edx
+	pop	rbx
+	ret
 	
 [global ispZero]
 ispZero:
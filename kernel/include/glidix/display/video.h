@@ -35,6 +35,12 @@
 
 #define	IOCTL_VIDEO_MODESET			IOCTL_ARG(VideoModeRequest, IOCTL_INT_VIDEO, 1)
 #define	IOCTL_VIDEO_GETINFO			IOCTL_ARG(VideoInfo, IOCTL_INT_VIDEO, 2)
+#define	IOCTL_VIDEO_FLIP			IOCTL_ARG(VideoFlipRequest, IOCTL_INT_VIDEO, 3)
+
+/**
+ * Video feature bits (the 'features' field of VideoInfo).
+ */
+#define	VIDEO_FEATURE_FLIP			(1 << 0)		/* can page-flip between presentable buffers */
 
 /**
  * Convenience macro to define GPU commands.
@@ -99,6 +105,23 @@ typedef struct
 	PixelFormat				format;
 } VideoModeRequest;
 
+/**
+ * Request for a page flip (IOCTL).
+ */
+typedef struct
+{
+	/**
+	 * (In) Index of the presentable buffer to scan out, from 0 to numPresentable-1. Buffer 'i' is
+	 * placed at virtual offset 'i' times the page-aligned size of the framebuffer.
+	 */
+	int					index;
+	
+	/**
+	 * Reserved.
+	 */
+	int					resv[7];
+} VideoFlipRequest;
+
 /**
  * Driver operations.
  */
@@ -127,6 +150,13 @@ typedef struct
 	 * ERRNO must also be set.
 	 */
 	int (*command)(struct VideoDisplay_ *display, uint64_t cmd, void *argp);
+	
+	/**
+	 * Start scanning out the presentable buffer with the given index (already checked to be in range).
+	 * Return 0 on success, -1 on error (and set ERRNO). May be NULL if the display cannot flip, in which
+	 * case it must not report VIDEO_FEATURE_FLIP.
+	 */
+	int (*flip)(struct VideoDisplay_ *display, int index);
 } VideoOps;
 
 /**
@@ -41,15 +41,55 @@
 #define	FT_FIXED_SIZE				(1 << 2)
 
 /**
- * Describes a single node on a file page tree. There are 16 entries, indexed by each 4
- * bits in a file offset. The bottom level specifies the physical page number.
+ * Shape of the file page tree: each node has 64 entries, indexed by 6 bits of the page index
+ * (the file offset shifted right by 12).
+ */
+#define	FT_NODE_SHIFT				6
+#define	FT_NODE_ENTRIES				(1 << FT_NODE_SHIFT)
+
+/**
+ * Readahead window limits, in pages.
+ */
+#define	FT_RA_MIN				4
+#define	FT_RA_MAX				32
+
+/**
+ * Number of pages loaded at once when a page fault on a file mapping misses the cache.
+ */
+#define	FT_RA_FAULT				16
+
+/**
+ * Maximum number of pages ftRead() takes from the tree per acquisition of its lock.
+ */
+#define	FT_RUN_MAX				32
+
+/**
+ * Describes a single node on a file page tree. The bottom level specifies the physical page
+ * number. Bottom-level nodes never move once allocated, so pointers to entries remain valid
+ * until the page is removed.
  */
 typedef union FileNode_
 {
-	union FileNode_*			nodes[16];
-	uint64_t				entries[16];
+	union FileNode_*			nodes[FT_NODE_ENTRIES];
+	uint64_t				entries[FT_NODE_ENTRIES];
 } FileNode;
 
+/**
+ * Sequential readahead state of an open file description; see ftRead().
+ */
+typedef struct
+{
+	/**
+	 * Page index just after the end of the previous read.
+	 */
+	uint64_t				next;
+	
+	/**
+	 * Current window size in pages; 0 if the access pattern is not sequential.
+	 */
+	uint64_t				size;
+} FileReadahead;
+
 /**
  * Describes the page structure of a file. It's like a page table except it refers to
  * the contents of a file.
@@ -92,6 +132,15 @@ typedef struct FileTree_
 	 */
 	int (*load)(struct FileTree_ *ft, off_t pos, void *buffer);
 	
+	/**
+	 * Optional function pointer set by the driver, to read 'count' consecutive pages, starting
+	 * at the page-aligned offset 'pos', into a buffer of 'count' pages, which is initialized to
+	 * all zeroes. This allows readahead to be done with a single request to the underlying
+	 * device. Returns the number of pages loaded from the start of the range (at least 1) on
+	 * success, or -1 on error. The range never extends past the end of the file.
+	 */
+	int (*loadpages)(struct FileTree_ *ft, off_t pos, int count, void *buffer);
+	
 	/**
 	 * Function pointer set by the driver, to flush a specific page into the file.
 	 * The passed offset is always page-aligned. Returns 0 on success, -1 on error.
@@ -112,9 +161,11 @@ typedef struct FileTree_
 	uint64_t (*getpage)(struct FileTree_ *ft, off_t pos);
 	
 	/**
-	 * Top-level node.
+	 * Top-level node, and the number of levels in the tree. The tree grows upwards as larger
+	 * offsets are accessed, so it indexes (FT_NODE_ENTRIES ^ depth) pages.
 	 */
-	FileNode				top;
+	FileNode*				top;
+	int					depth;
 	
 	/**
 	 * Current size of this file in bytes.
@@ -151,20 +202,35 @@ void ftDown(FileTree *ft);
 
 /**
  * Get a page mapping. If the requested offset (guaranteed to be page aligned) has not been loaded into
- * memory, it gets loaded now. Returns the physical page NUMBER on success, or 0 on error. The returned
- * frame has its reference count incremented.
+ * memory, it gets loaded now, along with up to FT_RA_FAULT-1 pages after it. Returns the physical page
+ * NUMBER on success, or 0 on error. The returned frame has its reference count incremented.
  */
 uint64_t ftGetPage(FileTree *ft, off_t pos);
 
+/**
+ * Look up 'count' consecutive pages starting at 'pos' (page-aligned) without loading anything. Each entry
+ * of 'frames' is set to the frame of the corresponding page, with its reference count incremented, or to 0
+ * if it is not cached. Returns the number of pages found.
+ */
+int ftGetCachedPages(FileTree *ft, off_t pos, int count, uint64_t *frames);
+
 /**
  * Commit the contents of the file tree to disk.
  */
 void ftFlush(FileTree *ft);
 
 /**
- * Read data from a file tree at the specified position.
+ * Read data from a file tree at the specified position. If 'ra' is not NULL, it is the readahead state of
+ * the file description being read; when reads are sequential, missing pages are loaded in batches which
+ * grow from FT_RA_MIN up to FT_RA_MAX pages past the end of the read.
+ */
+ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos, FileReadahead *ra);
+
+/**
+ * Same as ftRead(), but 'buffer' is in userspace, and the data is copied straight into it from the page
+ * cache. Returns -1 and sets ERRNO to EFAULT if nothing could be copied because the buffer is invalid.
  */
-ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos);
+ssize_t ftReadUser(FileTree *ft, void *buffer, size_t size, off_t pos, FileReadahead *ra);
 
 /**
  * Write data to a file tree at the specified position.
@@ -185,11 +251,19 @@ int ftTruncate(FileTree *ft, size_t size);
 void ftUncache(FileTree *ft);
 
 /**
- * Flush one of the pages of a file tree, and return the frame number, which can now be reused (but is not freed).
- * Return 0 if finding a spare page was unsuccessful.
+ * Reclaim one of the pages of the file cache, and return the frame number, which can now be reused (but is not freed).
+ * The victim is chosen from the inactive list, by a two-list (active/inactive) CLOCK algorithm driven by the accessed
+ * bits in pageinfo; it is written back first if it is dirty. Return 0 if finding a spare page was unsuccessful.
  */
 uint64_t ftGetFreePage();
 
+/**
+ * Called by the physical memory manager after frames are allocated. If the number of free frames has dropped below
+ * the low watermark, and there are cached pages which could be reclaimed, this wakes up the reclaimer thread (kswapd),
+ * which then reclaims pages until the high watermark is reached.
+ */
+void ftWakeReclaimer();
+
 /**
  * Release all record locks owned by the current process on the given file.
  */
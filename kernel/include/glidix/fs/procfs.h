@@ -32,8 +32,25 @@
 #include <glidix/util/common.h>
 #include <glidix/fs/vfs.h>
 
+/**
+ * Maximum size of the contents of a generated procfs file (see procfsAddFile()).
+ */
+#define	PROCFS_FILE_MAX				4096
+
+/**
+ * Generates the contents of a procfs file. It must place a NUL-terminated string of at most
+ * 'size' bytes (including the terminator) into 'buffer'; the buffer is zeroed out on entry.
+ */
+typedef void (*ProcfsGenerator)(char *buffer, size_t size);
+
 void initProcfs();
 
+/**
+ * Create a read-only file named /proc/<name>, whose contents are produced by calling 'gen' each
+ * time it is read. Returns 0 on success, or an error number on error.
+ */
+int procfsAddFile(const char *name, ProcfsGenerator gen);
+
 /**
  * Change the current PID. Called by switchTask().
  */
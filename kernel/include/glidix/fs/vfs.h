@@ -79,8 +79,14 @@
 #define	O_RSYNC				(1 << 9)
 #define	O_SYNC				(1 << 10)
 #define	O_CLOEXEC			(1 << 11)
+#define	O_DIRECT			(1 << 12)
 #define	O_ACCMODE			(O_RDWR)
-#define	O_ALL				(O_RDWR | O_APPEND | O_CREAT | O_EXCL | O_TRUNC | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)
+#define	O_ALL				(O_RDWR | O_APPEND | O_CREAT | O_EXCL | O_TRUNC | O_NOCTTY | O_NONBLOCK | O_CLOEXEC | O_DIRECT)
+
+/**
+ * Largest part of an O_DIRECT transfer for which the userspace buffer is pinned at once.
+ */
+#define	VFS_DIRECT_MAX			0x40000
 
 /**
  * Additional flags, cannot be passed to open().
@@ -696,6 +702,11 @@ struct File_
 	 * Reference count.
 	 */
 	int					refcount;
+	
+	/**
+	 * Readahead state for reads through the page cache.
+	 */
+	FileReadahead				ra;
 };
 
 /**
@@ -970,6 +981,16 @@ ssize_t vfsPRead(File *fp, void *buffer, size_t size, off_t offset);
 ssize_t vfsWrite(File *fp, const void *buffer, size_t size);
 ssize_t vfsPWrite(File *fp, const void *buffer, size_t size, off_t offset);
 
+/**
+ * Same as above, but 'buffer' is in userspace. Page-cached files are copied straight into it from the
+ * cache; block devices opened with O_DIRECT transfer to and from it without going through the block cache;
+ * everything else is copied through a kernel buffer. Fails with EFAULT if the buffer is not accessible.
+ */
+ssize_t vfsReadUser(File *fp, void *buffer, size_t size);
+ssize_t vfsPReadUser(File *fp, void *buffer, size_t size, off_t offset);
+ssize_t vfsWriteUser(File *fp, const void *buffer, size_t size);
+ssize_t vfsPWriteUser(File *fp, const void *buffer, size_t size, off_t offset);
+
 /**
  * Seek a file.
  */
@@ -107,6 +107,11 @@ void initPerCPU();
  */
 void initPerCPU2();
 
+/**
+ * Number of CPUs which were started (set by initMultiProc()).
+ */
+extern int numCPU;
+
 /**
  * Boot up other CPUs. This must be called after the scheduler is initialised.
  */
@@ -127,6 +132,11 @@ CPU* getCurrentCPU();
  */
 void sendHintToCPU(int id);
 
+/**
+ * Send the TLB shootdown IPI to a CPU (see vmOnShootdown()).
+ */
+void sendShootdownToCPU(int id);
+
 /**
  * Send the scheduler hint to all CPUs.
  */
@@ -93,7 +93,9 @@ typedef struct
 	uint64_t			accessed:1;
 	uint64_t			ignore:1;
 	uint64_t			ps:1;
-	uint64_t			moreIgnored:4;
+	uint64_t			moreIgnored:1;
+	uint64_t			gx_ptcow:1;			// page table shared after fork; copy before changing
+	uint64_t			evenMoreIgnored:2;
 	uint64_t			ptPhysAddr:36;
 	uint64_t			zero:4;
 	uint64_t			ignoredVeryVeryMuchLol:11;
@@ -126,7 +128,8 @@ typedef struct
 	uint64_t			gx_cow:1;			// copy this page upon write attempt
 	uint64_t			gx_shared:1;			// the page is shared (else it is private)
 	uint64_t			gx_perm_ovr:1;			// override default permissions (set by "mprotect")
-	uint64_t			moreIgnored:4;
+	uint64_t			gx_swap:1;			// page is in swap; "framePhysAddr" is the swap entry
+	uint64_t			moreIgnored:3;
 	uint64_t			xd:1;
 } PACKED PTe;
 
@@ -136,6 +139,12 @@ typedef struct
 } PACKED PT;
 
 PML4 *getPML4();
+
+/**
+ * Flush the whole TLB of the calling CPU (except global pages when PCIDs are not in use), for every PCID.
+ * Use this after changing kernel mappings; changes to a process address space should go through procmem,
+ * which only flushes what is needed, on the CPUs that need it.
+ */
 void refreshAddrSpace();
 
 /**
@@ -153,4 +162,31 @@ void frameRead(uint64_t frame, void *buffer);
  */
 void invlpg(void *addr);
 
+/**
+ * Control register access. With PCIDs enabled, the low 12 bits of CR3 are the current PCID, and setting
+ * CR3_NOFLUSH when loading it keeps the TLB entries tagged with that PCID.
+ */
+#define	CR3_NOFLUSH				(1UL << 63)
+#define	CR4_PGE					(1UL << 7)
+#define	CR4_PCIDE				(1UL << 17)
+uint64_t getCR3();
+void setCR3(uint64_t cr3);
+uint64_t getCR4();
+void setCR4(uint64_t cr4);
+
+/**
+ * Invalidate TLB entries with the INVPCID instruction (only if the CPU supports it). 'type' is one of the
+ * INVPCID_* values below; 'addr' is only used with INVPCID_ADDR.
+ */
+#define	INVPCID_ADDR				0
+#define	INVPCID_SINGLE				1
+#define	INVPCID_ALL_GLOBAL			2
+#define	INVPCID_ALL				3
+void invpcid(uint64_t type, uint64_t pcid, uint64_t addr);
+
+/**
+ * Execute CPUID with the specified leaf (EAX) and subleaf (ECX), storing EAX, EBX, ECX and EDX in 'regs'.
+ */
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *regs);
+
 #endif
@@ -40,10 +40,12 @@
  * phmTotalFrames			Total number of frames of physical memory.
  * phmUsedFrames			Number of frames currently allocated, either to applications or to the cache.
  * phmCachedFrames			Number of frames, out of phmUsedFrames, which are in the cache (and can be reallocated).
+ * phmEndFrame				One past the highest frame of usable RAM; immutable after initPhysMem2().
  */
 extern uint64_t phmTotalFrames;
 extern uint64_t phmUsedFrames;
 extern uint64_t phmCachedFrames;
+extern uint64_t phmEndFrame;
 
 /**
  * Initialize the physical memory manager.
@@ -69,6 +71,16 @@ uint64_t phmAllocFrame();
  */
 uint64_t phmAllocZeroFrame();
 
+/**
+ * Allocate 512 consecutive frames, aligned on a 512-frame (2MB) boundary, suitable for mapping as a
+ * huge page. Unlike the other allocation functions, this does not try to free memory if no such block
+ * is available; it simply returns 0, and the caller is expected to fall back to normal pages.
+ * phmAllocZeroHuge() also zeroes out the frames. Free the block with phmFreeHuge().
+ */
+uint64_t phmAllocHuge();
+uint64_t phmAllocZeroHuge();
+void phmFreeHuge(uint64_t base);
+
 /**
  * NOTE: Do not free frames until the heap is set up and initPhysMem2() was called.
  */
@@ -41,8 +41,32 @@ typedef struct _Symbol
 	void*			ptr;
 } PACKED Symbol;
 
+/**
+ * Build the name and address indices of the kernel symbol table.
+ */
 void initSymtab();
+
+/**
+ * Return the address of the named kernel (or exported) symbol, or NULL if it does not exist.
+ */
 void *getSymbol(const char *name);
+
+/**
+ * Find the kernel symbol containing the specified address.
+ */
 void findSymbolForAddr(uint64_t addr, Symbol *symbol);
 
+/**
+ * Make a symbol visible to getSymbol(), so that modules loaded afterwards can link against it. This is
+ * meant to be called by modules, for symbols they provide to other modules. Returns 0 on success, or -1
+ * if a symbol with that name already exists.
+ */
+int exportSymbol(const char *name, void *ptr);
+
+/**
+ * Remove all exported symbols whose addresses are in the range [start, end). Called when a module is
+ * removed.
+ */
+void unexportSymbols(uint64_t start, uint64_t end);
+
 #endif
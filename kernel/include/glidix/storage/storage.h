@@ -289,6 +289,7 @@ typedef struct
 	int					partIndex;		// -1 = master
 	char*					guidPath;		// path to link under /dev/guid or NULL
 	char					name[128];
+	int					isSwap;			// partition table marks it as swap space
 } SDDeviceFile;
 
 typedef struct
@@ -298,8 +299,14 @@ typedef struct
 	size_t					size;
 	int					partIndex;
 	char					name[128];
+	int					isSwap;
 } SDHandle;
 
+/**
+ * Number of frames currently holding cached tracks of storage devices (the block cache).
+ */
+extern uint64_t sdCacheFrames;
+
 /**
  * Initialize the storage device subsystem.
  */
@@ -324,6 +331,22 @@ void sdHangup(StorageDevice *sd);
  */
 void sdSync();
 
+/**
+ * If 'fp' is an open storage device partition which the partition table marks as swap space (GPT type
+ * 0657FD6D-A4AB-43C4-84E5-0933C84B4F4F, or MBR system ID 0x82), return its handle. Otherwise, set ERRNO and
+ * return NULL.
+ */
+struct File_;
+SDHandle* sdGetSwapHandle(struct File_ *fp);
+
+/**
+ * Transfer 'size' bytes between 'buffer' and the offset 'pos' into a swap partition, calling the driver
+ * directly instead of going through the block cache, so that no memory is allocated. 'pos' and 'size' must
+ * be multiples of the page size. If 'write' is nonzero, the buffer is written to the device; otherwise it
+ * is read. Returns 0 on success, or an error number.
+ */
+int sdSwapIO(SDHandle *handle, uint64_t pos, void *buffer, size_t size, int write);
+
 /**
  * TODO
  */
@@ -30,15 +30,16 @@
 #define __glidix_pageinfo_h
 
 /**
- * We use a 4-level global page tree (similar to the PML4) to hold information about each
- * frame of PHYSICAL memory. This is used by the virtual memory manager to keep track of
- * how many address spaces a certain frame was mapped into (so as to not release it by
- * accident), and also by file paging to use some frames for caching while allowing them
- * to be returned when an application needs memory and no more is free.
+ * Information about each frame of PHYSICAL memory is kept in a flat array, indexed by frame number,
+ * which is allocated at boot and covers all RAM. This is used by the virtual memory manager to keep
+ * track of how many address spaces a certain frame was mapped into (so as to not release it by
+ * accident), and also by file paging to use some frames for caching while allowing them to be
+ * returned when an application needs memory and no more is free.
  *
- * All levels of the tree contain pointers to the next level, except the bottommost level.
- * The bottommost level contains the number of references in the low 32 bits, and the high
- * 32 bits contain the flags, described below.
+ * The 'info' field of each entry contains the number of references in the low 32 bits, and the high
+ * 32 bits contain the flags, described below; it is only ever updated atomically, so no lock is needed
+ * to take or drop references. Frames outside of RAM (such as video memory) have no entry; they always
+ * appear to be static frames (see piStaticFrame()).
  */
 
 #include <glidix/util/common.h>
@@ -56,22 +57,49 @@
 #define	PI_DIRTY				(1UL << 33)
 
 /**
- * Set if at least 1 process accessed the page before unmapping it (so the access time needs to
- * be updated).
+ * Set if at least 1 process accessed the page before unmapping it, or if it was read or written
+ * through the page cache. The page cache reclaimer tests and clears this bit when aging pages.
  */
 #define	PI_ACCESSED				(1UL << 34)
 
 /**
- * Page information node.
+ * Information about a single frame.
  */
-typedef union PageInfoNode_
+typedef struct
 {
-	uint64_t				entries[512];
-	union PageInfoNode_*			branches[512];
-} PageInfoNode;
+	/**
+	 * Reference count and flags, as described above. Atomic.
+	 */
+	uint64_t				info;
+	
+	/**
+	 * Links used by a PageList; frame numbers, with 0 meaning none (frame 0 is never given out).
+	 */
+	uint32_t				lruPrev;
+	uint32_t				lruNext;
+	
+	/**
+	 * Private pointer for whoever put the page on a list (for example the page cache's descriptor
+	 * of the page), so that the reclaimer can find it from the frame number.
+	 */
+	void*					owner;
+} PageInfo;
+
+/**
+ * A doubly-linked list of frames, threaded through the 'lruPrev' and 'lruNext' fields of their PageInfo.
+ * A frame can be on at most one list at a time. Lists are NOT thread-safe; the owner of the list must
+ * protect it (and the links of the frames on it) with its own lock.
+ */
+typedef struct
+{
+	uint64_t				head;
+	uint64_t				tail;
+	uint64_t				count;
+} PageList;
 
 /**
- * Initialize the page info system.
+ * Initialize the page info system. This allocates the page info array, so it must be called after
+ * initPhysMem2().
  */
 void piInit();
 
@@ -82,6 +110,13 @@ void piInit();
  */
 uint64_t piNew(uint64_t flags);
 
+/**
+ * Start tracking a frame which was allocated directly from the physical memory manager (for example, a
+ * frame which was part of a huge page that is being split), with a use count of 1 and the specified flags.
+ * From then on it behaves exactly like a page returned by piNew().
+ */
+void piAdopt(uint64_t frame, uint64_t flags);
+
 /**
  * Increase the reference count of a page. The page must already exist, and it must not be possible for
  * it to be released before this call returns. A lock-free algorithm is involved.
@@ -90,9 +125,9 @@ void piIncref(uint64_t frame);
 
 /**
  * Decrease the reference count of a page. If the reference count reaches 0 as a result of this call, and
- * the page is not used for caching (PI_CACHE), it will be freed.
+ * the page is not used for caching (PI_CACHE), it will be freed. Returns the new reference count.
  */
-void piDecref(uint64_t frame);
+int piDecref(uint64_t frame);
 
 /**
  * Mark a page dirty. The caller must own a reference to the page. This is done atomically.
@@ -104,6 +139,11 @@ void piMarkDirty(uint64_t frame);
  */
 void piMarkAccessed(uint64_t frame);
 
+/**
+ * Clear the accessed flag of a page, and return true if it was set. This is done atomically.
+ */
+int piTestAndClearAccessed(uint64_t frame);
+
 /**
  * Determine if a page needs to be copied upon a write. If this returns false (0) it means that the page can
  * just be marked writeable because nobody else is using it and no copying is needed.
@@ -131,4 +171,25 @@ void piStaticFrame(uint64_t frame);
  */
 uint64_t piGetInfo(uint64_t frame);
 
+/**
+ * Initialize an empty page list.
+ */
+void piListInit(PageList *list);
+
+/**
+ * Insert a frame at the head of a list. The frame must be RAM and must not be on any list.
+ */
+void piListPush(PageList *list, uint64_t frame);
+
+/**
+ * Remove a frame from the list it is on.
+ */
+void piListRemove(PageList *list, uint64_t frame);
+
+/**
+ * Set or get the owner pointer of a frame. The owner of a frame which is not RAM is always NULL.
+ */
+void piSetOwner(uint64_t frame, void *owner);
+void* piGetOwner(uint64_t frame);
+
 #endif
@@ -32,6 +32,7 @@
 #include <glidix/util/common.h>
 #include <glidix/fs/ftree.h>
 #include <glidix/thread/semaphore.h>
+#include <glidix/thread/rwlock.h>
 
 /**
  * Protection settings.
@@ -53,7 +54,8 @@
 #	define	MAP_FIXED			(1 << 3)
 #	define	MAP_THREAD			(1 << 4)
 #	define	MAP_UN				(1 << 5)
-#	define	MAP_ALLFLAGS			((1 << 6)-1)
+#	define	MAP_POPULATE			(1 << 6)
+#	define	MAP_ALLFLAGS			((1 << 7)-1)
 #	define	MAP_FAILED			((uint64_t)-1)
 #endif
 
@@ -74,6 +76,24 @@ typedef struct Segment_
 	struct Segment_*			prev;
 	struct Segment_*			next;
 	
+	/**
+	 * Links in the segment index (an AVL tree keyed by 'start'), and the height of the subtree
+	 * rooted at this segment.
+	 */
+	struct Segment_*			left;
+	struct Segment_*			right;
+	int					height;
+	
+	/**
+	 * Virtual address of the start of this segment.
+	 */
+	uint64_t				start;
+	
+	/**
+	 * Held while a page fault is being handled within this segment.
+	 */
+	Semaphore				lock;
+	
 	/**
 	 * Size of this segment, in pages.
 	 */
@@ -113,18 +133,31 @@ typedef struct Segment_
 /**
  * Description of a virtual address space.
  */
-typedef struct
+typedef struct ProcMem_
 {
 	/**
-	 * Lock for the object.
+	 * Lock for the segment list. Page faults (and other operations which only load pages) take it
+	 * for reading, along with the lock of the segment they operate on, so faults in different
+	 * segments are handled concurrently. Anything that changes the segment list, or operates on
+	 * many segments, takes it for writing.
 	 */
-	Semaphore				lock;
+	RWLock					lock;
+	
+	/**
+	 * Protects the creation of page tables, which may be shared by more than one segment.
+	 */
+	Semaphore				ptLock;
 	
 	/**
-	 * Head of the segment list.
+	 * Head of the segment list. The segments cover the whole address space, in order.
 	 */
 	Segment*				segs;
 	
+	/**
+	 * Root of the segment index, for looking up the segment containing an address.
+	 */
+	Segment*				index;
+	
 	/**
 	 * Reference count.
 	 */
@@ -134,8 +167,58 @@ typedef struct
 	 * Physical frame number of the PDPT.
 	 */
 	uint64_t				phys;
+	
+	/**
+	 * Links in the list of all address spaces, which the swapper walks. Protected by the list lock
+	 * in procmem.c.
+	 */
+	struct ProcMem_*			listPrev;
+	struct ProcMem_*			listNext;
+	
+	/**
+	 * Unique ID, by which CPUs remember which address space each of their PCIDs belongs to (a pointer
+	 * could be reused once the address space is freed).
+	 */
+	uint64_t				id;
+	
+	/**
+	 * Bitmask of CPUs which may have TLB entries for this address space: those running it, and those which
+	 * still hold a PCID for it. Changes to the page tables are shot down on these CPUs only. A CPU only
+	 * ever sets or clears its own bit. Atomic.
+	 */
+	volatile uint32_t			cpuMask;
 } ProcMem;
 
+/**
+ * Number of pages (aligned around the faulting page) which a fault on a file mapping maps in at once,
+ * if they are already in the page cache.
+ */
+#define	VM_FAULT_AROUND				16
+
+/**
+ * Size of a huge page. Anonymous private mappings are backed by huge pages wherever a mapping covers
+ * a whole aligned huge page; it is split into normal pages as soon as anything needs to operate on a
+ * single page in it (mprotect(), partial munmap(), fork(), etc).
+ */
+#define	VM_HUGE_SIZE				0x200000UL
+
+/**
+ * Number of address spaces whose TLB entries each CPU keeps around, tagged with their own PCID, when the CPU
+ * supports it; switching back to one of them does not flush the TLB.
+ */
+#define	VM_PCID_SLOTS				8
+
+/**
+ * Invalidating more than this many pages at once flushes the whole address space from the TLB instead of
+ * invalidating each page.
+ */
+#define	VM_FLUSH_MAX				32
+
+/**
+ * Initialize the list of address spaces.
+ */
+void vmInit();
+
 /**
  * Create a new blank address space and switch to it. Returns 0 on success, -1 on error.
  */
@@ -152,6 +235,14 @@ int vmNew();
 struct File_;
 uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, struct File_ *fp, off_t off);
 
+/**
+ * Pre-fault the pages in the specified range of the calling process' address space (used to implement
+ * MAP_POPULATE), so that accessing them later does not fault. File pages are read in here. This is just
+ * a hint: pages which cannot be loaded (e.g. due to lack of memory) are silently left to be faulted in
+ * on demand.
+ */
+void vmPopulate(uint64_t addr, size_t len);
+
 /**
  * Handle a page fault. Simply returns on success; on error, it sets 'regs' as the return state,
  * and sends a SIGSEGV or SIGBUS signal and switches task. 'faultAddr' is the address being accessed,
@@ -187,10 +278,21 @@ void vmUp(ProcMem *pm);
 void vmDown(ProcMem *pm);
 
 /**
- * Switch to the specifies process memory.
+ * Switch to the specifies process memory. Does nothing if it is already the current one on this CPU.
  */
 void vmSwitch(ProcMem *pm);
 
+/**
+ * Enable PCIDs on the calling CPU if supported. Called by initPerCPU2() on each CPU.
+ */
+void vmInitCPU();
+
+/**
+ * Handle the TLB shootdown IPI (I_IPI_TLB), sent when another CPU changed the page tables of an address space
+ * which this CPU may have TLB entries for. Called with interrupts disabled.
+ */
+void vmOnShootdown();
+
 /**
  * Dump the list of segments in a process memory object. Show an arrow pointing to the given address.
  */
@@ -209,4 +311,32 @@ void vmDump(ProcMem *pm, uint64_t addr);
  */
 uint64_t vmGetPhys(uint64_t addr, int requiredPerms);
 
+/**
+ * Pin the userspace buffer of 'size' bytes at 'buffer' so that a device can transfer data to or from it
+ * directly: every page it touches is faulted in with 'requiredPerms' (so copy-on-write is broken now if
+ * PROT_WRITE is given), and 'frames' receives a referenced frame for each page. On success, the address
+ * space is left locked for reading, so that nothing can unmap or remap the buffer; the caller must release
+ * it promptly with vmUnpinUser(). Returns 0 on success, or EFAULT if the buffer is not accessible.
+ */
+int vmPinUser(const void *buffer, size_t size, int requiredPerms, uint64_t *frames);
+
+/**
+ * Release a buffer pinned by vmPinUser().
+ */
+void vmUnpinUser(const void *buffer, size_t size, uint64_t *frames);
+
+/**
+ * Write out up to 'target' pages, which are not shared and were not accessed recently, from all address spaces
+ * to swap, and free their frames. Address spaces are visited in turn, continuing where the last call left off;
+ * those whose locks are held by someone else are skipped. Returns the number of frames freed. The calling thread
+ * temporarily switches into each address space; no memory is allocated.
+ */
+int vmSwapOut(int target);
+
+/**
+ * Read every page which is in the specified swap area back into memory, in all address spaces. The caller
+ * must make sure that no new pages are written to the area, and that there is enough memory for its contents.
+ */
+void vmSwapOff(int area);
+
 #endif
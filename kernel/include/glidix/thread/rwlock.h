@@ -0,0 +1,71 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __glidix_rwlock_h
+#define __glidix_rwlock_h
+
+/**
+ * Reader-writer locks. Any number of readers may hold the lock at the same time, while a writer
+ * has exclusive access. A waiting writer stops new readers from getting in, so writers are not
+ * starved. These locks are NOT recursive.
+ */
+
+#include <glidix/util/common.h>
+#include <glidix/thread/semaphore.h>
+
+/**
+ * Maximum number of concurrent readers.
+ */
+#define	RW_MAX_READERS				1024
+
+typedef struct
+{
+	/**
+	 * Each reader holds one resource; a writer holds all of them.
+	 */
+	Semaphore				units;
+	
+	/**
+	 * Serializes writers, so that two of them cannot each collect part of the resources.
+	 */
+	Semaphore				wlock;
+} RWLock;
+
+void rwInit(RWLock *rw);
+void rwLockRead(RWLock *rw);
+
+/**
+ * Try to take the lock for reading without blocking. Returns 0 if it was taken, or -1 if a writer
+ * holds it or is waiting for it.
+ */
+int rwTryLockRead(RWLock *rw);
+
+void rwUnlockRead(RWLock *rw);
+void rwLockWrite(RWLock *rw);
+void rwUnlockWrite(RWLock *rw);
+
+#endif
@@ -46,6 +46,7 @@
 #define	DEFAULT_STACK_SIZE		0x200000
 #define	CLONE_THREAD			(1 << 0)
 #define	CLONE_DETACHED			(1 << 1)
+#define	CLONE_VFORK			(1 << 2)
 
 /**
  * Standard priorities.
@@ -508,6 +509,24 @@ typedef struct _Thread
 	 * to allocate from the file cache.
 	 */
 	int				sdMissNow;
+	
+	/**
+	 * Whether or not this thread is currently reclaiming a page from the file cache. Writing back
+	 * a dirty page may itself need memory, and this prevents reclaim from recursing. See ftree.c.
+	 */
+	int				reclaimNow;
+	
+	/**
+	 * If this process was created by vfork(), points to the 'vforkDone' semaphore of the parent
+	 * thread, which is suspended until we stop using its address space (by exec or exit).
+	 * NULL otherwise.
+	 */
+	Semaphore*			vforkSem;
+	
+	/**
+	 * Signalled by a child created with CLONE_VFORK once it releases our address space.
+	 */
+	Semaphore			vforkDone;
 } Thread;
 
 typedef struct
@@ -608,11 +627,20 @@ int signalThread(Thread *thread);
  *	CLONE_THREAD -		create a thread within the same process; otherwise a new process with
  *				an initial thread.
  *	CLONE_DETACHED -	create a detached thread.
+ *	CLONE_VFORK -		create a new process which shares the address space of the caller
+ *				until it calls exec or exits; the caller must then wait on its
+ *				'vforkDone' semaphore (which it must initialize to 0 beforehand).
  * state = use this when you need to set FPU registers basically. throwback to when this was a system
  *         call.
  */
 int threadClone(Regs *regs, int flags, MachineState *state);
 
+/**
+ * If the calling process was created by vfork(), let the parent continue, since we no longer use
+ * its address space. Called by exec after switching to the new address space, and on exit.
+ */
+void vforkRelease();
+
 /**
  * Exit the thread.
  */
@@ -0,0 +1,121 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __glidix_swap_h
+#define __glidix_swap_h
+
+/**
+ * Swap space. When memory runs low and the page cache has nothing left to give, the swapper thread writes
+ * private pages which only one address space refers to out to a swap partition, and their page table
+ * entries are changed to point to the swap slot instead of a frame (see vmSwapOut()). Touching such a page
+ * reads it back in, together with its neighbours if they were written out next to it.
+ */
+
+#include <glidix/util/common.h>
+
+/**
+ * Maximum number of swap areas in use at the same time.
+ */
+#define	SWAP_MAX_AREAS				16
+
+/**
+ * Maximum number of pages written out or read in with a single request. Runs of pages never cross an
+ * aligned group of this many pages in the address space, so they always share a page table.
+ */
+#define	SWAP_CLUSTER				8
+
+/**
+ * A swap entry, as stored in a page table entry: the area index in the high bits, and the slot (page index)
+ * within the area in the low SWAP_SLOT_BITS bits. Slot 0 of each area is never used, so that 0 is never a
+ * valid entry.
+ */
+#define	SWAP_SLOT_BITS				32
+#define	SWAP_ENTRY(area, slot)			(((uint64_t)(area) << SWAP_SLOT_BITS) | (uint64_t)(slot))
+#define	SWAP_AREA(entry)			((int) ((entry) >> SWAP_SLOT_BITS))
+#define	SWAP_SLOT(entry)			((entry) & ((1UL << SWAP_SLOT_BITS) - 1))
+
+/**
+ * Flags for swapOn().
+ */
+#define	SWAP_FLAGS_ALL				0
+
+/**
+ * Initialize swap support and start the swapper thread.
+ */
+void swapInit();
+
+/**
+ * Start using the swap partition at the specified path. Returns 0 on success, or an error number.
+ */
+int swapOn(const char *path, int flags);
+
+/**
+ * Stop using the swap partition at the specified path. Everything in it is read back into memory first,
+ * which fails with ENOMEM if there is not enough memory for it. Returns 0 on success, or an error number.
+ */
+int swapOff(const char *path);
+
+/**
+ * Allocate up to '*count' consecutive swap slots, each with a reference count of 1, and return the entry
+ * of the first one; '*count' is set to the number actually allocated (at least 1). Returns 0 if swap space
+ * is full, or there is none.
+ */
+uint64_t swapAlloc(int *count);
+
+/**
+ * Add a reference to a swap slot, for when a page table entry referring to it is copied.
+ */
+void swapDup(uint64_t entry);
+
+/**
+ * Drop a reference to a swap slot; the slot is free once no page table entry refers to it.
+ */
+void swapFree(uint64_t entry);
+
+/**
+ * Write the specified frames to 'count' consecutive slots starting at 'entry', or read them back. Returns 0
+ * on success, or an error number. No memory is allocated.
+ */
+int swapWrite(uint64_t entry, int count, const uint64_t *frames);
+int swapRead(uint64_t entry, int count, const uint64_t *frames);
+
+/**
+ * Called by the physical memory manager when it cannot find any free memory, and the page cache has nothing
+ * left to give. Writes some pages out to swap directly from the calling thread. Returns 0 if any frames were
+ * freed (so the allocation should be retried), or -1 if swap cannot help (there is none, it is full, or the
+ * caller cannot sleep).
+ */
+int swapFreeMemory();
+
+/**
+ * Wake up the swapper, if there is any swap space; called by the page cache reclaimer when it could not
+ * free up enough memory by itself.
+ */
+void swapWake();
+
+#endif
@@ -179,6 +179,7 @@ typedef struct
 	uint64_t			sst_frames_total;
 	uint64_t			sst_frames_used;
 	uint64_t			sst_frames_cached;
+	uint64_t			sst_num_cpus;
 } SystemState;
 
 typedef struct
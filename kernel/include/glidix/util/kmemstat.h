@@ -0,0 +1,56 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __glidix_kmemstat_h
+#define __glidix_kmemstat_h
+
+/**
+ * Kernel memory accounting. /proc/kmemstat reports how much memory the heap, the block cache and each kernel
+ * subsystem are using. Heap usage is charged to the allocation site (file and line) of each block, and a
+ * subsystem is the directory of the source files of its allocation sites (for example "fs", "net", or the
+ * name of a module).
+ */
+
+#include <glidix/util/common.h>
+
+/**
+ * Number of allocation sites listed in /proc/kmemstat, those with the most bytes allocated first.
+ */
+#define	KMEM_TOP_SITES				20
+
+/**
+ * Maximum number of subsystems listed in /proc/kmemstat; the rest are added up under "(other)".
+ */
+#define	KMEM_MAX_SUBSYS				24
+
+/**
+ * Create /proc/kmemstat.
+ */
+void kmemstatInit();
+
+#endif
@@ -53,6 +53,53 @@ void heapDump();
 #define	kxmalloc(size, flags)		_kxmalloc((size), (flags), "", 0)
 #define	kfree(x)			_kfree((x), __FILE__, __LINE__)
 
+/**
+ * Number of size classes in heap statistics. Class n counts blocks of more than 2^(n+4) and at most 2^(n+5)
+ * bytes (class 0 also counts smaller ones), including the block header.
+ */
+#define	HEAP_STAT_CLASSES		26
+
+/**
+ * Maximum number of distinct allocation sites whose usage is tracked; allocations from any further sites are
+ * all charged to a single "(other)" site.
+ */
+#define	HEAP_MAX_SITES			1024
+
+/**
+ * Heap usage attributed to one allocation site: the file and line passed to kxmallocDynamic() (normally those of
+ * the kmalloc() call). 'aid' is an empty string for allocations which do not say where they came from.
+ */
+typedef struct
+{
+	const char*			aid;
+	int				lineno;
+	uint64_t			bytes;		/* bytes requested by blocks currently allocated */
+	uint64_t			blocks;		/* number of blocks currently allocated */
+} HeapSite;
+
+/**
+ * Overall heap statistics; see heapGetStats().
+ */
+typedef struct
+{
+	uint64_t			frames;		/* frames mapped into the heap, including page tables */
+	uint64_t			allocated;	/* bytes in allocated blocks, including headers and rounding */
+	uint64_t			requested;	/* bytes actually requested for those blocks */
+	uint64_t			used[HEAP_STAT_CLASSES];	/* allocated blocks in each size class */
+	uint64_t			free[HEAP_STAT_CLASSES];	/* free blocks in each size class */
+} HeapStats;
+
+/**
+ * Fill in the overall heap statistics.
+ */
+void heapGetStats(HeapStats *st);
+
+/**
+ * Copy the usage of up to 'max' allocation sites which currently have blocks allocated into 'sites'. Returns
+ * the number of sites copied; an array of HEAP_MAX_SITES entries always has room for all of them.
+ */
+int heapGetSites(HeapSite *sites, int max);
+
 /**
  * Private heap structures.
  */
@@ -61,6 +61,34 @@ uint64_t video_getpage(FileTree *ft, off_t pos)
 	return disp->ops->getpage(disp, pos);
 };
 
+static int video_flip(VideoDisplay *disp, File *fp, VideoFlipRequest *req)
+{
+	// only whoever set the mode may decide what is on the screen
+	if (disp->modeSetter == NULL || disp->modeSetter != fp->filedata)
+	{
+		ERRNO = EPERM;
+		return -1;
+	};
+	
+	if (disp->ops->flip == NULL)
+	{
+		ERRNO = ENODEV;
+		return -1;
+	};
+	
+	VideoInfo info;
+	memset(&info, 0, sizeof(VideoInfo));
+	disp->ops->getinfo(disp, &info);
+	
+	if (req->index < 0 || req->index >= info.numPresentable)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	return disp->ops->flip(disp, req->index);
+};
+
 int video_ioctl(Inode *inode, File *fp, uint64_t cmd, void *argp)
 {
 	VideoDisplay *disp = inode->fsdata;
@@ -95,6 +123,8 @@ int video_ioctl(Inode *inode, File *fp, uint64_t cmd, void *argp)
 	case IOCTL_VIDEO_GETINFO:
 		disp->ops->getinfo(disp, (VideoInfo*) argp);
 		return 0;
+	case IOCTL_VIDEO_FLIP:
+		return video_flip(disp, fp, (VideoFlipRequest*) argp);
 	default:
 		ERRNO = ENODEV;
 		return -1;
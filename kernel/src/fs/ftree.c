@@ -35,15 +35,183 @@
 #include <glidix/thread/sched.h>
 #include <glidix/display/console.h>
 #include <glidix/hw/physmem.h>
+#include <glidix/fs/procfs.h>
+#include <glidix/thread/swap.h>
+#include <glidix/int/syscall.h>
+#include <glidix/util/errno.h>
+
+/**
+ * The two reclaim lists. Newly-loaded pages go on the head of the inactive list; the reclaimer
+ * evicts from its tail. Pages found to be in use, or accessed during two consecutive passes over
+ * the inactive list, are promoted to the active list, which is aged like a CLOCK and demotes
+ * pages back to the inactive list when it grows larger than it.
+ */
+#define	CP_INACTIVE				0
+#define	CP_ACTIVE				1
+
+/**
+ * Set on an inactive page whose accessed bit was found set once already.
+ */
+#define	CP_REFERENCED				(1 << 0)
+
+/**
+ * Describes a page of a non-anonymous file tree which is currently in the page cache. Each such
+ * page is on exactly one of the reclaim lists, which are threaded through the page info array;
+ * the descriptor is the owner of the frame, so that it can be found from the frame number when
+ * the page is uncached or reclaimed. Protected by ftMtx.
+ */
+typedef struct CachedPage_
+{
+	/**
+	 * The tree, the page-aligned offset in it, and the tree entry which points to the frame.
+	 */
+	FileTree*				ft;
+	off_t					pos;
+	uint64_t*				entry;
+	
+	/**
+	 * The frame, which list the page is on, and CP_* flags.
+	 */
+	uint64_t				frame;
+	int					list;
+	int					flags;
+} CachedPage;
+
+/**
+ * Reclaim statistics, exported in /proc/memstat. Updated atomically.
+ */
+static struct
+{
+	uint64_t				scanned;
+	uint64_t				activated;
+	uint64_t				deactivated;
+	uint64_t				rotated;
+	uint64_t				reclaimed;
+	uint64_t				writeback;
+	uint64_t				direct;
+	uint64_t				kswapdWakeups;
+	uint64_t				kswapdReclaimed;
+} ftStats;
 
 static Mutex ftMtx;
 static FileTree* ftFirst;
 static FileTree* ftLast;
 
+static PageList cpList[2];
+
+/**
+ * The reclaimer thread, and the free frame watermarks it maintains.
+ */
+static Semaphore semKswapd;
+static int kswapdPending;
+static int kswapdRunning;
+static uint64_t ftLowWatermark;
+static uint64_t ftHighWatermark;
+
+static void ftGenMemstat(char *buffer, size_t size);
+static void kswapdThread(void *context);
+
 void ftInit()
 {
 	mutexInit(&ftMtx);
 	ftFirst = ftLast = NULL;
+	piListInit(&cpList[CP_INACTIVE]);
+	piListInit(&cpList[CP_ACTIVE]);
+	
+	ftLowWatermark = phmTotalFrames / 128;
+	if (ftLowWatermark < 32) ftLowWatermark = 32;
+	ftHighWatermark = ftLowWatermark * 2;
+	
+	semInit2(&semKswapd, 0);
+	
+	KernelThreadParams pars;
+	memset(&pars, 0, sizeof(KernelThreadParams));
+	pars.stackSize = DEFAULT_STACK_SIZE;
+	pars.name = "kswapd";
+	CreateKernelThread(kswapdThread, &pars, NULL);
+	kswapdRunning = 1;
+	
+	if (procfsAddFile("memstat", ftGenMemstat) != 0)
+	{
+		panic("could not create /proc/memstat");
+	};
+};
+
+static void cpLink(CachedPage *cp, int list)
+{
+	cp->list = list;
+	piListPush(&cpList[list], cp->frame);
+};
+
+static void cpUnlink(CachedPage *cp)
+{
+	piListRemove(&cpList[cp->list], cp->frame);
+};
+
+/**
+ * Return the page at the tail of the specified list, or NULL if it is empty.
+ */
+static CachedPage* cpTail(int list)
+{
+	if (cpList[list].tail == 0) return NULL;
+	return (CachedPage*) piGetOwner(cpList[list].tail);
+};
+
+/**
+ * Move a page to the head of the specified list.
+ */
+static void cpMove(CachedPage *cp, int list)
+{
+	cpUnlink(cp);
+	cpLink(cp, list);
+};
+
+/**
+ * Stop tracking a page; call with ftMtx locked. The descriptor is not freed.
+ */
+static void cpRemove(CachedPage *cp)
+{
+	piSetOwner(cp->frame, NULL);
+	cpUnlink(cp);
+};
+
+/**
+ * Start tracking a newly-loaded page. The caller must hold the tree lock.
+ */
+static void cpAdd(FileTree *ft, uint64_t *entry, off_t pos, uint64_t frame)
+{
+	CachedPage *cp = NEW(CachedPage);
+	if (cp == NULL)
+	{
+		// the page will simply never be reclaimed
+		return;
+	};
+	
+	cp->ft = ft;
+	cp->pos = pos;
+	cp->entry = entry;
+	cp->frame = frame;
+	cp->flags = 0;
+	
+	mutexLock(&ftMtx);
+	piSetOwner(frame, cp);
+	cpLink(cp, CP_INACTIVE);
+	mutexUnlock(&ftMtx);
+};
+
+/**
+ * Stop tracking a page, if it is being tracked; called before it is uncached.
+ */
+static void cpForget(uint64_t frame)
+{
+	mutexLock(&ftMtx);
+	CachedPage *cp = (CachedPage*) piGetOwner(frame);
+	if (cp != NULL)
+	{
+		cpRemove(cp);
+		kfree(cp);
+	};
+	mutexUnlock(&ftMtx);
 };
 
 FileTree* ftCreate(int flags)
@@ -52,10 +220,13 @@ FileTree* ftCreate(int flags)
 	memset(ft, 0, sizeof(FileTree));
 	ft->refcount = 1;
 	ft->flags = flags;
-	memset(&ft->top, 0, sizeof(FileNode));
+	ft->top = NEW(FileNode);
+	memset(ft->top, 0, sizeof(FileNode));
+	ft->depth = 1;
 	semInit(&ft->lock);
 	ft->data = NULL;
 	ft->load = NULL;
+	ft->loadpages = NULL;
 	ft->flush = NULL;
 	ft->update = NULL;
 	ft->getpage = NULL;
@@ -88,21 +259,29 @@ void ftUp(FileTree *ft)
 	__sync_add_and_fetch(&ft->refcount, 1);
 };
 
+/**
+ * In all the tree walkers below, 'level' is the number of levels below 'node' (0 if it is a
+ * bottom-level node), and 'base' is the index of the first page under 'node'.
+ */
 static void deleteTree(int level, FileNode *node)
 {
 	int i;
-	for (i=0; i<16; i++)
+	for (i=0; i<FT_NODE_ENTRIES; i++)
 	{
-		if (level == 12)
+		if (level == 0)
 		{
-			if (node->entries[i] != 0) piUncache(node->entries[i]);
+			if (node->entries[i] != 0)
+			{
+				cpForget(node->entries[i]);
+				piUncache(node->entries[i]);
+			};
 		}
 		else
 		{
 			FileNode *subnode = node->nodes[i];
 			if (subnode != NULL)
 			{
-				deleteTree(level+1, subnode);
+				deleteTree(level-1, subnode);
 			};
 			kfree(subnode);
 		};
@@ -112,10 +291,10 @@ static void deleteTree(int level, FileNode *node)
 static void flushTree(FileTree *ft, int level, FileNode *node, uint64_t base)
 {
 	int i;
-	for (i=0; i<16; i++)
+	for (i=0; i<FT_NODE_ENTRIES; i++)
 	{
-		uint64_t pos = (base << 4) | (uint64_t)i;
-		if (level == 12)
+		uint64_t index = base + ((uint64_t) i << (FT_NODE_SHIFT * level));
+		if (level == 0)
 		{
 			if (ft->flush != NULL)
 			{
@@ -125,7 +304,7 @@ static void flushTree(FileTree *ft, int level, FileNode *node, uint64_t base)
 					{
 						uint8_t pagebuf[0x1000];
 						frameRead(node->entries[i], pagebuf);
-						ft->flush(ft, pos << 12, pagebuf);
+						ft->flush(ft, index << 12, pagebuf);
 					};
 				};
 			};
@@ -135,12 +314,82 @@ static void flushTree(FileTree *ft, int level, FileNode *node, uint64_t base)
 			FileNode *subnode = node->nodes[i];
 			if (subnode != NULL)
 			{
-				flushTree(ft, level+1, subnode, pos);
+				flushTree(ft, level-1, subnode, index);
+			};
+		};
+	};
+};
+
+/**
+ * Uncache all pages with an index of 'first' or above.
+ */
+static void truncateTree(int level, FileNode *node, uint64_t base, uint64_t first)
+{
+	int i;
+	for (i=0; i<FT_NODE_ENTRIES; i++)
+	{
+		uint64_t index = base + ((uint64_t) i << (FT_NODE_SHIFT * level));
+		uint64_t span = 1UL << (FT_NODE_SHIFT * level);
+		if ((index + span) <= first) continue;
+		
+		if (level == 0)
+		{
+			if (node->entries[i] != 0)
+			{
+				cpForget(node->entries[i]);
+				piUncache(node->entries[i]);
+				node->entries[i] = 0;
+			};
+		}
+		else
+		{
+			FileNode *subnode = node->nodes[i];
+			if (subnode != NULL)
+			{
+				truncateTree(level-1, subnode, index, first);
 			};
 		};
 	};
 };
 
+/**
+ * Return a pointer to the entry for page number 'index' in the tree. If 'create' is nonzero,
+ * missing nodes are allocated (and the tree made deeper if necessary); otherwise, NULL is
+ * returned if there is no node for it. Call with the tree lock held.
+ */
+static uint64_t* ftLookup(FileTree *ft, uint64_t index, int create)
+{
+	while ((index >> (FT_NODE_SHIFT * ft->depth)) != 0)
+	{
+		if (!create) return NULL;
+		
+		FileNode *newTop = NEW(FileNode);
+		memset(newTop, 0, sizeof(FileNode));
+		newTop->nodes[0] = ft->top;
+		ft->top = newTop;
+		ft->depth++;
+	};
+	
+	FileNode *node = ft->top;
+	int level;
+	for (level=ft->depth-1; level>0; level--)
+	{
+		uint64_t ent = (index >> (FT_NODE_SHIFT * level)) & (FT_NODE_ENTRIES-1);
+		if (node->nodes[ent] == NULL)
+		{
+			if (!create) return NULL;
+			
+			FileNode *newNode = NEW(FileNode);
+			memset(newNode, 0, sizeof(FileNode));
+			node->nodes[ent] = newNode;
+		};
+		
+		node = node->nodes[ent];
+	};
+	
+	return &node->entries[index & (FT_NODE_ENTRIES-1)];
+};
+
 void ftDown(FileTree *ft)
 {
 	int newRef = __sync_add_and_fetch(&ft->refcount, -1);
@@ -150,15 +399,19 @@ void ftDown(FileTree *ft)
 		{
 			if (ft->getpage == NULL)
 			{
-				// uncache all pages
-				deleteTree(0, &ft->top);
+				// uncache all pages; taking the lock waits for the reclaimer in
+				// case it is currently evicting one of them
+				semWait(&ft->lock);
+				deleteTree(ft->depth-1, ft->top);
+				semSignal(&ft->lock);
 			};
 
+			kfree(ft->top);
 			kfree(ft);
 		}
 		else
 		{
-			flushTree(ft, 0, &ft->top, 0);
+			flushTree(ft, ft->depth-1, ft->top, 0);
 		};
 	};
 };
@@ -166,74 +419,150 @@ void ftDown(FileTree *ft)
 void ftFlush(FileTree *ft)
 {
 	semWait(&ft->lock);
-	flushTree(ft, 0, &ft->top, 0);
+	flushTree(ft, ft->depth-1, ft->top, 0);
 	semSignal(&ft->lock);
 };
 
-static uint64_t getPageUnlocked(FileTree *ft, off_t pos)
+/**
+ * Load up to 'count' pages, starting with page number 'index', into the cache. The first page is
+ * always loaded; the rest of the range is cut short at the end of the file, or at the first page
+ * which is already cached. The first page is returned with a reference held by the caller; the
+ * others are only cached. Returns the frame of the first page, or 0 on error.
+ */
+static uint64_t loadPages(FileTree *ft, uint64_t *firstEnt, uint64_t index, uint64_t count)
 {
-	if (ft->getpage != NULL)
+	uint64_t endIndex = (ft->size + 0xFFF) >> 12;
+	if ((ft->flags & FT_ANON) || (index + count) > endIndex)
 	{
-		uint64_t frame = ft->getpage(ft, pos & ~0xFFF);
-		piStaticFrame(frame);
-		return frame;
+		count = 1;
 	};
 	
-	FileNode *node = &ft->top;
-	int i;
-	for (i=0; i<12; i++)
+	uint64_t i;
+	for (i=1; i<count; i++)
 	{
-		uint64_t ent = (pos >> (12 + 4 * (12 - i))) & 0xF;
-		
-		if (node->nodes[ent] == NULL)
-		{
-			FileNode *newNode = NEW(FileNode);
-			memset(newNode, 0, sizeof(FileNode));
-			
-			node->nodes[ent] = newNode;
-			node = newNode;
-		}
-		else
+		uint64_t *ent = ftLookup(ft, index+i, 0);
+		if (ent != NULL && *ent != 0) break;
+	};
+	count = i;
+	
+	uint8_t pagebuf[0x1000];
+	uint8_t *buffer = pagebuf;
+	if (count > 1)
+	{
+		buffer = (uint8_t*) kmalloc(count << 12);
+		if (buffer == NULL)
 		{
-			node = node->nodes[ent];
+			buffer = pagebuf;
+			count = 1;
 		};
 	};
 	
-	// load the page if necessary
-	uint64_t pageIndex = (pos >> 12) & 0xF;
-	if (node->entries[pageIndex] == 0)
+	memset(buffer, 0, count << 12);
+	
+	if ((ft->flags & FT_ANON) == 0)
 	{
-		// first let's try loading
-		uint8_t pagebuf[0x1000];
-		memset(pagebuf, 0, 0x1000);
+		if (ft->load == NULL)
+		{
+			if (buffer != pagebuf) kfree(buffer);
+			return 0;
+		};
 		
-		if ((ft->flags & FT_ANON) == 0)
+		int loaded = -1;
+		if (count > 1 && ft->loadpages != NULL)
 		{
-			if (ft->load == NULL)
+			loaded = ft->loadpages(ft, (off_t) (index << 12), (int) count, buffer);
+			if (loaded > (int) count) loaded = (int) count;
+		};
+		
+		if (loaded < 1)
+		{
+			// no batched load (or it failed); fall back to single pages, where
+			// only the first one is required to succeed
+			for (i=0; i<count; i++)
 			{
-				return 0;
+				if (ft->load(ft, (off_t) ((index + i) << 12), buffer + (i << 12)) != 0)
+				{
+					break;
+				};
 			};
-		
-			if (ft->load(ft, pos, pagebuf) != 0)
+			
+			loaded = (int) i;
+			if (loaded == 0)
 			{
+				if (buffer != pagebuf) kfree(buffer);
 				return 0;
 			};
 		};
 		
+		count = (uint64_t) loaded;
+	};
+	
+	uint64_t result = 0;
+	for (i=0; i<count; i++)
+	{
+		uint64_t *ent = firstEnt;
+		if (i != 0)
+		{
+			ent = ftLookup(ft, index+i, 1);
+			if (ent == NULL) break;
+		};
+		
 		uint64_t frame = piNew(PI_CACHE);
 		if (frame == 0)
 		{
-			return 0;
+			break;
 		};
 		
-		frameWrite(frame, pagebuf);
+		frameWrite(frame, buffer + (i << 12));
 		
-		node->entries[pageIndex] = frame;
+		*ent = frame;
+		if ((ft->flags & FT_ANON) == 0)
+		{
+			cpAdd(ft, ent, (off_t) ((index + i) << 12), frame);
+		};
+		
+		if (i == 0)
+		{
+			result = frame;
+		}
+		else
+		{
+			// readahead pages are not referenced by anyone yet
+			piDecref(frame);
+		};
+	};
+	
+	if (buffer != pagebuf) kfree(buffer);
+	return result;
+};
+
+/**
+ * Get the page at the specified offset, loading it and up to 'count'-1 pages after it if it
+ * is not cached. Returns the frame with a reference held by the caller, or 0 on error.
+ */
+static uint64_t getPageUnlocked(FileTree *ft, off_t pos, uint64_t count)
+{
+	if (ft->getpage != NULL)
+	{
+		uint64_t frame = ft->getpage(ft, pos & ~0xFFF);
+		piStaticFrame(frame);
 		return frame;
+	};
+	
+	uint64_t index = (uint64_t) pos >> 12;
+	uint64_t *ent = ftLookup(ft, index, 1);
+	if (ent == NULL)
+	{
+		return 0;
+	};
+	
+	if (*ent == 0)
+	{
+		return loadPages(ft, ent, index, count);
 	}
 	else
 	{
-		uint64_t frame = node->entries[pageIndex];
+		uint64_t frame = *ent;
 		piIncref(frame);
 		return frame;
 	};
@@ -242,12 +571,43 @@ static uint64_t getPageUnlocked(FileTree *ft, off_t pos)
 uint64_t ftGetPage(FileTree *ft, off_t pos)
 {
 	semWait(&ft->lock);
-	uint64_t frame = getPageUnlocked(ft, pos);
+	uint64_t frame = getPageUnlocked(ft, pos, FT_RA_FAULT);
 	semSignal(&ft->lock);
 	return frame;
 };
 
-ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos)
+int ftGetCachedPages(FileTree *ft, off_t pos, int count, uint64_t *frames)
+{
+	semWait(&ft->lock);
+	
+	int found = 0;
+	uint64_t index = (uint64_t) pos >> 12;
+	int i;
+	for (i=0; i<count; i++)
+	{
+		frames[i] = 0;
+		if (ft->getpage != NULL) continue;
+		
+		uint64_t *ent = ftLookup(ft, index+i, 0);
+		if (ent != NULL && *ent != 0)
+		{
+			piIncref(*ent);
+			frames[i] = *ent;
+			found++;
+		};
+	};
+	
+	semSignal(&ft->lock);
+	return found;
+};
+
+/**
+ * Read from the tree in runs of up to FT_RUN_MAX pages: the tree is locked once per run, to load any missing
+ * pages and take a reference to each, and the data is then copied out with the tree unlocked. If 'user' is
+ * nonzero, 'buffer' is in userspace; copying to it may fault, and the fault may need this very tree (if the
+ * buffer is a mapping of the file), which is why the lock must not be held while copying.
+ */
+static ssize_t readTree(FileTree *ft, void *buffer, size_t size, off_t pos, FileReadahead *ra, int user)
 {
 	semWait(&ft->lock);
 	
@@ -262,39 +622,127 @@ ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos)
 		size = ft->size - pos;
 	};
 	
+	// pages [firstIndex, endIndex) are being read; if this continues where the last read
+	// ended, grow the readahead window, otherwise turn readahead off until it does again
+	uint64_t firstIndex = (uint64_t) pos >> 12;
+	uint64_t endIndex = ((uint64_t) pos + size + 0xFFF) >> 12;
+	uint64_t raSize = 0;
+	if (ra != NULL)
+	{
+		if (ra->next == firstIndex || ra->next == firstIndex+1)
+		{
+			if (ra->size == 0) ra->size = FT_RA_MIN;
+			else if (ra->size < FT_RA_MAX) ra->size *= 2;
+		}
+		else
+		{
+			ra->size = 0;
+		};
+		
+		ra->next = endIndex;
+		raSize = ra->size;
+	};
+	
 	ssize_t sizeRead = 0;
 	uint8_t *put = (uint8_t*) buffer;
+	uint64_t frames[FT_RUN_MAX];
 	
-	while (size > 0)
+	while (1)
 	{
-		size_t sizeToRead = size;
-		size_t maxReadable = 0x1000 - (pos & 0xFFF);
-		if (sizeToRead > maxReadable) sizeToRead = maxReadable;
+		uint64_t index = (uint64_t) pos >> 12;
+		uint64_t numPages = endIndex - index;
+		if (numPages > FT_RUN_MAX) numPages = FT_RUN_MAX;
 		
-		uint64_t frame = getPageUnlocked(ft, pos & ~0xFFF);
-		if (frame == 0)
+		uint64_t got;
+		for (got=0; got<numPages; got++)
+		{
+			// on a miss, load the rest of this read plus the readahead window at once
+			uint64_t count = endIndex - (index + got) + raSize;
+			if (count > FT_RA_MAX) count = FT_RA_MAX;
+			
+			frames[got] = getPageUnlocked(ft, (off_t) ((index + got) << 12), count);
+			if (frames[got] == 0) break;
+		};
+		
+		semSignal(&ft->lock);
+		
+		int fault = 0;
+		uint64_t i;
+		for (i=0; i<got; i++)
+		{
+			size_t sizeToRead = size;
+			size_t maxReadable = 0x1000 - (pos & 0xFFF);
+			if (sizeToRead > maxReadable) sizeToRead = maxReadable;
+			
+			if (!fault)
+			{
+				uint64_t old = mapTempFrame(frames[i]);
+				void *src = (char*) tmpframe() + (pos & 0xFFF);
+				if (user)
+				{
+					fault = memcpy_k2u(put, src, sizeToRead);
+				}
+				else
+				{
+					memcpy(put, src, sizeToRead);
+				};
+				mapTempFrame(old);
+				piMarkAccessed(frames[i]);
+			};
+			
+			piDecref(frames[i]);
+			if (fault) continue;
+			
+			put += sizeToRead;
+			sizeRead += sizeToRead;
+			pos += sizeToRead;
+			size -= sizeToRead;
+		};
+		
+		if (fault)
 		{
+			if (sizeRead == 0)
+			{
+				ERRNO = EFAULT;
+				return -1;
+			};
+			
 			break;
-		}
-		else
+		};
+		
+		if (size == 0 || got != numPages)
 		{
-			uint64_t old = mapTempFrame(frame);
-			memcpy(put, (char*) tmpframe() + (pos & 0xFFF), sizeToRead);
-			mapTempFrame(old);
-			piMarkAccessed(frame);
-			piDecref(frame);
+			break;
+		};
+		
+		// the file may have been truncated while it was unlocked
+		semWait(&ft->lock);
+		if (pos >= ft->size)
+		{
+			semSignal(&ft->lock);
+			break;
 		};
 		
-		put += sizeToRead;
-		sizeRead += sizeToRead;
-		pos += sizeToRead;
-		size -= sizeToRead;
+		if ((pos+size) >= ft->size)
+		{
+			size = ft->size - pos;
+			endIndex = ((uint64_t) pos + size + 0xFFF) >> 12;
+		};
 	};
 	
-	semSignal(&ft->lock);
 	return sizeRead;
 };
 
+ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos, FileReadahead *ra)
+{
+	return readTree(ft, buffer, size, pos, ra, 0);
+};
+
+ssize_t ftReadUser(FileTree *ft, void *buffer, size_t size, off_t pos, FileReadahead *ra)
+{
+	return readTree(ft, buffer, size, pos, ra, 1);
+};
+
 ssize_t ftWrite(FileTree *ft, const void *buffer, size_t size, off_t pos)
 {
 	semWait(&ft->lock);
@@ -326,7 +774,7 @@ ssize_t ftWrite(FileTree *ft, const void *buffer, size_t size, off_t pos)
 		size_t maxWriteable = 0x1000 - (pos & 0xFFF);
 		if (sizeToWrite > maxWriteable) sizeToWrite = maxWriteable;
 		
-		uint64_t frame = getPageUnlocked(ft, pos & ~0xFFF);
+		uint64_t frame = getPageUnlocked(ft, pos & ~0xFFF, 1);
 		if (frame == 0)
 		{
 			break;
@@ -367,43 +815,13 @@ int ftTruncate(FileTree *ft, size_t size)
 	
 	if (size < ft->size)
 	{
-		size_t pos;
-		for (pos=(size+0xFFF) & (~0xFFF); pos<ft->size; pos+=0x1000)
-		{
-			FileNode *node = &ft->top;
-			int i;
-			int foundNode = 1;
-			for (i=0; i<12; i++)
-			{
-				uint64_t ent = (pos >> (12 + 4 * (12 - i))) & 0xF;
-		
-				if (node->nodes[ent] == NULL)
-				{
-					foundNode = 0;
-					break;
-				}
-				else
-				{
-					node = node->nodes[ent];
-				};
-			};
-			
-			if (foundNode)
-			{
-				uint64_t pageIndex = (pos >> 12) & 0xF;
-				if (node->entries[pageIndex] != 0)
-				{
-					piUncache(node->entries[pageIndex]);
-					node->entries[pageIndex] = 0;
-				};
-			};
-		};
+		truncateTree(ft->depth-1, ft->top, 0, (size + 0xFFF) >> 12);
 	};
 	
 	// zero out the end of the current page if truncating on a non-page-boundary.
 	if (size & 0xFFF)
 	{
-		uint64_t frame = getPageUnlocked(ft, size & ~0xFFF);
+		uint64_t frame = getPageUnlocked(ft, size & ~0xFFF, 1);
 		if (frame != 0)
 		{
 			uint64_t old = mapTempFrame(frame);
@@ -423,6 +841,9 @@ int ftTruncate(FileTree *ft, size_t size)
 void ftUncache(FileTree *ft)
 {
 	// TODO: maybe remove all the file locks ??
+	// the tree lock keeps the reclaimer from writing back pages while we detach the callbacks;
+	// the cached pages themselves are forgotten lazily by the reclaimer, or by ftDown()
+	semWait(&ft->lock);
 	mutexLock(&ftMtx);
 	if (ft->prev != NULL) ft->prev->next = ft->next;
 	if (ftFirst == ft) ftFirst = ft->next;
@@ -433,19 +854,20 @@ void ftUncache(FileTree *ft)
 	ft->update = NULL;
 	ft->flags |= FT_ANON;
 	mutexUnlock(&ftMtx);
+	semSignal(&ft->lock);
 };
 
 static void ftDumpTree(FileTree *ft, int level, FileNode *node, uint64_t base)
 {
 	char tabs[16];
 	memset(tabs, 0, 16);
-	memset(tabs, ' ', level+1);
+	memset(tabs, ' ', ft->depth-level);
 
 	int i;
-	for (i=0; i<16; i++)
+	for (i=0; i<FT_NODE_ENTRIES; i++)
 	{
-		uint64_t pos = (base << 4) | (uint64_t)i;
-		if (level == 12)
+		uint64_t index = base + ((uint64_t) i << (FT_NODE_SHIFT * level));
+		if (level == 0)
 		{
 			if (node->entries[i] != 0)
 			{
@@ -461,104 +883,227 @@ static void ftDumpTree(FileTree *ft, int level, FileNode *node, uint64_t base)
 			if (subnode != NULL)
 			{
 				kprintf("%sEntry %d:\n", tabs, i);
-				ftDumpTree(ft, level+1, subnode, pos);
+				ftDumpTree(ft, level-1, subnode, index);
 			};
 		};
 	};
 };
 
-static uint64_t tryFreeFrame(FileTree *ft, int level, FileNode *node, uint64_t base)
-{	
-	int i;
-	for (i=0; i<16; i++)
+/**
+ * Age one page from the tail of the active list: pages which are in use or were accessed since
+ * the last pass go back to its head, others are demoted to the inactive list. Call with ftMtx
+ * locked.
+ */
+static void cpAgeActive()
+{
+	CachedPage *cp = cpTail(CP_ACTIVE);
+	if (cp == NULL) return;
+	
+	uint64_t info = piGetInfo(cp->frame);
+	if ((info & 0xFFFFFFFF) != 0 || piTestAndClearAccessed(cp->frame))
+	{
+		cpMove(cp, CP_ACTIVE);
+	}
+	else
 	{
-		uint64_t pos = (base << 4) | (uint64_t)i;
-		if (level == 12)
+		cp->flags &= ~CP_REFERENCED;
+		cpMove(cp, CP_INACTIVE);
+		__sync_fetch_and_add(&ftStats.deactivated, 1);
+	};
+};
+
+static void cpActivate(CachedPage *cp)
+{
+	cp->flags &= ~CP_REFERENCED;
+	cpMove(cp, CP_ACTIVE);
+	__sync_fetch_and_add(&ftStats.activated, 1);
+};
+
+/**
+ * Scan the inactive list from its tail, and evict the first page which is unused, was not
+ * accessed recently, and whose tree is not locked by someone else. The page is written back if
+ * dirty, removed from its tree, and its frame returned; the frame is still marked as used. Returns
+ * 0 if nothing could be reclaimed.
+ */
+static uint64_t ftReclaimPage()
+{
+	Thread *me = getCurrentThread();
+	if (me->sdMissNow || me->reclaimNow) return 0;
+	me->reclaimNow = 1;
+	
+	mutexLock(&ftMtx);
+	
+	// every page can be looked at at most twice before we give up
+	uint64_t budget = 2 * (cpList[CP_ACTIVE].count + cpList[CP_INACTIVE].count);
+	while (budget-- != 0)
+	{
+		if (cpList[CP_ACTIVE].count > cpList[CP_INACTIVE].count)
 		{
-			if (node->entries[i] != 0)
+			cpAgeActive();
+		};
+		
+		CachedPage *cp = cpTail(CP_INACTIVE);
+		if (cp == NULL) break;
+		
+		__sync_fetch_and_add(&ftStats.scanned, 1);
+		FileTree *ft = cp->ft;
+		
+		if (ft->flags & FT_ANON)
+		{
+			// the file was deleted; its pages are released when the tree is
+			cpRemove(cp);
+			kfree(cp);
+			continue;
+		};
+		
+		if ((piGetInfo(cp->frame) & 0xFFFFFFFF) != 0)
+		{
+			// mapped into memory or currently being accessed
+			cpActivate(cp);
+			continue;
+		};
+		
+		if (piTestAndClearAccessed(cp->frame))
+		{
+			if (cp->flags & CP_REFERENCED)
 			{
-				uint64_t flags = piGetInfo(node->entries[i]);
-				if ((flags & 0xFFFFFFFF) == 0)
-				{
-					if (flags & PI_DIRTY)
-					{
-						if (ft->flush != NULL)
-						{
-							uint8_t pagebuf[0x1000];
-							frameRead(node->entries[i], pagebuf);
-							ft->flush(ft, pos << 12, pagebuf);
-						};
-					};
-					
-					uint64_t ent = node->entries[i];
-					node->entries[i] = 0;
-					__sync_fetch_and_add(&phmCachedFrames, -1);
-					return ent;
-				};
+				cpActivate(cp);
+			}
+			else
+			{
+				// give it one more pass to prove it's not just a one-shot read
+				cp->flags |= CP_REFERENCED;
+				cpMove(cp, CP_INACTIVE);
+				__sync_fetch_and_add(&ftStats.rotated, 1);
 			};
-		}
-		else
+			
+			continue;
+		};
+		
+		// we must never block on a tree lock here, since the caller might be holding it
+		if (semWaitGen(&ft->lock, 1, SEM_W_NONBLOCK, 0) != 1)
 		{
-			FileNode *subnode = node->nodes[i];
-			if (subnode != NULL)
+			cpMove(cp, CP_INACTIVE);
+			__sync_fetch_and_add(&ftStats.rotated, 1);
+			continue;
+		};
+		
+		// with the tree locked, nobody else can get a new reference to the page
+		if ((piGetInfo(cp->frame) & 0xFFFFFFFF) != 0)
+		{
+			semSignal(&ft->lock);
+			cpActivate(cp);
+			continue;
+		};
+		
+		cpRemove(cp);
+		mutexUnlock(&ftMtx);
+		
+		if (piCheckFlush(cp->frame))
+		{
+			if (ft->flush != NULL)
 			{
-				uint64_t val = tryFreeFrame(ft, level+1, subnode, pos);
-				if (val != 0) return val;
+				uint8_t pagebuf[0x1000];
+				frameRead(cp->frame, pagebuf);
+				ft->flush(ft, cp->pos, pagebuf);
+				__sync_fetch_and_add(&ftStats.writeback, 1);
 			};
 		};
+		
+		*cp->entry = 0;
+		__sync_fetch_and_add(&phmCachedFrames, -1);
+		semSignal(&ft->lock);
+		
+		uint64_t frame = cp->frame;
+		kfree(cp);
+		
+		__sync_fetch_and_add(&ftStats.reclaimed, 1);
+		me->reclaimNow = 0;
+		return frame;
 	};
 	
+	mutexUnlock(&ftMtx);
+	me->reclaimNow = 0;
 	return 0;
 };
 
-static int currentlyInFreePage = 0;
 uint64_t ftGetFreePage()
 {
-	if (getCurrentThread()->sdMissNow) return 0;
-	
-	mutexLock(&ftMtx);
-	
-	if (currentlyInFreePage)
+	uint64_t frame = ftReclaimPage();
+	if (frame != 0) __sync_fetch_and_add(&ftStats.direct, 1);
+	return frame;
+};
+
+static void kswapdThread(void *context)
+{
+	while (1)
 	{
-		mutexUnlock(&ftMtx);
-		return 0;
+		semWaitGen(&semKswapd, 1, 0, 0);
+		__sync_fetch_and_add(&ftStats.kswapdWakeups, 1);
+		
+		while ((phmTotalFrames - phmUsedFrames) < ftHighWatermark)
+		{
+			uint64_t frame = ftReclaimPage();
+			if (frame == 0) break;
+			
+			phmFreeFrame(frame);
+			__sync_fetch_and_add(&ftStats.kswapdReclaimed, 1);
+		};
+		
+		__sync_lock_release(&kswapdPending);
+		
+		// if the cache ran dry, the swapper has to make up the rest
+		swapWake();
 	};
+};
+
+void ftWakeReclaimer()
+{
+	if (!kswapdRunning) return;
 	
-	currentlyInFreePage = 1;
+	// semSignal() may reschedule, so don't do it in an atomic section; a later allocation will
+	// wake us instead
+	if ((getFlagsRegister() & (1 << 9)) == 0) return;
 	
-	FileTree *ft;
-	for (ft=ftFirst; ft!=NULL; ft=ft->next)
+	if ((phmTotalFrames - phmUsedFrames) >= ftLowWatermark) return;
+	if (phmCachedFrames == 0) return;
+	
+	if (__sync_bool_compare_and_swap(&kswapdPending, 0, 1))
 	{
-		if (ft->getpage == NULL)
-		{
-			uint64_t maybeFrame = tryFreeFrame(ft, 0, &ft->top, 0);
-			if (maybeFrame != 0)
-			{
-				// move this FileTree to the end of the list, so that we don't
-				// always free from the same one
-				if (ft != ftLast)
-				{
-					if (ftFirst == ft) ftFirst = ft->next;
-					if (ft->prev != NULL) ft->prev->next = ft->next;
-					if (ft->next != NULL) ft->next->prev = ft->prev;
-					
-					ftLast->next = ft;
-					ft->next = NULL;
-					ft->prev = ftLast;
-					
-					ftLast = ft;
-				};
-
-				currentlyInFreePage = 0;
-				mutexUnlock(&ftMtx);
-				return maybeFrame;
-			};
-		};
+		semSignal(&semKswapd);
 	};
-	
-	currentlyInFreePage = 0;
+};
+
+static void ftGenMemstat(char *buffer, size_t size)
+{
+	mutexLock(&ftMtx);
+	uint64_t active = cpList[CP_ACTIVE].count;
+	uint64_t inactive = cpList[CP_INACTIVE].count;
 	mutexUnlock(&ftMtx);
-	return 0;
+	
+	strformat(buffer, size,
+		"frames_total %lu\n"
+		"frames_used %lu\n"
+		"frames_cached %lu\n"
+		"cache_active %lu\n"
+		"cache_inactive %lu\n"
+		"watermark_low %lu\n"
+		"watermark_high %lu\n"
+		"reclaim_scanned %lu\n"
+		"reclaim_activated %lu\n"
+		"reclaim_deactivated %lu\n"
+		"reclaim_rotated %lu\n"
+		"reclaim_reclaimed %lu\n"
+		"reclaim_writeback %lu\n"
+		"reclaim_direct %lu\n"
+		"kswapd_wakeups %lu\n"
+		"kswapd_reclaimed %lu\n",
+		phmTotalFrames, phmUsedFrames, phmCachedFrames,
+		active, inactive, ftLowWatermark, ftHighWatermark,
+		ftStats.scanned, ftStats.activated, ftStats.deactivated, ftStats.rotated,
+		ftStats.reclaimed, ftStats.writeback, ftStats.direct,
+		ftStats.kswapdWakeups, ftStats.kswapdReclaimed
+	);
 };
 
 void ftReleaseProcessLocks(FileTree *ft)
@@ -588,6 +1133,6 @@ void ftDumpInfo()
 	for (ft=ftFirst; ft!=NULL; ft=ft->next)
 	{
 		kprintf("FileTree@%p (size=%lu, getpage=%p)\n", ft, ft->size, ft->getpage);
-		ftDumpTree(ft, 0, &ft->top, 0);
+		ftDumpTree(ft, ft->depth-1, ft->top, 0);
 	};
 };
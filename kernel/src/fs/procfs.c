@@ -43,6 +43,11 @@ static Inode *inodeProcSelf;
  */
 static PER_CPU char pidstrbuf[16];
 
+/**
+ * The procfs filesystem.
+ */
+static FileSystem *procfs;
+
 static int procfsRegInode(FileSystem *fs, Inode *inode)
 {
 	static ino_t nextIno = 10;
@@ -52,7 +57,7 @@ static int procfsRegInode(FileSystem *fs, Inode *inode)
 
 void initProcfs()
 {
-	FileSystem *procfs = vfsCreateFileSystem("procfs");
+	procfs = vfsCreateFileSystem("procfs");
 	assert(procfs != NULL);
 	procfs->numMounts = 1;
 	procfs->regInode = procfsRegInode;
@@ -85,6 +90,65 @@ void initProcfs()
 	procfs->flags |= VFS_ST_RDONLY;
 };
 
+static ssize_t procfsFileRead(Inode *inode, File *fp, void *buffer, size_t size, off_t offset)
+{
+	ProcfsGenerator gen = (ProcfsGenerator) inode->fsdata;
+	
+	char *text = (char*) kmalloc(PROCFS_FILE_MAX);
+	memset(text, 0, PROCFS_FILE_MAX);
+	gen(text, PROCFS_FILE_MAX);
+	
+	size_t len = strlen(text);
+	if ((size_t) offset >= len)
+	{
+		kfree(text);
+		return 0;
+	};
+	
+	if (size > (len - offset)) size = len - offset;
+	memcpy(buffer, &text[offset], size);
+	kfree(text);
+	return (ssize_t) size;
+};
+
+int procfsAddFile(const char *name, ProcfsGenerator gen)
+{
+	// make this independent of the caller's credentials
+	Creds *creds = getCurrentThread()->creds;
+	getCurrentThread()->creds = NULL;
+	
+	Inode *inode = vfsCreateInode(procfs, VFS_MODE_REGULAR | 0444);
+	inode->fsdata = gen;
+	inode->pread = procfsFileRead;
+	
+	char fullpath[256];
+	strformat(fullpath, 256, "/proc/%s", name);
+	
+	int error;
+	DentryRef dref = vfsGetDentry(VFS_NULL_IREF, fullpath, 1, &error);
+	if (dref.dent == NULL)
+	{
+		vfsUnrefDentry(dref);
+		vfsDownrefInode(inode);
+		getCurrentThread()->creds = creds;
+		return error;
+	};
+	
+	if (dref.dent->ino != 0)
+	{
+		vfsUnrefDentry(dref);
+		vfsDownrefInode(inode);
+		getCurrentThread()->creds = creds;
+		return EEXIST;
+	};
+	
+	vfsBindInode(dref, inode);
+	vfsDownrefInode(inode);		// since the above uprefs it, and we want to take the reference
+	
+	getCurrentThread()->creds = creds;
+	return 0;
+};
+
 static void procfsUpdateInfo(InodeRef startdir, const char *path, uid_t uid, gid_t gid)
 {
 	int error;
@@ -35,6 +35,7 @@
 #include <glidix/thread/semaphore.h>
 #include <glidix/util/errno.h>
 #include <glidix/thread/mutex.h>
+#include <glidix/int/syscall.h>
 
 static Semaphore semConst;
 static FileSystem* kernelRootFS;
@@ -1305,7 +1306,103 @@ void vfsClose(File *fp)
 	};
 };
 
-static ssize_t vfsReadUnlocked(File *fp, void *buffer, size_t size, off_t offset)
+/**
+ * Transfer between a userspace buffer and an O_DIRECT block device file: the buffer is pinned, one chunk of
+ * at most VFS_DIRECT_MAX bytes at a time, and passed to the driver as-is, so the device can DMA straight to
+ * or from it instead of going through a kernel buffer and the block cache.
+ */
+static ssize_t vfsDirectIO(File *fp, void *buffer, size_t size, off_t offset, int write)
+{
+	uint64_t frames[(VFS_DIRECT_MAX >> 12) + 1];
+	Inode *inode = fp->iref.inode;
+	
+	uint8_t *scan = (uint8_t*) buffer;
+	ssize_t sizeDone = 0;
+	
+	while (size > 0)
+	{
+		size_t sizeNow = size;
+		if (sizeNow > VFS_DIRECT_MAX) sizeNow = VFS_DIRECT_MAX;
+		
+		// reading from the device means writing to the buffer, and vice versa
+		int error = vmPinUser(scan, sizeNow, write ? PROT_READ : PROT_WRITE, frames);
+		if (error != 0)
+		{
+			if (sizeDone == 0)
+			{
+				ERRNO = error;
+				return -1;
+			};
+			
+			break;
+		};
+		
+		ssize_t result;
+		if (write) result = inode->pwrite(inode, fp, scan, sizeNow, offset);
+		else result = inode->pread(inode, fp, scan, sizeNow, offset);
+		vmUnpinUser(scan, sizeNow, frames);
+		
+		if (result == -1)
+		{
+			if (sizeDone == 0) return -1;
+			break;
+		};
+		
+		scan += result;
+		sizeDone += result;
+		offset += result;
+		size -= result;
+		
+		if (result != sizeNow) break;
+	};
+	
+	return sizeDone;
+};
+
+/**
+ * Transfer between a userspace buffer and a file which has no way of doing so directly, by copying through
+ * a kernel buffer.
+ */
+static ssize_t vfsBounceIO(File *fp, void *buffer, size_t size, off_t offset, int write)
+{
+	Inode *inode = fp->iref.inode;
+	void *tmpbuf = kmalloc(size);
+	if (tmpbuf == NULL)
+	{
+		ERRNO = ENOBUFS;
+		return -1;
+	};
+	
+	ssize_t result;
+	if (write)
+	{
+		if (memcpy_u2k(tmpbuf, buffer, size) != 0)
+		{
+			kfree(tmpbuf);
+			ERRNO = EFAULT;
+			return -1;
+		};
+		
+		if (inode->pwrite != NULL) result = inode->pwrite(inode, fp, tmpbuf, size, offset);
+		else result = ftWrite(inode->ft, tmpbuf, size, offset);
+	}
+	else
+	{
+		if (inode->pread != NULL) result = inode->pread(inode, fp, tmpbuf, size, offset);
+		else result = ftRead(inode->ft, tmpbuf, size, offset, &fp->ra);
+		
+		if (result > 0 && memcpy_k2u(buffer, tmpbuf, result) != 0)
+		{
+			ERRNO = EFAULT;
+			result = -1;
+		};
+	};
+	
+	kfree(tmpbuf);
+	return result;
+};
+
+static ssize_t vfsReadUnlocked(File *fp, void *buffer, size_t size, off_t offset, int user)
 {
 	if (offset < 0)
 	{
@@ -1320,21 +1417,40 @@ static ssize_t vfsReadUnlocked(File *fp, void *buffer, size_t size, off_t offset
 	};
 
 	fp->iref.inode->atime = time();
+	
+	if (fp->iref.inode->pread == NULL && fp->iref.inode->ft == NULL)
+	{
+		ERRNO = EPERM;
+		return -1;
+	};
+	
+	if (user)
+	{
+		if (fp->iref.inode->pread == NULL)
+		{
+			return ftReadUser(fp->iref.inode->ft, buffer, size, offset, &fp->ra);
+		}
+		else if ((fp->oflags & O_DIRECT) && (fp->iref.inode->mode & VFS_MODE_TYPEMASK) == VFS_MODE_BLKDEV)
+		{
+			return vfsDirectIO(fp, buffer, size, offset, 0);
+		}
+		else
+		{
+			return vfsBounceIO(fp, buffer, size, offset, 0);
+		};
+	};
 
 	if (fp->iref.inode->pread != NULL)
 	{
 		return fp->iref.inode->pread(fp->iref.inode, fp, buffer, size, offset);
 	}
-	else if (fp->iref.inode->ft != NULL)
+	else
 	{
-		return ftRead(fp->iref.inode->ft, buffer, size, offset);
+		return ftRead(fp->iref.inode->ft, buffer, size, offset, &fp->ra);
 	};
-	
-	ERRNO = EPERM;
-	return -1;
 };
 
-static ssize_t vfsWriteUnlocked(File *fp, const void *buffer, size_t size, off_t offset)
+static ssize_t vfsWriteUnlocked(File *fp, const void *buffer, size_t size, off_t offset, int user)
 {
 	if (offset < 0)
 	{
@@ -1350,20 +1466,36 @@ static ssize_t vfsWriteUnlocked(File *fp, const void *buffer, size_t size, off_t
 
 	fp->iref.inode->mtime = fp->iref.inode->ctime = time();
 	
+	if (fp->iref.inode->pwrite == NULL && fp->iref.inode->ft == NULL)
+	{
+		ERRNO = EPERM;
+		return -1;
+	};
+	
+	if (user)
+	{
+		if ((fp->oflags & O_DIRECT) && fp->iref.inode->pwrite != NULL
+			&& (fp->iref.inode->mode & VFS_MODE_TYPEMASK) == VFS_MODE_BLKDEV)
+		{
+			return vfsDirectIO(fp, (void*) buffer, size, offset, 1);
+		}
+		else
+		{
+			return vfsBounceIO(fp, (void*) buffer, size, offset, 1);
+		};
+	};
+	
 	if (fp->iref.inode->pwrite != NULL)
 	{
 		return fp->iref.inode->pwrite(fp->iref.inode, fp, buffer, size, offset);
 	}
-	else if (fp->iref.inode->ft != NULL)
+	else
 	{
 		return ftWrite(fp->iref.inode->ft, buffer, size, offset);
 	};
-
-	ERRNO = EPERM;
-	return -1;
 };
 
-ssize_t vfsRead(File *fp, void *buffer, size_t size)
+static ssize_t vfsReadAt(File *fp, void *buffer, size_t size, off_t *offsetp, int user)
 {
 	if ((fp->oflags & O_RDONLY) == 0)
 	{
@@ -1373,38 +1505,27 @@ ssize_t vfsRead(File *fp, void *buffer, size_t size)
 	
 	if (fp->iref.inode->ft == NULL)
 	{
-		return vfsReadUnlocked(fp, buffer, size, 0);
+		return vfsReadUnlocked(fp, buffer, size, offsetp == NULL ? 0 : *offsetp, user);
 	};
 	
 	semWait(&fp->lock);
-	ssize_t sz = vfsReadUnlocked(fp, buffer, size, fp->offset);
-	if (sz != -1) fp->offset += sz;
-	semSignal(&fp->lock);
-	return sz;
-};
-
-ssize_t vfsPRead(File *fp, void *buffer, size_t size, off_t offset)
-{
-	if ((fp->oflags & O_RDONLY) == 0)
+	ssize_t sz;
+	if (offsetp == NULL)
 	{
-		ERRNO = EBADF;
-		return -1;
-	};
-
-	if (fp->iref.inode->ft == NULL)
+		sz = vfsReadUnlocked(fp, buffer, size, fp->offset, user);
+		if (sz != -1) fp->offset += sz;
+	}
+	else
 	{
-		return vfsReadUnlocked(fp, buffer, size, offset);
+		sz = vfsReadUnlocked(fp, buffer, size, *offsetp, user);
 	};
-	
-	semWait(&fp->lock);
-	ssize_t sz = vfsReadUnlocked(fp, buffer, size, offset);
 	semSignal(&fp->lock);
 	return sz;
 };
 
-ssize_t vfsWrite(File *fp, const void *buffer, size_t size)
+static ssize_t vfsWriteAt(File *fp, const void *buffer, size_t size, off_t *offsetp, int user)
 {
-	if ((fp->oflags & O_WRONLY) == 0)
+	if (offsetp == NULL && (fp->oflags & O_WRONLY) == 0)
 	{
 		ERRNO = EBADF;
 		return -1;
@@ -1412,37 +1533,69 @@ ssize_t vfsWrite(File *fp, const void *buffer, size_t size)
 
 	if (fp->iref.inode->ft == NULL)
 	{
-		return vfsWriteUnlocked(fp, buffer, size, 0);
+		return vfsWriteUnlocked(fp, buffer, size, offsetp == NULL ? 0 : *offsetp, user);
 	};
 	
 	semWait(&fp->lock);
-	off_t offset = fp->offset;
-	if (fp->oflags & O_APPEND)
+	ssize_t sz;
+	if (offsetp == NULL)
 	{
-		if (fp->iref.inode->ft != NULL)
+		off_t offset = fp->offset;
+		if (fp->oflags & O_APPEND)
 		{
 			offset = (off_t) fp->iref.inode->ft->size;
 		};
+		
+		sz = vfsWriteUnlocked(fp, buffer, size, offset, user);
+		if (sz != -1 && ((fp->oflags & O_APPEND) == 0)) fp->offset += sz;
+	}
+	else
+	{
+		sz = vfsWriteUnlocked(fp, buffer, size, *offsetp, user);
 	};
 	
-	ssize_t sz = vfsWriteUnlocked(fp, buffer, size, offset);
-	if (sz != -1 && ((fp->oflags & O_APPEND) == 0)) fp->offset += sz;
-	
 	semSignal(&fp->lock);
 	return sz;
 };
 
+ssize_t vfsRead(File *fp, void *buffer, size_t size)
+{
+	return vfsReadAt(fp, buffer, size, NULL, 0);
+};
+
+ssize_t vfsPRead(File *fp, void *buffer, size_t size, off_t offset)
+{
+	return vfsReadAt(fp, buffer, size, &offset, 0);
+};
+
+ssize_t vfsWrite(File *fp, const void *buffer, size_t size)
+{
+	return vfsWriteAt(fp, buffer, size, NULL, 0);
+};
+
 ssize_t vfsPWrite(File *fp, const void *buffer, size_t size, off_t offset)
 {
-	if (fp->iref.inode->ft == NULL)
-	{
-		return vfsWriteUnlocked(fp, buffer, size, offset);
-	};
+	return vfsWriteAt(fp, buffer, size, &offset, 0);
+};
 
-	semWait(&fp->lock);
-	ssize_t sz = vfsWriteUnlocked(fp, buffer, size, offset);
-	semSignal(&fp->lock);
-	return sz;
+ssize_t vfsReadUser(File *fp, void *buffer, size_t size)
+{
+	return vfsReadAt(fp, buffer, size, NULL, 1);
+};
+
+ssize_t vfsPReadUser(File *fp, void *buffer, size_t size, off_t offset)
+{
+	return vfsReadAt(fp, buffer, size, &offset, 1);
+};
+
+ssize_t vfsWriteUser(File *fp, const void *buffer, size_t size)
+{
+	return vfsWriteAt(fp, buffer, size, NULL, 1);
+};
+
+ssize_t vfsPWriteUser(File *fp, const void *buffer, size_t size, off_t offset)
+{
+	return vfsWriteAt(fp, buffer, size, &offset, 1);
 };
 
 off_t vfsSeek(File *fp, off_t off, int whence)
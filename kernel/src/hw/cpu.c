@@ -39,6 +39,7 @@
 #include <glidix/util/isp.h>
 #include <glidix/thread/sched.h>
 #include <glidix/hw/idt.h>
+#include <glidix/thread/procmem.h>
 #include <glidix/hw/fpu.h>
 #include <glidix/hw/msr.h>
 
@@ -122,6 +123,9 @@ void initPerCPU2()
 	msrWrite(MSR_CSTAR, (uint64_t)(&_syscall_entry));		// we don't actually use compat mode
 	msrWrite(MSR_SFMASK, (1 << 9) | (1 << 10));			// disable interrupts on syscall and set DF=0
 	msrWrite(MSR_EFER, msrRead(MSR_EFER) | EFER_SCE | EFER_NXE);
+	
+	// tag TLB entries with PCIDs if supported
+	vmInitCPU();
 };
 
 extern char trampoline_start;
@@ -316,14 +320,14 @@ CPU *getCurrentCPU()
 	return currentCPU;
 };
 
-void sendHintToCPU(int cpuID)
+static void sendIPI(int cpuID, uint32_t vector)
 {
 	uint64_t retflags = getFlagsRegister();
 	cli();
 	
 	apic->icrHigh = cpuList[cpuID].apicID << 24;
 	__sync_synchronize();
-	apic->icrLow = 0x00004071;	// I_IPI_SCHED_HINT
+	apic->icrLow = 0x00004000 | vector;
 	__sync_synchronize();
 
 	while (apic->icrLow & (1 << 12))
@@ -334,6 +338,16 @@ void sendHintToCPU(int cpuID)
 	setFlagsRegister(retflags);
 };
 
+void sendHintToCPU(int cpuID)
+{
+	sendIPI(cpuID, I_IPI_SCHED_HINT);
+};
+
+void sendShootdownToCPU(int cpuID)
+{
+	sendIPI(cpuID, I_IPI_TLB);
+};
+
 void sendHintToEveryCPU()
 {
 	if (numCPU == 1) return;
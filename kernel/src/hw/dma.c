@@ -223,7 +223,18 @@ void dmaNextRegion(DMARegion *reg)
 		return;
 	};
 	
-	uint64_t frame = VIRT_TO_FRAME(reg->virtNext);
+	uint64_t frame;
+	PDe *pde = VIRT_TO_PDE(reg->virtNext);
+	if (pde->ps)
+	{
+		// part of a huge page
+		frame = pde->ptPhysAddr + ((reg->virtNext >> 12) & 0x1FF);
+	}
+	else
+	{
+		frame = VIRT_TO_FRAME(reg->virtNext);
+	};
+	
 	reg->physAddr = (frame << 12) | (reg->virtNext & 0xFFF);
 	
 	size_t sizeNow = PAGE_SIZE - (reg->virtNext & 0xFFF);
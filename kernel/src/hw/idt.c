@@ -27,6 +27,7 @@
 */
 
 #include <glidix/hw/idt.h>
+#include <glidix/thread/procmem.h>
 #include <glidix/util/string.h>
 #include <glidix/display/console.h>
 #include <glidix/util/common.h>
@@ -116,6 +117,7 @@ extern void isr64();
 extern void isr65();
 extern void isr112();
 extern void isr113();
+extern void isr114();
 extern void irq_ditch();
 
 int kernelDead = 0;
@@ -228,6 +230,7 @@ void initIDT()
 	setGate(65, isr65);
 	setGate(0x70, isr112);
 	setGate(0x71, isr113);
+	setGate(0x72, isr114);
 	
 	// set up IST for some
 	setGateIST(I_NMI, 1);
@@ -529,6 +532,10 @@ void isrHandler(Regs *regs)
 		// in response.
 		apic->eoi = 0;
 		break;
+	case I_IPI_TLB:
+		vmOnShootdown();
+		apic->eoi = 0;
+		break;
 	default:
 		if ((regs->intNo >= IRQ0) && (regs->intNo <= IRQ15))
 		{
@@ -36,10 +36,12 @@
 #include <glidix/storage/storage.h>
 #include <glidix/hw/pagetab.h>
 #include <glidix/fs/ftree.h>
+#include <glidix/thread/swap.h>
 
 uint64_t phmTotalFrames;
 uint64_t phmUsedFrames;
 uint64_t phmCachedFrames;
+uint64_t phmEndFrame;
 
 /**
  * The next frame to return if we are allocating using placement. This is done before
@@ -161,8 +163,10 @@ static int tryFreeMemory()
 		frame = sdFreeMemory();
 		if (frame == 0)
 		{
+			// nothing left in the caches; writing some pages out to swap frees frames
+			// directly, so the caller just has to try again
 			getCurrentThread()->allocFromCacheNow = 0;
-			return -1;
+			return swapFreeMemory();
 		};
 	};
 	
@@ -210,7 +214,12 @@ static uint64_t phmAllocSingle()
 		if (startAt == 0)
 		{
 			uint64_t result = frameFromCache();
-			if (result == 0) nomem();
+			if (result == 0)
+			{
+				if (swapFreeMemory() == 0) continue;
+				nomem();
+			};
+			
 			return result;
 		};
 	
@@ -219,12 +228,18 @@ static uint64_t phmAllocSingle()
 			if (phmTryFrame(i) == 0)
 			{
 				__sync_fetch_and_add(&phmUsedFrames, 1);
+				ftWakeReclaimer();
 				return i;
 			};
 		};
 		
 		uint64_t result = frameFromCache();
-		if (result == 0) nomem();
+		if (result == 0)
+		{
+			if (swapFreeMemory() == 0) continue;
+			nomem();
+		};
+		
 		return result;
 	};
 };
@@ -364,6 +379,39 @@ static uint64_t phmAlloc64()
 	};
 };
 
+static uint64_t phmAlloc512()
+{
+	uint64_t i;
+	uint64_t numGroups = numSystemFrames >> 9;
+	uint64_t *bitmap64 = (uint64_t*) frameBitmap;
+	
+	for (i=((lowestFreeFrame+511)>>9); i<numGroups; i++)
+	{
+		uint64_t *group = &bitmap64[i << 3];
+		
+		int j;
+		for (j=0; j<8; j++)
+		{
+			if (atomic_compare_and_swap64(&group[j], 0, 0xFFFFFFFFFFFFFFFF) != 0) break;
+		};
+		
+		if (j == 8)
+		{
+			// just claimed the 512 frames at this location
+			__sync_fetch_and_add(&phmUsedFrames, 512);
+			return i << 9;
+		};
+		
+		// someone else is using part of this group; give back what we claimed
+		while (j--)
+		{
+			group[j] = 0;
+		};
+	};
+	
+	return 0;
+};
+
 void initPhysMem2()
 {
 	frameBitmap = (uint8_t*) kmalloc(numSystemFrames/8+1);
@@ -373,6 +421,7 @@ void initPhysMem2()
 	memset(frameBitmap, 0xFF, numSystemFrames/8+1);
 	
 	phmTotalFrames = 0;
+	phmEndFrame = 0;
 	
 	MultibootMemoryMap *mmap = memoryMapStart;
 	while ((uint64_t) mmap < memoryMapEnd)
@@ -391,6 +440,8 @@ void initPhysMem2()
 					phmTotalFrames++;
 				};
 			};
+			
+			if (endFrame > phmEndFrame) phmEndFrame = endFrame;
 		};
 		
 		mmap = (MultibootMemoryMap*) ((uint64_t) mmap + mmap->size + 4);
@@ -507,9 +558,38 @@ uint64_t phmAllocFrameEx(uint64_t count, int flags)
 	
 	// free the unneeded frames
 	phmFreeFrameEx(base + count, actuallyAllocated - count);
+	ftWakeReclaimer();
+	return base;
+};
+
+uint64_t phmAllocHuge()
+{
+	if (frameBitmap == NULL) return 0;
+	
+	uint64_t base = phmAlloc512();
+	if (base != 0) ftWakeReclaimer();
+	return base;
+};
+
+uint64_t phmAllocZeroHuge()
+{
+	uint64_t base = phmAllocHuge();
+	if (base == 0) return 0;
+	
+	uint64_t i;
+	for (i=0; i<512; i++)
+	{
+		__zeroFrame(base+i);
+	};
+	
 	return base;
 };
 
+void phmFreeHuge(uint64_t base)
+{
+	phmFreeFrameEx(base, 512);
+};
+
 void phmFreeFrame(uint64_t frame)
 {
 	if (frame == 0) panic("attempted to free a null frame!");
@@ -237,7 +237,7 @@ void coredump(siginfo_t *si, Regs *regs)
 	// make the segment list
 	size_t numSegs = 0;
 	
-	semWait(&pm->lock);
+	rwLockRead(&pm->lock);
 	for (vmseg=pm->segs; vmseg!=NULL; vmseg=vmseg->next)
 	{
 		if (vmseg->flags != 0) numSegs++;
@@ -275,7 +275,7 @@ void coredump(siginfo_t *si, Regs *regs)
 		base += (vmseg->numPages << 12);
 	};
 	
-	semSignal(&pm->lock);
+	rwUnlockRead(&pm->lock);
 	
 	// write the segment list
 	vfsPWrite(fp, seglist, sizeof(CoreSegment) * numSegs, offSeglist);
@@ -563,8 +563,10 @@ int elfExec(const char *path, const char *pars, size_t parsz)
 	thread->szExecPars = parsz;
 	memcpy(thread->execPars, pars, parsz);
 
-	// create a new address space
+	// create a new address space; if we were vfork()ed, the parent may now have
+	// its own back
 	vmNew();
+	vforkRelease();
 
 	uint8_t zeroPage[0x1000];
 	memset(zeroPage, 0, 0x1000);
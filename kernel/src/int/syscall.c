@@ -56,6 +56,7 @@
 #include <glidix/int/trace.h>
 #include <glidix/fs/procfs.h>
 #include <glidix/usb/usb.h>
+#include <glidix/thread/swap.h>
 
 /**
  * Options for _glidix_kopt().
@@ -192,31 +193,11 @@ ssize_t sys_write(int fd, const void *buf, size_t size)
 		vfsClose(fp);
 		ERRNO = EBADF;
 		return -1;
-	}
-	else
-	{
-		void *tmpbuf = kmalloc(size);
-		if (tmpbuf == NULL)
-		{
-			vfsClose(fp);
-			ERRNO = ENOBUFS;
-			return -1;
-		}
-		else if (memcpy_u2k(tmpbuf, buf, size) != 0)
-		{
-			vfsClose(fp);
-			kfree(tmpbuf);
-			ERRNO = EFAULT;
-			return -1;
-		}
-		else
-		{
-			ssize_t out = vfsWrite(fp, tmpbuf, size);
-			vfsClose(fp);
-			kfree(tmpbuf);
-			return out;
-		};
 	};
+	
+	ssize_t out = vfsWriteUser(fp, buf, size);
+	vfsClose(fp);
+	return out;
 };
 
 uint64_t sys_pwrite(int fd, const void *buf, size_t size, off_t offset)
@@ -233,31 +214,11 @@ uint64_t sys_pwrite(int fd, const void *buf, size_t size, off_t offset)
 		vfsClose(fp);
 		ERRNO = EBADF;
 		return -1;
-	}
-	else
-	{
-		void *tmpbuf = kmalloc(size);
-		if (tmpbuf == NULL)
-		{
-			vfsClose(fp);
-			ERRNO = ENOBUFS;
-			return -1;
-		}
-		else if (memcpy_u2k(tmpbuf, buf, size) != 0)
-		{
-			vfsClose(fp);
-			kfree(tmpbuf);
-			ERRNO = EFAULT;
-			return -1;
-		}
-		else
-		{
-			ssize_t out = vfsPWrite(fp, tmpbuf, size, offset);
-			vfsClose(fp);
-			kfree(tmpbuf);
-			return out;
-		};
 	};
+	
+	ssize_t out = vfsPWriteUser(fp, buf, size, offset);
+	vfsClose(fp);
+	return out;
 };
 
 ssize_t sys_read(int fd, void *buf, size_t size)
@@ -274,31 +235,11 @@ ssize_t sys_read(int fd, void *buf, size_t size)
 		vfsClose(fp);
 		ERRNO = EBADF;
 		return -1;
-	}
-	else
-	{
-		void *tmpbuf = kmalloc(size);
-		if (tmpbuf == NULL)
-		{
-			vfsClose(fp);
-			ERRNO = ENOBUFS;
-			return -1;
-		};
-		
-		ssize_t out = vfsRead(fp, tmpbuf, size);
-		size_t toCopy = (size_t) out;
-		if (out == -1) toCopy = 0;
-		vfsClose(fp);
-		if (memcpy_k2u(buf, tmpbuf, toCopy) != 0)
-		{
-			ERRNO = EFAULT;
-			kfree(tmpbuf);
-			return -1;
-		};
-		kfree(tmpbuf);
-		
-		return out;
 	};
+	
+	ssize_t out = vfsReadUser(fp, buf, size);
+	vfsClose(fp);
+	return out;
 };
 
 ssize_t sys_pread(int fd, void *buf, size_t size, off_t offset)
@@ -315,31 +256,11 @@ ssize_t sys_pread(int fd, void *buf, size_t size, off_t offset)
 		vfsClose(fp);
 		ERRNO = EBADF;
 		return -1;
-	}
-	else
-	{
-		void *tmpbuf = kmalloc(size);
-		if (tmpbuf == NULL)
-		{
-			vfsClose(fp);
-			ERRNO = ENOBUFS;
-			return -1;
-		};
-		
-		ssize_t out = vfsPRead(fp, tmpbuf, size, offset);
-		size_t toCopy = (size_t) out;
-		if (out == -1) toCopy = 0;
-		vfsClose(fp);
-		if (memcpy_k2u(buf, tmpbuf, toCopy) != 0)
-		{
-			ERRNO = EFAULT;
-			kfree(tmpbuf);
-			return -1;
-		};
-		kfree(tmpbuf);
-		
-		return out;
 	};
+	
+	ssize_t out = vfsPReadUser(fp, buf, size, offset);
+	vfsClose(fp);
+	return out;
 };
 
 int sys_open(const char *upath, int oflag, mode_t mode)
@@ -914,7 +835,7 @@ uint64_t sys_mmap(uint64_t addr, size_t len, int prot, int flags, int fd, off_t
 		};
 	};
 
-	uint64_t result = vmMap(addr, len, prot, flags, fp, offset);
+	uint64_t result = vmMap(addr, len, prot, flags & ~MAP_POPULATE, fp, offset);
 	if (fp != NULL) vfsClose(fp);
 	
 	if (result < ADDR_MIN)
@@ -923,6 +844,11 @@ uint64_t sys_mmap(uint64_t addr, size_t len, int prot, int flags, int fd, off_t
 		return MAP_FAILED;
 	};
 	
+	if (flags & MAP_POPULATE)
+	{
+		vmPopulate(result, len);
+	};
+	
 	return result;
 };
 
@@ -2029,6 +1955,94 @@ int sys_fork()
 	return threadClone(&regs, 0, NULL);
 };
 
+int sys_vfork()
+{
+	Thread *me = getCurrentThread();
+	
+	// the child runs on our stack, and the first thing it does is return from the system
+	// call stub, so it will overwrite our return address; remember it and return the child
+	// straight to the caller
+	uint64_t retaddr;
+	if (memcpy_u2k(&retaddr, (void*) me->ursp, 8) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	Regs regs;
+	initUserRegs(&regs);
+	regs.rbx = me->urbx;
+	regs.rbp = me->urbp;
+	regs.rsp = me->ursp + 8;
+	regs.r12 = me->ur12;
+	regs.r13 = me->ur13;
+	regs.r14 = me->ur14;
+	regs.r15 = me->ur15;
+	regs.rip = retaddr;
+	regs.rflags = getFlagsRegister();
+	regs.fsbase = msrRead(MSR_FS_BASE);
+	regs.gsbase = msrRead(MSR_GS_BASE);
+	
+	semInit2(&me->vforkDone, 0);
+	int pid = threadClone(&regs, CLONE_VFORK, NULL);
+	
+	// wait until the child execs or exits, then put our return address back
+	semWait(&me->vforkDone);
+	memcpy_k2u((void*) me->ursp, &retaddr, 8);
+	
+	return pid;
+};
+
+int sys_swapon(const char *upath, int flags)
+{
+	if (!havePerm(XP_FSADMIN))
+	{
+		ERRNO = EACCES;
+		return -1;
+	};
+	
+	char path[USER_STRING_MAX];
+	if (strcpy_u2k(path, upath) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	int error = swapOn(path, flags);
+	if (error != 0)
+	{
+		ERRNO = error;
+		return -1;
+	};
+	
+	return 0;
+};
+
+int sys_swapoff(const char *upath)
+{
+	if (!havePerm(XP_FSADMIN))
+	{
+		ERRNO = EACCES;
+		return -1;
+	};
+	
+	char path[USER_STRING_MAX];
+	if (strcpy_u2k(path, upath) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	int error = swapOff(path);
+	if (error != 0)
+	{
+		ERRNO = error;
+		return -1;
+	};
+	
+	return 0;
+};
+
 int sys_waitpid(int pid, int *stat_loc, int flags)
 {	
 	int statret;
@@ -2968,6 +2982,7 @@ int sys_systat(void *buffer, size_t sz)
 	sst.sst_frames_total = phmTotalFrames;
 	sst.sst_frames_used = phmUsedFrames;
 	sst.sst_frames_cached = phmCachedFrames;
+	sst.sst_num_cpus = numCPU;
 	
 	if (sz > sizeof(SystemState))
 	{
@@ -3128,7 +3143,7 @@ int sys_fcntl_setfl(int fd, int oflag)
 		return -1;
 	};
 	
-	int allFlags = O_NONBLOCK;
+	int allFlags = O_NONBLOCK | O_DIRECT;
 	fp->oflags = (fp->oflags & ~allFlags) | (oflag & allFlags);
 	vfsClose(fp);
 	return 0;
@@ -3663,7 +3678,7 @@ int sys_usb_getstr(uint64_t devid, uint8_t index, uint16_t langid, char *ubuffer
  * System call table for fast syscalls, and the number of system calls.
  * Do not use NULL entries! Instead, for unused entries, enter SYS_NULL.
  */
-#define SYSCALL_NUMBER 157
+#define SYSCALL_NUMBER 160
 void* sysTable[SYSCALL_NUMBER] = {
 	&sys_exit,				// 0
 	&sys_write,				// 1
@@ -3822,6 +3837,9 @@ void* sysTable[SYSCALL_NUMBER] = {
 	&sys_usb_devdesc,			// 154
 	&sys_usb_langids,			// 155
 	&sys_usb_getstr,			// 156
+	&sys_vfork,				// 157
+	&sys_swapon,				// 158
+	&sys_swapoff,				// 159
 };
 uint64_t sysNumber = SYSCALL_NUMBER;
 
@@ -768,6 +768,7 @@ int rmmod(const char *modname, int flags)
 		kprintf("rmmod(%s): unmapping module memory\n", modname);
 	};
 
+	unexportSymbols(mod->baseAddr, mod->baseAddr + MODULE_SECTOR_SIZE * mod->numSectors);
 	unmapModuleArea(mod);
 
 	if (flags & RMMOD_VERBOSE)
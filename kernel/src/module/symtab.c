@@ -33,45 +33,245 @@
 #include <glidix/display/console.h>
 #include <glidix/int/elf64.h>
 #include <glidix/util/common.h>
+#include <glidix/thread/spinlock.h>
+
+/**
+ * An entry in the symbol name hash table. Kernel symbols live in one array allocated by initSymtab();
+ * exported symbols are allocated individually (with the name stored after the entry).
+ */
+typedef struct SymtabEntry_
+{
+	struct SymtabEntry_*			next;
+	const char*				name;
+	void*					ptr;
+	uint32_t				hash;
+	int					exported;
+} SymtabEntry;
 
 static Elf64_Sym *symbols;
 static const char *symStrings;
 extern uint8_t initrdImage[];
 static size_t symbolCount;
 
+/**
+ * Hash table of symbol names; 'numBuckets' is a power of 2.
+ */
+static SymtabEntry **buckets;
+static SymtabEntry *kernelEntries;
+static size_t numBuckets;
+static Spinlock symtabLock;
+
+/**
+ * Indices into 'symbols', sorted by address.
+ */
+static uint32_t *addrIndex;
+
+static uint32_t symtabHash(const char *name)
+{
+	uint32_t h = 5381;
+	for (; *name!=0; name++)
+	{
+		h = (h << 5) + h + (uint8_t) *name;
+	};
+	
+	return h;
+};
+
+static void symtabInsert(SymtabEntry *ent)
+{
+	SymtabEntry **bucket = &buckets[ent->hash & (numBuckets-1)];
+	ent->next = *bucket;
+	*bucket = ent;
+};
+
+static uint64_t symbolAddr(uint32_t index)
+{
+	return symbols[addrIndex[index]].st_value;
+};
+
+static void siftDown(size_t root, size_t count)
+{
+	while (2*root+1 < count)
+	{
+		size_t child = 2*root+1;
+		if (child+1 < count && symbolAddr(child+1) > symbolAddr(child)) child++;
+		if (symbolAddr(root) >= symbolAddr(child)) return;
+		
+		uint32_t temp = addrIndex[root];
+		addrIndex[root] = addrIndex[child];
+		addrIndex[child] = temp;
+		root = child;
+	};
+};
+
 void initSymtab()
 {
 	symbolCount = bootInfo->numSymbols;
 	symbols = (Elf64_Sym*) ((uint64_t)initrdImage + bootInfo->initrdSymtabOffset);
 	symStrings = (const char*) ((uint64_t)initrdImage + bootInfo->initrdStrtabOffset);
+	spinlockRelease(&symtabLock);
+	
+	// build the name hash table, with about one symbol per bucket
+	numBuckets = 64;
+	while (numBuckets < symbolCount) numBuckets <<= 1;
+	
+	buckets = (SymtabEntry**) kmalloc(sizeof(SymtabEntry*) * numBuckets);
+	memset(buckets, 0, sizeof(SymtabEntry*) * numBuckets);
+	kernelEntries = (SymtabEntry*) kmalloc(sizeof(SymtabEntry) * (symbolCount + 1));
+	
+	// insert in reverse, so that if a name appears more than once, the first one wins
+	// (as it did with the linear search)
+	size_t i;
+	for (i=symbolCount; i>0; i--)
+	{
+		SymtabEntry *ent = &kernelEntries[i-1];
+		ent->name = &symStrings[symbols[i-1].st_name];
+		ent->ptr = (void*) symbols[i-1].st_value;
+		ent->hash = symtabHash(ent->name);
+		ent->exported = 0;
+		symtabInsert(ent);
+	};
+	
+	// build the address index (heapsort, as we have no allocation-free qsort)
+	addrIndex = (uint32_t*) kmalloc(sizeof(uint32_t) * (symbolCount + 1));
+	for (i=0; i<symbolCount; i++)
+	{
+		addrIndex[i] = (uint32_t) i;
+	};
+	
+	for (i=symbolCount/2; i>0; i--)
+	{
+		siftDown(i-1, symbolCount);
+	};
+	
+	for (i=symbolCount; i>1; i--)
+	{
+		uint32_t temp = addrIndex[0];
+		addrIndex[0] = addrIndex[i-1];
+		addrIndex[i-1] = temp;
+		siftDown(0, i-1);
+	};
+};
+
+// call with symtabLock held
+static SymtabEntry* symtabFind(const char *name, uint32_t hash)
+{
+	SymtabEntry *ent;
+	for (ent=buckets[hash & (numBuckets-1)]; ent!=NULL; ent=ent->next)
+	{
+		if (ent->hash == hash && strcmp(ent->name, name) == 0)
+		{
+			return ent;
+		};
+	};
+	
+	return NULL;
 };
 
 void *getSymbol(const char *name)
 {
+	if (buckets == NULL) return NULL;
+	
+	uint32_t hash = symtabHash(name);
+	void *result = NULL;
+	
+	spinlockAcquire(&symtabLock);
+	SymtabEntry *ent = symtabFind(name, hash);
+	if (ent != NULL) result = ent->ptr;
+	spinlockRelease(&symtabLock);
+	
+	return result;
+};
+
+int exportSymbol(const char *name, void *ptr)
+{
+	SymtabEntry *ent = (SymtabEntry*) kmalloc(sizeof(SymtabEntry) + strlen(name) + 1);
+	char *nameput = (char*) &ent[1];
+	strcpy(nameput, name);
+	ent->name = nameput;
+	ent->ptr = ptr;
+	ent->hash = symtabHash(name);
+	ent->exported = 1;
+	
+	spinlockAcquire(&symtabLock);
+	if (symtabFind(name, ent->hash) != NULL)
+	{
+		spinlockRelease(&symtabLock);
+		kfree(ent);
+		return -1;
+	};
+	
+	symtabInsert(ent);
+	spinlockRelease(&symtabLock);
+	
+	return 0;
+};
+
+void unexportSymbols(uint64_t start, uint64_t end)
+{
+	// unlink the entries with the lock held, and free them afterwards
+	SymtabEntry *removed = NULL;
+	
+	spinlockAcquire(&symtabLock);
 	size_t i;
-	for (i=0; i<symbolCount; i++)
+	for (i=0; i<numBuckets; i++)
 	{
-		if (strcmp(&symStrings[symbols[i].st_name], name) == 0)
+		SymtabEntry **link = &buckets[i];
+		while (*link != NULL)
 		{
-			return (void*) symbols[i].st_value;
+			SymtabEntry *ent = *link;
+			uint64_t addr = (uint64_t) ent->ptr;
+			if (ent->exported && addr >= start && addr < end)
+			{
+				*link = ent->next;
+				ent->next = removed;
+				removed = ent;
+			}
+			else
+			{
+				link = &ent->next;
+			};
 		};
 	};
+	spinlockRelease(&symtabLock);
 	
-	return NULL;
+	while (removed != NULL)
+	{
+		SymtabEntry *next = removed->next;
+		kfree(removed);
+		removed = next;
+	};
 };
 
 void findSymbolForAddr(uint64_t addr, Symbol *symbol)
 {
-	size_t i;
-	size_t bestMatch = 0;
-	for (i=0; i<symbolCount; i++)
+	if (addrIndex == NULL || symbolCount == 0)
 	{
-		if ((symbols[i].st_value <= addr) && (symbols[i].st_value > symbols[bestMatch].st_value))
+		symbol->name = "??";
+		symbol->ptr = NULL;
+		return;
+	};
+	
+	// find the last symbol whose address is <= addr; if there is none, fall back to
+	// the lowest one (as the linear search did)
+	size_t low = 0;
+	size_t high = symbolCount;
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+		if (symbolAddr(mid) <= addr)
 		{
-			bestMatch = i;
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
 		};
 	};
 	
-	symbol->name = &symStrings[symbols[bestMatch].st_name];
-	symbol->ptr = (void*) symbols[bestMatch].st_value;
+	size_t best = addrIndex[0];
+	if (low != 0) best = addrIndex[low-1];
+	
+	symbol->name = &symStrings[symbols[best].st_name];
+	symbol->ptr = (void*) symbols[best].st_value;
 };
@@ -46,7 +46,10 @@ static uint32_t sdLetters;
 Mutex mtxList;
 static StorageDevice* sdList[26];
 
+uint64_t sdCacheFrames;
+
 static void reloadPartTable(StorageDevice *sd);
+static void* sdfile_open(Inode *inode, int oflags);
 
 static char sdAllocLetter()
 {
@@ -136,6 +139,55 @@ static int sdfile_ioctl(Inode *inode, File *fp, uint64_t cmd, void *params)
 	return -1;
 };
 
+SDHandle* sdGetSwapHandle(File *fp)
+{
+	if (fp->iref.inode->open != sdfile_open)
+	{
+		ERRNO = ENODEV;
+		return NULL;
+	};
+	
+	SDHandle *handle = (SDHandle*) fp->filedata;
+	if (!handle->isSwap)
+	{
+		ERRNO = EINVAL;
+		return NULL;
+	};
+	
+	return handle;
+};
+
+int sdSwapIO(SDHandle *handle, uint64_t pos, void *buffer, size_t size, int write)
+{
+	StorageDevice *sd = handle->sd;
+	if (sd->flags & SD_HANGUP)
+	{
+		return EIO;
+	};
+	
+	if ((pos + size) > handle->size)
+	{
+		return EINVAL;
+	};
+	
+	uint64_t start = handle->offset + pos;
+	if ((start % sd->blockSize) != 0 || (size % sd->blockSize) != 0)
+	{
+		return EINVAL;
+	};
+	
+	// the drivers do their own locking; nothing else has any business caching the contents
+	// of a swap partition, so the block cache is bypassed
+	if (write)
+	{
+		return sd->ops->writeBlocks(sd->drvdata, start / sd->blockSize, size / sd->blockSize, buffer);
+	}
+	else
+	{
+		return sd->ops->readBlocks(sd->drvdata, start / sd->blockSize, size / sd->blockSize, buffer);
+	};
+};
+
 static int sdfile_pathctl(Inode *inode, uint64_t cmd, void *params)
 {
 	if (cmd == IOCTL_SDI_IDENTITY)
@@ -323,6 +375,7 @@ static void* sdGetCache(StorageDevice *sd, uint64_t pos, int make, int dirty, in
 		};
 		
 		__sync_fetch_and_add(&phmCachedFrames, 8);
+		__sync_fetch_and_add(&sdCacheFrames, 8);
 		
 		node->entries[track] = ((uint64_t) vptr & 0xFFFFFFFFFFFF) | (1UL << 56);
 		if (dirty) node->entries[track] |= SD_BLOCK_DIRTY;
@@ -484,6 +537,82 @@ static ssize_t sdWrite(StorageDevice *sd, uint64_t pos, const void *buf, size_t
 	return sizeWritten;
 };
 
+/**
+ * Transfer data between the device and 'buf' directly, bypassing the block cache (O_DIRECT). The position, size
+ * and buffer must all be aligned to the block size; the buffer must stay mapped for the duration of the call
+ * (a userspace buffer must be pinned with vmPinUser()), since drivers DMA straight to or from it. Tracks which
+ * are already cached are kept coherent: reads take the cached data (which may be newer than the disk), and writes
+ * update it as well as the disk.
+ */
+static ssize_t sdDirect(StorageDevice *sd, uint64_t pos, void *buf, size_t size, int write)
+{
+	if (sd->flags & SD_HANGUP)
+	{
+		ERRNO = ENXIO;
+		return -1;
+	};
+	
+	if ((pos % sd->blockSize) != 0 || (size % sd->blockSize) != 0 || ((uint64_t) buf % sd->blockSize) != 0)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	uint8_t *scan = (uint8_t*) buf;
+	ssize_t sizeDone = 0;
+	
+	while (size > 0)
+	{
+		// never cross a track boundary, so that drivers are never given more than they
+		// get from the cache
+		uint64_t offsetIntoTrack = pos & (SD_TRACK_SIZE-1);
+		uint64_t toDo = SD_TRACK_SIZE - offsetIntoTrack;
+		if (toDo > size)
+		{
+			toDo = size;
+		};
+		
+		mutexLock(&sd->cacheLock);
+		
+		int error;
+		void *track = sdGetCache(sd, pos, 0, 0, &error);
+		int status = 0;
+		if (track != NULL && !write)
+		{
+			memcpy(scan, (char*) track + offsetIntoTrack, toDo);
+		}
+		else if (write)
+		{
+			if (track != NULL) memcpy((char*) track + offsetIntoTrack, scan, toDo);
+			status = sd->ops->writeBlocks(sd->drvdata, pos / sd->blockSize, toDo / sd->blockSize, scan);
+		}
+		else
+		{
+			status = sd->ops->readBlocks(sd->drvdata, pos / sd->blockSize, toDo / sd->blockSize, scan);
+		};
+		
+		mutexUnlock(&sd->cacheLock);
+		
+		if (status != 0)
+		{
+			if (sizeDone == 0)
+			{
+				ERRNO = status;
+				return -1;
+			};
+			
+			break;
+		};
+		
+		scan += toDo;
+		sizeDone += toDo;
+		pos += toDo;
+		size -= toDo;
+	};
+	
+	return sizeDone;
+};
+
 static ssize_t sdfile_pread(Inode *inode, File *fp, void *buf, size_t size, off_t offset)
 {
 	SDHandle *handle = (SDHandle*) fp->filedata;
@@ -500,6 +629,12 @@ static ssize_t sdfile_pread(Inode *inode, File *fp, void *buf, size_t size, off_
 			size = handle->size - offset;
 		};
 	};
+	
+	if (fp->oflags & O_DIRECT)
+	{
+		return sdDirect(handle->sd, actualStart, buf, size, 0);
+	};
+	
 	return sdRead(handle->sd, actualStart, buf, size);
 };
 
@@ -519,6 +654,12 @@ static ssize_t sdfile_pwrite(Inode *inode, File *fp, const void *buf, size_t siz
 			size = handle->size - offset;
 		};
 	};
+	
+	if (fp->oflags & O_DIRECT)
+	{
+		return sdDirect(handle->sd, actualStart, (void*) buf, size, 1);
+	};
+	
 	return sdWrite(handle->sd, actualStart, buf, size);
 };
 
@@ -568,6 +709,7 @@ static void* sdfile_open(Inode *inode, int oflags)
 	handle->offset = fdev->offset;
 	handle->size = fdev->size;
 	handle->partIndex = fdev->partIndex;
+	handle->isSwap = fdev->isSwap;
 	strcpy(handle->name, fdev->name);
 	
 	return handle;
@@ -738,6 +880,9 @@ static void reloadGPT(StorageDevice *sd)
 	unsigned int i;
 	
 	static uint8_t typeNone[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	
+	// 0657FD6D-A4AB-43C4-84E5-0933C84B4F4F
+	static uint8_t typeSwap[16] = {0x6D, 0xFD, 0x57, 0x06, 0xAB, 0xA4, 0xC4, 0x43, 0x84, 0xE5, 0x09, 0x33, 0xC8, 0x4B, 0x4F, 0x4F};
 	for (i=0; i<header.numPartEnts; i++)
 	{
 		if (nextPartIndex == 32) break;
@@ -750,6 +895,7 @@ static void reloadGPT(StorageDevice *sd)
 			fdev->offset = (uint64_t) table[i].startLBA * 512;
 			fdev->size = (uint64_t) (table[i].endLBA - table[i].startLBA + 1) * 512;
 			fdev->partIndex = nextPartIndex;
+			fdev->isSwap = (memcmp(table[i].type, typeSwap, 16) == 0);
 			
 			sdUpref(sd);
 
@@ -863,6 +1009,7 @@ static void reloadPartTable(StorageDevice *sd)
 			fdev->offset = (uint64_t) mbrParts[i].lbaStart * 512;
 			fdev->size = (uint64_t) mbrParts[i].numSectors * 512;
 			fdev->partIndex = i;
+			fdev->isSwap = (mbrParts[i].systemID == 0x82);
 			
 			sdUpref(sd);
 
@@ -1128,6 +1275,7 @@ static uint64_t sdTryFree(StorageDevice *sd, BlockTreeNode *node, int level, uin
 			};
 			
 			__sync_fetch_and_add(&phmCachedFrames, -8);
+			__sync_fetch_and_add(&sdCacheFrames, -8);
 			
 			return frames[0];
 		}
@@ -27,20 +27,39 @@
 */
 
 #include <glidix/thread/pageinfo.h>
-#include <glidix/thread/mutex.h>
 #include <glidix/util/memory.h>
 #include <glidix/hw/physmem.h>
 #include <glidix/util/string.h>
 #include <glidix/display/console.h>
 #include <glidix/util/common.h>
 
-static Mutex piLock;
-static PageInfoNode piRoot;
+/**
+ * What a frame with no entry (one which is not RAM) looks like.
+ */
+#define	PI_STATIC_INFO				(0xFFFFFFUL | PI_CACHE)
+
+static PageInfo* piArray;
+static uint64_t piCount;
 
 void piInit()
 {
-	mutexInit(&piLock);
-	memset(&piRoot, 0, sizeof(PageInfoNode));
+	piCount = phmEndFrame;
+	piArray = (PageInfo*) kmalloc(sizeof(PageInfo) * piCount);
+	if (piArray == NULL)
+	{
+		panic("could not allocate the page info array for %lu frames", piCount);
+	};
+	
+	memset(piArray, 0, sizeof(PageInfo) * piCount);
+};
+
+/**
+ * Return the entry for a frame, or NULL if it is not RAM.
+ */
+static PageInfo* piGet(uint64_t frame)
+{
+	if (frame >= piCount) return NULL;
+	return &piArray[frame];
 };
 
 uint64_t piNew(uint64_t flags)
@@ -48,51 +67,38 @@ uint64_t piNew(uint64_t flags)
 	uint64_t frame = phmAllocZeroFrame();
 	if (frame == 0) return 0;
 	
-	mutexLock(&piLock);
-	uint64_t i;
-	PageInfoNode *node = &piRoot;
-	for (i=0; i<3; i++)
-	{
-		uint64_t index = (frame >> (9 * (3-i))) & 0x1FF;
-		if (node->entries[index] == 0)
-		{
-			PageInfoNode *newNode = NEW(PageInfoNode);
-			memset(newNode, 0, sizeof(PageInfoNode));
-			
-			node->entries[index] = (uint64_t) newNode;
-			node = newNode;
-		}
-		else
-		{
-			node = (PageInfoNode*) node->entries[index];
-		};
-	};
-	
-	uint64_t index = frame & 0x1FF;
-	node->entries[index] = 1UL | flags;
-	mutexUnlock(&piLock);
-	
+	piAdopt(frame, flags);
 	return frame;
 };
 
+void piAdopt(uint64_t frame, uint64_t flags)
+{
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return;
+	
+	page->lruPrev = page->lruNext = 0;
+	page->owner = NULL;
+	__atomic_store_n(&page->info, 1UL | flags, __ATOMIC_RELEASE);
+};
+
 void piIncref(uint64_t frame)
 {
-	uint64_t newEnt = __sync_add_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		1);
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return;
 	
+	uint64_t newEnt = __sync_add_and_fetch(&page->info, 1);
 	if ((newEnt & 0xFFFFFFFF) == 1)
 	{
 		__sync_fetch_and_add(&phmCachedFrames, -1);
 	};
 };
 
-void piDecref(uint64_t frame)
+int piDecref(uint64_t frame)
 {
-	uint64_t newEnt = __sync_add_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		-1);
-
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return (int) (PI_STATIC_INFO & 0xFFFFFFFF);
+	
+	uint64_t newEnt = __sync_add_and_fetch(&page->info, -1);
 	if ((newEnt & 0xFFFFFFFF) == 0)
 	{
 		if ((newEnt & PI_CACHE) == 0)
@@ -104,25 +110,40 @@ void piDecref(uint64_t frame)
 			__sync_fetch_and_add(&phmCachedFrames, 1);
 		};
 	};
+	
+	return (int) (newEnt & 0xFFFFFFFF);
 };
 
 void piMarkDirty(uint64_t frame)
 {
-	__sync_or_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		PI_DIRTY);
+	PageInfo *page = piGet(frame);
+	if (page != NULL) __sync_fetch_and_or(&page->info, PI_DIRTY);
 };
 
 void piMarkAccessed(uint64_t frame)
 {
-	__sync_or_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		PI_ACCESSED);
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return;
+	
+	// avoid bouncing the cache line around on every access if it's already set
+	if ((__atomic_load_n(&page->info, __ATOMIC_RELAXED) & PI_ACCESSED) == 0)
+	{
+		__sync_fetch_and_or(&page->info, PI_ACCESSED);
+	};
+};
+
+int piTestAndClearAccessed(uint64_t frame)
+{
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return 0;
+	
+	uint64_t val = __sync_fetch_and_and(&page->info, ~PI_ACCESSED);
+	return !!(val & PI_ACCESSED);
 };
 
 int piNeedsCopyOnWrite(uint64_t frame)
 {
-	uint64_t val = piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF];
+	uint64_t val = piGetInfo(frame);
 	
 	if ((val & 0xFFFFFFFF) == 1)
 	{
@@ -134,10 +155,10 @@ int piNeedsCopyOnWrite(uint64_t frame)
 
 void piUncache(uint64_t frame)
 {
-	uint64_t newEnt = __sync_and_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		~PI_CACHE);
-
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return;
+	
+	uint64_t newEnt = __sync_and_and_fetch(&page->info, ~PI_CACHE);
 	if ((newEnt & 0xFFFFFFFF) == 0)
 	{
 		__sync_fetch_and_add(&phmCachedFrames, -1);
@@ -147,39 +168,71 @@ void piUncache(uint64_t frame)
 
 int piCheckFlush(uint64_t frame)
 {
-	uint64_t val = __sync_fetch_and_and(&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF], ~PI_DIRTY);
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return 0;
 	
+	uint64_t val = __sync_fetch_and_and(&page->info, ~PI_DIRTY);
 	return !!(val & PI_DIRTY);
 };
 
 void piStaticFrame(uint64_t frame)
 {
-	mutexLock(&piLock);
-	uint64_t i;
-	PageInfoNode *node = &piRoot;
-	for (i=0; i<3; i++)
-	{
-		uint64_t index = (frame >> (9 * (3-i))) & 0x1FF;
-		if (node->entries[index] == 0)
-		{
-			PageInfoNode *newNode = NEW(PageInfoNode);
-			memset(newNode, 0, sizeof(PageInfoNode));
-			
-			node->entries[index] = (uint64_t) newNode;
-			node = newNode;
-		}
-		else
-		{
-			node = (PageInfoNode*) node->entries[index];
-		};
-	};
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return;
 	
-	uint64_t index = frame & 0x1FF;
-	node->entries[index] = 0xFFFFFF | PI_CACHE;
-	mutexUnlock(&piLock);
+	page->lruPrev = page->lruNext = 0;
+	page->owner = NULL;
+	__atomic_store_n(&page->info, PI_STATIC_INFO, __ATOMIC_RELEASE);
 };
 
 uint64_t piGetInfo(uint64_t frame)
 {
-	return piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF];
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return PI_STATIC_INFO;
+	
+	return __atomic_load_n(&page->info, __ATOMIC_ACQUIRE);
+};
+
+void piListInit(PageList *list)
+{
+	list->head = list->tail = 0;
+	list->count = 0;
+};
+
+void piListPush(PageList *list, uint64_t frame)
+{
+	PageInfo *page = &piArray[frame];
+	page->lruPrev = 0;
+	page->lruNext = (uint32_t) list->head;
+	
+	if (list->head != 0) piArray[list->head].lruPrev = (uint32_t) frame;
+	else list->tail = frame;
+	list->head = frame;
+	list->count++;
+};
+
+void piListRemove(PageList *list, uint64_t frame)
+{
+	PageInfo *page = &piArray[frame];
+	
+	if (page->lruPrev != 0) piArray[page->lruPrev].lruNext = page->lruNext;
+	else list->head = page->lruNext;
+	if (page->lruNext != 0) piArray[page->lruNext].lruPrev = page->lruPrev;
+	else list->tail = page->lruPrev;
+	
+	page->lruPrev = page->lruNext = 0;
+	list->count--;
+};
+
+void piSetOwner(uint64_t frame, void *owner)
+{
+	PageInfo *page = piGet(frame);
+	if (page != NULL) page->owner = owner;
+};
+
+void* piGetOwner(uint64_t frame)
+{
+	PageInfo *page = piGet(frame);
+	if (page == NULL) return NULL;
+	return page->owner;
 };
@@ -37,85 +37,836 @@
 #include <glidix/thread/pageinfo.h>
 #include <glidix/display/console.h>
 #include <glidix/util/catch.h>
+#include <glidix/thread/swap.h>
+#include <glidix/thread/mutex.h>
+#include <glidix/hw/cpu.h>
+
+/**
+ * The list of all address spaces, and the one after which the swapper continues.
+ */
+static Semaphore vmListLock;
+static ProcMem* vmList;
+static ProcMem* vmSwapCursor;
+static int vmCount;
+
+static int swapInPage(Segment *seg, uint64_t pos, uint64_t addr, PTe *pte);
+static PTe* peekPage(uint64_t addr);
+
+/**
+ * Whether the CPUs support PCIDs and the INVPCID instruction, and the next address space ID to give out.
+ */
+static int vmUsePCID;
+static int vmUseINVPCID;
+static int vmFeaturesKnown;
+static uint64_t vmNextID;
+
+/**
+ * Address space state of each CPU, only ever accessed by the CPU itself with interrupts disabled. When PCIDs
+ * are in use, 'pcidOwner[i]' is the ID of the address space whose TLB entries are tagged with PCID i+1 (or 0
+ * if none); PCID 0 is used while the PML4 entry is being changed, and when no address space is loaded.
+ * 'cpuActiveID' is the ID of the address space the PML4 currently points to, and 'cpuActivePCID' the PCID
+ * it is loaded with.
+ */
+static PER_CPU uint64_t pcidOwner[VM_PCID_SLOTS];
+static PER_CPU int pcidNext;
+static PER_CPU uint64_t cpuActiveID;
+static PER_CPU uint64_t cpuActivePCID;
+static PER_CPU uint64_t cpuPML4Phys;
+
+/**
+ * The shootdown in progress: the address space, the pages to invalidate (all of them if 'count' is 0), and
+ * the CPUs which have not yet handled it. Protected by the shootdown lock.
+ */
+static Mutex vmShootLock;
+static ProcMem* vmShootPM;
+static uint64_t vmShootAddr;
+static uint64_t vmShootCount;
+static volatile uint32_t vmShootPending;
+
+void vmInitCPU()
+{
+	cpuPML4Phys = getCR3() & ~0xFFFUL;
+	
+	if (!vmFeaturesKnown)
+	{
+		// the boot CPU decides; the others are assumed to be the same
+		uint32_t regs[4];
+		cpuid(0, 0, regs);
+		uint32_t maxLeaf = regs[0];
+		
+		cpuid(1, 0, regs);
+		vmUsePCID = !!(regs[2] & (1 << 17));
+		
+		if (vmUsePCID && maxLeaf >= 7)
+		{
+			cpuid(7, 0, regs);
+			vmUseINVPCID = !!(regs[1] & (1 << 10));
+		};
+		
+		vmFeaturesKnown = 1;
+	};
+	
+	if (vmUsePCID)
+	{
+		// PCIDE can only be set while the current PCID is 0
+		setCR3(cpuPML4Phys);
+		setCR4(getCR4() | CR4_PCIDE);
+	};
+};
+
+/**
+ * Invalidate 'count' pages starting at 'addr' in the current address space on the calling CPU, or the whole
+ * address space if 'count' is 0. Call with interrupts disabled.
+ */
+static void vmFlushLocal(uint64_t addr, uint64_t count)
+{
+	if (count == 0 || count > VM_FLUSH_MAX)
+	{
+		// flushes only the current PCID (or everything but global pages without PCIDs)
+		setCR3(cpuPML4Phys | cpuActivePCID);
+	}
+	else
+	{
+		uint64_t i;
+		for (i=0; i<count; i++)
+		{
+			invlpg((void*)(addr + (i << 12)));
+		};
+	};
+};
+
+/**
+ * Invalidate 'count' pages starting at 'addr' in the current address space (or all of it if 'count' is 0)
+ * after changing its page tables, on every CPU which may have them cached. Frames which were unmapped may only
+ * be freed after this returns.
+ */
+static void vmShootdown(uint64_t addr, uint64_t count)
+{
+	ProcMem *pm = getCurrentThread()->pm;
+	
+	// the page table changes must be visible to everyone before we look at who to notify; a CPU
+	// which switches to the address space later sets its bit first, and walks the new tables
+	__sync_synchronize();
+	
+	uint64_t rflags = getFlagsRegister();
+	cli();
+	vmFlushLocal(addr, count);
+	uint32_t others = pm->cpuMask & ~(1U << getCurrentCPU()->id);
+	setFlagsRegister(rflags);
+	
+	if (others == 0)
+	{
+		return;
+	};
+	
+	mutexLock(&vmShootLock);
+	vmShootPM = pm;
+	vmShootAddr = addr;
+	vmShootCount = count;
+	vmShootPending = others;
+	__sync_synchronize();
+	
+	int i;
+	for (i=0; i<numCPU; i++)
+	{
+		if (others & (1U << i))
+		{
+			sendShootdownToCPU(i);
+		};
+	};
+	
+	while (vmShootPending != 0)
+	{
+		__sync_synchronize();
+	};
+	
+	mutexUnlock(&vmShootLock);
+};
+
+void vmOnShootdown()
+{
+	ProcMem *pm = vmShootPM;
+	uint32_t myBit = 1U << getCurrentCPU()->id;
+	
+	if (cpuActiveID == pm->id)
+	{
+		vmFlushLocal(vmShootAddr, vmShootCount);
+	}
+	else
+	{
+		// we are not running it, so drop anything still cached under its PCID; until we switch
+		// to it again, there is nothing for further shootdowns to do here
+		if (vmUsePCID)
+		{
+			int i;
+			for (i=0; i<VM_PCID_SLOTS; i++)
+			{
+				if (pcidOwner[i] == pm->id)
+				{
+					if (vmUseINVPCID) invpcid(INVPCID_SINGLE, i+1, 0);
+					else pcidOwner[i] = 0;
+				};
+			};
+		};
+		
+		__sync_fetch_and_and(&pm->cpuMask, ~myBit);
+	};
+	
+	__sync_fetch_and_and(&vmShootPending, ~myBit);
+};
+
+/**
+ * Stop using any address space on the calling CPU.
+ */
+static void vmUnload()
+{
+	uint64_t rflags = getFlagsRegister();
+	cli();
+	
+	PML4 *pml4 = getPML4();
+	if (vmUsePCID) setCR3(cpuPML4Phys | CR3_NOFLUSH);
+	pml4->entries[0].present = 0;
+	pml4->entries[0].pdptPhysAddr = 0;
+	setCR3(cpuPML4Phys);
+	
+	cpuActiveID = 0;
+	cpuActivePCID = 0;
+	setFlagsRegister(rflags);
+};
+
+static int segHeight(Segment *seg)
+{
+	if (seg == NULL) return 0;
+	return seg->height;
+};
+
+static void segUpdate(Segment *seg)
+{
+	int left = segHeight(seg->left);
+	int right = segHeight(seg->right);
+	if (left > right) seg->height = left + 1;
+	else seg->height = right + 1;
+};
+
+static Segment* segRotateRight(Segment *seg)
+{
+	Segment *top = seg->left;
+	seg->left = top->right;
+	top->right = seg;
+	segUpdate(seg);
+	segUpdate(top);
+	return top;
+};
+
+static Segment* segRotateLeft(Segment *seg)
+{
+	Segment *top = seg->right;
+	seg->right = top->left;
+	top->left = seg;
+	segUpdate(seg);
+	segUpdate(top);
+	return top;
+};
+
+/**
+ * Restore the AVL property at 'seg' after one of its subtrees changed height by at most 1, and
+ * return the new root of the subtree.
+ */
+static Segment* segBalance(Segment *seg)
+{
+	segUpdate(seg);
+	int balance = segHeight(seg->left) - segHeight(seg->right);
+	
+	if (balance > 1)
+	{
+		if (segHeight(seg->left->left) < segHeight(seg->left->right))
+		{
+			seg->left = segRotateLeft(seg->left);
+		};
+		
+		return segRotateRight(seg);
+	}
+	else if (balance < -1)
+	{
+		if (segHeight(seg->right->right) < segHeight(seg->right->left))
+		{
+			seg->right = segRotateRight(seg->right);
+		};
+		
+		return segRotateLeft(seg);
+	};
+	
+	return seg;
+};
+
+/**
+ * Insert 'seg' into the segment index rooted at 'root', and return the new root. 'seg->start' must
+ * already be set, and no other segment in the index may have the same start.
+ */
+static Segment* segInsert(Segment *root, Segment *seg)
+{
+	if (root == NULL)
+	{
+		seg->left = seg->right = NULL;
+		seg->height = 1;
+		return seg;
+	};
+	
+	if (seg->start < root->start)
+	{
+		root->left = segInsert(root->left, seg);
+	}
+	else
+	{
+		root->right = segInsert(root->right, seg);
+	};
+	
+	return segBalance(root);
+};
+
+/**
+ * Detach the leftmost segment from the subtree 'root', store it in 'min', and return the new root.
+ */
+static Segment* segRemoveMin(Segment *root, Segment **min)
+{
+	if (root->left == NULL)
+	{
+		*min = root;
+		return root->right;
+	};
+	
+	root->left = segRemoveMin(root->left, min);
+	return segBalance(root);
+};
+
+/**
+ * Remove 'seg' from the segment index rooted at 'root', and return the new root.
+ */
+static Segment* segRemove(Segment *root, Segment *seg)
+{
+	if (root == seg)
+	{
+		if (seg->right == NULL) return seg->left;
+		
+		Segment *min;
+		Segment *right = segRemoveMin(seg->right, &min);
+		min->left = seg->left;
+		min->right = right;
+		return segBalance(min);
+	};
+	
+	if (seg->start < root->start)
+	{
+		root->left = segRemove(root->left, seg);
+	}
+	else
+	{
+		root->right = segRemove(root->right, seg);
+	};
+	
+	return segBalance(root);
+};
+
+/**
+ * Find the segment containing the address 'addr' in the specified address space. The caller must hold
+ * the address space lock. Since the segments cover the whole address space, this never fails.
+ */
+static Segment* segLookup(ProcMem *pm, uint64_t addr)
+{
+	Segment *seg = pm->index;
+	Segment *best = NULL;
+	
+	while (seg != NULL)
+	{
+		if (seg->start <= addr)
+		{
+			best = seg;
+			seg = seg->right;
+		}
+		else
+		{
+			seg = seg->left;
+		};
+	};
+	
+	return best;
+};
+
+/**
+ * Make 'seg', whose fields have been filled in (possibly copied from another segment), a new member of the
+ * index of 'pm', starting at 'start'.
+ */
+static void segAdd(ProcMem *pm, Segment *seg, uint64_t start)
+{
+	seg->start = start;
+	semInit(&seg->lock);
+	pm->index = segInsert(pm->index, seg);
+};
+
+/**
+ * Split the huge page mapped by the specified PDE into a page table of normal pages, each of which then
+ * becomes an individually-tracked, loaded anonymous page with the permissions of the huge page.
+ */
+static void splitHuge(PDe *pde)
+{
+	PT pt;
+	memset(&pt, 0, sizeof(PT));
+	
+	uint64_t base = pde->ptPhysAddr;
+	int i;
+	for (i=0; i<512; i++)
+	{
+		PTe *pte = &pt.entries[i];
+		piAdopt(base + i, 0);
+		
+		pte->framePhysAddr = base + i;
+		pte->present = 1;
+		pte->user = 1;
+		pte->rw = pde->rw;
+		pte->xd = pde->xd;
+		pte->accessed = pde->accessed;
+		pte->dirty = pde->ignore;
+		pte->gx_r = 1;
+		pte->gx_w = pde->rw;
+		pte->gx_x = !pde->xd;
+		pte->gx_loaded = 1;
+		pte->gx_perm_ovr = 1;
+	};
+	
+	uint64_t ptFrame = phmAllocFrame();
+	frameWrite(ptFrame, &pt);
+	
+	PDe newEnt;
+	memset(&newEnt, 0, sizeof(PDe));
+	newEnt.present = 1;
+	newEnt.user = 1;
+	newEnt.rw = 1;
+	newEnt.ptPhysAddr = ptFrame;
+	
+	// replace the entry with a single store so that the region is never seen unmapped
+	*((volatile uint64_t*)pde) = *((uint64_t*)&newEnt);
+	vmShootdown(0, 0);
+};
+
+/**
+ * Make sure the PD containing 'addr' exists. Page tables may be shared between segments which are being
+ * faulted on concurrently, so this is done under the page table lock.
+ */
+static void makePD(uint64_t addr)
+{
+	ProcMem *pm = getCurrentThread()->pm;
+	PDPTe *pdpte = (PDPTe*) (((addr >> 27) | 0xffffffffffe00000UL) & ~0x7);
+	
+	semWait(&pm->ptLock);
+	if (!pdpte->present)
+	{
+		// entries which were not present are never cached, so there is nothing to
+		// invalidate
+		pdpte->pdPhysAddr = phmAllocZeroFrame();
+		pdpte->user = 1;
+		pdpte->rw = 1;
+		pdpte->present = 1;
+	};
+	semSignal(&pm->ptLock);
+};
+
+/**
+ * Give the calling process its own copy of the page table referred to by 'pde', which is currently shared
+ * with other address spaces after a fork. Private pages in it become copy-on-write, since they are now
+ * referenced from two tables. If we turn out to be the last user of the table, we simply take it over.
+ * Call with the page table lock held.
+ */
+static void unsharePT(PDe *pde)
+{
+	uint64_t ptFrame = pde->ptPhysAddr;
+	PT *pt = (PT*) (((uint64_t)pde) << 9);
+	
+	if (!piNeedsCopyOnWrite(ptFrame))
+	{
+		pde->gx_ptcow = 0;
+		pde->rw = 1;
+		vmShootdown(0, 0);
+		return;
+	};
+	
+	// the other users cannot write through the table, and do not change it while it is
+	// shared, so it is safe to mark pages copy-on-write in the original too
+	int i;
+	for (i=0; i<512; i++)
+	{
+		PTe *pte = &pt->entries[i];
+		if (pte->gx_loaded)
+		{
+			if (!pte->gx_shared)
+			{
+				pte->rw = 0;
+				pte->gx_cow = 1;
+			};
+			
+			piIncref(pte->framePhysAddr);
+		}
+		else if (pte->gx_swap)
+		{
+			swapDup(pte->framePhysAddr);
+		};
+	};
+	
+	PT copy;
+	memcpy(&copy, pt, sizeof(PT));
+	
+	uint64_t newFrame = phmAllocFrame();
+	frameWrite(newFrame, &copy);
+	
+	PDe newEnt;
+	memcpy(&newEnt, pde, sizeof(PDe));
+	newEnt.ptPhysAddr = newFrame;
+	newEnt.rw = 1;
+	newEnt.gx_ptcow = 0;
+	*((volatile uint64_t*)pde) = *((uint64_t*)&newEnt);
+	vmShootdown(0, 0);
+	
+	if (piDecref(ptFrame) == 0)
+	{
+		// everyone else let go of the original in the meantime, so its references
+		// are now ours to drop
+		for (i=0; i<512; i++)
+		{
+			if (copy.entries[i].gx_loaded)
+			{
+				piDecref(copy.entries[i].framePhysAddr);
+			}
+			else if (copy.entries[i].gx_swap)
+			{
+				swapFree(copy.entries[i].framePhysAddr);
+			};
+		};
+	};
+};
 
 static PTe *getPage(uint64_t addr, int make)
 {
-	addr &= ~0xFFF;
+	addr &= ~0xFFF;
+	
+	PDPTe *pdpte = (PDPTe*) (((addr >> 27) | 0xffffffffffe00000UL) & ~0x7);
+	if (!pdpte->present)
+	{
+		if (make)
+		{
+			makePD(addr);
+		}
+		else
+		{
+			return NULL;
+		};
+	};
+	
+	PDe *pde = (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
+	if (!pde->present)
+	{
+		if (make)
+		{
+			ProcMem *pm = getCurrentThread()->pm;
+			semWait(&pm->ptLock);
+			if (!pde->present)
+			{
+				pde->ptPhysAddr = phmAllocZeroFrame();
+				pde->user = 1;
+				pde->rw = 1;
+				pde->present = 1;
+			};
+			semSignal(&pm->ptLock);
+		}
+		else
+		{
+			return NULL;
+		};
+	};
+	
+	if (pde->ps)
+	{
+		// the caller wants to operate on a single page
+		splitHuge(pde);
+	};
+	
+	if (pde->gx_ptcow)
+	{
+		// the caller may change the entry, so we need our own copy of the table
+		ProcMem *pm = getCurrentThread()->pm;
+		semWait(&pm->ptLock);
+		if (pde->gx_ptcow) unsharePT(pde);
+		semSignal(&pm->ptLock);
+	};
+	
+	return (PTe*) (((addr >> 9) | 0xffffff8000000000UL) & ~0x7);
+};
+
+/**
+ * If 'addr' lies in an anonymous, private mapping 'seg' (which starts at 'pos'), and the mapping covers the
+ * whole 2MB region around it, with nothing yet mapped in that region, map a zeroed huge page there. Returns
+ * 0 if this was done, or -1 if the caller should fall back to normal pages.
+ */
+static int mapHuge(Segment *seg, uint64_t pos, uint64_t addr)
+{
+	if (seg->ft != NULL || (seg->flags & MAP_PRIVATE) == 0 || (seg->prot & PROT_READ) == 0)
+	{
+		return -1;
+	};
+	
+	uint64_t base = addr & ~(VM_HUGE_SIZE-1);
+	if (base < pos || (base + VM_HUGE_SIZE) > (pos + (seg->numPages << 12)))
+	{
+		return -1;
+	};
+	
+	makePD(base);
+	
+	// if there is already a page table here, then some pages were touched (or had their permissions
+	// changed) individually, so leave it alone
+	PDe *pde = (PDe*) (((base >> 18) | 0xffffffffc0000000UL) & ~0x7);
+	if (pde->present)
+	{
+		return -1;
+	};
+	
+	uint64_t frame = phmAllocZeroHuge();
+	if (frame == 0)
+	{
+		return -1;
+	};
+	
+	// the entry was not present, so it cannot be cached in the TLB; fill it in before setting
+	// the present bit
+	pde->ptPhysAddr = frame;
+	pde->user = 1;
+	pde->rw = !!(seg->prot & PROT_WRITE);
+	pde->xd = !(seg->prot & PROT_EXEC);
+	pde->ps = 1;
+	__sync_synchronize();
+	pde->present = 1;
+	return 0;
+};
+
+/**
+ * Set the default permissions of the segment 'seg' on a page, unless they were changed by mprotect().
+ */
+static void setDefaultPerms(Segment *seg, PTe *pte)
+{
+	if (!pte->gx_perm_ovr)
+	{
+		pte->gx_perm_ovr = 1;
+		if (seg->prot & PROT_READ)
+		{
+			pte->gx_r = 1;
+		};
+		
+		if (seg->prot & PROT_WRITE)
+		{
+			pte->gx_w = 1;
+		};
+		
+		if (seg->prot & PROT_EXEC)
+		{
+			pte->gx_x = 1;
+		};
+	};
+};
+
+/**
+ * Map 'frame' (whose reference the page now takes over) into a page of the segment 'seg' which was not yet
+ * loaded. Private pages are mapped read-only and copy-on-write.
+ */
+static void fillPage(Segment *seg, PTe *pte, uint64_t frame)
+{
+	pte->framePhysAddr = frame;
+	pte->gx_shared = !!(seg->flags & MAP_SHARED);
+	pte->gx_cow = 0;
+	if (seg->flags & MAP_PRIVATE)
+	{
+		pte->gx_cow = 1;
+		pte->rw = 0;
+	}
+	else if (pte->gx_w)
+	{
+		pte->rw = 1;
+	};
+	
+	if (!pte->gx_x) pte->xd = 1;
+	if (pte->gx_r) pte->present = 1;
+	pte->user = 1;
+	pte->gx_loaded = 1;
+};
+
+/**
+ * Map the pages of the file mapping 'seg' (which starts at 'pos') surrounding 'addr' which are already in the
+ * page cache, so that touching them later does not require a fault. Only the aligned block of VM_FAULT_AROUND
+ * pages containing 'addr' is considered, so all the pages share a page table. Nothing is read from disk here.
+ */
+static void faultAround(Segment *seg, uint64_t pos, uint64_t addr)
+{
+	uint64_t start = addr & ~((VM_FAULT_AROUND << 12) - 1);
+	uint64_t end = start + (VM_FAULT_AROUND << 12);
+	uint64_t segEnd = pos + (seg->numPages << 12);
 	
-	PDPTe *pdpte = (PDPTe*) (((addr >> 27) | 0xffffffffffe00000UL) & ~0x7);
-	if (!pdpte->present)
+	if (start < pos) start = pos;
+	if (end > segEnd) end = segEnd;
+	
+	uint64_t frames[VM_FAULT_AROUND];
+	int count = (int) ((end - start) >> 12);
+	if (ftGetCachedPages(seg->ft, seg->offset + (start - pos), count, frames) == 0)
 	{
-		if (make)
-		{
-			pdpte->pdPhysAddr = phmAllocZeroFrame();
-			pdpte->user = 1;
-			pdpte->rw = 1;
-			pdpte->present = 1;
-			refreshAddrSpace();
-		}
-		else
-		{
-			return NULL;
-		};
+		return;
 	};
 	
-	PDe *pde = (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
-	if (!pde->present)
+	int i;
+	for (i=0; i<count; i++)
 	{
-		if (make)
+		uint64_t frame = frames[i];
+		if (frame == 0) continue;
+		
+		PTe *pte = getPage(start + ((uint64_t) i << 12), 1);
+		setDefaultPerms(seg, pte);
+		
+		if (pte->gx_loaded || pte->gx_swap || !pte->gx_r)
 		{
-			pde->ptPhysAddr = phmAllocZeroFrame();
-			pde->user = 1;
-			pde->rw = 1;
-			pde->present = 1;
-			refreshAddrSpace();
+			piDecref(frame);
 		}
 		else
 		{
-			return NULL;
+			// the entry was not present, so there is nothing to invalidate
+			fillPage(seg, pte, frame);
 		};
 	};
-	
-	return (PTe*) (((addr >> 9) | 0xffffff8000000000UL) & ~0x7);
 };
 
 static void invalidatePage(uint64_t addr)
 {
-	// TODO: inter-CPU TLB flush
-	invlpg((void*)addr);
+	vmShootdown(addr & ~0xFFFUL, 1);
 };
 
 static void unmapArea(uint64_t base, uint64_t size)
 {
+	// first unmap everything, then shoot down the whole range at once, and only then release the
+	// frames, since other CPUs may be using them until they are told otherwise
 	uint64_t pos;
 	for (pos=base; pos<(base+size); pos+=0x1000)
 	{
+		// release whole huge pages without splitting them
+		if ((pos & (VM_HUGE_SIZE-1)) == 0 && (pos + VM_HUGE_SIZE) <= (base+size))
+		{
+			PDPTe *pdpte = (PDPTe*) (((pos >> 27) | 0xffffffffffe00000UL) & ~0x7);
+			PDe *pde = (PDe*) (((pos >> 18) | 0xffffffffc0000000UL) & ~0x7);
+			if (pdpte->present && pde->ps)
+			{
+				pde->present = 0;
+				pos += VM_HUGE_SIZE - 0x1000;
+				continue;
+			};
+		};
+		
+		PTe *pte = getPage(pos, 0);
+		if (pte != NULL)
+		{
+			pte->present = 0;
+		};
+	};
+	
+	vmShootdown(base, size >> 12);
+	
+	for (pos=base; pos<(base+size); pos+=0x1000)
+	{
+		if ((pos & (VM_HUGE_SIZE-1)) == 0 && (pos + VM_HUGE_SIZE) <= (base+size))
+		{
+			PDPTe *pdpte = (PDPTe*) (((pos >> 27) | 0xffffffffffe00000UL) & ~0x7);
+			PDe *pde = (PDe*) (((pos >> 18) | 0xffffffffc0000000UL) & ~0x7);
+			if (pdpte->present && pde->ps)
+			{
+				uint64_t frame = pde->ptPhysAddr;
+				*((uint64_t*)pde) = 0;
+				phmFreeHuge(frame);
+				
+				pos += VM_HUGE_SIZE - 0x1000;
+				continue;
+			};
+		};
+		
 		PTe *pte = getPage(pos, 0);
 		if (pte != NULL)
 		{
 			if (pte->gx_loaded)
 			{
-				pte->present = 0;
 				pte->gx_loaded = 0;
-				invalidatePage(pos);
 				if (pte->accessed) piMarkAccessed(pte->framePhysAddr);
 				if (pte->dirty) piMarkDirty(pte->framePhysAddr);
 				piDecref(pte->framePhysAddr);
 				*((uint64_t*)pte) = 0;
+			}
+			else if (pte->gx_swap)
+			{
+				swapFree(pte->framePhysAddr);
+				*((uint64_t*)pte) = 0;
 			};
 		};
 	};
 };
 
+void vmInit()
+{
+	mutexInit(&vmShootLock);
+	semInit(&vmListLock);
+	vmList = NULL;
+	vmSwapCursor = NULL;
+	vmCount = 0;
+};
+
+static void vmListAdd(ProcMem *pm)
+{
+	semWait(&vmListLock);
+	pm->listPrev = NULL;
+	pm->listNext = vmList;
+	if (vmList != NULL) vmList->listPrev = pm;
+	vmList = pm;
+	vmCount++;
+	semSignal(&vmListLock);
+};
+
+static void vmListRemove(ProcMem *pm)
+{
+	semWait(&vmListLock);
+	if (vmSwapCursor == pm) vmSwapCursor = pm->listPrev;
+	if (pm->listPrev != NULL) pm->listPrev->listNext = pm->listNext;
+	else vmList = pm->listNext;
+	if (pm->listNext != NULL) pm->listNext->listPrev = pm->listPrev;
+	vmCount--;
+	semSignal(&vmListLock);
+};
+
+/**
+ * Return the address space after 'pm' in the list (or the first one if 'pm' is NULL), with a new reference
+ * taken to it, skipping any which are already being deleted. Returns NULL at the end of the list. Call with
+ * the list lock held.
+ */
+static ProcMem* vmListNext(ProcMem *pm)
+{
+	for (pm=(pm == NULL ? vmList : pm->listNext); pm!=NULL; pm=pm->listNext)
+	{
+		int refcount = pm->refcount;
+		while (refcount != 0)
+		{
+			int old = __sync_val_compare_and_swap(&pm->refcount, refcount, refcount+1);
+			if (old == refcount) return pm;
+			refcount = old;
+		};
+	};
+	
+	return NULL;
+};
+
 int vmNew()
 {
 	Thread *ct = getCurrentThread();
 	ProcMem *oldPM = ct->pm;
 	ct->pm = NULL;
-	
-	PML4 *pml4 = getPML4();
-	pml4->entries[0].present = 0;
-	pml4->entries[0].pdptPhysAddr = 0;
+	vmUnload();
 	
 	if (oldPM != NULL)
 	{
@@ -128,7 +879,8 @@ int vmNew()
 		return -1;
 	};
 	
-	semInit(&pm->lock);
+	rwInit(&pm->lock);
+	semInit(&pm->ptLock);
 	
 	// create the initial blank segment
 	Segment *seg = NEW(Segment);
@@ -145,17 +897,16 @@ int vmNew()
 	seg->prot = 0;
 	
 	pm->segs = seg;
+	pm->index = NULL;
+	segAdd(pm, seg, 0);
 	pm->refcount = 1;
 	pm->phys = phmAllocZeroFrame();
+	pm->id = __sync_add_and_fetch(&vmNextID, 1);
+	pm->cpuMask = 0;
+	vmListAdd(pm);
 	
 	ct->pm = pm;
-	
-	pml4->entries[0].pdptPhysAddr = pm->phys;
-	pml4->entries[0].user = 1;
-	pml4->entries[0].rw = 1;
-	pml4->entries[0].present = 1;
-	
-	refreshAddrSpace();
+	vmSwitch(pm);
 	return 0;
 };
 
@@ -274,7 +1025,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 	{
 		// find an available mapping at the highest possible address
 		ProcMem *pm = getCurrentThread()->pm;
-		semWait(&pm->lock);
+		rwLockWrite(&pm->lock);
 		
 		// get the last segment
 		Segment *seg = pm->segs;
@@ -287,7 +1038,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 		{
 			if (seg->prev == NULL)
 			{
-				semSignal(&pm->lock);
+				rwUnlockWrite(&pm->lock);
 				return ENOMEM;
 			};
 			
@@ -299,7 +1050,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 		{
 			if (pos < ADDR_MIN)
 			{
-				semSignal(&pm->lock);
+				rwUnlockWrite(&pm->lock);
 				return ENOMEM;
 			};
 			
@@ -318,7 +1069,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			pos += ((seg->numPages - numPages) << 12);
 			if (pos < ADDR_MIN)
 			{
-				semSignal(&pm->lock);
+				rwUnlockWrite(&pm->lock);
 				return ENOMEM;
 			};
 			
@@ -345,9 +1096,10 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			newSeg->access = access;
 			
 			seg->numPages -= numPages;
+			segAdd(pm, newSeg, pos);
 		};
 		
-		semSignal(&pm->lock);
+		rwUnlockWrite(&pm->lock);
 		return pos;
 	}
 	else
@@ -369,22 +1121,10 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 		
 		// first find the segment which contains 'addr'.
 		ProcMem *pm = getCurrentThread()->pm;
-		semWait(&pm->lock);
-		
-		uint64_t pos = 0;
-		Segment *seg = pm->segs;
+		rwLockWrite(&pm->lock);
 		
-		while ((pos+(seg->numPages<<12)) <= addr)
-		{
-			if (seg->next == NULL)
-			{
-				semSignal(&pm->lock);
-				return ENOMEM;
-			};
-			
-			pos += (seg->numPages << 12);
-			seg = seg->next;
-		};
+		Segment *seg = segLookup(pm, addr);
+		uint64_t pos = seg->start;
 		
 		if ((pos == addr) && (seg->numPages == numPages))
 		{
@@ -430,6 +1170,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				newSeg->prev = seg;
 				seg->next = newSeg;
 				
+				segAdd(pm, newSeg, addr);
 				seg = newSeg;
 			};
 			
@@ -450,6 +1191,8 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				
 				newSeg->prev = seg;
 				seg->next = newSeg;
+				
+				segAdd(pm, newSeg, addr + (numPages << 12));
 			};
 			
 			// if too small, consume further segments until necessary space is found
@@ -473,10 +1216,14 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 					seg->next = next->next;
 					if (seg->next != NULL) seg->next->prev = seg;
 					
+					pm->index = segRemove(pm->index, next);
 					kfree(next);
 				}
 				else
 				{
+					// this does not change the order of segments, so the index
+					// remains valid
+					seg->next->start += pagesNeeded << 12;
 					seg->next->offset += pagesNeeded << 12;
 					seg->next->numPages -= pagesNeeded;
 					seg->numPages += pagesNeeded;
@@ -500,7 +1247,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			seg->access = access;
 		};
 		
-		semSignal(&pm->lock);
+		rwUnlockWrite(&pm->lock);
 		return addr;
 	};
 };
@@ -531,6 +1278,75 @@ static void invalidateBlocks(uint64_t frame)
 	setFlagsRegister(rflags);
 };
 
+void vmPopulate(uint64_t addr, size_t len)
+{
+	// this is rare enough that we just lock the whole address space rather than
+	// each segment in turn
+	ProcMem *pm = getCurrentThread()->pm;
+	rwLockWrite(&pm->lock);
+	
+	Segment *seg = segLookup(pm, addr);
+	uint64_t pos = seg->start;
+	
+	uint64_t end = addr + ((len + 0xFFF) & ~0xFFFUL);
+	while (addr < end)
+	{
+		while ((pos+(seg->numPages<<12)) <= addr)
+		{
+			pos += seg->numPages << 12;
+			seg = seg->next;
+		};
+		
+		if (seg->flags == 0)
+		{
+			addr += 0x1000;
+			continue;
+		};
+		
+		if (mapHuge(seg, pos, addr) == 0)
+		{
+			addr = (addr & ~(VM_HUGE_SIZE-1)) + VM_HUGE_SIZE;
+			continue;
+		};
+		
+		PTe *pte = getPage(addr, 1);
+		setDefaultPerms(seg, pte);
+		
+		if (pte->gx_swap)
+		{
+			if (swapInPage(seg, pos, addr, pte) != 0)
+			{
+				break;
+			};
+		};
+		
+		if (!pte->gx_loaded && pte->gx_r)
+		{
+			uint64_t frame;
+			if (seg->ft != NULL)
+			{
+				frame = ftGetPage(seg->ft, seg->offset + (addr - pos));
+			}
+			else
+			{
+				frame = piNew(0);
+			};
+			
+			if (frame == 0)
+			{
+				// leave the rest to be faulted in
+				break;
+			};
+			
+			fillPage(seg, pte, frame);
+		};
+		
+		addr += 0x1000;
+	};
+	
+	rwUnlockWrite(&pm->lock);
+};
+
 void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 {
 	if ((faultAddr < ADDR_MIN) || (faultAddr >= ADDR_MAX))
@@ -550,22 +1366,16 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 	};
 	
 	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
-	
-	// try finding the segment in question
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
+	rwLockRead(&pm->lock);
 	
-	while ((pos+(seg->numPages<<12)) <= faultAddr)
-	{
-		pos += seg->numPages << 12;
-		seg = seg->next;
-	};
+	// find the segment in question
+	Segment *seg = segLookup(pm, faultAddr);
+	uint64_t pos = seg->start;
 	
 	// if unmapped, send the SIGSEGV signal
 	if (seg->flags == 0)
 	{
-		semSignal(&pm->lock);
+		rwUnlockRead(&pm->lock);
 		throw(EX_PAGE_FAULT);
 		
 		siginfo_t si;
@@ -580,27 +1390,22 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 		switchTaskUnlocked(regs);
 	};
 	
-	// set permission if currently unset
-	PTe *pte = getPage(faultAddr, 1);
-	if (!pte->gx_perm_ovr)
+	// other faults in this segment must wait
+	semWait(&seg->lock);
+	
+	// anonymous memory is mapped in huge pages where possible; if the access is not actually allowed,
+	// we'll fault again, split the page, and deal with it below
+	if (mapHuge(seg, pos, faultAddr) == 0)
 	{
-		pte->gx_perm_ovr = 1;
-		if (seg->prot & PROT_READ)
-		{
-			pte->gx_r = 1;
-		};
-		
-		if (seg->prot & PROT_WRITE)
-		{
-			pte->gx_w = 1;
-		};
-		
-		if (seg->prot & PROT_EXEC)
-		{
-			pte->gx_x = 1;
-		};
+		semSignal(&seg->lock);
+		rwUnlockRead(&pm->lock);
+		return;
 	};
 	
+	// set permission if currently unset
+	PTe *pte = getPage(faultAddr, 1);
+	setDefaultPerms(seg, pte);
+	
 	// check permissions
 	int allowed = 1;
 	
@@ -627,7 +1432,8 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 	
 	if (!allowed)
 	{
-		semSignal(&pm->lock);
+		semSignal(&seg->lock);
+		rwUnlockRead(&pm->lock);
 		throw(EX_PAGE_FAULT);
 		
 		if ((regs->cs & 3) == 0)
@@ -647,6 +1453,27 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 		switchTaskUnlocked(regs);
 	};
 	
+	// if the page was written out to swap, read it back in
+	if (pte->gx_swap)
+	{
+		if (swapInPage(seg, pos, faultAddr, pte) != 0)
+		{
+			semSignal(&seg->lock);
+			rwUnlockRead(&pm->lock);
+			throw(EX_PAGE_FAULT);
+
+			siginfo_t si;
+			memset(&si, 0, sizeof(siginfo_t));
+			si.si_signo = SIGBUS;
+			si.si_code = BUS_OBJERR;
+	
+			cli();
+			lockSched();
+			sendSignal(getCurrentThread(), &si);
+			switchTaskUnlocked(regs);
+		};
+	};
+	
 	// if the page is not yet loaded, load it
 	if (!pte->gx_loaded)
 	{
@@ -657,7 +1484,8 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 			
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
 				throw(EX_PAGE_FAULT);
 
 				siginfo_t si;
@@ -671,14 +1499,15 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 				switchTaskUnlocked(regs);
 			};
 			
-			pte->framePhysAddr = frame;
+			fillPage(seg, pte, frame);
 		}
 		else
 		{
 			uint64_t frame = piNew(0);
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
 				throw(EX_PAGE_FAULT);
 
 				siginfo_t si;
@@ -692,29 +1521,18 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 				switchTaskUnlocked(regs);
 			};
 			
-			pte->framePhysAddr = frame;
-		};
-
-		pte->gx_shared = !!(seg->flags & MAP_SHARED);
-		pte->gx_cow = 0;
-		if (seg->flags & MAP_PRIVATE)
-		{
-			pte->gx_cow = 1;
-			pte->rw = 0;
-		}
-		else if (pte->gx_w)
-		{
-			pte->rw = 1;
+			fillPage(seg, pte, frame);
 		};
 		
-		if (!pte->gx_x) pte->xd = 1;
-		if (pte->gx_r) pte->present = 1;
-		pte->user = 1;
-		pte->gx_loaded = 1;
-		
 		// invalidate the page on the CURRENT CPU, in case we need copy-on-write
 		// below
 		invlpg((void*)faultAddr);
+		
+		// map in any neighbours which are already cached
+		if (seg->ft != NULL)
+		{
+			faultAround(seg, pos, faultAddr);
+		};
 	};
 	
 	// check for copy-on-write faults
@@ -727,7 +1545,8 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 				uint64_t frame = piNew(0);
 				if (frame == 0)
 				{
-					semSignal(&pm->lock);
+					semSignal(&seg->lock);
+					rwUnlockRead(&pm->lock);
 					throw(EX_PAGE_FAULT);
 
 					siginfo_t si;
@@ -743,8 +1562,10 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 			
 				frameWrite(frame, (void*)(faultAddr & ~0xFFF));
 			
+				// other CPUs must stop using the old frame before we drop it
 				uint64_t old = pte->framePhysAddr;
 				pte->framePhysAddr = frame;
+				invalidatePage(faultAddr);
 				piDecref(old);
 				
 				invalidateBlocks(old);
@@ -755,9 +1576,11 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 		};
 	};
 	
-	// finally we must invalidate the page
-	invalidatePage(faultAddr);
-	semSignal(&pm->lock);
+	// finally we must invalidate the page; other CPUs could only have cached a stricter entry,
+	// which at worst gives them a spurious fault that ends up here
+	invlpg((void*)faultAddr);
+	semSignal(&seg->lock);
+	rwUnlockRead(&pm->lock);
 };
 
 int vmProtect(uint64_t base, size_t len, int prot)
@@ -788,10 +1611,10 @@ int vmProtect(uint64_t base, size_t len, int prot)
 	};
 	
 	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
+	rwLockWrite(&pm->lock);
 	
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
+	Segment *seg = segLookup(pm, base);
+	uint64_t pos = seg->start;
 	
 	uint64_t addr;
 	for (addr=base; addr<(base+len); addr+=0x1000)
@@ -804,7 +1627,8 @@ int vmProtect(uint64_t base, size_t len, int prot)
 		
 		if (seg->flags == 0)
 		{
-			semSignal(&pm->lock);
+			vmShootdown(base, (addr - base) >> 12);
+			rwUnlockWrite(&pm->lock);
 			return ENOMEM;
 		};
 		
@@ -817,7 +1641,8 @@ int vmProtect(uint64_t base, size_t len, int prot)
 				if ((seg->access & O_WRONLY) == 0)
 				{
 					// not allowed, sorry
-					semSignal(&pm->lock);
+					vmShootdown(base, (addr - base) >> 12);
+					rwUnlockWrite(&pm->lock);
 					return EACCES;
 				};
 			};
@@ -847,10 +1672,11 @@ int vmProtect(uint64_t base, size_t len, int prot)
 				pte->xd = 1;
 			};
 		};
-		
-		invalidatePage(addr);
 	};
 	
+	// invalidate the whole range at once
+	vmShootdown(base, (addr - base) >> 12);
+	rwUnlockWrite(&pm->lock);
 	return 0;
 };
 
@@ -858,9 +1684,8 @@ void vmUnmapThread()
 {
 	ProcMem *pm = getCurrentThread()->pm;
 	
-	semWait(&pm->lock);
+	rwLockWrite(&pm->lock);
 	
-	uint64_t pos = 0;
 	Segment *seg = pm->segs;
 	
 	Thread *ct = getCurrentThread();
@@ -870,7 +1695,7 @@ void vmUnmapThread()
 		{
 			if (seg->creator == ct)
 			{
-				unmapArea(pos, seg->numPages << 12);
+				unmapArea(seg->start, seg->numPages << 12);
 				if (seg->ft != NULL)
 				{
 					ftDown(seg->ft);
@@ -890,6 +1715,7 @@ void vmUnmapThread()
 						seg->prev->numPages += seg->numPages;
 						
 						Segment *prev = seg->prev;
+						pm->index = segRemove(pm->index, seg);
 						kfree(seg);
 						seg = prev;
 					};
@@ -902,6 +1728,7 @@ void vmUnmapThread()
 						seg->numPages += seg->next->numPages;
 						
 						Segment *next = seg->next->next;
+						pm->index = segRemove(pm->index, seg->next);
 						kfree(seg->next);
 						seg->next = next;
 						if (next != NULL) next->prev = seg;
@@ -910,36 +1737,10 @@ void vmUnmapThread()
 			};
 		};
 		
-		pos += seg->numPages << 12;
 		seg = seg->next;
 	};
 	
-	semSignal(&pm->lock);
-};
-
-static uint64_t clonePT(PT *pt)
-{
-	uint64_t frame = phmAllocFrame();
-	
-	int i;
-	for (i=0; i<512; i++)
-	{
-		PTe *pte = &pt->entries[i];
-		
-		if (pte->gx_loaded)
-		{
-			if (!pte->gx_shared)
-			{
-				pte->rw = 0;
-				pte->gx_cow = 1;
-			};
-			
-			piIncref(pte->framePhysAddr);
-		};
-	};
-	
-	frameWrite(frame, pt);
-	return frame;
+	rwUnlockWrite(&pm->lock);
 };
 
 static uint64_t clonePD(PD *pd)
@@ -952,14 +1753,26 @@ static uint64_t clonePD(PD *pd)
 	int i;
 	for (i=0; i<512; i++)
 	{
-		if (pd->entries[i].present)
+		PDe *pde = &pd->entries[i];
+		if (pde->present)
 		{
-			copy.entries[i].rw = 1;
-			copy.entries[i].user = 1;
-			copy.entries[i].present = 1;
+			if (pde->ps)
+			{
+				// huge pages cannot be copied-on-write as a whole
+				splitHuge(pde);
+			};
+			
+			// instead of copying the page table, both address spaces use it read-only
+			// until one of them needs to change it (see unsharePT())
+			if (!pde->gx_ptcow)
+			{
+				piAdopt(pde->ptPhysAddr, 0);
+				pde->rw = 0;
+				pde->gx_ptcow = 1;
+			};
 			
-			uint64_t ptAddr = ((uint64_t)&pd->entries[i]) << 9;
-			copy.entries[i].ptPhysAddr = clonePT((PT*) ptAddr);
+			piIncref(pde->ptPhysAddr);
+			memcpy(&copy.entries[i], pde, sizeof(PDe));
 		};
 	};
 	
@@ -997,8 +1810,10 @@ ProcMem* vmClone()
 	ProcMem *pm = getCurrentThread()->pm;
 	ProcMem *newPM = NEW(ProcMem);
 	
-	semInit(&newPM->lock);
-	if (pm != NULL) semWait(&pm->lock);
+	rwInit(&newPM->lock);
+	semInit(&newPM->ptLock);
+	newPM->index = NULL;
+	if (pm != NULL) rwLockWrite(&pm->lock);
 	
 	Segment *lastSeg = NULL;
 	
@@ -1032,7 +1847,8 @@ ProcMem* vmClone()
 				newSeg->next = NULL;
 				lastSeg->next = newSeg;
 			};
-		
+			
+			segAdd(newPM, newSeg, seg->start);
 			lastSeg = newSeg;
 		};
 	}
@@ -1046,14 +1862,26 @@ ProcMem* vmClone()
 		seg->prot = 0;
 	
 		newPM->segs = seg;
+		segAdd(newPM, seg, 0);
 	};
 	
 	newPM->refcount = 1;
-	if (pm != NULL) newPM->phys = clonePDPT((PDPT*) 0xFFFFFFFFFFE00000);	/* first PDPT */
-	else newPM->phys = phmAllocZeroFrame();
-	refreshAddrSpace();
+	newPM->id = __sync_add_and_fetch(&vmNextID, 1);
+	newPM->cpuMask = 0;
+	if (pm != NULL)
+	{
+		// our page directories are now read-only, which other CPUs running us must see
+		// before we let go of the lock
+		newPM->phys = clonePDPT((PDPT*) 0xFFFFFFFFFFE00000);	/* first PDPT */
+		vmShootdown(0, 0);
+	}
+	else
+	{
+		newPM->phys = phmAllocZeroFrame();
+	};
 	
-	if (pm != NULL) semSignal(&pm->lock);
+	if (pm != NULL) rwUnlockWrite(&pm->lock);
+	vmListAdd(newPM);
 	return newPM;
 };
 
@@ -1062,11 +1890,20 @@ void vmUp(ProcMem *pm)
 	__sync_fetch_and_add(&pm->refcount, 1);
 };
 
-void deletePT(uint64_t frame)
+void deletePT(uint64_t frame, int shared)
 {
 	PT pt;
 	frameRead(frame, &pt);
-	phmFreeFrame(frame);
+	
+	if (shared)
+	{
+		// other address spaces may still be using it
+		if (piDecref(frame) != 0) return;
+	}
+	else
+	{
+		phmFreeFrame(frame);
+	};
 	
 	int i;
 	for (i=0; i<512; i++)
@@ -1076,6 +1913,10 @@ void deletePT(uint64_t frame)
 			if (pt.entries[i].dirty) piMarkDirty(pt.entries[i].framePhysAddr);
 			if (pt.entries[i].accessed) piMarkAccessed(pt.entries[i].framePhysAddr);
 			piDecref(pt.entries[i].framePhysAddr);
+		}
+		else if (pt.entries[i].gx_swap)
+		{
+			swapFree(pt.entries[i].framePhysAddr);
 		};
 	};
 };
@@ -1089,9 +1930,13 @@ void deletePD(uint64_t frame)
 	int i;
 	for (i=0; i<512; i++)
 	{
-		if (pd.entries[i].present)
+		if (pd.entries[i].ps)
+		{
+			phmFreeHuge(pd.entries[i].ptPhysAddr);
+		}
+		else if (pd.entries[i].present)
 		{
-			deletePT(pd.entries[i].ptPhysAddr);
+			deletePT(pd.entries[i].ptPhysAddr, pd.entries[i].gx_ptcow);
 		};
 	};
 };
@@ -1116,6 +1961,7 @@ void vmDown(ProcMem *pm)
 {
 	if (__sync_add_and_fetch(&pm->refcount, -1) == 0)
 	{
+		vmListRemove(pm);
 		deletePDPT(pm->phys);
 		
 		Segment *seg = pm->segs;
@@ -1127,17 +1973,70 @@ void vmDown(ProcMem *pm)
 			seg = next;
 		};
 	};
-};
-
-void vmSwitch(ProcMem *pm)
-{
-	PML4 *pml4 = getPML4();
-	pml4->entries[0].pdptPhysAddr = pm->phys;
-	pml4->entries[0].user = 1;
-	pml4->entries[0].rw = 1;
-	pml4->entries[0].present = 1;
+};
+
+void vmSwitch(ProcMem *pm)
+{
+	uint64_t rflags = getFlagsRegister();
+	cli();
+	
+	if (cpuActiveID == pm->id)
+	{
+		// already loaded (we only ran kernel threads since)
+		setFlagsRegister(rflags);
+		return;
+	};
+	
+	// shootdowns are sent to us from now on; any earlier changes are already in the tables we are
+	// about to walk
+	uint32_t myBit = 1U << getCurrentCPU()->id;
+	if ((pm->cpuMask & myBit) == 0)
+	{
+		__sync_fetch_and_or(&pm->cpuMask, myBit);
+	};
+	
+	PML4 *pml4 = getPML4();
+	if (vmUsePCID)
+	{
+		// if we still have a PCID for this address space, its entries are up to date
+		uint64_t flush = 0;
+		int slot;
+		for (slot=0; slot<VM_PCID_SLOTS; slot++)
+		{
+			if (pcidOwner[slot] == pm->id) break;
+		};
+		
+		if (slot == VM_PCID_SLOTS)
+		{
+			// take over the next PCID in turn; what it had cached is flushed as we load it
+			slot = pcidNext;
+			pcidNext = (pcidNext + 1) % VM_PCID_SLOTS;
+			pcidOwner[slot] = pm->id;
+			flush = 1;
+		};
+		
+		// change the PML4 entry under PCID 0, so that no other PCID caches translations
+		// through the wrong tables
+		setCR3(cpuPML4Phys | CR3_NOFLUSH);
+		pml4->entries[0].pdptPhysAddr = pm->phys;
+		pml4->entries[0].user = 1;
+		pml4->entries[0].rw = 1;
+		pml4->entries[0].present = 1;
+		
+		cpuActivePCID = slot + 1;
+		setCR3(cpuPML4Phys | cpuActivePCID | (flush ? 0 : CR3_NOFLUSH));
+	}
+	else
+	{
+		pml4->entries[0].pdptPhysAddr = pm->phys;
+		pml4->entries[0].user = 1;
+		pml4->entries[0].rw = 1;
+		pml4->entries[0].present = 1;
+		setCR3(cpuPML4Phys);
+	};
 	
-	refreshAddrSpace();
+	cpuActiveID = pm->id;
+	setFlagsRegister(rflags);
 };
 
 void vmDump(ProcMem *pm, uint64_t addr)
@@ -1182,44 +2081,23 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 	};
 	
 	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
-	
-	// try finding the segment in question
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
+	rwLockRead(&pm->lock);
 	
-	while ((pos+(seg->numPages<<12)) <= faultAddr)
-	{
-		pos += seg->numPages << 12;
-		seg = seg->next;
-	};
+	// find the segment in question
+	Segment *seg = segLookup(pm, faultAddr);
+	uint64_t pos = seg->start;
 	
 	if (seg->flags == 0)
 	{
-		semSignal(&pm->lock);
+		rwUnlockRead(&pm->lock);
 		return 0;
 	};
 	
+	semWait(&seg->lock);
+	
 	// set permission if currently unset
 	PTe *pte = getPage(faultAddr, 1);
-	if (!pte->gx_perm_ovr)
-	{
-		pte->gx_perm_ovr = 1;
-		if (seg->prot & PROT_READ)
-		{
-			pte->gx_r = 1;
-		};
-		
-		if (seg->prot & PROT_WRITE)
-		{
-			pte->gx_w = 1;
-		};
-		
-		if (seg->prot & PROT_EXEC)
-		{
-			pte->gx_x = 1;
-		};
-	};
+	setDefaultPerms(seg, pte);
 	
 	// check permissions
 	int allowed = 1;
@@ -1247,10 +2125,22 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 	
 	if (!allowed)
 	{
-		semSignal(&pm->lock);
+		semSignal(&seg->lock);
+		rwUnlockRead(&pm->lock);
 		return 0;
 	};
 	
+	// if the page was written out to swap, read it back in
+	if (pte->gx_swap)
+	{
+		if (swapInPage(seg, pos, faultAddr, pte) != 0)
+		{
+			semSignal(&seg->lock);
+			rwUnlockRead(&pm->lock);
+			return 0;
+		};
+	};
+	
 	// if the page is not yet loaded, load it
 	if (!pte->gx_loaded)
 	{
@@ -1261,41 +2151,26 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 			
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
 				return 0;
 			};
 			
-			pte->framePhysAddr = frame;
+			fillPage(seg, pte, frame);
 		}
 		else
 		{
 			uint64_t frame = piNew(0);
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
 				return 0;
 			};
 			
-			pte->framePhysAddr = frame;
-		};
-
-		pte->gx_shared = !!(seg->flags & MAP_SHARED);
-		pte->gx_cow = 0;
-		if (seg->flags & MAP_PRIVATE)
-		{
-			pte->gx_cow = 1;
-			pte->rw = 0;
-		}
-		else if (pte->gx_w)
-		{
-			pte->rw = 1;
+			fillPage(seg, pte, frame);
 		};
 		
-		if (!pte->gx_x) pte->xd = 1;
-		if (pte->gx_r) pte->present = 1;
-		pte->user = 1;
-		pte->gx_loaded = 1;
-		
 		// invalidate the page on the CURRENT CPU, in case we need copy-on-write
 		// below
 		invlpg((void*)faultAddr);
@@ -1309,7 +2184,8 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 			uint64_t frame = piNew(0);
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
 				return 0;
 			};
 		
@@ -1317,6 +2193,7 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 		
 			uint64_t old = pte->framePhysAddr;
 			pte->framePhysAddr = frame;
+			invalidatePage(faultAddr);
 			piDecref(old);
 		};
 		
@@ -1324,11 +2201,473 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 		pte->rw = 1;
 	};
 	
-	// finally we must invalidate the page
-	invalidatePage(faultAddr);
+	// finally we must invalidate the page (see vmFault())
+	invlpg((void*)faultAddr);
 	uint64_t result = pte->framePhysAddr;
 	piIncref(result);
-	semSignal(&pm->lock);
+	semSignal(&seg->lock);
+	rwUnlockRead(&pm->lock);
 	
 	return result;
 };
+
+int vmPinUser(const void *buffer, size_t size, int requiredPerms, uint64_t *frames)
+{
+	if (size == 0)
+	{
+		rwLockRead(&getCurrentThread()->pm->lock);
+		return 0;
+	};
+	
+	uint64_t start = (uint64_t) buffer & ~0xFFFUL;
+	uint64_t end = ((uint64_t) buffer + size + 0xFFF) & ~0xFFFUL;
+	if (end <= start || (uint64_t) buffer < ADDR_MIN || end > ADDR_MAX)
+	{
+		return EFAULT;
+	};
+	
+	uint64_t numPages = (end - start) >> 12;
+	uint64_t i;
+	for (i=0; i<numPages; i++)
+	{
+		frames[i] = vmGetPhys(start + (i << 12), requiredPerms);
+		if (frames[i] == 0)
+		{
+			while (i--) piDecref(frames[i]);
+			return EFAULT;
+		};
+	};
+	
+	// the buffer might have been unmapped or remapped between faulting in a page and taking the
+	// lock; once we hold it, nothing can change the mappings until vmUnpinUser()
+	ProcMem *pm = getCurrentThread()->pm;
+	rwLockRead(&pm->lock);
+	
+	for (i=0; i<numPages; i++)
+	{
+		PTe *pte = peekPage(start + (i << 12));
+		if (pte == NULL || !pte->present || pte->framePhysAddr != frames[i]
+			|| ((requiredPerms & PROT_WRITE) && !pte->rw))
+		{
+			break;
+		};
+	};
+	
+	if (i != numPages)
+	{
+		rwUnlockRead(&pm->lock);
+		for (i=0; i<numPages; i++) piDecref(frames[i]);
+		return EFAULT;
+	};
+	
+	return 0;
+};
+
+void vmUnpinUser(const void *buffer, size_t size, uint64_t *frames)
+{
+	rwUnlockRead(&getCurrentThread()->pm->lock);
+	
+	if (size == 0) return;
+	uint64_t start = (uint64_t) buffer & ~0xFFFUL;
+	uint64_t end = ((uint64_t) buffer + size + 0xFFF) & ~0xFFFUL;
+	
+	uint64_t i;
+	for (i=0; i<((end - start) >> 12); i++)
+	{
+		piDecref(frames[i]);
+	};
+};
+
+/**
+ * Make the calling kernel thread use the address space 'pm', so that its pages can be reached through the
+ * recursive mapping. Returns the address space the thread was using before, to pass to vmReturn().
+ */
+static ProcMem* vmBorrow(ProcMem *pm)
+{
+	Thread *ct = getCurrentThread();
+	ProcMem *old = ct->pm;
+	
+	// the scheduler switches to 'ct->pm' whenever we are resumed, so set it first
+	ct->pm = pm;
+	vmSwitch(pm);
+	return old;
+};
+
+static void vmReturn(ProcMem *old)
+{
+	Thread *ct = getCurrentThread();
+	ct->pm = old;
+	
+	if (old != NULL)
+	{
+		vmSwitch(old);
+	}
+	else
+	{
+		// the borrowed address space may go away once we drop our reference
+		vmUnload();
+	};
+};
+
+/**
+ * Return the entry of a page in the current address space, without creating or unsharing anything. Returns
+ * NULL if the page has no page table, is part of a huge page, or is in a page table shared after a fork.
+ */
+static PTe* peekPage(uint64_t addr)
+{
+	PDPTe *pdpte = (PDPTe*) (((addr >> 27) | 0xffffffffffe00000UL) & ~0x7);
+	if (!pdpte->present)
+	{
+		return NULL;
+	};
+	
+	PDe *pde = (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
+	if (!pde->present || pde->ps || pde->gx_ptcow)
+	{
+		return NULL;
+	};
+	
+	return (PTe*) (((addr >> 9) | 0xffffff8000000000UL) & ~0x7);
+};
+
+/**
+ * Returns nonzero if the page is private to this address space, so that it may be written out to swap.
+ */
+static int canSwapOut(PTe *pte)
+{
+	if (!pte->gx_loaded || pte->gx_shared)
+	{
+		return 0;
+	};
+	
+	// exactly one reference (ours), and not part of the page cache
+	return (piGetInfo(pte->framePhysAddr) & (0xFFFFFFFFUL | PI_CACHE)) == 1;
+};
+
+/**
+ * Write the 'count' consecutive pages starting at 'addr' (whose entries start at 'pte') out to swap, and free
+ * their frames. Call with the segment lock held. Returns the number of pages written out (which may be less
+ * than 'count' if swap space is fragmented), or 0 if none could be.
+ */
+static int swapOutRun(uint64_t addr, PTe *pte, int count)
+{
+	uint64_t entry = swapAlloc(&count);
+	if (entry == 0)
+	{
+		return 0;
+	};
+	
+	// unmap the pages first, so that they are not modified while being written out; a thread trying
+	// to access them waits for the segment lock in vmFault()
+	uint64_t frames[SWAP_CLUSTER];
+	int i;
+	for (i=0; i<count; i++)
+	{
+		frames[i] = pte[i].framePhysAddr;
+		pte[i].present = 0;
+	};
+	
+	vmShootdown(addr, count);
+	
+	if (swapWrite(entry, count, frames) != 0)
+	{
+		for (i=0; i<count; i++)
+		{
+			pte[i].present = pte[i].gx_r;
+			swapFree(entry + i);
+		};
+		
+		return 0;
+	};
+	
+	for (i=0; i<count; i++)
+	{
+		PTe swapped;
+		memset(&swapped, 0, sizeof(PTe));
+		swapped.gx_r = pte[i].gx_r;
+		swapped.gx_w = pte[i].gx_w;
+		swapped.gx_x = pte[i].gx_x;
+		swapped.gx_perm_ovr = pte[i].gx_perm_ovr;
+		swapped.gx_swap = 1;
+		swapped.framePhysAddr = entry + i;
+		*((volatile uint64_t*)&pte[i]) = *((uint64_t*)&swapped);
+		
+		piDecref(frames[i]);
+	};
+	
+	return count;
+};
+
+/**
+ * Write up to 'target' pages of the current address space out to swap. Pages accessed since the last visit
+ * get a second chance: their accessed bit is cleared, and they are written out on the next visit if they are
+ * still not touched by then. Returns the number of frames freed.
+ */
+static int swapOutSpace(ProcMem *pm, int target)
+{
+	if (rwTryLockRead(&pm->lock) != 0)
+	{
+		return 0;
+	};
+	
+	int freed = 0;
+	Segment *seg;
+	for (seg=pm->segs; seg!=NULL && freed<target; seg=seg->next)
+	{
+		if ((seg->flags & MAP_PRIVATE) == 0)
+		{
+			continue;
+		};
+		
+		// don't wait for threads faulting in this segment
+		if (semWaitGen(&seg->lock, 1, SEM_W_NONBLOCK, 0) != 1)
+		{
+			continue;
+		};
+		
+		uint64_t addr = seg->start;
+		uint64_t end = seg->start + (seg->numPages << 12);
+		while (addr < end && freed < target)
+		{
+			PTe *pte = peekPage(addr);
+			if (pte == NULL)
+			{
+				addr = (addr & ~(VM_HUGE_SIZE-1)) + VM_HUGE_SIZE;
+				continue;
+			};
+			
+			if (!canSwapOut(pte))
+			{
+				addr += 0x1000;
+				continue;
+			};
+			
+			if (pte->accessed)
+			{
+				// other CPUs may not set the bit again while they have the entry cached,
+				// which only makes the page look older than it is
+				pte->accessed = 0;
+				invlpg((void*)addr);
+				addr += 0x1000;
+				continue;
+			};
+			
+			// collect a run of pages to write out together, within the aligned cluster (and
+			// therefore within this page table)
+			uint64_t clusterEnd = (addr & ~((SWAP_CLUSTER << 12) - 1)) + (SWAP_CLUSTER << 12);
+			if (clusterEnd > end) clusterEnd = end;
+			
+			int count = 1;
+			while ((addr + ((uint64_t) count << 12)) < clusterEnd && count < (target - freed))
+			{
+				if (!canSwapOut(&pte[count]) || pte[count].accessed) break;
+				count++;
+			};
+			
+			int written = swapOutRun(addr, pte, count);
+			if (written == 0)
+			{
+				// swap is full or failing; nothing more to do here
+				semSignal(&seg->lock);
+				rwUnlockRead(&pm->lock);
+				return freed;
+			};
+			
+			freed += written;
+			addr += (uint64_t) written << 12;
+		};
+		
+		semSignal(&seg->lock);
+	};
+	
+	rwUnlockRead(&pm->lock);
+	return freed;
+};
+
+int vmSwapOut(int target)
+{
+	int freed = 0;
+	
+	// each address space is visited at most twice, so that pages given a second chance on the first
+	// visit may be written out on the next
+	semWait(&vmListLock);
+	int visits = 2 * vmCount;
+	ProcMem *pm = vmListNext(vmSwapCursor);
+	
+	while (freed < target && visits-- > 0)
+	{
+		if (pm == NULL)
+		{
+			// wrap around
+			pm = vmListNext(NULL);
+			if (pm == NULL) break;
+		};
+		
+		vmSwapCursor = pm;
+		semSignal(&vmListLock);
+		
+		ProcMem *old = vmBorrow(pm);
+		freed += swapOutSpace(pm, target - freed);
+		vmReturn(old);
+		
+		semWait(&vmListLock);
+		ProcMem *next = vmListNext(pm);
+		
+		// dropping the reference may remove 'pm' from the list, which takes the lock
+		semSignal(&vmListLock);
+		vmDown(pm);
+		semWait(&vmListLock);
+		
+		pm = next;
+	};
+	
+	semSignal(&vmListLock);
+	if (pm != NULL) vmDown(pm);
+	return freed;
+};
+
+/**
+ * Read the page at 'addr' in the segment 'seg' (which starts at 'pos'), whose entry is 'pte' and refers to a
+ * swap slot, back into memory, along with any neighbours in the same cluster which were written out next to it.
+ * Call with the segment lock held, and the page table unshared. Returns 0 on success, or -1 if the page could
+ * not be read.
+ */
+static int swapInPage(Segment *seg, uint64_t pos, uint64_t addr, PTe *pte)
+{
+	addr &= ~0xFFFUL;
+	uint64_t entry = pte->framePhysAddr;
+	
+	uint64_t clusterStart = addr & ~((SWAP_CLUSTER << 12) - 1);
+	uint64_t clusterEnd = clusterStart + (SWAP_CLUSTER << 12);
+	uint64_t segEnd = pos + (seg->numPages << 12);
+	if (clusterStart < pos) clusterStart = pos;
+	if (clusterEnd > segEnd) clusterEnd = segEnd;
+	
+	// extend the run to the neighbours which are in consecutive slots
+	int first = 0;
+	while ((addr - ((uint64_t) (first+1) << 12)) >= clusterStart)
+	{
+		PTe *prev = pte - (first+1);
+		if (!prev->gx_swap || prev->framePhysAddr != entry - (first+1)) break;
+		first++;
+	};
+	
+	int count = first + 1;
+	while ((addr + ((uint64_t) (count-first) << 12)) < clusterEnd)
+	{
+		PTe *next = pte + (count-first);
+		if (!next->gx_swap || next->framePhysAddr != entry + (count-first)) break;
+		count++;
+	};
+	
+	PTe *base = pte - first;
+	entry -= first;
+	
+	uint64_t frames[SWAP_CLUSTER];
+	int i;
+	for (i=0; i<count; i++)
+	{
+		frames[i] = phmAllocFrame();
+		piAdopt(frames[i], 0);
+	};
+	
+	if (swapRead(entry, count, frames) != 0)
+	{
+		for (i=0; i<count; i++)
+		{
+			piDecref(frames[i]);
+		};
+		
+		return -1;
+	};
+	
+	// the entries are not present, so there is nothing to invalidate
+	for (i=0; i<count; i++)
+	{
+		PTe *ent = &base[i];
+		swapFree(entry + i);
+		
+		ent->gx_swap = 0;
+		ent->gx_shared = 0;
+		ent->gx_cow = 0;
+		ent->framePhysAddr = frames[i];
+		ent->rw = ent->gx_w;
+		ent->xd = !ent->gx_x;
+		ent->user = 1;
+		ent->gx_loaded = 1;
+		__sync_synchronize();
+		ent->present = ent->gx_r;
+	};
+	
+	return 0;
+};
+
+/**
+ * Read every page of the current address space which is in swap area 'area' back into memory.
+ */
+static void swapInSpace(ProcMem *pm, int area)
+{
+	rwLockWrite(&pm->lock);
+	
+	Segment *seg;
+	for (seg=pm->segs; seg!=NULL; seg=seg->next)
+	{
+		if (seg->flags == 0)
+		{
+			continue;
+		};
+		
+		uint64_t addr = seg->start;
+		uint64_t end = seg->start + (seg->numPages << 12);
+		while (addr < end)
+		{
+			PDPTe *pdpte = (PDPTe*) (((addr >> 27) | 0xffffffffffe00000UL) & ~0x7);
+			PDe *pde = (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
+			if (!pdpte->present || !pde->present || pde->ps)
+			{
+				addr = (addr & ~(VM_HUGE_SIZE-1)) + VM_HUGE_SIZE;
+				continue;
+			};
+			
+			PTe *pte = (PTe*) (((addr >> 9) | 0xffffff8000000000UL) & ~0x7);
+			if (pte->gx_swap && SWAP_AREA(pte->framePhysAddr) == area)
+			{
+				// the page table may be shared after a fork, so get our own copy first
+				pte = getPage(addr, 1);
+				if (pte->gx_swap)
+				{
+					swapInPage(seg, seg->start, addr, pte);
+				};
+			};
+			
+			addr += 0x1000;
+		};
+	};
+	
+	rwUnlockWrite(&pm->lock);
+};
+
+void vmSwapOff(int area)
+{
+	semWait(&vmListLock);
+	ProcMem *pm = vmListNext(NULL);
+	
+	while (pm != NULL)
+	{
+		semSignal(&vmListLock);
+		
+		ProcMem *old = vmBorrow(pm);
+		swapInSpace(pm, area);
+		vmReturn(old);
+		
+		semWait(&vmListLock);
+		ProcMem *next = vmListNext(pm);
+		semSignal(&vmListLock);
+		vmDown(pm);
+		semWait(&vmListLock);
+		
+		pm = next;
+	};
+	
+	semSignal(&vmListLock);
+};
@@ -0,0 +1,69 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <glidix/thread/rwlock.h>
+
+void rwInit(RWLock *rw)
+{
+	semInit2(&rw->units, RW_MAX_READERS);
+	semInit(&rw->wlock);
+};
+
+void rwLockRead(RWLock *rw)
+{
+	semWait(&rw->units);
+};
+
+int rwTryLockRead(RWLock *rw)
+{
+	if (semWaitGen(&rw->units, 1, SEM_W_NONBLOCK, 0) == 1) return 0;
+	return -1;
+};
+
+void rwUnlockRead(RWLock *rw)
+{
+	semSignal(&rw->units);
+};
+
+void rwLockWrite(RWLock *rw)
+{
+	semWait(&rw->wlock);
+	
+	// collect all the resources; new readers queue up behind us while we wait for the
+	// current ones to leave
+	int got = 0;
+	while (got < RW_MAX_READERS)
+	{
+		got += semWaitGen(&rw->units, RW_MAX_READERS - got, 0, 0);
+	};
+};
+
+void rwUnlockWrite(RWLock *rw)
+{
+	semSignal2(&rw->units, RW_MAX_READERS);
+	semSignal(&rw->wlock);
+};
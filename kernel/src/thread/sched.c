@@ -975,7 +975,16 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	}
 	else
 	{
-		thread->pm = vmClone();
+		if (flags & CLONE_VFORK)
+		{
+			vmUp(currentThread->pm);
+			thread->pm = currentThread->pm;
+			thread->vforkSem = &currentThread->vforkDone;
+		}
+		else
+		{
+			thread->pm = vmClone();
+		};
 		
 		thread->sigdisp = sigdispCreate();
 		if (currentThread->sigdisp != NULL)
@@ -1147,12 +1156,24 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	};
 };
 
+void vforkRelease()
+{
+	Semaphore *sem = currentThread->vforkSem;
+	if (sem != NULL)
+	{
+		currentThread->vforkSem = NULL;
+		semSignal(sem);
+	};
+};
+
 void threadExitEx(uint64_t retval)
 {
 	if (currentThread->creds == NULL)
 	{
 		panic("a kernel thread called threadExitEx()");
 	};
+	
+	vforkRelease();
 
 	if (currentThread->debugFlags & DBG_DEBUG_MODE)
 	{
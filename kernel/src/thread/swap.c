@@ -0,0 +1,461 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <glidix/thread/swap.h>
+#include <glidix/thread/procmem.h>
+#include <glidix/thread/mutex.h>
+#include <glidix/thread/sched.h>
+#include <glidix/thread/semaphore.h>
+#include <glidix/storage/storage.h>
+#include <glidix/hw/physmem.h>
+#include <glidix/hw/pagetab.h>
+#include <glidix/fs/vfs.h>
+#include <glidix/fs/procfs.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/string.h>
+#include <glidix/util/errno.h>
+#include <glidix/display/console.h>
+
+/**
+ * Flags for a swap area.
+ */
+#define	SWAP_AREA_ACTIVE			(1 << 0)
+#define	SWAP_AREA_DRAINING			(1 << 1)
+
+/**
+ * Describes a swap area (partition) in use.
+ */
+typedef struct
+{
+	/**
+	 * The open partition, and the path it was opened by (shown in /proc/swaps).
+	 */
+	File*					fp;
+	SDHandle*				handle;
+	char					path[256];
+	
+	/**
+	 * Number of slots (pages) in the area, and the number of references to each slot; a slot is free
+	 * when its count is 0.
+	 */
+	uint64_t				numSlots;
+	uint32_t*				refs;
+	
+	/**
+	 * Number of slots in use, and where to start looking for free ones.
+	 */
+	uint64_t				used;
+	uint64_t				hint;
+	
+	/**
+	 * SWAP_AREA_* flags.
+	 */
+	int					flags;
+} SwapArea;
+
+/**
+ * Protects the swap areas and their slot reference counts.
+ */
+static Mutex swapLock;
+static SwapArea swapAreas[SWAP_MAX_AREAS];
+static int swapActiveCount;
+
+/**
+ * Pages are copied through this buffer when written out or read in, since the drivers work on kernel
+ * virtual memory, and must not allocate anything. Protected by the I/O lock.
+ */
+static Mutex swapIOLock;
+static uint8_t swapBuffer[SWAP_CLUSTER * 0x1000] PAGE_ALIGN;
+
+/**
+ * Statistics, exported in /proc/swaps. Updated atomically.
+ */
+static uint64_t swapPagesOut;
+static uint64_t swapPagesIn;
+static uint64_t swapDirect;
+
+/**
+ * The swapper thread, and the number of free frames it tries to maintain.
+ */
+static Semaphore semSwapd;
+static int swapdPending;
+static uint64_t swapTarget;
+
+static void swapGenInfo(char *buffer, size_t size);
+static void swapdThread(void *context);
+
+void swapInit()
+{
+	mutexInit(&swapLock);
+	mutexInit(&swapIOLock);
+	memset(swapAreas, 0, sizeof(swapAreas));
+	swapActiveCount = 0;
+	
+	swapTarget = phmTotalFrames / 64;
+	if (swapTarget < 64) swapTarget = 64;
+	
+	semInit2(&semSwapd, 0);
+	
+	KernelThreadParams pars;
+	memset(&pars, 0, sizeof(KernelThreadParams));
+	pars.stackSize = DEFAULT_STACK_SIZE;
+	pars.name = "swapd";
+	CreateKernelThread(swapdThread, &pars, NULL);
+	
+	if (procfsAddFile("swaps", swapGenInfo) != 0)
+	{
+		panic("could not create /proc/swaps");
+	};
+};
+
+int swapOn(const char *path, int flags)
+{
+	if (flags & ~SWAP_FLAGS_ALL)
+	{
+		return EINVAL;
+	};
+	
+	if (strlen(path) >= 256)
+	{
+		return ENAMETOOLONG;
+	};
+	
+	int error;
+	File *fp = vfsOpen(VFS_NULL_IREF, path, O_RDWR, 0, &error);
+	if (fp == NULL)
+	{
+		return error;
+	};
+	
+	SDHandle *handle = sdGetSwapHandle(fp);
+	if (handle == NULL)
+	{
+		error = ERRNO;
+		vfsClose(fp);
+		return error;
+	};
+	
+	uint64_t numSlots = handle->size / 0x1000;
+	if (numSlots < 2 || numSlots > (1UL << SWAP_SLOT_BITS))
+	{
+		vfsClose(fp);
+		return EINVAL;
+	};
+	
+	uint32_t *refs = (uint32_t*) kmalloc(sizeof(uint32_t) * numSlots);
+	if (refs == NULL)
+	{
+		vfsClose(fp);
+		return ENOMEM;
+	};
+	
+	memset(refs, 0, sizeof(uint32_t) * numSlots);
+	refs[0] = 1;			// never used, so that 0 is not a valid entry
+	
+	mutexLock(&swapLock);
+	
+	int i;
+	int area = -1;
+	for (i=0; i<SWAP_MAX_AREAS; i++)
+	{
+		SwapArea *sa = &swapAreas[i];
+		if (sa->flags == 0)
+		{
+			if (area == -1) area = i;
+		}
+		else if (sa->handle->sd == handle->sd && sa->handle->offset == handle->offset)
+		{
+			// this partition is already in use
+			mutexUnlock(&swapLock);
+			kfree(refs);
+			vfsClose(fp);
+			return EBUSY;
+		};
+	};
+	
+	if (area == -1)
+	{
+		mutexUnlock(&swapLock);
+		kfree(refs);
+		vfsClose(fp);
+		return ENOSPC;
+	};
+	
+	SwapArea *sa = &swapAreas[area];
+	sa->fp = fp;
+	sa->handle = handle;
+	strcpy(sa->path, path);
+	sa->numSlots = numSlots;
+	sa->refs = refs;
+	sa->used = 0;
+	sa->hint = 1;
+	sa->flags = SWAP_AREA_ACTIVE;
+	swapActiveCount++;
+	
+	mutexUnlock(&swapLock);
+	return 0;
+};
+
+int swapOff(const char *path)
+{
+	mutexLock(&swapLock);
+	
+	int area;
+	for (area=0; area<SWAP_MAX_AREAS; area++)
+	{
+		if ((swapAreas[area].flags & SWAP_AREA_ACTIVE) && strcmp(swapAreas[area].path, path) == 0)
+		{
+			break;
+		};
+	};
+	
+	if (area == SWAP_MAX_AREAS)
+	{
+		mutexUnlock(&swapLock);
+		return EINVAL;
+	};
+	
+	SwapArea *sa = &swapAreas[area];
+	
+	// everything in the area must fit in memory, without needing to write anything else out to it
+	uint64_t avail = phmTotalFrames - phmUsedFrames + phmCachedFrames;
+	if (sa->used > avail)
+	{
+		mutexUnlock(&swapLock);
+		return ENOMEM;
+	};
+	
+	// no new pages go to this area from now on
+	sa->flags = SWAP_AREA_ACTIVE | SWAP_AREA_DRAINING;
+	swapActiveCount--;
+	mutexUnlock(&swapLock);
+	
+	vmSwapOff(area);
+	
+	mutexLock(&swapLock);
+	if (sa->used != 0)
+	{
+		// some pages could not be read back
+		sa->flags = SWAP_AREA_ACTIVE;
+		swapActiveCount++;
+		mutexUnlock(&swapLock);
+		return EIO;
+	};
+	
+	File *fp = sa->fp;
+	kfree(sa->refs);
+	memset(sa, 0, sizeof(SwapArea));
+	mutexUnlock(&swapLock);
+	
+	vfsClose(fp);
+	return 0;
+};
+
+uint64_t swapAlloc(int *count)
+{
+	mutexLock(&swapLock);
+	
+	int area;
+	for (area=0; area<SWAP_MAX_AREAS; area++)
+	{
+		SwapArea *sa = &swapAreas[area];
+		if (sa->flags != SWAP_AREA_ACTIVE || sa->used == (sa->numSlots - 1))
+		{
+			continue;
+		};
+		
+		// find a free slot, starting at the hint and wrapping around once
+		uint64_t slot = sa->hint;
+		uint64_t tries;
+		for (tries=0; tries<sa->numSlots; tries++)
+		{
+			if (slot >= sa->numSlots) slot = 1;
+			if (sa->refs[slot] == 0) break;
+			slot++;
+		};
+		
+		// take as many of the following slots as are free, up to the requested count
+		int got = 0;
+		while (got < *count && (slot + got) < sa->numSlots && sa->refs[slot + got] == 0)
+		{
+			sa->refs[slot + got] = 1;
+			got++;
+		};
+		
+		sa->used += got;
+		sa->hint = slot + got;
+		mutexUnlock(&swapLock);
+		
+		*count = got;
+		return SWAP_ENTRY(area, slot);
+	};
+	
+	mutexUnlock(&swapLock);
+	return 0;
+};
+
+void swapDup(uint64_t entry)
+{
+	mutexLock(&swapLock);
+	swapAreas[SWAP_AREA(entry)].refs[SWAP_SLOT(entry)]++;
+	mutexUnlock(&swapLock);
+};
+
+void swapFree(uint64_t entry)
+{
+	mutexLock(&swapLock);
+	SwapArea *sa = &swapAreas[SWAP_AREA(entry)];
+	if (--sa->refs[SWAP_SLOT(entry)] == 0)
+	{
+		sa->used--;
+	};
+	mutexUnlock(&swapLock);
+};
+
+/**
+ * Return the handle of the area containing 'entry'. The area cannot go away while any of its slots are
+ * referenced.
+ */
+static SDHandle* swapGetHandle(uint64_t entry)
+{
+	mutexLock(&swapLock);
+	SDHandle *handle = swapAreas[SWAP_AREA(entry)].handle;
+	mutexUnlock(&swapLock);
+	return handle;
+};
+
+int swapWrite(uint64_t entry, int count, const uint64_t *frames)
+{
+	SDHandle *handle = swapGetHandle(entry);
+	
+	mutexLock(&swapIOLock);
+	int i;
+	for (i=0; i<count; i++)
+	{
+		frameRead(frames[i], &swapBuffer[i << 12]);
+	};
+	
+	int error = sdSwapIO(handle, SWAP_SLOT(entry) << 12, swapBuffer, (size_t) count << 12, 1);
+	mutexUnlock(&swapIOLock);
+	
+	if (error == 0) __sync_fetch_and_add(&swapPagesOut, count);
+	return error;
+};
+
+int swapRead(uint64_t entry, int count, const uint64_t *frames)
+{
+	SDHandle *handle = swapGetHandle(entry);
+	
+	mutexLock(&swapIOLock);
+	int error = sdSwapIO(handle, SWAP_SLOT(entry) << 12, swapBuffer, (size_t) count << 12, 0);
+	if (error == 0)
+	{
+		int i;
+		for (i=0; i<count; i++)
+		{
+			frameWrite(frames[i], &swapBuffer[i << 12]);
+		};
+	};
+	mutexUnlock(&swapIOLock);
+	
+	if (error == 0) __sync_fetch_and_add(&swapPagesIn, count);
+	return error;
+};
+
+int swapFreeMemory()
+{
+	if (swapActiveCount == 0)
+	{
+		return -1;
+	};
+	
+	// we are about to sleep on locks and disk I/O
+	if ((getFlagsRegister() & (1 << 9)) == 0)
+	{
+		return -1;
+	};
+	
+	__sync_fetch_and_add(&swapDirect, 1);
+	if (vmSwapOut(SWAP_CLUSTER) == 0)
+	{
+		return -1;
+	};
+	
+	return 0;
+};
+
+static void swapdThread(void *context)
+{
+	while (1)
+	{
+		semWaitGen(&semSwapd, 1, 0, 0);
+		
+		while ((phmTotalFrames - phmUsedFrames) < swapTarget)
+		{
+			if (vmSwapOut(SWAP_CLUSTER * 4) == 0) break;
+		};
+		
+		__sync_lock_release(&swapdPending);
+	};
+};
+
+void swapWake()
+{
+	if (swapActiveCount == 0) return;
+	if ((getFlagsRegister() & (1 << 9)) == 0) return;
+	if ((phmTotalFrames - phmUsedFrames) >= swapTarget) return;
+	
+	if (__sync_bool_compare_and_swap(&swapdPending, 0, 1))
+	{
+		semSignal(&semSwapd);
+	};
+};
+
+static void swapGenInfo(char *buffer, size_t size)
+{
+	size_t len = 0;
+	strformat(buffer, size, "Filename\tSize\tUsed\n");
+	len = strlen(buffer);
+	
+	mutexLock(&swapLock);
+	int i;
+	for (i=0; i<SWAP_MAX_AREAS; i++)
+	{
+		SwapArea *sa = &swapAreas[i];
+		if (sa->flags == 0) continue;
+		
+		strformat(&buffer[len], size - len, "%s\t%luK\t%luK%s\n",
+			sa->path, (sa->numSlots - 1) * 4, sa->used * 4,
+			(sa->flags & SWAP_AREA_DRAINING) ? "\t(draining)" : "");
+		len += strlen(&buffer[len]);
+	};
+	mutexUnlock(&swapLock);
+	
+	strformat(&buffer[len], size - len, "pages_out %lu\npages_in %lu\ndirect %lu\n",
+		swapPagesOut, swapPagesIn, swapDirect);
+};
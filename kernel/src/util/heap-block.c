@@ -506,6 +506,92 @@ void heapDump()
 	kprintf("---\n");
 };
 
+/**
+ * Return the statistics size class of a block of the given size (including its header).
+ */
+static int sizeClass(uint64_t size)
+{
+	int class = 0;
+	while (class < HEAP_STAT_CLASSES-1 && (1UL << (class+5)) < size)
+	{
+		class++;
+	};
+	
+	return class;
+};
+
+void heapGetStats(HeapStats *st)
+{
+	memset(st, 0, sizeof(HeapStats));
+	
+	mutexLock(&heapLock);
+	
+	// each table maps 2MB, plus the table itself
+	st->frames = (uint64_t) nextHeapTable * 513;
+	
+	HeapHeader *head;
+	for (head=(HeapHeader*) HEAP_BASE_ADDR; head!=NULL; head=heapWalkRight(head))
+	{
+		uint64_t blockSize = head->size + sizeof(HeapHeader) + sizeof(HeapFooter);
+		if (head->flags & HEAP_BLOCK_TAKEN)
+		{
+			// the requested size is not recorded, only the one rounded up to 16 bytes
+			st->allocated += blockSize;
+			st->requested += head->size;
+			st->used[sizeClass(blockSize)]++;
+		}
+		else
+		{
+			st->free[sizeClass(blockSize)]++;
+		};
+	};
+	
+	mutexUnlock(&heapLock);
+};
+
+int heapGetSites(HeapSite *sites, int max)
+{
+	int count = 0;
+	if (max == 0) return 0;
+	
+	mutexLock(&heapLock);
+	
+	HeapHeader *head;
+	for (head=(HeapHeader*) HEAP_BASE_ADDR; head!=NULL; head=heapWalkRight(head))
+	{
+		if ((head->flags & HEAP_BLOCK_TAKEN) == 0) continue;
+		
+		int i;
+		for (i=0; i<count; i++)
+		{
+			if (sites[i].aid == head->aid && sites[i].lineno == head->lineno) break;
+		};
+		
+		if (i == count)
+		{
+			// sites beyond the limit are charged to the last one
+			if (count == max)
+			{
+				i = max-1;
+			}
+			else
+			{
+				sites[i].aid = head->aid;
+				sites[i].lineno = head->lineno;
+				sites[i].bytes = 0;
+				sites[i].blocks = 0;
+				count++;
+			};
+		};
+		
+		sites[i].bytes += head->size;
+		sites[i].blocks++;
+	};
+	
+	mutexUnlock(&heapLock);
+	return count;
+};
+
 void checkBlockValidity(void *addr_)
 {
 	uint64_t addr = (uint64_t) addr_;
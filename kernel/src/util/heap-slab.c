@@ -62,7 +62,12 @@ typedef struct
 	/**
 	 * Index of the bucket in which this slab belongs.
 	 */
-	uint64_t				bucket;
+	uint32_t				bucket;
+	
+	/**
+	 * Index of the allocation site (in heapSites) which this slab is charged to.
+	 */
+	uint32_t				site;
 	
 	/**
 	 * Actual requested size.
@@ -87,7 +92,18 @@ typedef struct
 static FreeSlab* buckets[NUM_BUCKETS];
 
 /**
- * Ensure that the specified page range is mapped.
+ * Usage accounting, protected by the heap lock. Allocation sites are kept in an open-addressing hash table
+ * keyed by the 'aid' pointer and line number; entry 0 is reserved for allocations from sites which did not
+ * fit in the table. Entries are never removed, so the index of a site stored in a slab remains valid.
+ */
+static HeapSite heapSites[HEAP_MAX_SITES];
+static uint64_t heapUsedSlabs[NUM_BUCKETS];
+static uint64_t heapRequested;
+static uint64_t heapFrames;
+
+/**
+ * Ensure that the specified page range is mapped. Entries only ever go from not present to present here, and
+ * those are never cached in the TLB, so nothing needs to be invalidated.
  */
 static void mapPages(void *ptr_, size_t size)
 {
@@ -98,41 +114,59 @@ static void mapPages(void *ptr_, size_t size)
 		PML4e *pml4e = VIRT_TO_PML4E(addr);
 		if (!pml4e->present)
 		{
+			__sync_fetch_and_add(&heapFrames, 1);
 			pml4e->pdptPhysAddr = phmAllocZeroFrame();
 			pml4e->rw = 1;
 			pml4e->present = 1;
-			
-			refreshAddrSpace();
 		};
 		
 		PDPTe *pdpte = VIRT_TO_PDPTE(addr);
 		if (!pdpte->present)
 		{
+			__sync_fetch_and_add(&heapFrames, 1);
 			pdpte->pdPhysAddr = phmAllocZeroFrame();
 			pdpte->rw = 1;
 			pdpte->present = 1;
-			
-			refreshAddrSpace();
 		};
 		
 		PDe *pde = VIRT_TO_PDE(addr);
+		uint64_t hugeBase = addr & ~0x1FFFFFUL;
+		if (!pde->present && hugeBase >= ptr && (hugeBase + 0x200000) <= (ptr + size))
+		{
+			// the whole 2MB region belongs to this range and nothing is mapped there
+			// yet, so use a huge page if one is available
+			uint64_t frame = phmAllocHuge();
+			if (frame != 0)
+			{
+				__sync_fetch_and_add(&heapFrames, 512);
+				pde->ptPhysAddr = frame;
+				pde->rw = 1;
+				pde->ps = 1;
+				pde->present = 1;
+			};
+		};
+		
+		if (pde->ps)
+		{
+			addr = hugeBase + 0x200000 - 0x1000;
+			continue;
+		};
+		
 		if (!pde->present)
 		{
+			__sync_fetch_and_add(&heapFrames, 1);
 			pde->ptPhysAddr = phmAllocZeroFrame();
 			pde->rw = 1;
 			pde->present = 1;
-			
-			refreshAddrSpace();
 		};
 		
 		PTe *pte = VIRT_TO_PTE(addr);
 		if (!pte->present)
 		{
+			__sync_fetch_and_add(&heapFrames, 1);
 			pte->framePhysAddr = phmAllocFrame();
 			pte->rw = 1;
 			pte->present = 1;
-			
-			invlpg((void*)addr);
 		};
 	};
 };
@@ -169,11 +203,45 @@ static FreeSlab* slabAlloc(int bucket)
 	};
 };
 
+/**
+ * Return the index of the entry for the given allocation site in heapSites, adding it if necessary. Called with
+ * the heap lock held.
+ */
+static uint32_t siteLookup(const char *aid, int lineno)
+{
+	if (aid == NULL) aid = "";
+	
+	uint64_t hash = ((uint64_t) aid * 31 + (uint64_t) lineno) % (HEAP_MAX_SITES - 1);
+	uint64_t i;
+	for (i=0; i<HEAP_MAX_SITES-1; i++)
+	{
+		uint32_t index = 1 + (uint32_t) ((hash + i) % (HEAP_MAX_SITES - 1));
+		HeapSite *site = &heapSites[index];
+		
+		if (site->aid == NULL)
+		{
+			site->aid = aid;
+			site->lineno = lineno;
+			return index;
+		};
+		
+		if (site->aid == aid && site->lineno == lineno)
+		{
+			return index;
+		};
+	};
+	
+	// table full
+	return 0;
+};
+
 /**
  * Initialize the heap. This is done by adding a single big slab.
  */
 void initMemoryPhase2()
 {
+	heapSites[0].aid = "(other)";
+	
 	FreeSlab *initSlab = (FreeSlab*) HEAP_BASE_ADDR;
 	mapPages(initSlab, 1);
 	initSlab->next = NULL;
@@ -215,10 +283,17 @@ void *kxmallocDynamic(size_t size, int flags, const char *aid, int lineno)
 		return NULL;
 	};
 	mapPages(fslab, size);
+	
+	uint32_t site = siteLookup(aid, lineno);
+	heapSites[site].bytes += size - 16;
+	heapSites[site].blocks++;
+	heapUsedSlabs[bucket]++;
+	heapRequested += size - 16;
 	mutexUnlock(&heapLock);
 	
 	UsedSlab *uslab = (UsedSlab*) fslab;
 	uslab->bucket = bucket;
+	uslab->site = site;
 	uslab->realSize = size - 16;
 	
 	return uslab->data;
@@ -238,11 +313,26 @@ void _kfree(void *block, const char *who, int line)
 	int bucket = (int) uslab->bucket;
 	
 	mutexLock(&heapLock);
+	heapSites[uslab->site].bytes -= uslab->realSize;
+	heapSites[uslab->site].blocks--;
+	heapUsedSlabs[bucket]--;
+	heapRequested -= uslab->realSize;
+	
 	fslab->next = buckets[bucket];
 	buckets[bucket] = fslab;
 	mutexUnlock(&heapLock);
 };
 
+/**
+ * Change the requested size of a used slab, updating the statistics. Called with the heap lock held.
+ */
+static void resize(UsedSlab *slab, uint64_t realSize)
+{
+	heapSites[slab->site].bytes += realSize - slab->realSize;
+	heapRequested += realSize - slab->realSize;
+	slab->realSize = realSize;
+};
+
 /**
  * Re-allocate a block of memory (basically the kernel equivalent of realloc()).
  */
@@ -271,14 +361,16 @@ void *krealloc(void *block, size_t size)
 	// if shrinking below the size of the previous bucket, split this slab in half
 	if (slab->bucket != 0 && size < (currentSize>>1))
 	{
+		mutexLock(&heapLock);
+		heapUsedSlabs[slab->bucket]--;
 		slab->bucket--;
-		slab->realSize = size-16;
+		heapUsedSlabs[slab->bucket]++;
+		resize(slab, size-16);
 		
 		size_t newBucketSize = (1UL << (slab->bucket+5));
 		FreeSlab *second = (FreeSlab*) ((uint64_t) slab + newBucketSize);
 		mapPages(second, 1);
 		
-		mutexLock(&heapLock);
 		second->next = buckets[slab->bucket];
 		buckets[slab->bucket] = second;
 		mutexUnlock(&heapLock);
@@ -289,13 +381,16 @@ void *krealloc(void *block, size_t size)
 	// in all other cases, first check if we already have enough memory
 	if (size <= currentSize)
 	{
-		slab->realSize = size-16;
+		mutexLock(&heapLock);
+		resize(slab, size-16);
 		mapPages(slab, size);
+		mutexUnlock(&heapLock);
 		return block;
 	};
 	
-	// worst case: slab not big enough, do a full reallocation
-	void *newblock = kmalloc(size-16);
+	// worst case: slab not big enough, do a full reallocation, charged to the same site
+	HeapSite *site = &heapSites[slab->site];
+	void *newblock = kxmallocDynamic(size-16, 0, site->aid, site->lineno);
 	if (newblock == NULL) return NULL;
 	
 	size_t toCopy = slab->realSize;
@@ -306,6 +401,47 @@ void *krealloc(void *block, size_t size)
 	return newblock;
 };
 
+void heapGetStats(HeapStats *st)
+{
+	memset(st, 0, sizeof(HeapStats));
+	
+	mutexLock(&heapLock);
+	int bucket;
+	for (bucket=0; bucket<NUM_BUCKETS; bucket++)
+	{
+		st->used[bucket] = heapUsedSlabs[bucket];
+		st->allocated += heapUsedSlabs[bucket] << (bucket+5);
+		
+		FreeSlab *slab;
+		for (slab=buckets[bucket]; slab!=NULL; slab=slab->next)
+		{
+			st->free[bucket]++;
+		};
+	};
+	
+	st->requested = heapRequested;
+	st->frames = heapFrames;
+	mutexUnlock(&heapLock);
+};
+
+int heapGetSites(HeapSite *sites, int max)
+{
+	int count = 0;
+	
+	mutexLock(&heapLock);
+	int i;
+	for (i=0; i<HEAP_MAX_SITES && count<max; i++)
+	{
+		if (heapSites[i].blocks != 0)
+		{
+			memcpy(&sites[count++], &heapSites[i], sizeof(HeapSite));
+		};
+	};
+	mutexUnlock(&heapLock);
+	
+	return count;
+};
+
 /**
  * Dump the heap status.
  */
@@ -60,6 +60,8 @@
 #include <glidix/usb/usb.h>
 #include <glidix/thread/pageinfo.h>
 #include <glidix/fs/ftree.h>
+#include <glidix/thread/swap.h>
+#include <glidix/util/kmemstat.h>
 #include <glidix/hw/msr.h>
 #include <glidix/humin/ptr.h>
 #include <glidix/display/bootfb.h>
@@ -362,6 +364,10 @@ void kmain(KernelBootInfo *info)
 	piInit();
 	DONE();
 	
+	kprintf("Initializing address space list... ");
+	vmInit();
+	DONE();
+	
 	initModuleInterface();
 
 	kprintf("Getting ACPI info... ");
@@ -562,6 +568,14 @@ void kmain2()
 	ftInit();
 	DONE();
 	
+	kprintf("Initializing swap... ");
+	swapInit();
+	DONE();
+	
+	kprintf("Initializing memory accounting... ");
+	kmemstatInit();
+	DONE();
+	
 	status = AcpiInitializeTables(NULL, 16, FALSE);
 	if (ACPI_FAILURE(status))
 	{
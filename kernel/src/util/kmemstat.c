@@ -0,0 +1,212 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <glidix/util/kmemstat.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/string.h>
+#include <glidix/thread/mutex.h>
+#include <glidix/fs/procfs.h>
+#include <glidix/storage/storage.h>
+#include <glidix/display/console.h>
+
+typedef struct
+{
+	char					name[32];
+	uint64_t				bytes;
+	uint64_t				blocks;
+} Subsystem;
+
+/**
+ * Snapshot of the allocation sites, static so that generating the report does not itself show up in it.
+ * Protected by kmemLock, along with the subsystem table.
+ */
+static Mutex kmemLock;
+static HeapSite kmemSites[HEAP_MAX_SITES];
+static Subsystem kmemSubsys[KMEM_MAX_SUBSYS];
+
+static void kmemGenInfo(char *buffer, size_t size);
+
+void kmemstatInit()
+{
+	mutexInit(&kmemLock);
+	
+	if (procfsAddFile("kmemstat", kmemGenInfo) != 0)
+	{
+		panic("could not create /proc/kmemstat");
+	};
+};
+
+/**
+ * Return the start of the last 'count' components of the path 'aid' (the whole path if it is shorter).
+ */
+static const char* pathTail(const char *aid, int count)
+{
+	const char *scan = aid + strlen(aid);
+	while (scan != aid)
+	{
+		if (scan[-1] == '/' && --count == 0) break;
+		scan--;
+	};
+	
+	return scan;
+};
+
+/**
+ * Store the name of the subsystem which the allocation site 'aid' belongs to, which is the name of the
+ * directory containing the source file, into 'name'.
+ */
+static void subsysName(const char *aid, char *name)
+{
+	if (aid[0] == 0)
+	{
+		strcpy(name, "(unknown)");
+		return;
+	};
+	
+	const char *dir = pathTail(aid, 2);
+	const char *file = pathTail(aid, 1);
+	if (dir == file)
+	{
+		// no directory
+		strcpy(name, "(other)");
+		return;
+	};
+	
+	size_t len = file - dir - 1;
+	if (len > 31) len = 31;
+	memcpy(name, dir, len);
+	name[len] = 0;
+};
+
+/**
+ * Charge a site to its subsystem in kmemSubsys, which has 'count' entries so far. Returns the new count.
+ */
+static int subsysAdd(int count, HeapSite *site)
+{
+	char name[32];
+	subsysName(site->aid, name);
+	
+	int i;
+	for (i=0; i<count; i++)
+	{
+		if (strcmp(kmemSubsys[i].name, name) == 0) break;
+	};
+	
+	if (i == count)
+	{
+		if (count == KMEM_MAX_SUBSYS)
+		{
+			// out of room; the last entry takes the rest
+			i = count - 1;
+			strcpy(kmemSubsys[i].name, "(other)");
+		}
+		else
+		{
+			strcpy(kmemSubsys[i].name, name);
+			kmemSubsys[i].bytes = 0;
+			kmemSubsys[i].blocks = 0;
+			count++;
+		};
+	};
+	
+	kmemSubsys[i].bytes += site->bytes;
+	kmemSubsys[i].blocks += site->blocks;
+	return count;
+};
+
+static void kmemGenInfo(char *buffer, size_t size)
+{
+	HeapStats st;
+	heapGetStats(&st);
+	
+	uint64_t blocks = 0;
+	int i;
+	for (i=0; i<HEAP_STAT_CLASSES; i++)
+	{
+		blocks += st.used[i];
+	};
+	
+	strformat(buffer, size,
+		"heap_frames %lu\n"
+		"heap_allocated %lu\n"
+		"heap_requested %lu\n"
+		"heap_blocks %lu\n"
+		"block_cache_frames %lu\n",
+		st.frames, st.allocated, st.requested, blocks, sdCacheFrames
+	);
+	size_t len = strlen(buffer);
+	
+	for (i=0; i<HEAP_STAT_CLASSES; i++)
+	{
+		if (st.used[i] != 0 || st.free[i] != 0)
+		{
+			strformat(&buffer[len], size - len, "class %lu %lu %lu\n", 1UL << (i+5), st.used[i], st.free[i]);
+			len += strlen(&buffer[len]);
+		};
+	};
+	
+	mutexLock(&kmemLock);
+	int numSites = heapGetSites(kmemSites, HEAP_MAX_SITES);
+	
+	int numSubsys = 0;
+	for (i=0; i<numSites; i++)
+	{
+		numSubsys = subsysAdd(numSubsys, &kmemSites[i]);
+	};
+	
+	for (i=0; i<numSubsys; i++)
+	{
+		strformat(&buffer[len], size - len, "subsys %s %lu %lu\n",
+			kmemSubsys[i].name, kmemSubsys[i].bytes, kmemSubsys[i].blocks);
+		len += strlen(&buffer[len]);
+	};
+	
+	// move the biggest sites to the front
+	int top = numSites;
+	if (top > KMEM_TOP_SITES) top = KMEM_TOP_SITES;
+	for (i=0; i<top; i++)
+	{
+		int j;
+		for (j=i+1; j<numSites; j++)
+		{
+			if (kmemSites[j].bytes > kmemSites[i].bytes)
+			{
+				HeapSite tmp = kmemSites[i];
+				kmemSites[i] = kmemSites[j];
+				kmemSites[j] = tmp;
+			};
+		};
+		
+		const char *name = kmemSites[i].aid[0] == 0 ? "(unknown)" : pathTail(kmemSites[i].aid, 2);
+		strformat(&buffer[len], size - len, "site %s:%d %lu %lu\n",
+			name, kmemSites[i].lineno, kmemSites[i].bytes, kmemSites[i].blocks);
+		len += strlen(&buffer[len]);
+	};
+	
+	mutexUnlock(&kmemLock);
+};
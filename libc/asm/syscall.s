@@ -165,3 +165,7 @@ GLIDIX_SYSCALL	149,	rmdir
 
 GLIDIX_SYSCALL	151,	_glidix_pathctlat
 GLIDIX_SYSCALL	152,	_glidix_pathctl
+
+GLIDIX_SYSCALL	157,	vfork
+GLIDIX_SYSCALL	158,	swapon
+GLIDIX_SYSCALL	159,	swapoff
@@ -148,6 +148,7 @@ typedef	int64_t				Elf64_Sxword;
 				   pre-initialization functions. */
 #define	DT_PREINIT_ARRAYSZ 33	/* Size in bytes of the array of
 				   pre-initialization functions. */
+#define	DT_GNU_HASH	0x6ffffef5	/* Address of GNU-style symbol hash table. */
 
 typedef	uint64_t			Elf64_Addr;
 typedef	uint16_t			Elf64_Half;
@@ -167,9 +167,10 @@ typedef struct Dl_Library_
 	Elf64_Rela*				pltRela;
 	
 	/**
-	 * Hash table.
+	 * Hash table (DT_HASH), and the GNU hash table (DT_GNU_HASH); either may be NULL.
 	 */
 	Elf64_Word*				hashtab;
+	Elf64_Word*				gnuHash;
 	
 	/**
 	 * PLT GOT.
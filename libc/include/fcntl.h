@@ -45,6 +45,7 @@
 #define	O_RSYNC				(1 << 9)
 #define	O_SYNC				(1 << 10)
 #define	O_CLOEXEC			(1 << 11)
+#define	O_DIRECT			(1 << 12)
 #define	O_ACCMODE			(O_RDWR)
 
 #define	FD_CLOEXEC			O_CLOEXEC
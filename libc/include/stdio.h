@@ -42,7 +42,7 @@
 #define	_IOLBF				1
 #define	_IONBF				2
 
-#define	BUFSIZ				1024
+#define	BUFSIZ				4096
 #define	FILENAME_MAX			128
 #define	FOPEN_MAX			32
 #define	PATH_MAX			256
@@ -57,6 +57,7 @@
 #define	__FILE_READ			(1 << 1)
 #define	__FILE_WRITE			(1 << 2)
 #define	__FILE_EOF			(1 << 3)
+#define	__FILE_MYBUF			(1 << 4)
 
 typedef uint64_t			fpos_t;
 
@@ -64,21 +65,35 @@ typedef struct __file
 {
 	/**
 	 * The buffer for this FILE. bufsiz is the remaining number of bytes
-	 * in the buffer. The 'trigger' is a character which when encountered,
-	 * forces the buffer to be flushed.
+	 * in the buffer, and is only nonzero while the stream is writing. Data
+	 * between rdbuf and wrbuf has been written to the stream but not yet
+	 * flushed. If buf is NULL, a buffer is allocated on first use.
 	 */
 	void				*_buf;
 	const char			*_rdbuf;
 	char				*_wrbuf;
 	size_t				_bufsiz;
 	size_t				_bufsiz_org;
-	char				_trigger;
+
+	/**
+	 * Input buffered in the same buffer: bytes between rdptr and rdend were
+	 * read from the file but not yet consumed. A stream only ever holds
+	 * buffered input or buffered output, never both at once.
+	 */
+	char				*_rdptr;
+	char				*_rdend;
+
+	/**
+	 * Buffering mode; one of _IOFBF, _IOLBF or _IONBF.
+	 */
+	int				_bufmode;
 
 	/**
 	 * This is called when the buffer overflows or an explicit flush or a flush
-	 * caused by the trigger is needed.
+	 * caused by a newline on a line-buffered stream is needed. Returns 0 on
+	 * success, or -1 on error.
 	 */
-	void (*_flush)(struct __file *fp);
+	int (*_flush)(struct __file *fp);
 
 	/**
 	 * The file descriptor, if applicable.
@@ -90,11 +105,6 @@ typedef struct __file
 	 */
 	char _nanobuf;
 
-	/**
-	 * The character pushed by ungetc().
-	 */
-	int _ungot;
-
 	/**
 	 * Flags.
 	 */
@@ -104,6 +114,13 @@ typedef struct __file
 	 * pid of the child process if this stream was opened with popen().
 	 */
 	int _pid;
+	
+	/**
+	 * Links in the list of open streams, so that fflush(NULL) and exit()
+	 * can reach all of them.
+	 */
+	struct __file *_prev;
+	struct __file *_next;
 } FILE;
 
 #ifdef __cplusplus
@@ -173,6 +190,19 @@ FILE*	popen(const char *cmd, const char *mode);
 int	pclose(FILE *fp);
 char*	cuserid(char *buffer);
 
+/* slow paths of getc_unlocked() and putc_unlocked(); do not call directly */
+int	__fgetc_fill(FILE *fp);
+int	__fputc_flush(int c, FILE *fp);
+
+/**
+ * The unlocked character I/O functions are expanded inline, so that reading or writing
+ * a buffered character does not cost a function call.
+ */
+#define	getc_unlocked(_fp)		((_fp)->_rdptr < (_fp)->_rdend ? (int)(unsigned char)*(_fp)->_rdptr++ : __fgetc_fill(_fp))
+#define	getchar_unlocked()		getc_unlocked(stdin)
+#define	putc_unlocked(_c, _fp)		((_fp)->_bufsiz != 0 && (_fp)->_bufmode == _IOFBF ? ((_fp)->_bufsiz--, (int)(unsigned char)(*(_fp)->_wrbuf++ = (char)(_c))) : __fputc_flush((_c), (_fp)))
+#define	putchar_unlocked(_c)		putc_unlocked((_c), stdout)
+
 /* off_t is the same as long on Glidix */
 #define	fseeko					fseek
 #define	ftello					ftell
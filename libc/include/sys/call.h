@@ -186,6 +186,9 @@
 #define	__SYS_usb_devdesc			154
 #define	__SYS_usb_langids			155
 #define	__SYS_usb_getstr			156
+#define	__SYS_vfork				157
+#define	__SYS_swapon				158
+#define	__SYS_swapoff				159
 
 /* flags for __SYS_mv */
 #define	__MV_EXCL				(1 << 0)
@@ -50,6 +50,8 @@ extern "C" {
 #define	MAP_UN				(1 << 5)
 #endif
 
+#define	MAP_POPULATE			(1 << 6)
+
 #define	MAP_ANON			MAP_ANONYMOUS
 
 #define	MAP_FAILED			((void*)-1)
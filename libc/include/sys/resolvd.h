@@ -0,0 +1,76 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SYS_RESOLVD_H
+#define _SYS_RESOLVD_H
+
+/**
+ * Protocol spoken between getaddrinfo() and the resolver daemon (resolvd), over a SOCK_SEQPACKET
+ * socket bound to RESOLVD_SOCKET. Each request message is a _glidix_resolvd_req, and the daemon
+ * answers with exactly one _glidix_resolvd_resp.
+ */
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <inttypes.h>
+
+#define	RESOLVD_SOCKET				"/run/resolvd"
+
+/**
+ * Maximum number of addresses of each family in a response.
+ */
+#define	RESOLVD_MAX_ADDR			16
+
+/**
+ * Response status.
+ */
+#define	RESOLVD_OK				0		/* name resolved (may still have no addresses) */
+#define	RESOLVD_NONAME				1		/* the name does not exist */
+#define	RESOLVD_FAIL				2		/* no nameserver could be reached */
+
+typedef struct
+{
+	char					name[256];
+} _glidix_resolvd_req;
+
+typedef struct
+{
+	int					status;
+	
+	/**
+	 * How many seconds the result may be cached for by the client.
+	 */
+	uint32_t				ttl;
+	
+	uint32_t				count4;
+	uint32_t				count6;
+	struct in_addr				addr4[RESOLVD_MAX_ADDR];
+	struct in6_addr				addr6[RESOLVD_MAX_ADDR];
+} _glidix_resolvd_resp;
+
+#endif
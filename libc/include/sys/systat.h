@@ -39,6 +39,7 @@ struct system_state
 	uint64_t			sst_frames_total;	/* total number of physical memory frames */
 	uint64_t			sst_frames_used;	/* number on frames in application use */
 	uint64_t			sst_frames_cached;	/* number of cached frames */
+	uint64_t			sst_num_cpus;		/* number of CPUs in use */
 };
 
 #endif
@@ -43,6 +43,8 @@ extern "C" {
 #define	_SC_PAGE_SIZE				3 // {
 #define	_SC_NGROUPS_MAX				4
 #define	_SC_OPEN_MAX				5
+#define	_SC_NPROCESSORS_CONF			6
+#define	_SC_NPROCESSORS_ONLN			7
 
 #define	LOGIN_NAME_MAX				127
 #define	PAGESIZE				0x1000
@@ -85,6 +87,7 @@ int		execl(const char *, const char *arg0, ...);
 int		execle(const char *, const char *arg0, ...);
 int		execlp(const char *, const char *arg0, ...);
 pid_t		fork(void);
+pid_t		vfork(void);
 int		truncate(const char *path, off_t length);
 long		fpathconf(int fd, int name);
 long		pathconf(const char *path, int name);
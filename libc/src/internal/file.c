@@ -29,11 +29,23 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
-static char _buf_stdout[128];
-static char _buf_stderr[128];
+int __fd_flush(FILE *fp);
 
-void __fd_flush(FILE *fp)
+/**
+ * All open streams, linked through _prev/_next. The standard streams start out on
+ * the list; others are added by __file_init() and removed by fclose().
+ */
+static FILE _file_stdin;
+static FILE _file_stdout;
+static FILE _file_stderr;
+FILE *__file_head = &_file_stdin;
+pthread_mutex_t __file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int __fd_flush(FILE *fp)
 {
 	if (fp->_wrbuf < fp->_rdbuf)
 	{
@@ -42,10 +54,205 @@ void __fd_flush(FILE *fp)
 		abort();
 	};
 
-	write(fp->_fd, fp->_rdbuf, (size_t)(fp->_wrbuf - fp->_rdbuf));
+	int status = 0;
+	while (fp->_rdbuf != fp->_wrbuf)
+	{
+		ssize_t ret = write(fp->_fd, fp->_rdbuf, (size_t)(fp->_wrbuf - fp->_rdbuf));
+		if (ret == -1)
+		{
+			if (errno == EINTR) continue;
+			fp->_flags |= __FILE_FERROR;
+			status = -1;
+			break;
+		};
+		
+		fp->_rdbuf += ret;
+	};
+	
 	fp->_wrbuf = fp->_buf;
 	fp->_rdbuf = fp->_buf;
 	fp->_bufsiz = fp->_bufsiz_org;
+	return status;
+};
+
+void __file_link(FILE *fp)
+{
+	pthread_mutex_lock(&__file_lock);
+	fp->_prev = NULL;
+	fp->_next = __file_head;
+	if (__file_head != NULL) __file_head->_prev = fp;
+	__file_head = fp;
+	pthread_mutex_unlock(&__file_lock);
+};
+
+void __file_unlink(FILE *fp)
+{
+	pthread_mutex_lock(&__file_lock);
+	if (fp->_prev != NULL || __file_head == fp)
+	{
+		if (fp->_prev != NULL) fp->_prev->_next = fp->_next;
+		else __file_head = fp->_next;
+		if (fp->_next != NULL) fp->_next->_prev = fp->_prev;
+	};
+	
+	fp->_prev = NULL;
+	fp->_next = NULL;
+	pthread_mutex_unlock(&__file_lock);
+};
+
+void __file_init(FILE *fp, int fd, int flags)
+{
+	fp->_buf = NULL;
+	fp->_rdbuf = NULL;
+	fp->_wrbuf = NULL;
+	fp->_bufsiz = 0;
+	fp->_bufsiz_org = 0;
+	fp->_rdptr = NULL;
+	fp->_rdend = NULL;
+	fp->_bufmode = _IOFBF;
+	fp->_flush = __fd_flush;
+	fp->_fd = fd;
+	fp->_flags = flags;
+	fp->_pid = 0;
+	__file_link(fp);
+};
+
+void __fsetup(FILE *fp)
+{
+	if (fp->_buf != NULL) return;
+	
+	if (fp->_bufmode != _IONBF)
+	{
+		fp->_buf = malloc(BUFSIZ);
+		if (fp->_buf != NULL)
+		{
+			fp->_bufsiz_org = BUFSIZ;
+			fp->_flags |= __FILE_MYBUF;
+			
+			// interactive streams are line-buffered unless setvbuf() said otherwise
+			if (fp->_fd != -1 && isatty(fp->_fd))
+			{
+				fp->_bufmode = _IOLBF;
+			};
+		};
+	};
+	
+	if (fp->_buf == NULL)
+	{
+		fp->_buf = &fp->_nanobuf;
+		fp->_bufsiz_org = 1;
+		fp->_bufmode = _IONBF;
+	};
+	
+	fp->_rdbuf = fp->_buf;
+	fp->_wrbuf = fp->_buf;
+	fp->_rdptr = fp->_buf;
+	fp->_rdend = fp->_buf;
+	fp->_bufsiz = 0;
+};
+
+int __fdrop(FILE *fp)
+{
+	off_t unread = (off_t) (fp->_rdend - fp->_rdptr);
+	if (unread != 0)
+	{
+		if (fp->_fd == -1 || lseek(fp->_fd, -unread, SEEK_CUR) == (off_t)-1)
+		{
+			return -1;
+		};
+	};
+	
+	fp->_rdptr = fp->_buf;
+	fp->_rdend = fp->_buf;
+	return 0;
+};
+
+int __fwrmode(FILE *fp)
+{
+	if ((fp->_flags & __FILE_WRITE) == 0)
+	{
+		fp->_flags |= __FILE_FERROR;
+		errno = EBADF;
+		return -1;
+	};
+	
+	__fsetup(fp);
+	if (fp->_rdptr != fp->_rdend)
+	{
+		// buffered input which cannot be given back (e.g. a socket); the caller must
+		// bypass the buffer for this write
+		if (__fdrop(fp) != 0) return 1;
+	};
+	
+	if (fp->_wrbuf == fp->_rdbuf)
+	{
+		fp->_rdbuf = fp->_buf;
+		fp->_wrbuf = fp->_buf;
+		fp->_bufsiz = fp->_bufsiz_org;
+	};
+	
+	return 0;
+};
+
+ssize_t __fd_read(FILE *fp, void *buf, size_t size)
+{
+	// requesting input on an interactive stream makes pending prompts visible
+	if (fp->_bufmode != _IOFBF && fp != stdout && stdout->_bufmode == _IOLBF && stdout->_wrbuf != stdout->_rdbuf)
+	{
+		fflush(stdout);
+	};
+	
+	ssize_t ret;
+	do
+	{
+		ret = read(fp->_fd, buf, size);
+	} while (ret == -1 && errno == EINTR);
+	
+	if (ret == 0)
+	{
+		fp->_flags |= __FILE_EOF;
+	}
+	else if (ret == -1)
+	{
+		fp->_flags |= __FILE_FERROR;
+	};
+	
+	return ret;
+};
+
+ssize_t __fd_fill(FILE *fp)
+{
+	if ((fp->_flags & __FILE_READ) == 0 || fp->_fd == -1)
+	{
+		fp->_flags |= __FILE_FERROR;
+		errno = EBADF;
+		return -1;
+	};
+	
+	__fsetup(fp);
+	if (fp->_rdptr != fp->_rdend)
+	{
+		return (ssize_t) (fp->_rdend - fp->_rdptr);
+	};
+	
+	// switching from writing to reading
+	if (fp->_wrbuf != fp->_rdbuf)
+	{
+		if (fflush(fp) != 0) return -1;
+	};
+	fp->_bufsiz = 0;
+	
+	ssize_t ret = __fd_read(fp, fp->_buf, fp->_bufsiz_org);
+	if (ret <= 0)
+	{
+		fp->_rdptr = fp->_buf;
+		fp->_rdend = fp->_buf;
+		return ret;
+	};
+	
+	fp->_rdptr = fp->_buf;
+	fp->_rdend = (char*) fp->_buf + ret;
+	return ret;
 };
 
 static FILE _file_stdin = {
@@ -54,37 +261,46 @@ static FILE _file_stdin = {
 	._wrbuf = NULL,
 	._bufsiz = 0,
 	._bufsiz_org = 0,
-	._trigger = 0,
-	._flush = NULL,
+	._rdptr = NULL,
+	._rdend = NULL,
+	._bufmode = _IOFBF,
+	._flush = &__fd_flush,
 	._fd = 0,
 	._flags = __FILE_READ,
-	._ungot = -1
+	._prev = NULL,
+	._next = &_file_stdout
 };
 
 static FILE _file_stdout = {
-	._buf = _buf_stdout,
-	._rdbuf = _buf_stdout,
-	._wrbuf = _buf_stdout,
-	._bufsiz = 128,
-	._bufsiz_org = 128,
-	._trigger = '\n',
+	._buf = NULL,
+	._rdbuf = NULL,
+	._wrbuf = NULL,
+	._bufsiz = 0,
+	._bufsiz_org = 0,
+	._rdptr = NULL,
+	._rdend = NULL,
+	._bufmode = _IOFBF,
 	._flush = &__fd_flush,
 	._fd = 1,
 	._flags = __FILE_WRITE,
-	._ungot = -1
+	._prev = &_file_stdin,
+	._next = &_file_stderr
 };
 
 static FILE _file_stderr = {
-	._buf = _buf_stderr,
-	._rdbuf = _buf_stderr,
-	._wrbuf = _buf_stderr,
-	._bufsiz = 128,
-	._bufsiz_org = 128,
-	._trigger = '\n',
+	._buf = &_file_stderr._nanobuf,
+	._rdbuf = &_file_stderr._nanobuf,
+	._wrbuf = &_file_stderr._nanobuf,
+	._bufsiz = 0,
+	._bufsiz_org = 1,
+	._rdptr = &_file_stderr._nanobuf,
+	._rdend = &_file_stderr._nanobuf,
+	._bufmode = _IONBF,
 	._flush = &__fd_flush,
 	._fd = 2,
 	._flags = __FILE_WRITE,
-	._ungot = -1
+	._prev = &_file_stdout,
+	._next = NULL
 };
 
 FILE *stdin  = &_file_stdin;
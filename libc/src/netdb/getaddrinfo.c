@@ -29,6 +29,8 @@
 #include <sys/glidix.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/un.h>
+#include <sys/resolvd.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <stdlib.h>
@@ -96,6 +98,8 @@ static NameResolution *dnsLast = NULL;
 static struct in6_addr *dnsServers = NULL;
 static size_t dnsNumServers = 0;
 static uint16_t dnsNextID = 0x100;
+static int dnsDaemonFD = -1;
+static pid_t dnsDaemonPid;
 
 static void pktInit(PacketBuffer *buffer)
 {
@@ -503,6 +507,119 @@ static void dnsPerformResolution(NameResolution *res)
 	close(sockfd);
 };
 
+static int dnsDaemonConnect()
+{
+	int sockfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sockfd == -1)
+	{
+		return -1;
+	};
+	
+	struct sockaddr_un srvaddr;
+	memset(&srvaddr, 0, sizeof(struct sockaddr_un));
+	srvaddr.sun_family = AF_UNIX;
+	strcpy(srvaddr.sun_path, RESOLVD_SOCKET);
+	
+	if (connect(sockfd, (struct sockaddr*) &srvaddr, sizeof(struct sockaddr_un)) != 0)
+	{
+		close(sockfd);
+		return -1;
+	};
+	
+	// the daemon itself gives up on nameservers after 5 seconds
+	struct timeval tv;
+	tv.tv_sec = 10;
+	tv.tv_usec = 0;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
+	
+	return sockfd;
+};
+
+/**
+ * Ask the resolver daemon (resolvd) to resolve the name, and store the answer in 'res'. The connection
+ * is kept open for later lookups. Returns 0 on success, or -1 if the daemon is not running, in which
+ * case the caller should resolve the name itself. Call with dnsLock held.
+ */
+static int dnsAskDaemon(NameResolution *res)
+{
+	_glidix_resolvd_req req;
+	memset(&req, 0, sizeof(_glidix_resolvd_req));
+	strcpy(req.name, res->nodename);
+	
+	// a connection inherited through fork() is shared with the parent, and the answers could get mixed up
+	if (dnsDaemonFD != -1 && dnsDaemonPid != getpid())
+	{
+		close(dnsDaemonFD);
+		dnsDaemonFD = -1;
+	};
+	
+	_glidix_resolvd_resp resp;
+	int attempt;
+	for (attempt=0; attempt<2; attempt++)
+	{
+		// (re)connect if necessary; if the daemon restarted, our old connection is dead
+		if (dnsDaemonFD == -1)
+		{
+			dnsDaemonFD = dnsDaemonConnect();
+			if (dnsDaemonFD == -1) return -1;
+			dnsDaemonPid = getpid();
+		};
+		
+		if (send(dnsDaemonFD, &req, sizeof(_glidix_resolvd_req), 0) == sizeof(_glidix_resolvd_req)
+			&& recv(dnsDaemonFD, &resp, sizeof(_glidix_resolvd_resp), 0) == sizeof(_glidix_resolvd_resp))
+		{
+			break;
+		};
+		
+		close(dnsDaemonFD);
+		dnsDaemonFD = -1;
+	};
+	
+	if (attempt == 2)
+	{
+		return -1;
+	};
+	
+	free(res->addrList4);
+	free(res->addrList6);
+	res->addrList4 = NULL;
+	res->addrList6 = NULL;
+	res->addrCount4 = 0;
+	res->addrCount6 = 0;
+	
+	if (resp.status == RESOLVD_OK)
+	{
+		if (resp.count4 > RESOLVD_MAX_ADDR) resp.count4 = RESOLVD_MAX_ADDR;
+		if (resp.count6 > RESOLVD_MAX_ADDR) resp.count6 = RESOLVD_MAX_ADDR;
+		
+		if (resp.count4 != 0)
+		{
+			res->addrList4 = (struct in_addr*) malloc(4 * resp.count4);
+			memcpy(res->addrList4, resp.addr4, 4 * resp.count4);
+			res->addrCount4 = resp.count4;
+		};
+		
+		if (resp.count6 != 0)
+		{
+			res->addrList6 = (struct in6_addr*) malloc(16 * resp.count6);
+			memcpy(res->addrList6, resp.addr6, 16 * resp.count6);
+			res->addrCount6 = resp.count6;
+		};
+	};
+	
+	if (resp.ttl == 0)
+	{
+		// ask again next time
+		res->expires = 1;
+	}
+	else
+	{
+		res->expires = clock() + (clock_t)resp.ttl * CLOCKS_PER_SEC;
+	};
+	
+	return 0;
+};
+
 static NameResolution *dnsCreateResolution(const char *nodename)
 {
 	NameResolution *res = (NameResolution*) malloc(sizeof(NameResolution));
@@ -920,15 +1037,18 @@ int getaddrinfo(const char *nodename, const char *servname, const struct addrinf
 		else
 		{
 			pthread_mutex_lock(&dnsLock);
-			if (!dnsInitDone)
-			{
-				dnsInit();
-			};
 			
+			// names are normally resolved by the resolver daemon, which has /etc/hosts loaded
+			// and a system-wide cache; only if it's not running do we do all the work here
 			NameResolution *res = dnsGetResolution(nodename, 1);
-			if (res->expires != 0)
+			if (res->expires != 0 && res->expires <= clock() && dnsAskDaemon(res) != 0)
 			{
-				if (res->expires <= clock())
+				if (!dnsInitDone)
+				{
+					dnsInit();
+				};
+				
+				if (res->expires != 0 && res->expires <= clock())
 				{
 					dnsPerformResolution(res);
 				};
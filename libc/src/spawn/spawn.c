@@ -0,0 +1,360 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+
+enum
+{
+	__SPAWN_CLOSE,
+	__SPAWN_DUP2,
+	__SPAWN_OPEN,
+	__SPAWN_TCSETPGRP
+};
+
+struct __spawn_action
+{
+	int					type;
+	int					fd;
+	int					newfd;
+	char*					path;
+	int					oflag;
+	mode_t					mode;
+};
+
+/* unistd/exec.c */
+int __find_command(char *path, char *cmd);
+
+extern char **environ;
+
+static int addAction(posix_spawn_file_actions_t *file_actions, struct __spawn_action *action)
+{
+	struct __spawn_action *newActions = (struct __spawn_action*) realloc(file_actions->__actions,
+		sizeof(struct __spawn_action) * (file_actions->__count + 1));
+	if (newActions == NULL)
+	{
+		return ENOMEM;
+	};
+	
+	newActions[file_actions->__count++] = *action;
+	file_actions->__actions = newActions;
+	return 0;
+};
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+	file_actions->__count = 0;
+	file_actions->__actions = NULL;
+	return 0;
+};
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+	int i;
+	for (i=0; i<file_actions->__count; i++)
+	{
+		free(file_actions->__actions[i].path);
+	};
+	
+	free(file_actions->__actions);
+	file_actions->__count = 0;
+	file_actions->__actions = NULL;
+	return 0;
+};
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fildes)
+{
+	if (fildes < 0) return EBADF;
+	
+	struct __spawn_action action;
+	memset(&action, 0, sizeof(struct __spawn_action));
+	action.type = __SPAWN_CLOSE;
+	action.fd = fildes;
+	return addAction(file_actions, &action);
+};
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fildes, int newfildes)
+{
+	if (fildes < 0 || newfildes < 0) return EBADF;
+	
+	struct __spawn_action action;
+	memset(&action, 0, sizeof(struct __spawn_action));
+	action.type = __SPAWN_DUP2;
+	action.fd = fildes;
+	action.newfd = newfildes;
+	return addAction(file_actions, &action);
+};
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fildes, const char *path,
+	int oflag, mode_t mode)
+{
+	if (fildes < 0) return EBADF;
+	
+	struct __spawn_action action;
+	memset(&action, 0, sizeof(struct __spawn_action));
+	action.type = __SPAWN_OPEN;
+	action.fd = fildes;
+	action.path = strdup(path);
+	action.oflag = oflag;
+	action.mode = mode;
+	if (action.path == NULL) return ENOMEM;
+	
+	int status = addAction(file_actions, &action);
+	if (status != 0) free(action.path);
+	return status;
+};
+
+int posix_spawn_file_actions_addtcsetpgrp_np(posix_spawn_file_actions_t *file_actions, int fildes)
+{
+	if (fildes < 0) return EBADF;
+	
+	struct __spawn_action action;
+	memset(&action, 0, sizeof(struct __spawn_action));
+	action.type = __SPAWN_TCSETPGRP;
+	action.fd = fildes;
+	return addAction(file_actions, &action);
+};
+
+int posix_spawnattr_init(posix_spawnattr_t *attr)
+{
+	memset(attr, 0, sizeof(posix_spawnattr_t));
+	return 0;
+};
+
+int posix_spawnattr_destroy(posix_spawnattr_t *attr)
+{
+	return 0;
+};
+
+int posix_spawnattr_getflags(const posix_spawnattr_t *attr, short *flags)
+{
+	*flags = attr->__flags;
+	return 0;
+};
+
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags)
+{
+	if (flags & ~(POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK))
+	{
+		return EINVAL;
+	};
+	
+	attr->__flags = flags;
+	return 0;
+};
+
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attr, pid_t *pgroup)
+{
+	*pgroup = attr->__pgroup;
+	return 0;
+};
+
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup)
+{
+	attr->__pgroup = pgroup;
+	return 0;
+};
+
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr, sigset_t *sigdefault)
+{
+	*sigdefault = attr->__sigdefault;
+	return 0;
+};
+
+int posix_spawnattr_setsigdefault(posix_spawnattr_t *attr, const sigset_t *sigdefault)
+{
+	attr->__sigdefault = *sigdefault;
+	return 0;
+};
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attr, sigset_t *sigmask)
+{
+	*sigmask = attr->__sigmask;
+	return 0;
+};
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attr, const sigset_t *sigmask)
+{
+	attr->__sigmask = *sigmask;
+	return 0;
+};
+
+/**
+ * Runs in the vfork()ed child, on the parent's stack and in the parent's address space; so it must
+ * not allocate memory or touch anything the parent relies on. Returns only if something failed, with
+ * the error number.
+ */
+static int spawnChild(const char *path, const posix_spawn_file_actions_t *file_actions,
+	const posix_spawnattr_t *attrp, char *const argv[], char *const envp[], const sigset_t *oldmask)
+{
+	short flags = 0;
+	if (attrp != NULL) flags = attrp->__flags;
+	
+	// handlers belong to the parent's image; any signal that is caught (or was asked to be defaulted)
+	// goes back to the default action before we unblock anything
+	int sig;
+	for (sig=1; sig<NSIG; sig++)
+	{
+		struct sigaction sa;
+		if (sigaction(sig, NULL, &sa) != 0) continue;
+		
+		if ((sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL)
+			|| ((flags & POSIX_SPAWN_SETSIGDEF) && sigismember(&attrp->__sigdefault, sig)))
+		{
+			sa.sa_handler = SIG_DFL;
+			sa.sa_flags = 0;
+			sigemptyset(&sa.sa_mask);
+			sigaction(sig, &sa, NULL);
+		};
+	};
+	
+	if (flags & POSIX_SPAWN_SETPGROUP)
+	{
+		if (setpgid(0, attrp->__pgroup) != 0) return errno;
+	};
+	
+	if (flags & POSIX_SPAWN_RESETIDS)
+	{
+		if (setegid(getgid()) != 0) return errno;
+		if (seteuid(getuid()) != 0) return errno;
+	};
+	
+	if (file_actions != NULL)
+	{
+		int i;
+		for (i=0; i<file_actions->__count; i++)
+		{
+			struct __spawn_action *action = &file_actions->__actions[i];
+			int fd;
+			
+			switch (action->type)
+			{
+			case __SPAWN_CLOSE:
+				close(action->fd);
+				break;
+			case __SPAWN_DUP2:
+				if (dup2(action->fd, action->newfd) == -1) return errno;
+				break;
+			case __SPAWN_OPEN:
+				fd = open(action->path, action->oflag, action->mode);
+				if (fd == -1) return errno;
+				if (fd != action->fd)
+				{
+					if (dup2(fd, action->fd) == -1) return errno;
+					close(fd);
+				};
+				break;
+			case __SPAWN_TCSETPGRP:
+				if (tcsetpgrp(action->fd, getpgrp()) != 0) return errno;
+				break;
+			};
+		};
+	};
+	
+	if (flags & POSIX_SPAWN_SETSIGMASK)
+	{
+		sigprocmask(SIG_SETMASK, &attrp->__sigmask, NULL);
+	}
+	else
+	{
+		sigprocmask(SIG_SETMASK, oldmask, NULL);
+	};
+	
+	execve(path, argv, envp);
+	return errno;
+};
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+	const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	// the child shares our address space (and hence errno) until it calls execve()
+	int saveErrno = errno;
+	volatile int childError = 0;
+	
+	// block everything so that no handler of ours runs in the child while it borrows our memory
+	sigset_t allmask, oldmask;
+	sigfillset(&allmask);
+	sigprocmask(SIG_SETMASK, &allmask, &oldmask);
+	
+	pid_t child = vfork();
+	if (child == 0)
+	{
+		childError = spawnChild(path, file_actions, attrp, argv, envp, &oldmask);
+		_exit(127);
+	};
+	
+	int result = 0;
+	if (child == -1)
+	{
+		result = errno;
+	}
+	else if (childError != 0)
+	{
+		// the child has already exited; reap it so it doesn't linger as a zombie
+		result = childError;
+		while (waitpid(child, NULL, 0) == -1 && errno == EINTR);
+	}
+	else if (pid != NULL)
+	{
+		*pid = child;
+	};
+	
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+	errno = saveErrno;
+	return result;
+};
+
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+	const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	if (strchr(file, '/') != NULL)
+	{
+		return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+	};
+	
+	// resolve the path here, where we may still allocate memory
+	char path[256];
+	char *filedup = strdup(file);
+	if (filedup == NULL) return ENOMEM;
+	int ok = __find_command(path, filedup);
+	free(filedup);
+	
+	if (ok == -1)
+	{
+		return ENOENT;
+	};
+	
+	return posix_spawn(pid, path, file_actions, attrp, argv, envp);
+};
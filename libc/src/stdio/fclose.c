@@ -30,13 +30,41 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+/* internal/file.c */
+void __file_unlink(FILE *fp);
+
 int fclose(FILE *fp)
 {
-	fflush(fp);
-	if (fp->_fd != -1) close(fp->_fd);
+	int status = 0;
+	if (fp->_wrbuf != fp->_rdbuf)
+	{
+		if (fflush(fp) != 0) status = EOF;
+	};
+	
+	__file_unlink(fp);
+	if (fp->_fd != -1)
+	{
+		if (close(fp->_fd) != 0) status = EOF;
+	};
+	
+	if (fp->_flags & __FILE_MYBUF)
+	{
+		free(fp->_buf);
+	};
+	
 	if ((fp != stdin) && (fp != stdout) && (fp != stderr))
 	{
 		free(fp);
+	}
+	else
+	{
+		fp->_buf = NULL;
+		fp->_rdbuf = NULL;
+		fp->_wrbuf = NULL;
+		fp->_rdptr = NULL;
+		fp->_rdend = NULL;
+		fp->_bufsiz = 0;
+		fp->_flags &= ~__FILE_MYBUF;
 	};
-	return 0;
+	return status;
 };
@@ -34,7 +34,7 @@
 #include <sys/glidix.h>
 
 /* internal/file.c */
-void __fd_flush(FILE *fp);
+void __file_init(FILE *fp, int fd, int flags);
 
 FILE *fdopen(int fd, const char *mode)
 {
@@ -69,15 +69,7 @@ FILE *fdopen(int fd, const char *mode)
 	};
 
 	FILE *fp = (FILE*) malloc(sizeof(FILE));
-	fp->_buf = &fp->_nanobuf;
-	fp->_rdbuf = fp->_buf;
-	fp->_wrbuf = fp->_buf;
-	fp->_bufsiz = 1;
-	fp->_bufsiz_org = 1;
-	fp->_trigger = 0;
-	fp->_flush = __fd_flush;
-	fp->_fd = fd;
-	fp->_flags = fpflags;
-	fp->_ungot = -1;
+	if (fp == NULL) return NULL;
+	__file_init(fp, fd, fpflags);
 	return fp;
 };
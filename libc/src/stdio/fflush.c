@@ -27,20 +27,46 @@
 */
 
 #include <stdio.h>
+#include <pthread.h>
+
+/* internal/file.c */
+extern FILE *__file_head;
+extern pthread_mutex_t __file_lock;
+int __fdrop(FILE *fp);
 
 int fflush(FILE *fp)
 {
-	//int shift = (fp->_ungot != -1);
-	if (fp->_flush != NULL) fp->_flush(fp);
-	fp->_bufsiz = fp->_bufsiz_org;
-	//fp->_ungot = -1;
-
-#if 0
-	if (shift)
+	if (fp == NULL)
+	{
+		int status = 0;
+		pthread_mutex_lock(&__file_lock);
+		for (fp=__file_head; fp!=NULL; fp=fp->_next)
+		{
+			if (fp->_wrbuf != fp->_rdbuf)
+			{
+				if (fflush(fp) != 0) status = EOF;
+			};
+		};
+		pthread_mutex_unlock(&__file_lock);
+		return status;
+	};
+	
+	if (fp->_rdptr != fp->_rdend)
+	{
+		// discard buffered input, if the file position can be moved back to match
+		__fdrop(fp);
+		return 0;
+	};
+	
+	if (fp->_wrbuf == fp->_rdbuf || fp->_flush == NULL)
+	{
+		return 0;
+	};
+	
+	if (fp->_flush(fp) != 0)
 	{
-		fseek(fp, -1, SEEK_CUR);
+		return EOF;
 	};
-#endif
 
 	return 0;
 };
@@ -27,40 +27,31 @@
 */
 
 #include <stdio.h>
-#include <unistd.h>
 
-int fgetc(FILE *fp)
-{
-	if (fp->_ungot != -1)
-	{
-		int out = fp->_ungot;
-		fp->_ungot = -1;
-		return out;
-	};
+/* internal/file.c */
+ssize_t __fd_fill(FILE *fp);
 
-	unsigned char c;
-	ssize_t ret = read(fp->_fd, &c, 1);
-	if (ret == 0)
+int __fgetc_fill(FILE *fp)
+{
+	if (__fd_fill(fp) <= 0)
 	{
-		fp->_flags |= __FILE_EOF;
 		return EOF;
 	};
+	
+	return (int) (unsigned char) *fp->_rdptr++;
+};
 
-	if (ret == 1)
-	{
-		return (int) c;
-	};
-
-	fp->_flags |= __FILE_FERROR;
-	return EOF;
+int fgetc(FILE *fp)
+{
+	return getc_unlocked(fp);
 };
 
 int getc(FILE *fp)
 {
-	return fgetc(fp);
+	return getc_unlocked(fp);
 };
 
 int getchar()
 {
-	return fgetc(stdin);
+	return getc_unlocked(stdin);
 };
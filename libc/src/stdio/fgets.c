@@ -27,6 +27,10 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+
+/* internal/file.c */
+ssize_t __fd_fill(FILE *fp);
 
 char* fgets(char *s, int size, FILE *stream)
 {
@@ -36,26 +40,37 @@ char* fgets(char *s, int size, FILE *stream)
 		return s;
 	};
 	
+	if ((stream->_flags & __FILE_READ) == 0)
+	{
+		stream->_flags |= __FILE_FERROR;
+		return NULL;
+	};
+	
 	char *ret = s;
 	int readAny = 0;
 	
-	size--;
-	while (size--)
+	// copy whole runs out of the buffer instead of going character by character
+	size_t left = (size_t) (size - 1);
+	while (left != 0)
 	{
-		int c = fgetc(stream);
-		if (c == EOF)
+		if (stream->_rdptr == stream->_rdend)
 		{
-			break;
+			if (__fd_fill(stream) <= 0) break;
 		};
 		
+		size_t count = stream->_rdend - stream->_rdptr;
+		if (count > left) count = left;
+		
+		char *newline = (char*) memchr(stream->_rdptr, '\n', count);
+		if (newline != NULL) count = newline - stream->_rdptr + 1;
+		
+		memcpy(s, stream->_rdptr, count);
+		stream->_rdptr += count;
+		s += count;
+		left -= count;
 		readAny = 1;
-		if (c == '\n')
-		{
-			*s++ = c;
-			break;
-		};
 		
-		*s++ = c;
+		if (newline != NULL) break;
 	};
 	
 	*s = 0;
@@ -35,7 +35,8 @@
 #include <sys/glidix.h>
 
 /* internal/file.c */
-void __fd_flush(FILE *fp);
+void __file_init(FILE *fp, int fd, int flags);
+void __file_unlink(FILE *fp);
 
 FILE *__fopen_strm(FILE *fp, const char *path, const char *mode)
 {
@@ -70,6 +71,7 @@ FILE *__fopen_strm(FILE *fp, const char *path, const char *mode)
 			break;
 		case '+':
 			oflags |= O_RDWR;
+			fpflags = __FILE_READ | __FILE_WRITE;
 			break;
 		case 'e':
 			oflags |= O_CLOEXEC;
@@ -96,23 +98,17 @@ FILE *__fopen_strm(FILE *fp, const char *path, const char *mode)
 		fd = fp->_fd;
 	};
 
-	fp->_buf = &fp->_nanobuf;
-	fp->_rdbuf = fp->_buf;
-	fp->_wrbuf = fp->_buf;
-	fp->_bufsiz = 1;
-	fp->_bufsiz_org = 1;
-	fp->_trigger = 0;
-	fp->_flush = __fd_flush;
-	fp->_fd = fd;
-	fp->_flags = fpflags;
-	fp->_ungot = -1;
+	__file_init(fp, fd, fpflags);
 	return fp;
 };
 
 FILE *fopen(const char *filename, const char *mode)
 {
 	FILE *fp = (FILE*) malloc(sizeof(FILE));
+	if (fp == NULL) return NULL;
 	fp->_fd = -1;
+	fp->_prev = NULL;
+	fp->_next = NULL;
 	FILE *out = __fopen_strm(fp, filename, mode);
 	if (out == NULL) free(fp);
 	return out;
@@ -121,6 +117,11 @@ FILE *fopen(const char *filename, const char *mode)
 FILE *freopen(const char *filename, const char *mode, FILE *fp)
 {
 	fflush(fp);
+	__file_unlink(fp);
+	if (fp->_flags & __FILE_MYBUF)
+	{
+		free(fp->_buf);
+	};
 	
 	FILE *out = __fopen_strm(fp, filename, mode);
 	if (out == NULL)
@@ -27,8 +27,14 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+/* internal/file.c */
+void __fsetup(FILE *fp);
+ssize_t __fd_read(FILE *fp, void *buf, size_t size);
+ssize_t __fd_fill(FILE *fp);
+
 size_t fread(void *buf, size_t a, size_t b, FILE *fp)
 {
 	if ((fp->_flags & __FILE_READ) == 0)
@@ -43,40 +49,43 @@ size_t fread(void *buf, size_t a, size_t b, FILE *fp)
 		return 0;
 	};
 	
-	ssize_t addret = 0;
-	if (fp->_ungot != -1)
-	{
-		char *out = (char*) buf;
-		*out++ = (char) fp->_ungot;
-		fp->_ungot = -1;
-		buf = out;
-		size--;
-		addret++;
-	};
+	char *out = (char*) buf;
+	size_t got = 0;
 	
-	if (size == 0)
-	{
-		return addret;
-	};
-
-	if (fp->_flags & __FILE_WRITE)
+	// first take whatever is already buffered
+	size_t avail = fp->_rdend - fp->_rdptr;
+	if (avail != 0)
 	{
-		// flush before reading!
-		fflush(fp);
+		if (avail > size) avail = size;
+		memcpy(out, fp->_rdptr, avail);
+		fp->_rdptr += avail;
+		got = avail;
 	};
 	
-	ssize_t ret = read(fp->_fd, buf, size);
-	if (ret >= 0)
+	__fsetup(fp);
+	while (got < size)
 	{
-		if (ret < size)
+		size_t left = size - got;
+		if (left >= fp->_bufsiz_org && fp->_wrbuf == fp->_rdbuf)
+		{
+			// big request; read straight into the caller's memory
+			fp->_bufsiz = 0;
+			ssize_t ret = __fd_read(fp, out + got, left);
+			if (ret <= 0) break;
+			got += ret;
+		}
+		else
 		{
-			fp->_flags |= __FILE_EOF;
+			ssize_t ret = __fd_fill(fp);
+			if (ret <= 0) break;
+			
+			size_t count = (size_t) ret;
+			if (count > left) count = left;
+			memcpy(out + got, fp->_rdptr, count);
+			fp->_rdptr += count;
+			got += count;
 		};
-		return (ret+addret) / a;
-	}
-	else
-	{
-		fp->_flags |= __FILE_FERROR;
-		return 0;
 	};
+
+	return got / a;
 };
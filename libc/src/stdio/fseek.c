@@ -31,20 +31,34 @@
 
 int fseek(FILE *fp, long offset, int whence)
 {
-	fp->_ungot = -1;
 	fflush(fp);
+	
+	// buffered input is ahead of the position the caller sees
+	if (whence == SEEK_CUR)
+	{
+		offset -= (long) (fp->_rdend - fp->_rdptr);
+	};
+	
 	off_t ret = lseek(fp->_fd, (off_t) offset, whence);
 	if (ret == (off_t)-1)
 	{
 		fp->_flags |= __FILE_FERROR;
 		return -1;
 	};
+	
+	fp->_rdptr = fp->_buf;
+	fp->_rdend = fp->_buf;
+	fp->_flags &= ~__FILE_EOF;
 	return 0;
 };
 
 long ftell(FILE *fp)
 {
-	fflush(fp);
+	if (fp->_wrbuf != fp->_rdbuf)
+	{
+		fflush(fp);
+	};
+	
 	off_t ret = lseek(fp->_fd, 0, SEEK_CUR);
 	if (ret == (off_t)-1)
 	{
@@ -52,10 +66,5 @@ long ftell(FILE *fp)
 		return -1L;
 	};
 	
-	if (fp->_ungot != -1)
-	{
-		ret--;
-	};
-	
-	return (long) ret;
+	return (long) (ret - (off_t) (fp->_rdend - fp->_rdptr));
 };
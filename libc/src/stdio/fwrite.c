@@ -28,53 +28,90 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* internal/file.c */
+int __fd_flush(FILE *fp);
+int __fwrmode(FILE *fp);
+
+static size_t __fwrite_direct(FILE *fp, const char *data, size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t ret = write(fp->_fd, data + done, size - done);
+		if (ret == -1)
+		{
+			if (errno == EINTR) continue;
+			fp->_flags |= __FILE_FERROR;
+			break;
+		};
+		
+		done += ret;
+	};
+	
+	return done;
+};
 
 size_t fwrite(const void *buf, size_t size, size_t count, FILE *fp)
 {
-	if ((fp->_flags & __FILE_WRITE) == 0)
+	size_t rsz = size * count;
+	if (rsz == 0)
+	{
+		return 0;
+	};
+	
+	int mode = __fwrmode(fp);
+	if (mode == -1)
 	{
-		fp->_flags |= __FILE_FERROR;
 		return 0;
 	};
 
-	const void *buf_org = buf;
-
-	size_t ret = count;
-	size_t rsz = size * count;
-	while (fp->_bufsiz < rsz)
+	const char *data = (const char*) buf;
+	if (fp->_flush == __fd_flush && (mode == 1 || rsz >= fp->_bufsiz_org))
 	{
-		if (fp->_flush == NULL)
-		{
-			// truncate
-			rsz = fp->_bufsiz;
-		}
-		else
+		// at least a whole buffer's worth (or an unbuffered stream); copying it
+		// through the buffer would only add a memcpy, so write it out directly
+		if (mode == 0 && fflush(fp) != 0)
 		{
-			if (fp->_bufsiz != 0) memcpy(fp->_wrbuf, buf, fp->_bufsiz);
-			fp->_wrbuf += fp->_bufsiz;
-			buf = (void*) ((char*) buf + fp->_bufsiz);
-			rsz -= fp->_bufsiz;
-			fp->_bufsiz = 0;
-			fflush(fp);
+			return 0;
 		};
+		
+		return __fwrite_direct(fp, data, rsz) / size;
 	};
-
-	if (rsz != 0) memcpy(fp->_wrbuf, buf, rsz);
-	fp->_wrbuf += rsz;
-	fp->_bufsiz -= rsz;
-	const char *scan = (const char *) buf_org;
-
-	while (rsz--)
+	
+	size_t left = rsz;
+	while (left != 0)
 	{
-		if (*scan == fp->_trigger)
+		if (fp->_bufsiz == 0)
 		{
-			if (fp->_flush != NULL) fflush(fp);
+			if (fp->_flush == NULL)
+			{
+				// fixed-size buffer (e.g. snprintf()); truncate
+				break;
+			};
+			
+			if (fflush(fp) != 0)
+			{
+				return (rsz - left) / size;
+			};
 		};
+		
+		size_t chunk = left;
+		if (chunk > fp->_bufsiz) chunk = fp->_bufsiz;
+		
+		memcpy(fp->_wrbuf, data, chunk);
+		fp->_wrbuf += chunk;
+		fp->_bufsiz -= chunk;
+		data += chunk;
+		left -= chunk;
+	};
 
-		scan++;
+	if (fp->_bufmode == _IONBF || (fp->_bufmode == _IOLBF && memchr(buf, '\n', rsz) != NULL))
+	{
+		fflush(fp);
 	};
 
-	//BREAKPOINT();
-	if (fp->_flush != NULL) fflush(fp);		// TODO: shit, we need some way to call fflush() at exit instead.
-	return ret;
+	return count;
 };
@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <spawn.h>
 
 enum
 {
@@ -41,7 +42,10 @@ enum
 };
 
 /* internal/file.c */
-void __fd_flush(FILE *fp);
+void __file_init(FILE *fp, int fd, int flags);
+void __file_unlink(FILE *fp);
+
+extern char **environ;
 
 FILE *popen(const char *cmd, const char *mode)
 {
@@ -66,68 +70,80 @@ FILE *popen(const char *cmd, const char *mode)
 		return NULL;
 	};
 	
-	pid_t pid = fork();
-	if (pid == -1)
+	FILE *fp = (FILE*) malloc(sizeof(FILE));
+	if (fp == NULL)
 	{
+		close(pipefd[0]);
+		close(pipefd[1]);
+		errno = ENOMEM;
 		return NULL;
 	};
 	
-	if (pid == 0)
+	// the child keeps only its own end of the pipe, on the right descriptor(s)
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (m == __MODE_READ)
 	{
-		if (m == __MODE_READ)
-		{
-			// they're reading from our stdout/stderr
-			close(1);
-			close(2);
-			dup2(pipefd[1], 1);
-			dup2(pipefd[2], 2);
-		}
-		else
-		{
-			// they're writing to out stdin
-			close(0);
-			dup2(pipefd[0], 0);
-		};
-		
-		execl("/bin/sh", "sh", "-c", cmd, NULL);
-		_exit(127);
+		// they're reading from our stdout/stderr
+		posix_spawn_file_actions_adddup2(&actions, pipefd[1], 1);
+		posix_spawn_file_actions_adddup2(&actions, pipefd[1], 2);
 	}
 	else
 	{
-		FILE *fp = (FILE*) malloc(sizeof(FILE));
-		fp->_buf = &fp->_nanobuf;
-		fp->_rdbuf = fp->_buf;
-		fp->_wrbuf = fp->_buf;
-		fp->_bufsiz = 1;
-		fp->_bufsiz_org = 1;
-		fp->_trigger = 0;
-		fp->_flush = __fd_flush;
-		if (m == __MODE_READ)
-		{
-			fp->_fd = pipefd[0];
-			fp->_flags = __FILE_READ;
-		}
-		else
-		{
-			fp->_fd = pipefd[1];
-			fp->_flags = __FILE_WRITE;
-		};
-		fp->_ungot = -1;
-		fp->_pid = pid;
-		
-		return fp;
+		// they're writing to our stdin
+		posix_spawn_file_actions_adddup2(&actions, pipefd[0], 0);
+	};
+	posix_spawn_file_actions_addclose(&actions, pipefd[0]);
+	posix_spawn_file_actions_addclose(&actions, pipefd[1]);
+	
+	pid_t pid;
+	char *argv[] = {"sh", "-c", (char*) cmd, NULL};
+	int error = posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	
+	if (error != 0)
+	{
+		free(fp);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		errno = error;
+		return NULL;
 	};
+	
+	if (m == __MODE_READ)
+	{
+		close(pipefd[1]);
+		__file_init(fp, pipefd[0], __FILE_READ);
+	}
+	else
+	{
+		close(pipefd[0]);
+		__file_init(fp, pipefd[1], __FILE_WRITE);
+	};
+	fp->_pid = pid;
+	
+	return fp;
 };
 
 int pclose(FILE *fp)
 {
+	// the child only sees end-of-file once our end is flushed and closed
+	fflush(fp);
+	__file_unlink(fp);
+	close(fp->_fd);
+	if (fp->_flags & __FILE_MYBUF)
+	{
+		free(fp->_buf);
+	};
+	
+	pid_t pid = fp->_pid;
+	free(fp);
+	
 	int status;
 	do
 	{
-		if (waitpid(fp->_pid, &status, 0) > 0)
+		if (waitpid(pid, &status, 0) > 0)
 		{
-			close(fp->_fd);
-			free(fp);
 			if (WIFEXITED(status))
 			{
 				return WEXITSTATUS(status);
@@ -27,32 +27,59 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+
+/* internal/file.c */
+int __fdrop(FILE *fp);
 
 int setvbuf(FILE *fp, char *buf, int type, size_t size)
 {
+	if (type != _IOFBF && type != _IOLBF && type != _IONBF)
+	{
+		return -1;
+	};
+	
 	fflush(fp);
+	if (__fdrop(fp) != 0)
+	{
+		return -1;
+	};
+	
+	if (fp->_flags & __FILE_MYBUF)
+	{
+		free(fp->_buf);
+		fp->_flags &= ~__FILE_MYBUF;
+	};
+	
+	if (type == _IONBF || size == 0)
+	{
+		buf = &fp->_nanobuf;
+		size = 1;
+		type = _IONBF;
+	}
+	else if (buf == NULL)
+	{
+		buf = (char*) malloc(size);
+		if (buf == NULL)
+		{
+			buf = &fp->_nanobuf;
+			size = 1;
+			type = _IONBF;
+		}
+		else
+		{
+			fp->_flags |= __FILE_MYBUF;
+		};
+	};
+	
 	fp->_buf = buf;
 	fp->_rdbuf = buf;
 	fp->_wrbuf = buf;
-	fp->_bufsiz = size;
+	fp->_rdptr = buf;
+	fp->_rdend = buf;
+	fp->_bufsiz = 0;
 	fp->_bufsiz_org = size;
-	
-	switch (type)
-	{
-	case _IOFBF:
-		fp->_trigger = 0;
-		break;
-	case _IOLBF:
-		fp->_trigger = '\n';
-		break;
-	case _IONBF:
-		fp->_buf = &fp->_nanobuf;
-		fp->_rdbuf = fp->_buf;
-		fp->_wrbuf = fp->_buf;
-		fp->_bufsiz = 1;
-		fp->_bufsiz_org = 1;
-		break;
-	};
+	fp->_bufmode = type;
 	
 	return 0;
 };
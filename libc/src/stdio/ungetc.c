@@ -28,12 +28,36 @@
 
 #include <stdio.h>
 
+/* internal/file.c */
+void __fsetup(FILE *fp);
+
 int ungetc(int c, FILE *fp)
 {
-	//printf("{ungetc %c}\n", (char)c);
-	if (fp->_ungot != -1) return EOF;
 	if (c == EOF) return EOF;
-	fp->_ungot = c;
+	
+	__fsetup(fp);
+	if (fp->_wrbuf != fp->_rdbuf)
+	{
+		fflush(fp);
+	};
+	
+	if (fp->_rdptr == fp->_rdend)
+	{
+		// no buffered input; the pushed-back byte becomes the whole buffer
+		fp->_rdptr = fp->_buf;
+		fp->_rdend = fp->_rdptr + 1;
+		*fp->_rdptr = (char) c;
+	}
+	else if (fp->_rdptr != (char*) fp->_buf)
+	{
+		*--fp->_rdptr = (char) c;
+	}
+	else
+	{
+		return EOF;
+	};
+	
+	fp->_bufsiz = 0;
 	fp->_flags &= ~__FILE_EOF;
-	return c;
+	return (unsigned char) c;
 };
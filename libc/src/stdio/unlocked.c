@@ -28,22 +28,26 @@
 
 #include <stdio.h>
 
-int getc_unlocked(FILE *stream)
+/**
+ * Streams are not locked by this library, so these are the same as the normal
+ * versions; stdio.h expands them inline, and these are for taking their addresses.
+ */
+int (getc_unlocked)(FILE *stream)
 {
-	return getc(stream);
+	return getc_unlocked(stream);
 };
 
-int getchar_unlocked(void)
+int (getchar_unlocked)(void)
 {
-	return getchar();
+	return getc_unlocked(stdin);
 };
 
-int putc_unlocked(int c, FILE *stream)
+int (putc_unlocked)(int c, FILE *stream)
 {
-	return putc(c, stream);
+	return putc_unlocked(c, stream);
 };
 
-int putchar_unlocked(int c)
+int (putchar_unlocked)(int c)
 {
-	return putchar(c);
+	return putc_unlocked(c, stdout);
 };
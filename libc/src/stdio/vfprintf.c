@@ -57,20 +57,33 @@ enum
 	_LM_t,
 };
 
+/* internal/file.c */
+int __fd_flush(FILE *fp);
+
+int __fputc_flush(int ch, FILE *fp)
+{
+	unsigned char c = (unsigned char) ch;
+	if (fwrite(&c, 1, 1, fp) != 1)
+	{
+		return EOF;
+	};
+	
+	return (int) c;
+};
+
 int fputc(int ch, FILE *fp)
 {
-	char c = (char) ch;
-	return fwrite(&c, 1, 1, fp);
+	return putc_unlocked(ch, fp);
 };
 
 int putc(int c, FILE *fp)
 {
-	return fputc(c, fp);
+	return putc_unlocked(c, fp);
 };
 
 int putchar(int ch)
 {
-	return fputc(ch, stdout);
+	return putc_unlocked(ch, stdout);
 };
 
 static int __parse_flag(const char **fmtptr, int *flagptr)
@@ -897,6 +910,30 @@ static int __printf_conv_s(FILE *fp, int flags, int lenmod, int fieldWidth, int
 
 int vfprintf(FILE *fp, const char *fmt, va_list ap)
 {
+	if (fp->_bufmode == _IONBF && fp->_flush == __fd_flush && (fp->_flags & __FILE_WRITE))
+	{
+		// format into a temporary buffer first, so that an unbuffered stream still
+		// gets each call's output in one write rather than one per field
+		char buffer[1024];
+		FILE temp;
+		temp._buf = buffer;
+		temp._rdbuf = buffer;
+		temp._wrbuf = buffer;
+		temp._bufsiz = sizeof(buffer);
+		temp._bufsiz_org = sizeof(buffer);
+		temp._rdptr = buffer;
+		temp._rdend = buffer;
+		temp._bufmode = _IOFBF;
+		temp._flush = __fd_flush;
+		temp._fd = fp->_fd;
+		temp._flags = __FILE_WRITE;
+		
+		int ret = vfprintf(&temp, fmt, ap);
+		fflush(&temp);
+		fp->_flags |= (temp._flags & __FILE_FERROR);
+		return ret;
+	};
+	
 	int out = 0;
 	while ((*fmt) != 0)
 	{
@@ -39,7 +39,9 @@ int vsnprintf(char *s, size_t n, const char *fmt, va_list ap)
 	temp._rdbuf = s;
 	temp._bufsiz = n-1;
 	temp._bufsiz_org = n-1;
-	temp._trigger = 0;
+	temp._rdptr = s;
+	temp._rdend = s;
+	temp._bufmode = _IOFBF;
 	temp._flush = NULL;
 	temp._fd = -1;
 	temp._flags = __FILE_WRITE;
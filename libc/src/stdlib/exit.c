@@ -27,6 +27,7 @@
 */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -68,6 +69,9 @@ void exit(int status)
 		cxa_atexit_array[i].func(cxa_atexit_array[i].arg);
 	};
 	
+	// write out everything still sitting in stream buffers
+	fflush(NULL);
+	
 	_Exit(status);
 };
 
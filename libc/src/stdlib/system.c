@@ -30,8 +30,11 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
+#include <spawn.h>
 #include <errno.h>
 
+extern char **environ;
+
 int system(const char *cmd)
 {
 	const char *shell = getenv("SHELL");
@@ -46,20 +49,34 @@ int system(const char *cmd)
 	if (cmd == NULL) return 1;
 	sa.sa_handler = SIG_IGN;
 	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
 	sigaction(SIGINT, &sa, &savintr);
 	sigaction(SIGQUIT, &sa, &savequit);
 	
-	if ((pid = fork()) == 0)
-	{
-		sigaction(SIGINT, &savintr, NULL);
-		sigaction(SIGQUIT, &savequit, NULL);
-		execl(shell, "sh", "-c", cmd, NULL);
-		_exit(127);
-	};
+	// the child gets back whatever dispositions we had before ignoring the signals
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t sigdef;
+	sigemptyset(&sigdef);
+	if (savintr.sa_handler != SIG_IGN) sigaddset(&sigdef, SIGINT);
+	if (savequit.sa_handler != SIG_IGN) sigaddset(&sigdef, SIGQUIT);
+	posix_spawnattr_setsigdefault(&attr, &sigdef);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
 	
-	if (pid == -1)
+	char *argv[] = {"sh", "-c", (char*) cmd, NULL};
+	int error = posix_spawn(&pid, shell, NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	
+	if (error == EAGAIN || error == ENOMEM)
+	{
+		// no child could be created
+		errno = error;
+		stat = -1;
+	}
+	else if (error != 0)
 	{
-		stat = -1; /* errno comes from fork() */
+		// same as a child which could not exec the shell
+		stat = 127 << 8;
 	}
 	else
 	{
@@ -29,6 +29,23 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/call.h>
+#include <sys/systat.h>
+
+static long sysconf_ncpus()
+{
+	struct system_state sst;
+	memset(&sst, 0, sizeof(struct system_state));
+	
+	// older kernels do not report the CPU count; assume one
+	if (__syscall(__SYS_systat, &sst, sizeof(struct system_state)) != 0 || sst.sst_num_cpus == 0)
+	{
+		return 1;
+	};
+	
+	return (long) sst.sst_num_cpus;
+};
 
 long sysconf(int name)
 {
@@ -46,6 +63,9 @@ long sysconf(int name)
 		return NGROUPS_MAX;
 	case _SC_OPEN_MAX:
 		return OPEN_MAX;
+	case _SC_NPROCESSORS_CONF:
+	case _SC_NPROCESSORS_ONLN:
+		return sysconf_ncpus();
 	default:
 		errno = EINVAL;
 		return -1;
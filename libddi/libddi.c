@@ -33,11 +33,13 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <png.h>
 #include <dlfcn.h>
+#include <emmintrin.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
@@ -80,25 +82,53 @@ typedef struct PenLine_
 	struct PenLine_ *next;
 } PenLine;
 
+/**
+ * Number of buckets in the glyph hashtable of each font (power of 2), and the maximum number of
+ * glyphs cached per font.
+ */
+#define	DDI_GLYPH_BUCKETS			256
+#define	DDI_GLYPH_CACHE_MAX			512
+
+/**
+ * Maximum size of a font's glyph atlas, in bytes.
+ */
+#define	DDI_ATLAS_MAX_SIZE			(1024 * 1024)
+
+/**
+ * Number of buckets in the text run hashtable (power of 2), the maximum number of cached runs,
+ * and the longest text (in bytes) for which runs are cached.
+ */
+#define	DDI_RUN_BUCKETS				256
+#define	DDI_RUN_CACHE_MAX			256
+#define	DDI_RUN_MAX_TEXT			1024
+
 /**
  * Represents a cache glyph; see the glyph hashtable in "DDIFont".
  */
 typedef struct DDIGlyphCache_
 {
 	/**
-	 * Link.
+	 * Link in the hashtable bucket.
 	 */
 	struct DDIGlyphCache_* next;
 	
+	/**
+	 * Links in the font's LRU list (most recently used first).
+	 */
+	struct DDIGlyphCache_* lruPrev;
+	struct DDIGlyphCache_* lruNext;
+	
 	/**
 	 * The Unicode codepoint.
 	 */
 	long codepoint;
 	
 	/**
-	 * The rendered bitmap.
+	 * The rendered bitmap. This points into the font's atlas, unless the glyph did not fit into an
+	 * atlas cell, in which case it is separately allocated and 'cell' is -1.
 	 */
 	uint8_t* bitmap;
+	int cell;
 	
 	/**
 	 * Parameters.
@@ -134,11 +164,92 @@ struct DDIFont_
 	int size;
 	
 	/**
-	 * Hashtable of cached glyph bitmaps. The hash is the bottom 5 bits of the codepoint.
+	 * Hashtable of cached glyphs, and the LRU list of them. At most DDI_GLYPH_CACHE_MAX glyphs are
+	 * cached; the least recently used one is evicted to make space for a new one.
+	 */
+	DDIGlyphCache* glyphCache[DDI_GLYPH_BUCKETS];
+	DDIGlyphCache* lruHead;
+	DDIGlyphCache* lruTail;
+	int numGlyphs;
+	
+	/**
+	 * The glyph atlas: an alpha texture divided into equally-sized cells, each big enough for any
+	 * glyph of the font (according to its bounding box), with a stack of free cells. Allocated when
+	 * the first glyph is cached.
 	 */
-	DDIGlyphCache* glyphCache[32];
+	uint8_t* atlas;
+	int atlasPitch;
+	int cellWidth, cellHeight;
+	int atlasCols;
+	int numCells;
+	int* freeCells;
+	int numFreeCells;
 };
 
+/**
+ * A glyph (or tab) placed in a laid-out text run.
+ */
+typedef struct
+{
+	/**
+	 * The codepoint ('\t' for tabs).
+	 */
+	long codepoint;
+	
+	/**
+	 * Pen position at which the glyph is drawn, relative to the start of the segment.
+	 */
+	int penX, penY;
+	
+	/**
+	 * Width of the character, as used for cursor positioning.
+	 */
+	int width;
+} DDIRunGlyph;
+
+/**
+ * A measured and laid-out text segment. This is what calculateSegmentSize() reports for a piece of
+ * text, plus the position of every glyph in it. Runs are cached, keyed by the text up to the first
+ * newline, the font, the available width and the pen parameters which affect layout.
+ */
+typedef struct DDITextRun_
+{
+	/**
+	 * Link in the hashtable bucket, and links in the LRU list.
+	 */
+	struct DDITextRun_* next;
+	struct DDITextRun_* lruPrev;
+	struct DDITextRun_* lruNext;
+	
+	/**
+	 * The key.
+	 */
+	uint32_t hash;
+	DDIFont* font;
+	int availWidth;
+	int letterSpacing;
+	long mask;
+	size_t textLen;
+	char* text;
+	
+	/**
+	 * Results of calculateSegmentSize(). 'nextOffset' is the offset of 'nextEl' from the start of
+	 * the text, or -1 if it was NULL; 'segSize' is the number of bytes in the segment.
+	 */
+	int width, height;
+	int offsetX, offsetY;
+	int include;
+	int advanceX;
+	long nextOffset;
+	size_t segSize;
+	
+	/**
+	 * The glyphs in the segment.
+	 */
+	size_t numGlyphs;
+	DDIRunGlyph glyphs[];
+} DDITextRun;
+
 struct DDIPen_
 {
 	/**
@@ -211,6 +322,8 @@ struct DDIPen_
 };
 
 static int ddiFD;
+static DDIModeRequest ddiCurrentMode;
+static int ddiModeSet = 0;
 DDIDisplayInfo ddiDisplayInfo;
 DDIDriver* ddiDriver;
 static void *libDriver;
@@ -283,25 +396,20 @@ static size_t ddiGetSurfaceDataSize(DDISurface *surface)
 	return size;
 };
 
-DDISurface* ddiSetVideoMode(uint64_t res)
+static DDISurface* ddiMapPresentable(DDIModeRequest *req, int index)
 {
-	DDIModeRequest req;
-	req.res = res;
-	
-	if (ioctl(ddiFD, DDI_IOCTL_VIDEO_MODESET, &req) != 0)
-	{
-		return NULL;
-	};
-	
 	DDISurface *surface = (DDISurface*) malloc(sizeof(DDISurface));
-	memcpy(&surface->format, &req.format, sizeof(DDIPixelFormat));
+	memcpy(&surface->format, &req->format, sizeof(DDIPixelFormat));
 	
-	surface->width = (int) DDI_RES_WIDTH(req.res);
-	surface->height = (int) DDI_RES_HEIGHT(req.res);
+	surface->width = (int) DDI_RES_WIDTH(req->res);
+	surface->height = (int) DDI_RES_HEIGHT(req->res);
 	surface->flags = 0;
 	surface->id = 0;
-	surface->data = (uint8_t*) mmap(NULL, ddiGetSurfaceDataSize(surface),
-					PROT_READ | PROT_WRITE, MAP_SHARED, ddiFD, 0);
+	
+	// presentable buffers are placed one after another, each starting on a page boundary
+	size_t size = ddiGetSurfaceDataSize(surface);
+	size_t stride = (size + 0xFFF) & ~((size_t)0xFFF);
+	surface->data = (uint8_t*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ddiFD, (off_t) (stride * index));
 	
 	if (surface->data == MAP_FAILED)
 	{
@@ -315,6 +423,40 @@ DDISurface* ddiSetVideoMode(uint64_t res)
 	return surface;
 };
 
+DDISurface* ddiSetVideoMode(uint64_t res)
+{
+	DDIModeRequest req;
+	req.res = res;
+	
+	if (ioctl(ddiFD, DDI_IOCTL_VIDEO_MODESET, &req) != 0)
+	{
+		return NULL;
+	};
+	
+	memcpy(&ddiCurrentMode, &req, sizeof(DDIModeRequest));
+	ddiModeSet = 1;
+	return ddiMapPresentable(&req, 0);
+};
+
+DDISurface* ddiGetPresentable(int index)
+{
+	if (!ddiModeSet || index < 0 || index >= ddiDisplayInfo.numPresentable)
+	{
+		errno = EINVAL;
+		return NULL;
+	};
+	
+	return ddiMapPresentable(&ddiCurrentMode, index);
+};
+
+int ddiFlip(int index)
+{
+	DDIFlipRequest req;
+	memset(&req, 0, sizeof(DDIFlipRequest));
+	req.index = index;
+	return ioctl(ddiFD, DDI_IOCTL_VIDEO_FLIP, &req);
+};
+
 int ddiCommand(uint64_t cmd, void *argp)
 {
 	return ioctl(ddiFD, cmd, argp);
@@ -673,6 +815,27 @@ void ddiBlit(DDISurface *src, int srcX, int srcY, DDISurface *dest, int destX, i
 static void ddiExpandBitmapRow(unsigned char *put, uint8_t row, const void *fill, int bpp, size_t pixelSize)
 {
 	static uint8_t mask[8] = {128, 64, 32, 16, 8, 4, 2, 1};
+	
+	if (bpp == 4 && pixelSize == 4)
+	{
+		// select the fill pixel or the old one, 4 pixels at a time (the first pixel is the top bit)
+		__m128i fillVec = _mm_set1_epi32(*((const uint32_t*) fill));
+		__m128i rowVec = _mm_set1_epi32(row);
+		__m128i bitsLeft = _mm_set_epi32(16, 32, 64, 128);
+		__m128i bitsRight = _mm_set_epi32(1, 2, 4, 8);
+		
+		__m128i selLeft = _mm_cmpeq_epi32(_mm_and_si128(rowVec, bitsLeft), bitsLeft);
+		__m128i selRight = _mm_cmpeq_epi32(_mm_and_si128(rowVec, bitsRight), bitsRight);
+		
+		__m128i *putVec = (__m128i*) put;
+		__m128i oldLeft = _mm_loadu_si128(&putVec[0]);
+		__m128i oldRight = _mm_loadu_si128(&putVec[1]);
+		
+		_mm_storeu_si128(&putVec[0], _mm_or_si128(_mm_and_si128(selLeft, fillVec), _mm_andnot_si128(selLeft, oldLeft)));
+		_mm_storeu_si128(&putVec[1], _mm_or_si128(_mm_and_si128(selRight, fillVec), _mm_andnot_si128(selRight, oldRight)));
+		return;
+	};
+	
 	int i;
 	for (i=0; i<8; i++)
 	{
@@ -990,13 +1153,115 @@ void ddiSetPenSpacing(DDIPen *pen, int letterSpacing, int lineHeight)
 	pen->lineHeight = lineHeight;
 };
 
+static int ddiGlyphHash(long codepoint)
+{
+	return (int) (((uint32_t) codepoint * 2654435761U) >> 24) & (DDI_GLYPH_BUCKETS-1);
+};
+
+/**
+ * Allocate the glyph atlas of a font. Returns 0 on success, -1 if we could not, in which case glyphs
+ * are allocated separately.
+ */
+static int ddiInitAtlas(DDIFont *font)
+{
+	FT_Face face = font->face;
+	if (!FT_IS_SCALABLE(face)) return -1;
+	
+	// each cell must fit the bounding box of all glyphs
+	int cellWidth = ((FT_MulFix(face->bbox.xMax - face->bbox.xMin, face->size->metrics.x_scale) + 63) >> 6) + 1;
+	int cellHeight = ((FT_MulFix(face->bbox.yMax - face->bbox.yMin, face->size->metrics.y_scale) + 63) >> 6) + 1;
+	if (cellWidth <= 0 || cellHeight <= 0) return -1;
+	
+	int numCells = DDI_ATLAS_MAX_SIZE / (cellWidth * cellHeight);
+	if (numCells > DDI_GLYPH_CACHE_MAX) numCells = DDI_GLYPH_CACHE_MAX;
+	if (numCells < 16) return -1;
+	
+	int cols = 32;
+	if (cols > numCells) cols = numCells;
+	int rows = (numCells + cols - 1) / cols;
+	
+	font->atlas = (uint8_t*) malloc(cols * cellWidth * rows * cellHeight);
+	font->freeCells = (int*) malloc(sizeof(int) * numCells);
+	if (font->atlas == NULL || font->freeCells == NULL)
+	{
+		free(font->atlas);
+		free(font->freeCells);
+		font->atlas = NULL;
+		font->freeCells = NULL;
+		return -1;
+	};
+	
+	font->atlasPitch = cols * cellWidth;
+	font->cellWidth = cellWidth;
+	font->cellHeight = cellHeight;
+	font->atlasCols = cols;
+	font->numCells = numCells;
+	
+	int i;
+	for (i=0; i<numCells; i++) font->freeCells[i] = numCells - 1 - i;
+	font->numFreeCells = numCells;
+	
+	return 0;
+};
+
+static void ddiGlyphUnlinkLRU(DDIFont *font, DDIGlyphCache *cache)
+{
+	if (cache->lruPrev != NULL) cache->lruPrev->lruNext = cache->lruNext;
+	else font->lruHead = cache->lruNext;
+	if (cache->lruNext != NULL) cache->lruNext->lruPrev = cache->lruPrev;
+	else font->lruTail = cache->lruPrev;
+};
+
+static void ddiGlyphPushLRU(DDIFont *font, DDIGlyphCache *cache)
+{
+	cache->lruPrev = NULL;
+	cache->lruNext = font->lruHead;
+	if (font->lruHead != NULL) font->lruHead->lruPrev = cache;
+	else font->lruTail = cache;
+	font->lruHead = cache;
+};
+
+/**
+ * Evict the least recently used glyph of a font.
+ */
+static void ddiEvictGlyph(DDIFont *font)
+{
+	DDIGlyphCache *cache = font->lruTail;
+	if (cache == NULL) return;
+	ddiGlyphUnlinkLRU(font, cache);
+	
+	DDIGlyphCache **link = &font->glyphCache[ddiGlyphHash(cache->codepoint)];
+	while (*link != cache) link = &(*link)->next;
+	*link = cache->next;
+	
+	if (cache->cell == -1) free(cache->bitmap);
+	else font->freeCells[font->numFreeCells++] = cache->cell;
+	
+	free(cache);
+	font->numGlyphs--;
+};
+
+/**
+ * Get the cached glyph for a codepoint, rendering and caching it if necessary. Call with ddiTextCacheLock
+ * held; the returned glyph may be evicted once it is released.
+ */
 DDIGlyphCache* ddiGetGlyph(DDIFont *font, long codepoint)
 {
 	// first try getting the cache glyph
 	DDIGlyphCache *cache;
-	for (cache=font->glyphCache[codepoint & 0x1F]; cache!=NULL; cache=cache->next)
+	int hash = ddiGlyphHash(codepoint);
+	for (cache=font->glyphCache[hash]; cache!=NULL; cache=cache->next)
 	{
-		if (cache->codepoint == codepoint) return cache;
+		if (cache->codepoint == codepoint)
+		{
+			if (font->lruHead != cache)
+			{
+				ddiGlyphUnlinkLRU(font, cache);
+				ddiGlyphPushLRU(font, cache);
+			};
+			
+			return cache;
+		};
 	};
 	
 	FT_UInt glyph = FT_Get_Char_Index(font->face, codepoint);
@@ -1007,20 +1272,65 @@ DDIGlyphCache* ddiGetGlyph(DDIFont *font, long codepoint)
 
 	FT_Bitmap *bitmap = &font->face->glyph->bitmap;
 	
+	if (font->atlas == NULL && font->numCells == 0)
+	{
+		if (ddiInitAtlas(font) != 0) font->numCells = -1;
+	};
+	
+	if (font->numGlyphs == DDI_GLYPH_CACHE_MAX) ddiEvictGlyph(font);
+	
 	cache = (DDIGlyphCache*) malloc(sizeof(DDIGlyphCache));
-	cache->next = font->glyphCache[codepoint & 0x1F];
-	font->glyphCache[codepoint & 0x1F] = cache;
+	if (cache == NULL) return NULL;
+	
 	cache->codepoint = codepoint;
-	cache->bitmap = (uint8_t*) malloc(bitmap->pitch * bitmap->rows);
-	memcpy(cache->bitmap, bitmap->buffer, bitmap->pitch * bitmap->rows);
 	cache->width = bitmap->width;
 	cache->height = bitmap->rows;
-	cache->pitch = bitmap->pitch;
 	cache->advanceX = font->face->glyph->advance.x;
 	cache->advanceY = font->face->glyph->advance.y;
 	cache->bitmap_top = font->face->glyph->bitmap_top;
 	cache->bitmap_left = font->face->glyph->bitmap_left;
 	
+	// store the bitmap in an atlas cell if it fits, evicting glyphs if no cell is free
+	if (font->atlas != NULL && cache->width <= font->cellWidth && cache->height <= font->cellHeight)
+	{
+		while (font->numFreeCells == 0 && font->lruTail != NULL) ddiEvictGlyph(font);
+	};
+	
+	if (font->atlas != NULL && cache->width <= font->cellWidth && cache->height <= font->cellHeight
+		&& font->numFreeCells != 0)
+	{
+		cache->cell = font->freeCells[--font->numFreeCells];
+		cache->pitch = font->atlasPitch;
+		cache->bitmap = font->atlas
+			+ (cache->cell / font->atlasCols) * font->cellHeight * font->atlasPitch
+			+ (cache->cell % font->atlasCols) * font->cellWidth;
+	}
+	else
+	{
+		cache->cell = -1;
+		cache->pitch = bitmap->width;
+		cache->bitmap = (uint8_t*) malloc(bitmap->width * bitmap->rows + 1);
+		if (cache->bitmap == NULL)
+		{
+			free(cache);
+			return NULL;
+		};
+	};
+	
+	unsigned int y;
+	for (y=0; y<cache->height; y++)
+	{
+		const uint8_t *scan;
+		if (bitmap->pitch >= 0) scan = bitmap->buffer + y * bitmap->pitch;
+		else scan = bitmap->buffer + (cache->height - 1 - y) * (-bitmap->pitch);
+		memcpy(cache->bitmap + y * cache->pitch, scan, cache->width);
+	};
+	
+	cache->next = font->glyphCache[hash];
+	font->glyphCache[hash] = cache;
+	ddiGlyphPushLRU(font, cache);
+	font->numGlyphs++;
+	
 	return cache;
 };
 
@@ -1122,6 +1432,7 @@ static int calculateSegmentSize(DDIPen *pen, const char *text, int *width, int *
 		else
 		{
 			DDIGlyphCache *glyph = ddiGetGlyph(pen->font, point);
+			if (glyph == NULL) continue;
 			
 			int left = penX + glyph->bitmap_left;
 			int top = penY - glyph->bitmap_top;
@@ -1198,6 +1509,220 @@ static int calculateSegmentSize(DDIPen *pen, const char *text, int *width, int *
 	return 0;
 };
 
+/**
+ * Protects the text run cache below, and the glyph caches (and FreeType faces) of all fonts, which
+ * may be shared by pens on different threads.
+ */
+static pthread_mutex_t ddiTextCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The text run cache (see DDITextRun), and the last run which was too long to be cached.
+ */
+static DDITextRun* ddiRunCache[DDI_RUN_BUCKETS];
+static DDITextRun* ddiRunHead;
+static DDITextRun* ddiRunTail;
+static int ddiNumRuns;
+static DDITextRun* ddiScratchRun;
+
+static void ddiRunUnlinkLRU(DDITextRun *run)
+{
+	if (run->lruPrev != NULL) run->lruPrev->lruNext = run->lruNext;
+	else ddiRunHead = run->lruNext;
+	if (run->lruNext != NULL) run->lruNext->lruPrev = run->lruPrev;
+	else ddiRunTail = run->lruPrev;
+};
+
+static void ddiRunPushLRU(DDITextRun *run)
+{
+	run->lruPrev = NULL;
+	run->lruNext = ddiRunHead;
+	if (ddiRunHead != NULL) ddiRunHead->lruPrev = run;
+	else ddiRunTail = run;
+	ddiRunHead = run;
+};
+
+static void ddiEvictRun()
+{
+	DDITextRun *run = ddiRunTail;
+	ddiRunUnlinkLRU(run);
+	
+	DDITextRun **link = &ddiRunCache[run->hash & (DDI_RUN_BUCKETS-1)];
+	while (*link != run) link = &(*link)->next;
+	*link = run->next;
+	
+	free(run->text);
+	free(run);
+	ddiNumRuns--;
+};
+
+/**
+ * Measure and lay out the next segment of text to be written by a pen (see calculateSegmentSize()),
+ * using the run cache if possible. Call with ddiTextCacheLock held; the returned run is only valid
+ * until it is released.
+ */
+static DDITextRun* ddiGetTextRun(DDIPen *pen, const char *text)
+{
+	// the layout can only depend on the text up to the first newline (inclusive), unless
+	// masking is on, in which case newlines are masked too
+	const char *newline = (pen->mask == 0) ? strchr(text, '\n') : NULL;
+	size_t textLen = (newline == NULL) ? strlen(text) : (size_t) (newline - text + 1);
+	int availWidth = pen->wrap ? pen->width - pen->currentLine->currentWidth : -1;
+	
+	// FNV-1a hash of the key
+	uint32_t hash = 2166136261U;
+	size_t i;
+	for (i=0; i<textLen; i++) hash = (hash ^ (uint8_t) text[i]) * 16777619U;
+	hash = (hash ^ (uint32_t) availWidth) * 16777619U;
+	hash = (hash ^ (uint32_t) pen->letterSpacing) * 16777619U;
+	hash = (hash ^ (uint32_t) pen->mask) * 16777619U;
+	hash = (hash ^ (uint32_t) (uintptr_t) pen->font) * 16777619U;
+	
+	DDITextRun *run;
+	for (run=ddiRunCache[hash & (DDI_RUN_BUCKETS-1)]; run!=NULL; run=run->next)
+	{
+		if (run->hash == hash && run->font == pen->font && run->availWidth == availWidth
+			&& run->letterSpacing == pen->letterSpacing && run->mask == pen->mask
+			&& run->textLen == textLen && memcmp(run->text, text, textLen) == 0)
+		{
+			if (ddiRunHead != run)
+			{
+				ddiRunUnlinkLRU(run);
+				ddiRunPushLRU(run);
+			};
+			
+			return run;
+		};
+	};
+	
+	// not cached; measure the segment
+	int width, height, offsetX, offsetY, advanceX;
+	int include = 0;
+	const char *nextEl;
+	calculateSegmentSize(pen, text, &width, &height, &offsetX, &offsetY, &nextEl, &include, &advanceX);
+	size_t segSize = (nextEl == NULL) ? strlen(text) : (size_t) (nextEl - text);
+	
+	// there are at most as many characters as bytes
+	run = (DDITextRun*) malloc(sizeof(DDITextRun) + sizeof(DDIRunGlyph) * segSize);
+	if (run == NULL) return NULL;
+	
+	run->hash = hash;
+	run->font = pen->font;
+	run->availWidth = availWidth;
+	run->letterSpacing = pen->letterSpacing;
+	run->mask = pen->mask;
+	run->textLen = textLen;
+	run->text = NULL;
+	run->width = width;
+	run->height = height;
+	run->offsetX = offsetX;
+	run->offsetY = offsetY;
+	run->include = include;
+	run->advanceX = advanceX;
+	run->nextOffset = (nextEl == NULL) ? -1 : (long) (nextEl - text);
+	run->segSize = segSize;
+	run->numGlyphs = 0;
+	
+	// lay out the glyphs
+	const char *scan = text;
+	const char *scanEnd = text + segSize;
+	int penX = 0, penY = 0;
+	while (scan != scanEnd)
+	{
+		long point = ddiReadUTF8(&scan);
+		if (pen->mask == 1)
+		{
+			point = 0x25CF;
+		}
+		else if (pen->mask != 0)
+		{
+			point = pen->mask;
+		};
+		
+		DDIRunGlyph *rglyph = &run->glyphs[run->numGlyphs];
+		rglyph->penX = penX;
+		rglyph->penY = penY;
+		
+		if (point == '\t')
+		{
+			int oldPenX = penX;
+			penX = penX/DDI_TAB_LEN*DDI_TAB_LEN + DDI_TAB_LEN;
+			rglyph->codepoint = '\t';
+			rglyph->width = penX - oldPenX;
+		}
+		else
+		{
+			DDIGlyphCache *glyph = ddiGetGlyph(pen->font, point);
+			if (glyph == NULL) break;
+			
+			rglyph->codepoint = point;
+			rglyph->width = (glyph->advanceX >> 6) + pen->letterSpacing;
+			penX += (glyph->advanceX >> 6) + pen->letterSpacing;
+			penY += glyph->advanceY >> 6;
+		};
+		
+		run->numGlyphs++;
+	};
+	
+	// cache it if it's short enough
+	if (textLen <= DDI_RUN_MAX_TEXT) run->text = (char*) malloc(textLen);
+	if (run->text == NULL)
+	{
+		free(ddiScratchRun);
+		ddiScratchRun = run;
+		return run;
+	};
+	
+	memcpy(run->text, text, textLen);
+	if (ddiNumRuns == DDI_RUN_CACHE_MAX) ddiEvictRun();
+	
+	run->next = ddiRunCache[hash & (DDI_RUN_BUCKETS-1)];
+	ddiRunCache[hash & (DDI_RUN_BUCKETS-1)] = run;
+	ddiRunPushLRU(run);
+	ddiNumRuns++;
+	
+	return run;
+};
+
+/**
+ * Draw a glyph with its pen position at (x, y) on a segment surface: set every pixel covered by the
+ * glyph to 'pixel', with the alpha byte at 'alphaIndex' (if not -1) replaced by the glyph's alpha.
+ */
+static void ddiDrawGlyph(DDISurface *surface, int x, int y, DDIGlyphCache *glyph, uint32_t pixel, int alphaIndex)
+{
+	unsigned int pixelSize = surface->format.bpp + surface->format.pixelSpacing;
+	unsigned int scanlineSize = pixelSize * surface->width + surface->format.scanlineSpacing;
+	
+	// clip the glyph rectangle to the surface once
+	int left = x + glyph->bitmap_left;
+	int top = y - glyph->bitmap_top;
+	int startX = left < 0 ? -left : 0;
+	int startY = top < 0 ? -top : 0;
+	int endX = glyph->width;
+	int endY = glyph->height;
+	if (left + endX > (int) surface->width) endX = (int) surface->width - left;
+	if (top + endY > (int) surface->height) endY = (int) surface->height - top;
+	
+	int row;
+	for (row=startY; row<endY; row++)
+	{
+		const uint8_t *scan = glyph->bitmap + row * glyph->pitch + startX;
+		uint8_t *put = surface->data + (top + row) * scanlineSize + (left + startX) * pixelSize;
+		
+		int col;
+		for (col=startX; col<endX; col++)
+		{
+			uint8_t alpha = *scan++;
+			if (alpha != 0)
+			{
+				if (alphaIndex != -1) ((uint8_t*) &pixel)[alphaIndex] = alpha;
+				*((uint32_t*) put) = pixel;
+			};
+			
+			put += pixelSize;
+		};
+	};
+};
+
 void ddiWritePen(DDIPen *pen, const char *text)
 {
 	if (*text == 0) return;
@@ -1206,110 +1731,77 @@ void ddiWritePen(DDIPen *pen, const char *text)
 	
 	while (1)
 	{
-		int include = 0;
-		if (calculateSegmentSize(pen, text, &width, &height, &offsetX, &offsetY, &nextEl, &include, &advanceX) != 0)
+		// take a private copy of the run, since another thread may evict it once we release
+		// the lock
+		pthread_mutex_lock(&ddiTextCacheLock);
+		DDITextRun *cached = ddiGetTextRun(pen, text);
+		DDITextRun *run = NULL;
+		if (cached != NULL)
 		{
-			break;
+			size_t runSize = sizeof(DDITextRun) + sizeof(DDIRunGlyph) * cached->numGlyphs;
+			run = (DDITextRun*) malloc(runSize);
+			if (run != NULL) memcpy(run, cached, runSize);
 		};
+		pthread_mutex_unlock(&ddiTextCacheLock);
 		
-		// create a segment object for this
-		size_t textSize;
-		if (nextEl == NULL)
-		{
-			textSize = strlen(text);
-		}
-		else
+		if (run == NULL)
 		{
-			textSize = nextEl - text;
+			break;
 		};
+		
+		width = run->width;
+		height = run->height;
+		offsetX = run->offsetX;
+		offsetY = run->offsetY;
+		advanceX = run->advanceX;
+		int include = run->include;
+		nextEl = (run->nextOffset == -1) ? NULL : text + run->nextOffset;
+		
+		// create a segment object for this
+		size_t textSize = run->segSize;
 
-		// preallocate the width array for the most characters we could possibly have
-		// (worst case ASCII)
-		int *widths = (int*) malloc(sizeof(int) * (textSize+1));
+		// allocate the width array, plus an entry for the break character
+		int *widths = (int*) malloc(sizeof(int) * (run->numGlyphs+1));
 		size_t numChars = 0;
 		
-		const char *textEnd = &text[textSize];
-		
 		DDISurface *surface = ddiCreateSurface(&pen->format, width, height, NULL, 0);
 		DDIColor fillColor;
 		memcpy(&fillColor, &pen->foreground, sizeof(DDIColor));
 		fillColor.alpha = 0;
 		ddiFillRect(surface, 0, 0, width, height, &fillColor);
 
-		unsigned int pixelSize = pen->format.bpp + pen->format.pixelSpacing;
-		unsigned int scanlineSize = pixelSize * width + pen->format.scanlineSpacing;
-
 		uint32_t pixel;
 		ddiColorToPixel(&pixel, &surface->format, &fillColor);
-		uint8_t *alphaPtr = (uint8_t*) &pixel + ddiGetIndexForMask(pen->format.alphaMask);
-		if (pen->format.alphaMask == 0) alphaPtr = NULL;
+		int alphaIndex = ddiGetIndexForMask(pen->format.alphaMask);
+		if (pen->format.alphaMask == 0) alphaIndex = -1;
 		
 		if (pen->font->face->size->metrics.height >> 6 > pen->currentLine->maxHeight)
 		{
 			pen->currentLine->maxHeight = pen->font->face->size->metrics.height >> 6;
 		};
 		
-		int penX = 0, penY = 0;
 		int firstCharPos = pen->writePos;
-		while (text != textEnd)
+		size_t i;
+		pthread_mutex_lock(&ddiTextCacheLock);
+		for (i=0; i<run->numGlyphs; i++)
 		{
-			long point = ddiReadUTF8(&text);
-			if (pen->mask == 1)
-			{
-				point = 0x25CF;
-			}
-			else if (pen->mask != 0)
+			DDIRunGlyph *rglyph = &run->glyphs[i];
+			if (rglyph->codepoint != '\t')
 			{
-				point = pen->mask;
-			};
-
-			if (point == '\t')
-			{
-				int oldPenX = penX;
-				penX = penX/DDI_TAB_LEN*DDI_TAB_LEN + DDI_TAB_LEN;
-
-				pen->writePos++;
-				widths[numChars++] = penX - oldPenX;
-			}
-			else
-			{
-				DDIGlyphCache *glyph = ddiGetGlyph(pen->font, point);
+				DDIGlyphCache *glyph = ddiGetGlyph(pen->font, rglyph->codepoint);
 				if (glyph == NULL) break;
 				
-				pen->writePos++;
-				
-				int x, y;
-				int putX, putY;
-				for (y=0; y<glyph->height; y++)
-				{
-					for (x=0; x<glyph->width; x++)
-					{
-						if (glyph->bitmap[y * glyph->pitch + x] != 0)
-						{
-							putX = penX+offsetX+x+glyph->bitmap_left;
-							putY = penY+offsetY+y-glyph->bitmap_top;
-							
-							if (putX >= 0 && putX < width && putY >= 0 && putY < height)
-							{
-								if (alphaPtr != NULL) *alphaPtr = glyph->bitmap[y * glyph->pitch + x];
-								*((uint32_t*)(surface->data
-									+ putY * scanlineSize
-									+ putX * pixelSize
-								)) = pixel;
-							};
-						};
-					};
-				};
-			
-				widths[numChars++] = (glyph->advanceX >> 6) + pen->letterSpacing;
-			
-				penX += (glyph->advanceX >> 6) + pen->letterSpacing;
-				penY += glyph->advanceY >> 6;
+				ddiDrawGlyph(surface, rglyph->penX + offsetX, rglyph->penY + offsetY, glyph, pixel, alphaIndex);
 			};
+			
+			pen->writePos++;
+			widths[numChars++] = rglyph->width;
 		};
+		pthread_mutex_unlock(&ddiTextCacheLock);
+		free(run);
+		text += textSize;
 
 		pen->currentLine->currentWidth += width;
-		
 		PenSegment *seg = (PenSegment*) malloc(sizeof(PenSegment));
 		seg->surface = surface;
 		seg->next = NULL;
@@ -1542,17 +2034,12 @@ int ddiPenCoordsToPos(DDIPen *pen, int x, int y)
 					int offX = x - seg->drawX;
 				
 					int i;
-					for (i=0; seg->widths[i]<offX; i++)
+					for (i=0; ((size_t)i != seg->numChars) && (seg->widths[i]<offX); i++)
 					{
-						if ((size_t)i == seg->numChars)
-						{
-							break;
-						};
-					
 						offX -= seg->widths[i];
 					};
 				
-					if ((seg->widths[i]/2 <= offX) && ((size_t)i != seg->numChars))
+					if (((size_t)i != seg->numChars) && (seg->widths[i]/2 <= offX))
 					{
 						i++;
 					};
@@ -1675,184 +2162,6 @@ void ddiColorToString(const DDIColor *col, char *buffer)
 	sprintf(buffer, "#%02hhx%02hhx%02hhx", col->red, col->green, col->blue);
 };
 
-static DDISurface* ddiScaleBorderedGradient(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
-{
-	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
-	if (out == NULL) return NULL;
-	
-	ddiOverlay(surface, 0, 0, out, 0, 0, surface->width/2, surface->height/2);
-	ddiOverlay(surface, surface->width-surface->width/2, 0, out, newWidth-(surface->width/2), 0, surface->width/2, surface->height/2);
-	ddiOverlay(surface, 0, surface->height-surface->height/2, out, 0, newHeight-(surface->height/2), surface->width/2, surface->height/2);
-	ddiOverlay(surface, surface->width-surface->width/2, surface->height-surface->height/2, out, newWidth-(surface->width/2), newHeight-(surface->height/2), surface->width/2, surface->height/2);
-
-	if (newWidth < surface->width || newHeight < surface->height) return out;
-	
-	// top part: mix colors from the left/right borders
-	int y;
-	for (y=0; y<surface->height/2; y++)
-	{
-		DDIColor left, right;
-		ddiGetPixelColor(surface, surface->width/2, y, &left);
-		ddiGetPixelColor(surface, surface->width-surface->width/2, y, &right);
-		
-		int baseX = surface->width/2-1;
-		int endX = newWidth - (surface->width/2);
-		int lineWidth = endX - baseX;
-		
-		int x;
-		for (x=1; x<lineWidth; x++)
-		{
-			float factor = (float) x / (float) lineWidth;
-			DDIColor color;
-			ddiSampleLinearGradient(&color, factor, &left, &right);
-			ddiFillRect(out, baseX+x, y, 1, 1, &color);
-		};
-	};
-	
-	// bottom part: same idea
-	int baseY = newHeight-(surface->height/2);
-	for (y=baseY; y<newHeight; y++)
-	{
-		int srcY = surface->height - (newHeight - y);
-		DDIColor left, right;
-		ddiGetPixelColor(surface, surface->width/2, srcY, &left);
-		ddiGetPixelColor(surface, surface->width-surface->width/2, srcY, &right);
-		
-		int baseX = surface->width/2-1;
-		int endX = newWidth - (surface->width/2);
-		int lineWidth = endX - baseX;
-		
-		int x;
-		for (x=1; x<lineWidth; x++)
-		{
-			float factor = (float) x / (float) lineWidth;
-			DDIColor color;
-			ddiSampleLinearGradient(&color, factor, &left, &right);
-			ddiFillRect(out, baseX+x, y, 1, 1, &color);
-		};
-	};
-	
-	// left part
-	int x;
-	for (x=0; x<surface->width/2; x++)
-	{
-		DDIColor top, bottom;
-		ddiGetPixelColor(surface, x, surface->height/2, &top);
-		ddiGetPixelColor(surface, x, surface->height-surface->height/2, &bottom);
-		
-		int baseY = surface->height/2-1;
-		int endY = newHeight - (surface->height/2);
-		int lineHeight = endY - baseY;
-		
-		int y;
-		for (y=1; y<lineHeight; y++)
-		{
-			float factor = (float) y / (float) lineHeight;
-			DDIColor color;
-			ddiSampleLinearGradient(&color, factor, &top, &bottom);
-			ddiFillRect(out, x, baseY+y, 1, 1, &color);
-		};
-	};
-
-	// right part
-	int baseX = newWidth-(surface->width-surface->width/2);
-	for (x=baseX; x<newWidth; x++)
-	{
-		int srcX = surface->width - (newWidth - x);
-		DDIColor top, bottom;
-		ddiGetPixelColor(surface, srcX, surface->height/2, &top);
-		ddiGetPixelColor(surface, srcX, surface->height-surface->height/2, &bottom);
-		
-		int baseY = surface->height/2-1;
-		int endY = newHeight - (surface->height/2);
-		int lineHeight = endY - baseY;
-		
-		int y;
-		for (y=1; y<lineHeight; y++)
-		{
-			float factor = (float) y / (float) lineHeight;
-			DDIColor color;
-			ddiSampleLinearGradient(&color, factor, &top, &bottom);
-			ddiFillRect(out, x, baseY+y, 1, 1, &color);
-		};
-	};
-
-	// finally the middle part (quadratic interpolation)
-	int subwidth = newWidth - surface->width;
-	int subheight = newHeight - surface->height;
-	
-	baseX = surface->width / 2;
-	baseY = surface->height / 2;
-	
-	unsigned int totalArea = subwidth * subheight;
-	
-	DDIColor topleft, topright, bottomleft, bottomright;
-	ddiGetPixelColor(surface, surface->width/2, baseY, &topleft);
-	ddiGetPixelColor(surface, surface->width-surface->width/2, baseY, &topright);
-	ddiGetPixelColor(surface, surface->width/2, baseY+1, &bottomleft);
-	ddiGetPixelColor(surface, surface->width-surface->width/2, baseY+1, &bottomright);
-	
-	for (y=0; y<subheight; y++)
-	{
-		for (x=0; x<subwidth; x++)
-		{
-			unsigned int areaTL = x * y;
-			unsigned int areaTR = (subwidth-x) * y;
-			unsigned int areaBL = x * (subheight-y);
-			unsigned int areaBR = (subwidth-x) * (subheight-y);
-			
-			DDIColor result;
-			result.red = ((unsigned int) topleft.red * areaTL + (unsigned int) topright.red * areaTR + (unsigned int) bottomleft.red * areaBL + (unsigned int) bottomright.red * areaBR) / totalArea;
-			result.green = ((unsigned int) topleft.green * areaTL + (unsigned int) topright.green * areaTR + (unsigned int) bottomleft.green * areaBL + (unsigned int) bottomright.green * areaBR) / totalArea;
-			result.blue = ((unsigned int) topleft.blue * areaTL + (unsigned int) topright.blue * areaTR + (unsigned int) bottomleft.blue * areaBL + (unsigned int) bottomright.blue * areaBR) / totalArea;
-			result.alpha = ((unsigned int) topleft.alpha * areaTL + (unsigned int) topright.alpha * areaTR + (unsigned int) bottomleft.alpha * areaBL + (unsigned int) bottomright.alpha * areaBR) / totalArea;
-			
-			ddiFillRect(out, baseX+x, baseY+y, 1, 1, &result);
-		};
-	};
-	
-	return out;
-};
-
-static DDISurface* ddiScaleLinear(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
-{
-	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
-	if (out == NULL) return NULL;
-	
-	unsigned int x, y;
-	for (y=0; y<newHeight; y++)
-	{
-		uint8_t *row = &out->data[((out->format.bpp + out->format.pixelSpacing) * newWidth + out->format.scanlineSpacing) * y];
-		
-		for (x=0; x<newWidth; x++)
-		{
-			unsigned int srcX = x * surface->width / newWidth;
-			unsigned int srcY = y * surface->height / newHeight;
-			
-			uint8_t *src = &surface->data[((surface->format.bpp + surface->format.pixelSpacing) * surface->width + surface->format.scanlineSpacing) * srcY + (surface->format.bpp + surface->format.pixelSpacing) * srcX];
-			
-			memcpy(&row[(out->format.bpp + out->format.pixelSpacing) * x], src, out->format.bpp);
-		};
-	};
-	
-	return out;
-};
-
-DDISurface* ddiScale(DDISurface *surface, unsigned int newWidth, unsigned int newHeight, int algorithm)
-{
-	switch (algorithm)
-	{
-	case DDI_SCALE_BEST:
-	case DDI_SCALE_FASTEST:
-	case DDI_SCALE_LINEAR:
-		return ddiScaleLinear(surface, newWidth, newHeight);
-	case DDI_SCALE_BORDERED_GRADIENT:
-		return ddiScaleBorderedGradient(surface, newWidth, newHeight);
-	default:
-		return NULL;
-	};
-};
-
 void ddiSampleLinearGradient(DDIColor *out, float fb, DDIColor *a, DDIColor *b)
 {
 	float fa = 1.0 - fb;
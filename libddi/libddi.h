@@ -71,6 +71,12 @@
  */
 #define	DDI_IOCTL_VIDEO_MODESET			_GLIDIX_IOCTL_ARG(DDIModeRequest, _GLIDIX_IOCTL_INT_VIDEO, 1)
 #define	DDI_IOCTL_VIDEO_GETINFO			_GLIDIX_IOCTL_ARG(DDIDisplayInfo, _GLIDIX_IOCTL_INT_VIDEO, 2)
+#define	DDI_IOCTL_VIDEO_FLIP			_GLIDIX_IOCTL_ARG(DDIFlipRequest, _GLIDIX_IOCTL_INT_VIDEO, 3)
+
+/**
+ * Display feature bits (the 'features' field of DDIDisplayInfo).
+ */
+#define	DDI_FEATURE_FLIP			(1 << 0)		/* can page-flip between presentable surfaces */
 
 /**
  * Macro for constructing DDI commands (GPU IOCTLs).
@@ -109,6 +115,8 @@
 #define	DDI_SCALE_FASTEST			1
 #define	DDI_SCALE_LINEAR			2
 #define	DDI_SCALE_BORDERED_GRADIENT		3
+#define	DDI_SCALE_NEAREST			4
+#define	DDI_SCALE_AREA				5
 
 /**
  * Describes the pixel format of a surface.
@@ -181,6 +189,22 @@ typedef struct
 	DDIPixelFormat				format;
 } DDIModeRequest;
 
+/**
+ * Request for a page flip (IOCTL).
+ */
+typedef struct
+{
+	/**
+	 * (In) Index of the presentable surface to display.
+	 */
+	int					index;
+	
+	/**
+	 * Reserved.
+	 */
+	int					resv[7];
+} DDIFlipRequest;
+
 /**
  * Describes a surface.
  */
@@ -361,6 +385,20 @@ void ddiQuit();
  */
 DDISurface* ddiSetVideoMode(uint64_t res);
 
+/**
+ * Return a surface representing the presentable buffer with the given index, after ddiSetVideoMode() was
+ * called. Index 0 is the buffer returned by ddiSetVideoMode() (but this returns a new surface object). The
+ * number of presentable buffers is given by ddiDisplayInfo.numPresentable. Returns NULL on error, and sets
+ * 'errno'.
+ */
+DDISurface* ddiGetPresentable(int index);
+
+/**
+ * Display the presentable buffer with the given index (only possible if ddiDisplayInfo.features has the
+ * DDI_FEATURE_FLIP bit set). Returns 0 on success, or -1 on error and sets 'errno'.
+ */
+int ddiFlip(int index);
+
 /**
  * Send a command to the kernel-mode driver. 'cmd' must be constructed using DDI_COMMAND_* macros, and the final
  * argument 'argp' depends on the command. Everything else is command-dependent and driver-dependent. This function
@@ -596,10 +634,16 @@ void ddiColorToString(const DDIColor *col, char *buffer);
 
 /**
  * Scale a surface to the specifies size, using the specified algorithm.
- * DDI_SCALE_BEST			Highest-quality algorithm available.
- * DDI_SCALE_FASTEST			Fastest algorithm available.
- * DDI_SCALE_LINEAR			Linear scaling algorithm.
+ * DDI_SCALE_BEST			Highest-quality algorithm available (area averaging when shrinking,
+ *					bilinear otherwise).
+ * DDI_SCALE_FASTEST			Fastest algorithm available (currently nearest neighbour).
+ * DDI_SCALE_LINEAR			Bilinear filtering.
  * DDI_SCALE_BORDERED_GRADIENT		Bordered gradient scaling.
+ * DDI_SCALE_NEAREST			Nearest neighbour.
+ * DDI_SCALE_AREA			Area averaging (box filter); best for shrinking.
+ * The filtering algorithms work on 32-bit formats only; other formats are scaled by nearest neighbour.
+ * Large outputs are scaled on multiple threads, and results for small sources are cached, so scaling
+ * the same image to the same size repeatedly is cheap.
  * Returns a new surface on success, NULL on error.
  */
 DDISurface* ddiScale(DDISurface *surface, unsigned int newWidth, unsigned int newHeight, int algorithm);
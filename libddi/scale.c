@@ -0,0 +1,802 @@
+/*
+	Glidix Display Device Interface (DDI)
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <emmintrin.h>
+
+#include "libddi.h"
+
+/**
+ * Only outputs with at least this many pixels are scaled in parallel, and at most this many
+ * threads are used.
+ */
+#define	DDI_SCALE_PARALLEL_MIN			(256 * 256)
+#define	DDI_SCALE_MAX_THREADS			16
+
+/**
+ * Scale cache limits: only sources up to DDI_SCALE_CACHE_SRC_MAX bytes are cached (their data is
+ * kept for comparison), and the cache holds at most DDI_SCALE_CACHE_SIZE bytes of scaled data.
+ */
+#define	DDI_SCALE_CACHE_SRC_MAX			(64 * 1024)
+#define	DDI_SCALE_CACHE_SIZE			(8 * 1024 * 1024)
+
+/**
+ * A job for the row-parallel scalers. 'scaleRows' produces output rows [startY, endY).
+ */
+typedef struct DDIScaleJob_
+{
+	DDISurface*				src;
+	DDISurface*				dest;
+	
+	/**
+	 * Number of bits to rotate pixels left by so that alpha is in the top byte, and whether there
+	 * is an alpha channel at all (otherwise the top byte is filtered like the other channels).
+	 */
+	int					rotate;
+	int					hasAlpha;
+	
+	/**
+	 * Bilinear: source column offsets (in bytes) and weights for each output column.
+	 */
+	unsigned int*				colLeft;
+	unsigned int*				colRight;
+	float*					colFrac;
+	
+	/**
+	 * Area: for each output column, the first source column, the number of source columns and
+	 * the index of the first weight in 'colWeights'. Same for rows.
+	 */
+	unsigned int*				colFirst;
+	unsigned int*				colCount;
+	unsigned int*				colIndex;
+	float*					colWeights;
+	unsigned int*				rowFirst;
+	unsigned int*				rowCount;
+	unsigned int*				rowIndex;
+	float*					rowWeights;
+	
+	void (*scaleRows)(struct DDIScaleJob_ *job, unsigned int startY, unsigned int endY);
+} DDIScaleJob;
+
+typedef struct
+{
+	DDIScaleJob*				job;
+	unsigned int				startY;
+	unsigned int				endY;
+} DDIScaleBand;
+
+/**
+ * Cached scaling result.
+ */
+typedef struct DDIScaleCacheEntry_
+{
+	struct DDIScaleCacheEntry_*		next;
+	DDIPixelFormat				format;
+	unsigned int				srcWidth, srcHeight;
+	unsigned int				newWidth, newHeight;
+	int					algorithm;
+	size_t					srcSize;
+	uint8_t*				srcData;
+	DDISurface*				result;
+	size_t					resultSize;
+} DDIScaleCacheEntry;
+
+/**
+ * The scale cache, most recently used entry first.
+ */
+static pthread_mutex_t ddiScaleCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static DDIScaleCacheEntry* ddiScaleCache;
+static size_t ddiScaleCacheSize;
+
+static inline uint32_t ddiRotl(uint32_t x, int n)
+{
+	return n == 0 ? x : (x << n) | (x >> (32 - n));
+};
+
+static inline uint32_t ddiRotr(uint32_t x, int n)
+{
+	return n == 0 ? x : (x >> n) | (x << (32 - n));
+};
+
+static size_t ddiPixelStride(DDISurface *surface)
+{
+	return surface->format.bpp + surface->format.pixelSpacing;
+};
+
+static size_t ddiScanlineStride(DDISurface *surface)
+{
+	return ddiPixelStride(surface) * surface->width + surface->format.scanlineSpacing;
+};
+
+/**
+ * Convert a pixel (with alpha in the top byte) to floats; with 'hasAlpha', the color channels are
+ * premultiplied by alpha.
+ */
+static inline __m128 ddiLoadPixel(uint32_t pixel, int hasAlpha)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128 value = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) pixel), zero), zero));
+	if (!hasAlpha) return value;
+	
+	__m128 alpha = _mm_shuffle_ps(value, value, 0xFF);
+	__m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	return _mm_or_ps(_mm_andnot_ps(alphaMask, _mm_mul_ps(value, alpha)), _mm_and_ps(alphaMask, alpha));
+};
+
+/**
+ * Convert filtered floats back to a pixel (with alpha in the top byte), undoing the premultiplication
+ * if 'hasAlpha'.
+ */
+static inline uint32_t ddiStorePixel(__m128 value, int hasAlpha)
+{
+	if (hasAlpha)
+	{
+		__m128 alpha = _mm_shuffle_ps(value, value, 0xFF);
+		float alphaScalar = _mm_cvtss_f32(alpha);
+		if (alphaScalar < 0.5f) return 0;
+		
+		__m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+		value = _mm_or_ps(_mm_andnot_ps(alphaMask, _mm_div_ps(value, alpha)), _mm_and_ps(alphaMask, alpha));
+	};
+	
+	__m128i words = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+	words = _mm_packs_epi32(words, words);
+	return (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+};
+
+static void* ddiScaleThread(void *context)
+{
+	DDIScaleBand *band = (DDIScaleBand*) context;
+	band->job->scaleRows(band->job, band->startY, band->endY);
+	return NULL;
+};
+
+/**
+ * Run a scaling job, splitting the output rows between threads if the output is large.
+ */
+static void ddiRunScaleJob(DDIScaleJob *job)
+{
+	unsigned int height = job->dest->height;
+	long numThreads = 1;
+	if ((size_t) job->dest->width * height >= DDI_SCALE_PARALLEL_MIN)
+	{
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (numThreads > DDI_SCALE_MAX_THREADS) numThreads = DDI_SCALE_MAX_THREADS;
+		if (numThreads > height) numThreads = height;
+		if (numThreads < 1) numThreads = 1;
+	};
+	
+	DDIScaleBand bands[DDI_SCALE_MAX_THREADS];
+	pthread_t threads[DDI_SCALE_MAX_THREADS];
+	int started[DDI_SCALE_MAX_THREADS];
+	
+	long i;
+	for (i=0; i<numThreads; i++)
+	{
+		bands[i].job = job;
+		bands[i].startY = height * i / numThreads;
+		bands[i].endY = height * (i+1) / numThreads;
+		started[i] = 0;
+	};
+	
+	// the first band is done by the calling thread; if a thread can't be created, we do its band
+	for (i=1; i<numThreads; i++)
+	{
+		started[i] = pthread_create(&threads[i], NULL, ddiScaleThread, &bands[i]) == 0;
+	};
+	
+	for (i=0; i<numThreads; i++)
+	{
+		if (!started[i]) ddiScaleThread(&bands[i]);
+	};
+	
+	for (i=1; i<numThreads; i++)
+	{
+		if (started[i]) pthread_join(threads[i], NULL);
+	};
+};
+
+static DDISurface* ddiScaleNearest(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
+{
+	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
+	if (out == NULL) return NULL;
+	
+	size_t bpp = surface->format.bpp;
+	size_t srcPixelStride = ddiPixelStride(surface);
+	size_t srcScanline = ddiScanlineStride(surface);
+	size_t outPixelStride = ddiPixelStride(out);
+	size_t outScanline = ddiScanlineStride(out);
+	
+	unsigned int *colOffsets = (unsigned int*) malloc(sizeof(unsigned int) * newWidth);
+	if (colOffsets == NULL)
+	{
+		ddiDeleteSurface(out);
+		return NULL;
+	};
+	
+	// 16.16 fixed-point stepping through the source
+	uint64_t stepX = ((uint64_t) surface->width << 16) / newWidth;
+	uint64_t stepY = ((uint64_t) surface->height << 16) / newHeight;
+	
+	unsigned int x, y;
+	uint64_t pos = 0;
+	for (x=0; x<newWidth; x++)
+	{
+		colOffsets[x] = (pos >> 16) * srcPixelStride;
+		pos += stepX;
+	};
+	
+	pos = 0;
+	for (y=0; y<newHeight; y++)
+	{
+		const uint8_t *scan = surface->data + (pos >> 16) * srcScanline;
+		uint8_t *put = out->data + y * outScanline;
+		pos += stepY;
+		
+		if (bpp == 4)
+		{
+			for (x=0; x<newWidth; x++)
+			{
+				*((uint32_t*) put) = *((const uint32_t*) (scan + colOffsets[x]));
+				put += outPixelStride;
+			};
+		}
+		else
+		{
+			for (x=0; x<newWidth; x++)
+			{
+				memcpy(put, scan + colOffsets[x], bpp);
+				put += outPixelStride;
+			};
+		};
+	};
+	
+	free(colOffsets);
+	return out;
+};
+
+static void ddiScaleBilinearRows(DDIScaleJob *job, unsigned int startY, unsigned int endY)
+{
+	DDISurface *src = job->src;
+	DDISurface *dest = job->dest;
+	size_t srcScanline = ddiScanlineStride(src);
+	size_t outScanline = ddiScanlineStride(dest);
+	size_t outPixelStride = ddiPixelStride(dest);
+	int rotate = job->rotate;
+	int hasAlpha = job->hasAlpha;
+	
+	float scaleY = (float) src->height / (float) dest->height;
+	
+	unsigned int x, y;
+	for (y=startY; y<endY; y++)
+	{
+		// sample at the center of the output pixel
+		float srcY = (y + 0.5f) * scaleY - 0.5f;
+		if (srcY < 0.0f) srcY = 0.0f;
+		unsigned int top = (unsigned int) srcY;
+		if (top > src->height - 1) top = src->height - 1;
+		unsigned int bottom = top + 1 < src->height ? top + 1 : top;
+		__m128 fracY = _mm_set1_ps(srcY - (float) top);
+		
+		const uint8_t *scanTop = src->data + top * srcScanline;
+		const uint8_t *scanBottom = src->data + bottom * srcScanline;
+		uint8_t *put = dest->data + y * outScanline;
+		
+		for (x=0; x<dest->width; x++)
+		{
+			__m128 tl = ddiLoadPixel(ddiRotl(*((const uint32_t*) (scanTop + job->colLeft[x])), rotate), hasAlpha);
+			__m128 tr = ddiLoadPixel(ddiRotl(*((const uint32_t*) (scanTop + job->colRight[x])), rotate), hasAlpha);
+			__m128 bl = ddiLoadPixel(ddiRotl(*((const uint32_t*) (scanBottom + job->colLeft[x])), rotate), hasAlpha);
+			__m128 br = ddiLoadPixel(ddiRotl(*((const uint32_t*) (scanBottom + job->colRight[x])), rotate), hasAlpha);
+			
+			__m128 fracX = _mm_set1_ps(job->colFrac[x]);
+			__m128 upper = _mm_add_ps(tl, _mm_mul_ps(_mm_sub_ps(tr, tl), fracX));
+			__m128 lower = _mm_add_ps(bl, _mm_mul_ps(_mm_sub_ps(br, bl), fracX));
+			__m128 value = _mm_add_ps(upper, _mm_mul_ps(_mm_sub_ps(lower, upper), fracY));
+			
+			*((uint32_t*) put) = ddiRotr(ddiStorePixel(value, hasAlpha), rotate);
+			put += outPixelStride;
+		};
+	};
+};
+
+static void ddiScaleAreaRows(DDIScaleJob *job, unsigned int startY, unsigned int endY)
+{
+	DDISurface *src = job->src;
+	DDISurface *dest = job->dest;
+	size_t srcScanline = ddiScanlineStride(src);
+	size_t srcPixelStride = ddiPixelStride(src);
+	size_t outScanline = ddiScanlineStride(dest);
+	size_t outPixelStride = ddiPixelStride(dest);
+	int rotate = job->rotate;
+	int hasAlpha = job->hasAlpha;
+	
+	float *acc = (float*) malloc(sizeof(float) * 4 * dest->width);
+	if (acc == NULL) return;
+	
+	unsigned int x, y;
+	for (y=startY; y<endY; y++)
+	{
+		memset(acc, 0, sizeof(float) * 4 * dest->width);
+		
+		unsigned int i;
+		for (i=0; i<job->rowCount[y]; i++)
+		{
+			const uint8_t *scan = src->data + (job->rowFirst[y] + i) * srcScanline;
+			__m128 weightY = _mm_set1_ps(job->rowWeights[job->rowIndex[y] + i]);
+			
+			for (x=0; x<dest->width; x++)
+			{
+				const uint8_t *fetch = scan + job->colFirst[x] * srcPixelStride;
+				const float *weightsX = &job->colWeights[job->colIndex[x]];
+				__m128 sum = _mm_loadu_ps(&acc[4*x]);
+				
+				unsigned int j;
+				for (j=0; j<job->colCount[x]; j++)
+				{
+					__m128 pixel = ddiLoadPixel(ddiRotl(*((const uint32_t*) fetch), rotate), hasAlpha);
+					sum = _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_mul_ps(weightY, _mm_set1_ps(weightsX[j]))));
+					fetch += srcPixelStride;
+				};
+				
+				_mm_storeu_ps(&acc[4*x], sum);
+			};
+		};
+		
+		uint8_t *put = dest->data + y * outScanline;
+		for (x=0; x<dest->width; x++)
+		{
+			*((uint32_t*) put) = ddiRotr(ddiStorePixel(_mm_loadu_ps(&acc[4*x]), hasAlpha), rotate);
+			put += outPixelStride;
+		};
+	};
+	
+	free(acc);
+};
+
+/**
+ * Compute the area-averaging weights along one axis: output pixel 'i' covers source pixels from
+ * i*srcSize/newSize to (i+1)*srcSize/newSize, each weighted by how much of it is covered.
+ */
+static int ddiAreaWeights(unsigned int srcSize, unsigned int newSize, unsigned int **firstOut, unsigned int **countOut,
+				unsigned int **indexOut, float **weightsOut)
+{
+	unsigned int *first = (unsigned int*) malloc(sizeof(unsigned int) * newSize);
+	unsigned int *count = (unsigned int*) malloc(sizeof(unsigned int) * newSize);
+	unsigned int *index = (unsigned int*) malloc(sizeof(unsigned int) * newSize);
+	
+	// each output pixel covers at most ceil(srcSize/newSize)+1 source pixels
+	size_t maxWeights = (size_t) newSize * ((srcSize + newSize - 1) / newSize + 1);
+	float *weights = (float*) malloc(sizeof(float) * maxWeights);
+	
+	if (first == NULL || count == NULL || index == NULL || weights == NULL)
+	{
+		free(first);
+		free(count);
+		free(index);
+		free(weights);
+		return -1;
+	};
+	
+	double scale = (double) srcSize / (double) newSize;
+	unsigned int numWeights = 0;
+	unsigned int i;
+	for (i=0; i<newSize; i++)
+	{
+		double start = i * scale;
+		double end = (i + 1) * scale;
+		unsigned int pos = (unsigned int) start;
+		
+		first[i] = pos;
+		index[i] = numWeights;
+		count[i] = 0;
+		
+		for (; pos < srcSize && (double) pos < end; pos++)
+		{
+			double left = (double) pos > start ? (double) pos : start;
+			double right = (double) (pos + 1) < end ? (double) (pos + 1) : end;
+			weights[numWeights++] = (float) ((right - left) / scale);
+			count[i]++;
+		};
+	};
+	
+	*firstOut = first;
+	*countOut = count;
+	*indexOut = index;
+	*weightsOut = weights;
+	return 0;
+};
+
+static void ddiInitScaleJob(DDIScaleJob *job, DDISurface *src, DDISurface *dest)
+{
+	memset(job, 0, sizeof(DDIScaleJob));
+	job->src = src;
+	job->dest = dest;
+	
+	if (src->format.alphaMask != 0)
+	{
+		job->hasAlpha = 1;
+		job->rotate = 8 * (3 - ddiGetIndexForMask(src->format.alphaMask));
+	};
+};
+
+static DDISurface* ddiScaleBilinear(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
+{
+	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
+	if (out == NULL) return NULL;
+	
+	DDIScaleJob job;
+	ddiInitScaleJob(&job, surface, out);
+	job.colLeft = (unsigned int*) malloc(sizeof(unsigned int) * newWidth);
+	job.colRight = (unsigned int*) malloc(sizeof(unsigned int) * newWidth);
+	job.colFrac = (float*) malloc(sizeof(float) * newWidth);
+	
+	if (job.colLeft == NULL || job.colRight == NULL || job.colFrac == NULL)
+	{
+		free(job.colLeft);
+		free(job.colRight);
+		free(job.colFrac);
+		ddiDeleteSurface(out);
+		return NULL;
+	};
+	
+	size_t pixelStride = ddiPixelStride(surface);
+	float scaleX = (float) surface->width / (float) newWidth;
+	unsigned int x;
+	for (x=0; x<newWidth; x++)
+	{
+		float srcX = (x + 0.5f) * scaleX - 0.5f;
+		if (srcX < 0.0f) srcX = 0.0f;
+		unsigned int left = (unsigned int) srcX;
+		if (left > surface->width - 1) left = surface->width - 1;
+		unsigned int right = left + 1 < surface->width ? left + 1 : left;
+		
+		job.colLeft[x] = left * pixelStride;
+		job.colRight[x] = right * pixelStride;
+		job.colFrac[x] = srcX - (float) left;
+	};
+	
+	job.scaleRows = ddiScaleBilinearRows;
+	ddiRunScaleJob(&job);
+	
+	free(job.colLeft);
+	free(job.colRight);
+	free(job.colFrac);
+	return out;
+};
+
+static DDISurface* ddiScaleArea(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
+{
+	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
+	if (out == NULL) return NULL;
+	
+	DDIScaleJob job;
+	ddiInitScaleJob(&job, surface, out);
+	
+	if (ddiAreaWeights(surface->width, newWidth, &job.colFirst, &job.colCount, &job.colIndex, &job.colWeights) != 0)
+	{
+		ddiDeleteSurface(out);
+		return NULL;
+	};
+	
+	if (ddiAreaWeights(surface->height, newHeight, &job.rowFirst, &job.rowCount, &job.rowIndex, &job.rowWeights) != 0)
+	{
+		free(job.colFirst);
+		free(job.colCount);
+		free(job.colIndex);
+		free(job.colWeights);
+		ddiDeleteSurface(out);
+		return NULL;
+	};
+	
+	job.scaleRows = ddiScaleAreaRows;
+	ddiRunScaleJob(&job);
+	
+	free(job.colFirst);
+	free(job.colCount);
+	free(job.colIndex);
+	free(job.colWeights);
+	free(job.rowFirst);
+	free(job.rowCount);
+	free(job.rowIndex);
+	free(job.rowWeights);
+	return out;
+};
+
+/**
+ * Set a single pixel of a surface to the specified color.
+ */
+static void ddiPutPixel(DDISurface *surface, int x, int y, DDIColor *color)
+{
+	if (x < 0 || y < 0 || x >= (int) surface->width || y >= (int) surface->height) return;
+	
+	uint32_t pixel = 0;
+	ddiColorToPixel(&pixel, &surface->format, color);
+	memcpy(surface->data + y * ddiScanlineStride(surface) + x * ddiPixelStride(surface), &pixel, surface->format.bpp);
+};
+
+static DDISurface* ddiScaleBorderedGradient(DDISurface *surface, unsigned int newWidth, unsigned int newHeight)
+{
+	DDISurface *out = ddiCreateSurface(&surface->format, newWidth, newHeight, NULL, 0);
+	if (out == NULL) return NULL;
+	
+	ddiOverlay(surface, 0, 0, out, 0, 0, surface->width/2, surface->height/2);
+	ddiOverlay(surface, surface->width-surface->width/2, 0, out, newWidth-(surface->width/2), 0, surface->width/2, surface->height/2);
+	ddiOverlay(surface, 0, surface->height-surface->height/2, out, 0, newHeight-(surface->height/2), surface->width/2, surface->height/2);
+	ddiOverlay(surface, surface->width-surface->width/2, surface->height-surface->height/2, out, newWidth-(surface->width/2), newHeight-(surface->height/2), surface->width/2, surface->height/2);
+
+	if (newWidth < surface->width || newHeight < surface->height) return out;
+	
+	// top part: mix colors from the left/right borders
+	int y;
+	for (y=0; y<surface->height/2; y++)
+	{
+		DDIColor left, right;
+		ddiGetPixelColor(surface, surface->width/2, y, &left);
+		ddiGetPixelColor(surface, surface->width-surface->width/2, y, &right);
+		
+		int baseX = surface->width/2-1;
+		int endX = newWidth - (surface->width/2);
+		int lineWidth = endX - baseX;
+		
+		int x;
+		for (x=1; x<lineWidth; x++)
+		{
+			float factor = (float) x / (float) lineWidth;
+			DDIColor color;
+			ddiSampleLinearGradient(&color, factor, &left, &right);
+			ddiPutPixel(out, baseX+x, y, &color);
+		};
+	};
+	
+	// bottom part: same idea
+	int baseY = newHeight-(surface->height/2);
+	for (y=baseY; y<newHeight; y++)
+	{
+		int srcY = surface->height - (newHeight - y);
+		DDIColor left, right;
+		ddiGetPixelColor(surface, surface->width/2, srcY, &left);
+		ddiGetPixelColor(surface, surface->width-surface->width/2, srcY, &right);
+		
+		int baseX = surface->width/2-1;
+		int endX = newWidth - (surface->width/2);
+		int lineWidth = endX - baseX;
+		
+		int x;
+		for (x=1; x<lineWidth; x++)
+		{
+			float factor = (float) x / (float) lineWidth;
+			DDIColor color;
+			ddiSampleLinearGradient(&color, factor, &left, &right);
+			ddiPutPixel(out, baseX+x, y, &color);
+		};
+	};
+	
+	// left part
+	int x;
+	for (x=0; x<surface->width/2; x++)
+	{
+		DDIColor top, bottom;
+		ddiGetPixelColor(surface, x, surface->height/2, &top);
+		ddiGetPixelColor(surface, x, surface->height-surface->height/2, &bottom);
+		
+		int baseY = surface->height/2-1;
+		int endY = newHeight - (surface->height/2);
+		int lineHeight = endY - baseY;
+		
+		int y;
+		for (y=1; y<lineHeight; y++)
+		{
+			float factor = (float) y / (float) lineHeight;
+			DDIColor color;
+			ddiSampleLinearGradient(&color, factor, &top, &bottom);
+			ddiPutPixel(out, x, baseY+y, &color);
+		};
+	};
+
+	// right part
+	int baseX = newWidth-(surface->width-surface->width/2);
+	for (x=baseX; x<newWidth; x++)
+	{
+		int srcX = surface->width - (newWidth - x);
+		DDIColor top, bottom;
+		ddiGetPixelColor(surface, srcX, surface->height/2, &top);
+		ddiGetPixelColor(surface, srcX, surface->height-surface->height/2, &bottom);
+		
+		int baseY = surface->height/2-1;
+		int endY = newHeight - (surface->height/2);
+		int lineHeight = endY - baseY;
+		
+		int y;
+		for (y=1; y<lineHeight; y++)
+		{
+			float factor = (float) y / (float) lineHeight;
+			DDIColor color;
+			ddiSampleLinearGradient(&color, factor, &top, &bottom);
+			ddiPutPixel(out, x, baseY+y, &color);
+		};
+	};
+
+	// finally the middle part (quadratic interpolation)
+	int subwidth = newWidth - surface->width;
+	int subheight = newHeight - surface->height;
+	
+	baseX = surface->width / 2;
+	baseY = surface->height / 2;
+	
+	unsigned int totalArea = subwidth * subheight;
+	
+	DDIColor topleft, topright, bottomleft, bottomright;
+	ddiGetPixelColor(surface, surface->width/2, baseY, &topleft);
+	ddiGetPixelColor(surface, surface->width-surface->width/2, baseY, &topright);
+	ddiGetPixelColor(surface, surface->width/2, baseY+1, &bottomleft);
+	ddiGetPixelColor(surface, surface->width-surface->width/2, baseY+1, &bottomright);
+	
+	for (y=0; y<subheight; y++)
+	{
+		for (x=0; x<subwidth; x++)
+		{
+			unsigned int areaTL = x * y;
+			unsigned int areaTR = (subwidth-x) * y;
+			unsigned int areaBL = x * (subheight-y);
+			unsigned int areaBR = (subwidth-x) * (subheight-y);
+			
+			DDIColor result;
+			result.red = ((unsigned int) topleft.red * areaTL + (unsigned int) topright.red * areaTR + (unsigned int) bottomleft.red * areaBL + (unsigned int) bottomright.red * areaBR) / totalArea;
+			result.green = ((unsigned int) topleft.green * areaTL + (unsigned int) topright.green * areaTR + (unsigned int) bottomleft.green * areaBL + (unsigned int) bottomright.green * areaBR) / totalArea;
+			result.blue = ((unsigned int) topleft.blue * areaTL + (unsigned int) topright.blue * areaTR + (unsigned int) bottomleft.blue * areaBL + (unsigned int) bottomright.blue * areaBR) / totalArea;
+			result.alpha = ((unsigned int) topleft.alpha * areaTL + (unsigned int) topright.alpha * areaTR + (unsigned int) bottomleft.alpha * areaBL + (unsigned int) bottomright.alpha * areaBR) / totalArea;
+			
+			ddiPutPixel(out, baseX+x, baseY+y, &result);
+		};
+	};
+	
+	return out;
+};
+
+static DDISurface* ddiScaleUncached(DDISurface *surface, unsigned int newWidth, unsigned int newHeight, int algorithm)
+{
+	// the filtering scalers need 32-bit pixels; anything else is scaled by nearest neighbour
+	int filter = (surface->format.bpp == 4);
+	
+	switch (algorithm)
+	{
+	case DDI_SCALE_BEST:
+		if (!filter) return ddiScaleNearest(surface, newWidth, newHeight);
+		if (newWidth <= surface->width && newHeight <= surface->height) return ddiScaleArea(surface, newWidth, newHeight);
+		return ddiScaleBilinear(surface, newWidth, newHeight);
+	case DDI_SCALE_FASTEST:
+	case DDI_SCALE_NEAREST:
+		return ddiScaleNearest(surface, newWidth, newHeight);
+	case DDI_SCALE_LINEAR:
+		if (!filter) return ddiScaleNearest(surface, newWidth, newHeight);
+		return ddiScaleBilinear(surface, newWidth, newHeight);
+	case DDI_SCALE_AREA:
+		if (!filter) return ddiScaleNearest(surface, newWidth, newHeight);
+		return ddiScaleArea(surface, newWidth, newHeight);
+	case DDI_SCALE_BORDERED_GRADIENT:
+		return ddiScaleBorderedGradient(surface, newWidth, newHeight);
+	default:
+		return NULL;
+	};
+};
+
+/**
+ * Return a copy of a surface.
+ */
+static DDISurface* ddiCopySurface(DDISurface *surface)
+{
+	return ddiCreateSurface(&surface->format, surface->width, surface->height, (char*) surface->data, 0);
+};
+
+DDISurface* ddiScale(DDISurface *surface, unsigned int newWidth, unsigned int newHeight, int algorithm)
+{
+	if (newWidth == 0 || newHeight == 0 || surface->width == 0 || surface->height == 0) return NULL;
+	
+	// small sources (theme elements, icons) are cached by content, since callers often
+	// scale the same image to the same size on every redraw
+	size_t srcSize = ddiGetFormatDataSize(&surface->format, surface->width, surface->height);
+	size_t resultSize = ddiGetFormatDataSize(&surface->format, newWidth, newHeight);
+	if (srcSize > DDI_SCALE_CACHE_SRC_MAX || resultSize > DDI_SCALE_CACHE_SIZE / 4)
+	{
+		return ddiScaleUncached(surface, newWidth, newHeight, algorithm);
+	};
+	
+	pthread_mutex_lock(&ddiScaleCacheLock);
+	DDIScaleCacheEntry **link;
+	for (link=&ddiScaleCache; *link!=NULL; link=&(*link)->next)
+	{
+		DDIScaleCacheEntry *entry = *link;
+		if (entry->srcWidth == surface->width && entry->srcHeight == surface->height
+			&& entry->newWidth == newWidth && entry->newHeight == newHeight
+			&& entry->algorithm == algorithm
+			&& memcmp(&entry->format, &surface->format, sizeof(DDIPixelFormat)) == 0
+			&& memcmp(entry->srcData, surface->data, srcSize) == 0)
+		{
+			// move to front
+			*link = entry->next;
+			entry->next = ddiScaleCache;
+			ddiScaleCache = entry;
+			
+			DDISurface *copy = ddiCopySurface(entry->result);
+			pthread_mutex_unlock(&ddiScaleCacheLock);
+			return copy;
+		};
+	};
+	pthread_mutex_unlock(&ddiScaleCacheLock);
+	
+	DDISurface *result = ddiScaleUncached(surface, newWidth, newHeight, algorithm);
+	if (result == NULL) return NULL;
+	
+	DDIScaleCacheEntry *entry = (DDIScaleCacheEntry*) malloc(sizeof(DDIScaleCacheEntry));
+	if (entry == NULL) return result;
+	
+	entry->srcData = (uint8_t*) malloc(srcSize);
+	entry->result = ddiCopySurface(result);
+	if (entry->srcData == NULL || entry->result == NULL)
+	{
+		free(entry->srcData);
+		if (entry->result != NULL) ddiDeleteSurface(entry->result);
+		free(entry);
+		return result;
+	};
+	
+	memcpy(entry->srcData, surface->data, srcSize);
+	memcpy(&entry->format, &surface->format, sizeof(DDIPixelFormat));
+	entry->srcWidth = surface->width;
+	entry->srcHeight = surface->height;
+	entry->newWidth = newWidth;
+	entry->newHeight = newHeight;
+	entry->algorithm = algorithm;
+	entry->srcSize = srcSize;
+	entry->resultSize = resultSize;
+	
+	pthread_mutex_lock(&ddiScaleCacheLock);
+	entry->next = ddiScaleCache;
+	ddiScaleCache = entry;
+	ddiScaleCacheSize += srcSize + resultSize;
+	
+	// evict the least recently used entries until we're within the limit
+	while (ddiScaleCacheSize > DDI_SCALE_CACHE_SIZE)
+	{
+		for (link=&ddiScaleCache; (*link)->next!=NULL; link=&(*link)->next);
+		DDIScaleCacheEntry *victim = *link;
+		*link = NULL;
+		
+		ddiScaleCacheSize -= victim->srcSize + victim->resultSize;
+		free(victim->srcData);
+		ddiDeleteSurface(victim->result);
+		free(victim);
+	};
+	pthread_mutex_unlock(&ddiScaleCacheLock);
+	
+	return result;
+};
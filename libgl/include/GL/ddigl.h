@@ -252,10 +252,34 @@ typedef struct __ddigl_ctx
 	 */
 	GLenum (*drawArrays)(struct __ddigl_ctx *ctx, GLenum mode, GLint first, GLsizei count);
 	
+	/**
+	 * Draw primitives from the current vertex array, using 'count' indices of the specified type
+	 * (GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, already validated). If an element
+	 * array buffer is bound, 'indices' is an offset into it; otherwise it points to the indices.
+	 * Return GL_NO_ERROR on success, or a GL error number on error.
+	 */
+	GLenum (*drawElements)(struct __ddigl_ctx *ctx, GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+	
 	/**
 	 * Set the viewport.
 	 */
 	void (*viewport)(struct __ddigl_ctx *ctx, GLint x, GLint y, GLsizei width, GLsizei height);
+	
+	/**
+	 * Enable or disable a capability (glEnable() and glDisable()). Return GL_NO_ERROR on success, or
+	 * GL_INVALID_ENUM if the capability is not supported.
+	 */
+	GLenum (*setCapability)(struct __ddigl_ctx *ctx, GLenum cap, GLboolean enable);
+	
+	/**
+	 * Set the depth comparison function. Return GL_NO_ERROR on success, or a GL error number on error.
+	 */
+	GLenum (*depthFunc)(struct __ddigl_ctx *ctx, GLenum func);
+	
+	/**
+	 * Enable or disable writing to the depth buffer.
+	 */
+	void (*depthMask)(struct __ddigl_ctx *ctx, GLboolean flag);
 } DDIGL_Context;
 
 extern DDIGL_Context* __ddigl_current;
@@ -188,6 +188,23 @@ extern "C" {
 #define GL_MAX_3D_TEXTURE_SIZE			0x8073
 #define GL_TEXTURE_BINDING_3D			0x806A
 
+/**
+ * Capabilities for glEnable() and glDisable().
+ */
+#define	GL_DEPTH_TEST				0x0B71
+
+/**
+ * Depth comparison functions.
+ */
+#define	GL_NEVER				0x0200
+#define	GL_LESS					0x0201
+#define	GL_EQUAL				0x0202
+#define	GL_LEQUAL				0x0203
+#define	GL_GREATER				0x0204
+#define	GL_NOTEQUAL				0x0205
+#define	GL_GEQUAL				0x0206
+#define	GL_ALWAYS				0x0207
+
 /**
  * Primitive modes.
  */
@@ -237,6 +254,18 @@ GLenum glGetError();
  */
 void glViewport(GLint x, GLint y, GLsizei w, GLsizei h);
 
+/**
+ * Capabilities.
+ */
+void glEnable(GLenum cap);
+void glDisable(GLenum cap);
+
+/**
+ * Depth buffer.
+ */
+void glDepthFunc(GLenum func);
+void glDepthMask(GLboolean flag);
+
 /**
  * Buffer clearing.
  */
@@ -274,6 +303,7 @@ void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean norm
  * Drawing.
  */
 void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
 
 #ifdef __cplusplus
 }	/* extern "C" */
@@ -42,6 +42,32 @@
 #define	DATA_ROW_HEIGHT				20
 #define	DATA_CHILD_INDENT			20
 
+/**
+ * Describes what was drawn in a visible row, to work out which rows changed between redraws.
+ */
+typedef struct
+{
+	/**
+	 * The node drawn in this row.
+	 */
+	GWMDataNode*				node;
+	
+	/**
+	 * Where it was drawn.
+	 */
+	int					drawY;
+	
+	/**
+	 * Whether it was selected.
+	 */
+	int					selected;
+	
+	/**
+	 * Whether any of its cells were re-rendered.
+	 */
+	int					redrawn;
+} DataRowState;
+
 /**
  * Represents a column of data in a data control. Structure is opaquely typedefed to GWMDataColumn by libgwm.h.
  */
@@ -212,6 +238,25 @@ typedef struct
 	 * If set to 1, the control is "completly dirty" and all cells reuqire a re-draw.
 	 */
 	int					dirty;
+	
+	/**
+	 * Rows drawn during the current and previous redraw. Only rows which differ between the two
+	 * are reported to the window manager as damaged.
+	 */
+	DataRowState*				rows;
+	int					numRows;
+	DataRowState*				prevRows;
+	int					numPrevRows;
+	int					rowsCapacity;
+	
+	/**
+	 * Geometry of the previous redraw; if any of it changes, the whole control is damaged.
+	 */
+	int					lastWidth;
+	int					lastHeight;
+	int					lastScrollX;
+	int					lastFlags;
+	int					lastColsWidth;
 } DataCtrlData;
 
 static DataCell* getCellByKey(GWMDataNode *node, int key)
@@ -239,6 +284,16 @@ static DataCell* getCellByKey(GWMDataNode *node, int key)
 	return cell;
 };
 
+static void invalidateNode(GWMDataNode *node)
+{
+	DataCell *cell;
+	for (cell=node->first; cell!=NULL; cell=cell->next)
+	{
+		if (cell->surf != NULL) ddiDeleteSurface(cell->surf);
+		cell->surf = NULL;
+	};
+};
+
 void gwmSetDataString(GWMDataCtrl *ctrl, GWMDataNode *node, int key, const char *str)
 {
 	DataCell *cell = getCellByKey(node, key);
@@ -246,6 +301,9 @@ void gwmSetDataString(GWMDataCtrl *ctrl, GWMDataNode *node, int key, const char
 	free(cell->strval);
 	cell->strval = strdup(str);
 	
+	if (cell->surf != NULL) ddiDeleteSurface(cell->surf);
+	cell->surf = NULL;
+	
 	gwmPostUpdate(ctrl);
 };
 
@@ -266,6 +324,7 @@ const char* gwmGetDataString(GWMDataCtrl *ctrl, GWMDataNode *node, int key)
 void gwmSetDataNodeIcon(GWMDataCtrl *ctrl, GWMDataNode *node, DDISurface *icon)
 {
 	node->icon = icon;
+	invalidateNode(node);
 	gwmPostUpdate(ctrl);
 };
 
@@ -288,6 +347,19 @@ static int drawNode(GWMWindow *datactrl, DataCtrlData *data, GWMDataNode *parent
 		if (drawY > -DATA_ROW_HEIGHT && drawY < canvas->height)
 		{
 			// actually visible; let's draw
+			if (data->numRows == data->rowsCapacity)
+			{
+				data->rowsCapacity = 2 * data->rowsCapacity + 16;
+				data->rows = (DataRowState*) realloc(data->rows, sizeof(DataRowState) * data->rowsCapacity);
+				data->prevRows = (DataRowState*) realloc(data->prevRows, sizeof(DataRowState) * data->rowsCapacity);
+			};
+			
+			DataRowState *row = &data->rows[data->numRows++];
+			row->node = node;
+			row->drawY = drawY;
+			row->selected = node->selected;
+			row->redrawn = 0;
+			
 			if (node->selected)
 			{
 				ddiFillRect(canvas, 1, drawY, canvas->width-2, DATA_ROW_HEIGHT, GWM_COLOR_SELECTION);
@@ -307,6 +379,7 @@ static int drawNode(GWMWindow *datactrl, DataCtrlData *data, GWMDataNode *parent
 				
 				if (cell->surf == NULL || cell->surf->width != col->width || update)
 				{
+					row->redrawn = 1;
 					if (cell->surf != NULL) ddiDeleteSurface(cell->surf);
 					
 					cell->surf = ddiCreateSurface(&canvas->format, col->width, DATA_ROW_HEIGHT, NULL, 0);
@@ -388,6 +461,26 @@ static void ctrlRedraw(GWMDataCtrl *ctrl)
 	int plotY = 1;
 	if (data->flags & GWM_DATA_SHOW_HEADERS) plotY = DATA_ROW_HEIGHT;
 	
+	int colsWidth = 0;
+	GWMDataColumn *col;
+	for (col=data->cols; col!=NULL; col=col->next)
+	{
+		colsWidth = colsWidth * 31 + col->width;
+	};
+	
+	int fullDamage = data->dirty
+		|| data->lastWidth != canvas->width
+		|| data->lastHeight != canvas->height
+		|| data->lastScrollX != data->scrollX
+		|| data->lastFlags != data->flags
+		|| data->lastColsWidth != colsWidth;
+	
+	DataRowState *tmp = data->prevRows;
+	data->prevRows = data->rows;
+	data->numPrevRows = data->numRows;
+	data->rows = tmp;
+	data->numRows = 0;
+	
 	int maxY = drawNode(ctrl, data, data->root, 0, plotY);
 	
 	if (data->flags & GWM_DATA_SHOW_HEADERS)
@@ -397,7 +490,6 @@ static void ctrlRedraw(GWMDataCtrl *ctrl)
 		
 		int drawX = 1;
 		
-		GWMDataColumn *col;
 		for (col=data->cols; col!=NULL; col=col->next)
 		{
 			ddiFillRect(canvas, drawX, 0, col->width, DATA_ROW_HEIGHT, &border);
@@ -446,7 +538,80 @@ static void ctrlRedraw(GWMDataCtrl *ctrl)
 	};
 	
 	data->dirty = 0;
-	gwmPostDirty(ctrl);
+	data->lastWidth = canvas->width;
+	data->lastHeight = canvas->height;
+	data->lastScrollX = data->scrollX;
+	data->lastFlags = data->flags;
+	data->lastColsWidth = colsWidth;
+	
+	if (fullDamage)
+	{
+		gwmPostDirty(ctrl);
+		return;
+	};
+	
+	// find the rows which changed, and merge vertically adjacent ones
+	GWMDamageRect rects[GWM_MAX_DAMAGE_RECTS];
+	int numRects = 0;
+	
+	int i;
+	int count = data->numRows;
+	if (data->numPrevRows > count) count = data->numPrevRows;
+	for (i=0; i<count; i++)
+	{
+		DataRowState *cur = NULL;
+		DataRowState *prev = NULL;
+		if (i < data->numRows) cur = &data->rows[i];
+		if (i < data->numPrevRows) prev = &data->prevRows[i];
+		
+		if (cur != NULL && prev != NULL && cur->node == prev->node && cur->drawY == prev->drawY
+			&& cur->selected == prev->selected && !cur->redrawn)
+		{
+			continue;
+		};
+		
+		int top = canvas->height;
+		int bottom = 0;
+		
+		if (cur != NULL)
+		{
+			top = cur->drawY;
+			bottom = cur->drawY + DATA_ROW_HEIGHT;
+		};
+		
+		if (prev != NULL)
+		{
+			if (prev->drawY < top) top = prev->drawY;
+			if ((prev->drawY + DATA_ROW_HEIGHT) > bottom) bottom = prev->drawY + DATA_ROW_HEIGHT;
+		};
+		
+		if (numRects != 0 && rects[numRects-1].y + rects[numRects-1].height >= top)
+		{
+			GWMDamageRect *last = &rects[numRects-1];
+			if (bottom > last->y + last->height) last->height = bottom - last->y;
+			if (top < last->y)
+			{
+				last->height += last->y - top;
+				last->y = top;
+			};
+			continue;
+		};
+		
+		if (numRects == GWM_MAX_DAMAGE_RECTS)
+		{
+			// too fragmented; just redraw everything
+			gwmPostDirty(ctrl);
+			return;
+		};
+		
+		rects[numRects].x = 0;
+		rects[numRects].y = top;
+		rects[numRects].width = canvas->width;
+		rects[numRects].height = bottom - top;
+		numRects++;
+	};
+	
+	if (numRects != 0) gwmPostDirtyRects(ctrl, rects, numRects);
 };
 
 static void unselectRecur(GWMDataNode *parent)
@@ -782,6 +947,11 @@ GWMDataCtrl* gwmNewDataCtrl(GWMWindow *parent)
 	
 	data->dirty = 0;
 	
+	data->rows = data->prevRows = NULL;
+	data->numRows = data->numPrevRows = data->rowsCapacity = 0;
+	data->lastWidth = data->lastHeight = -1;
+	data->lastScrollX = data->lastFlags = data->lastColsWidth = 0;
+	
 	ctrl->getMinSize = ctrlMinSize;
 	ctrl->getPrefSize = ctrlPrefSize;
 	ctrl->position = ctrlPosition;
@@ -943,6 +1113,7 @@ GWMDataNode* gwmGetDataNode(GWMDataCtrl *ctrl, GWMDataNode *parent, int index)
 void gwmSetDataNodeFlags(GWMDataCtrl *ctrl, GWMDataNode *node, int flags)
 {
 	node->flags = flags;
+	invalidateNode(node);
 	gwmPostUpdate(ctrl);
 };
 
@@ -1043,6 +1214,8 @@ void gwmDestroyDataCtrl(GWMDataCtrl *ctrl)
 	};
 	
 	gwmDestroyScrollbar(data->sbar);
+	free(data->rows);
+	free(data->prevRows);
 	free(data);
 	gwmDestroyWindow(ctrl);
 };
@@ -65,10 +65,17 @@ typedef struct GWMWaiter_
 	sem_t				lock;
 } GWMWaiter;
 
+/**
+ * Number of buckets in the index of aggregating events waiting in the queue.
+ */
+#define	GWM_AGG_BUCKETS			64
+
 typedef struct EventBuffer_
 {
 	struct EventBuffer_*		prev;
 	struct EventBuffer_*		next;
+	struct EventBuffer_*		aggNext;	// next in the same bucket of 'aggEvents'
+	uint32_t			serial;		// for events which came over the socket
 	GWMEvent			payload;
 } EventBuffer;
 
@@ -80,6 +87,33 @@ typedef struct FileIconCache_
 	DDISurface*			large;
 } FileIconCache;
 
+/**
+ * Buffer state of a double- or triple-buffered window.
+ */
+typedef struct GWMBufferState_
+{
+	struct GWMBufferState_*		prev;
+	struct GWMBufferState_*		next;
+	uint64_t			id;				// window ID
+	int				numBuffers;
+	DDISurface*			bufs[GWM_MAX_BUFFERS];
+	int				current;			// being drawn into (the canvas)
+	int				front;				// displayed by the server, or -1
+	int				busy[GWM_MAX_BUFFERS];		// committed to the server
+	int				queue[GWM_MAX_BUFFERS];		// awaiting GWM_EVENT_FRAME_DONE, oldest first
+	int				queueLen;
+	uint32_t			nextSerial;
+	uint32_t			firstSerial;			// earlier frames predate the last resize
+	sem_t				semRelease;			// posted whenever a buffer is released
+	
+	/**
+	 * Regions which changed in later frames, and must be copied into each buffer before it
+	 * is drawn into again. -1 means the whole buffer is out of date.
+	 */
+	int				numDamage[GWM_MAX_BUFFERS];
+	GWMDamageRect			damage[GWM_MAX_BUFFERS][GWM_MAX_DAMAGE_RECTS];
+} GWMBufferState;
+
 static pthread_mutex_t waiterLock;
 static GWMWaiter* waiters = NULL;
 static sem_t semEventCounter;
@@ -89,6 +123,30 @@ static EventBuffer *lastEvent;
 static GWMHandlerInfo *firstHandler = NULL;
 static GWMInfo *gwminfo = NULL;
 static FileIconCache *fileIconCache = NULL;
+static pthread_mutex_t bufferLock;
+static GWMBufferState *bufferedWindows = NULL;
+
+/**
+ * Aggregating events in the queue, hashed by type and window, so that a new one can replace an
+ * older one without searching the queue.
+ */
+static EventBuffer *aggEvents[GWM_AGG_BUCKETS];
+
+/**
+ * The ring shared with the window manager (NULL if we couldn't attach one), and the ring we're
+ * attaching. 'cmdLock' serializes threads writing into the command ring.
+ */
+static GWMRing* volatile ring;
+static GWMRing* pendingRing;
+static pthread_mutex_t cmdLock;
+
+/**
+ * Serial number of the next event from the window manager, and events which arrived over the
+ * socket before their turn (listening thread only).
+ */
+static uint32_t nextEventSerial;
+static EventBuffer *firstOverflow;
+static EventBuffer *lastOverflow;
 
 DDIColor* gwmColorSelectionP;
 DDIColor* gwmBackColorP;
@@ -98,6 +156,56 @@ DDIColor* gwmBorderDarkColorP;
 DDIColor* gwmFaintColorP;
 DDIColor* gwmWinTextColorP;
 
+/**
+ * Wake up the window manager's thread for this client, if it's waiting for commands.
+ */
+static void gwmWakeServer(GWMRing *r)
+{
+	if (__sync_bool_compare_and_swap(&r->serverSleeping, 1, 0))
+	{
+		GWMCommand cmd;
+		cmd.wakeup.cmd = GWM_CMD_WAKEUP;
+		write(queueFD, &cmd, sizeof(cmd.wakeup));
+	};
+};
+
+/**
+ * Send a command to the window manager. Returns 0 on success, -1 on error.
+ */
+static int gwmSendCommand(const GWMCommand *cmd)
+{
+	GWMRing *r = ring;
+	if (r == NULL)
+	{
+		if (write(queueFD, cmd, sizeof(GWMCommand)) != sizeof(GWMCommand))
+		{
+			perror("write(queueFD)");
+			return -1;
+		};
+		
+		return 0;
+	};
+	
+	pthread_mutex_lock(&cmdLock);
+	uint32_t tail = r->cmdTail;
+	while ((uint32_t) (tail - r->cmdHead) >= GWM_RING_COMMANDS)
+	{
+		// full; make sure the window manager is draining it
+		gwmWakeServer(r);
+		_glidix_yield();
+	};
+	
+	memcpy(&r->commands[tail % GWM_RING_COMMANDS], cmd, sizeof(GWMCommand));
+	__sync_synchronize();
+	r->cmdTail = tail + 1;
+	__sync_synchronize();
+	pthread_mutex_unlock(&cmdLock);
+	
+	// a single wakeup covers all commands queued until the window manager gets to them
+	gwmWakeServer(r);
+	return 0;
+};
+
 static void gwmPostWaiter(uint64_t seq, GWMMessage *resp, const GWMCommand *cmd)
 {
 	GWMWaiter *waiter = (GWMWaiter*) malloc(sizeof(GWMWaiter));
@@ -106,24 +214,205 @@ static void gwmPostWaiter(uint64_t seq, GWMMessage *resp, const GWMCommand *cmd)
 	waiter->seq = seq;
 	sem_init(&waiter->lock, 0, 0);
 	
+	// register the waiter before sending, so that the response can't arrive first
 	pthread_mutex_lock(&waiterLock);
-	if (write(queueFD, cmd, sizeof(GWMCommand)) != sizeof(GWMCommand))
-	{
-		pthread_mutex_unlock(&waiterLock);
-		perror("write(queueFD)");
-	};
-	
 	waiter->next = waiters;
 	waiter->prev = NULL;
+	if (waiters != NULL) waiters->prev = waiter;
 	waiters = waiter;
 	pthread_mutex_unlock(&waiterLock);
 	
+	gwmSendCommand(cmd);
+	
 	// wait for response
 	sem_wait(&waiter->lock);
 	memcpy(resp, &waiter->resp, sizeof(GWMMessage));
 	free(waiter);
 };
 
+static void gwmFrameDone(uint64_t id, uint32_t serial)
+{
+	pthread_mutex_lock(&bufferLock);
+	
+	GWMBufferState *st;
+	for (st=bufferedWindows; st!=NULL; st=st->next)
+	{
+		if (st->id == id) break;
+	};
+	
+	if (st != NULL && (int32_t)(serial - st->firstSerial) >= 0 && st->queueLen != 0)
+	{
+		// the oldest committed buffer is now on the screen, so the one before it is free
+		int shown = st->queue[0];
+		st->queueLen--;
+		memmove(&st->queue[0], &st->queue[1], sizeof(int) * st->queueLen);
+		
+		if (st->front != -1 && st->front != shown)
+		{
+			st->busy[st->front] = 0;
+			sem_post(&st->semRelease);
+		};
+		
+		st->front = shown;
+	};
+	
+	pthread_mutex_unlock(&bufferLock);
+};
+
+/**
+ * Return the bucket in 'aggEvents' for an event, or -1 if the event doesn't aggregate.
+ */
+static int gwmAggBucket(GWMEvent *ev)
+{
+	if (ev->type == GWM_EVENT_UPDATE || ev->type == GWM_EVENT_RESIZE_REQUEST || (ev->type & GWM_EVENT_AGG))
+	{
+		return (int) ((ev->win * 31 + (uint64_t) ev->type) % GWM_AGG_BUCKETS);
+	};
+	
+	return -1;
+};
+
+/**
+ * Remove an event from the queue (but don't free it). Call with 'eventLock' held.
+ */
+static void gwmUnqueueEvent(EventBuffer *buf)
+{
+	if (buf->prev != NULL) buf->prev->next = buf->next;
+	else firstEvent = buf->next;
+	if (buf->next != NULL) buf->next->prev = buf->prev;
+	else lastEvent = buf->prev;
+	
+	int bucket = gwmAggBucket(&buf->payload);
+	if (bucket != -1)
+	{
+		EventBuffer **link;
+		for (link=&aggEvents[bucket]; *link!=buf; link=&(*link)->aggNext);
+		*link = buf->aggNext;
+	};
+};
+
+/**
+ * Add an event to the queue read by gwmWaitEvent(), with 'eventLock' held. Aggregating events replace
+ * an older event of the same type for the same window, and a motion event replaces a motion event for the
+ * same window at the end of the queue. Returns 1 if the queue got longer (and so 'semEventCounter' must be
+ * posted), 0 if an event was replaced.
+ */
+static int gwmQueueEvent(GWMEvent *ev)
+{
+	if (ev->type == GWM_EVENT_MOTION && lastEvent != NULL && lastEvent->payload.type == GWM_EVENT_MOTION
+		&& lastEvent->payload.win == ev->win)
+	{
+		memcpy(&lastEvent->payload, ev, sizeof(GWMEvent));
+		return 0;
+	};
+	
+	int result = 1;
+	int bucket = gwmAggBucket(ev);
+	EventBuffer *buf = NULL;
+	if (bucket != -1)
+	{
+		// the older event is dropped, and this one is delivered in its own position
+		for (buf=aggEvents[bucket]; buf!=NULL; buf=buf->aggNext)
+		{
+			if (buf->payload.type == ev->type && buf->payload.win == ev->win)
+			{
+				gwmUnqueueEvent(buf);
+				result = 0;
+				break;
+			};
+		};
+	};
+	
+	if (buf == NULL)
+	{
+		buf = (EventBuffer*) malloc(sizeof(EventBuffer));
+	};
+	
+	memcpy(&buf->payload, ev, sizeof(GWMEvent));
+	buf->next = NULL;
+	buf->prev = lastEvent;
+	if (lastEvent == NULL) firstEvent = buf;
+	else lastEvent->next = buf;
+	lastEvent = buf;
+	
+	if (bucket != -1)
+	{
+		buf->aggNext = aggEvents[bucket];
+		aggEvents[bucket] = buf;
+	};
+	
+	return result;
+};
+
+/**
+ * Handle an event from the window manager, on the listening thread.
+ */
+static void gwmReceiveEvent(GWMEvent *ev)
+{
+	if (ev->type == GWM_EVENT_FRAME_DONE)
+	{
+		// release buffers here, since the application may be blocked waiting for one
+		gwmFrameDone(ev->win, (uint32_t) ev->value);
+	};
+	
+	pthread_mutex_lock(&eventLock);
+	int added = gwmQueueEvent(ev);
+	pthread_mutex_unlock(&eventLock);
+	
+	if (added) sem_post(&semEventCounter);
+};
+
+/**
+ * Returns nonzero if the next event (by serial number) has arrived.
+ */
+static int gwmEventReady(GWMRing *r)
+{
+	if (firstOverflow != NULL && firstOverflow->serial == nextEventSerial) return 1;
+	
+	uint32_t head = r->evHead;
+	if (head == r->evTail) return 0;
+	__sync_synchronize();
+	
+	return r->events[head % GWM_RING_EVENTS].serial == nextEventSerial;
+};
+
+/**
+ * Receive events from the ring, and events which overflowed onto the socket, in order; stop when the
+ * next event hasn't arrived yet.
+ */
+static void gwmDrainEvents(GWMRing *r)
+{
+	while (1)
+	{
+		if (firstOverflow != NULL && firstOverflow->serial == nextEventSerial)
+		{
+			EventBuffer *buf = firstOverflow;
+			firstOverflow = buf->next;
+			if (firstOverflow == NULL) lastOverflow = NULL;
+			
+			nextEventSerial++;
+			gwmReceiveEvent(&buf->payload);
+			free(buf);
+			continue;
+		};
+		
+		if (!gwmEventReady(r)) break;
+		
+		uint32_t head = r->evHead;
+		GWMEventSlot *slot = &r->events[head % GWM_RING_EVENTS];
+		
+		// the window manager only holds a claim while copying an event in
+		while (!__sync_bool_compare_and_swap(&slot->claim, GWM_SLOT_FREE, GWM_SLOT_READER));
+		GWMEvent ev;
+		memcpy(&ev, &slot->ev, sizeof(GWMEvent));
+		r->evHead = head + 1;
+		__sync_lock_release(&slot->claim);
+		
+		nextEventSerial++;
+		gwmReceiveEvent(&ev);
+	};
+};
+
 static void* listenThreadFunc(void *ignore)
 {
 	(void)ignore;
@@ -132,7 +421,24 @@ static void* listenThreadFunc(void *ignore)
 	initFinished = 1;
 	while (1)
 	{
+		GWMRing *r = ring;
+		if (r != NULL)
+		{
+			gwmDrainEvents(r);
+			
+			// ask for a wakeup, unless more events arrived in the meantime
+			r->clientSleeping = 1;
+			__sync_synchronize();
+			if (gwmEventReady(r))
+			{
+				r->clientSleeping = 0;
+				continue;
+			};
+		};
+		
 		ssize_t size = read(queueFD, msgbuf, 65536);
+		if (r != NULL) r->clientSleeping = 0;
+		
 		if (size == -1)
 		{
 			if (errno == EINTR) continue;
@@ -141,14 +447,27 @@ static void* listenThreadFunc(void *ignore)
 
 		if (size > 0)
 		{
+			GWMMessage *msg = (GWMMessage*) msgbuf;
+			if (size >= sizeof(msg->wakeup) && msg->generic.type == GWM_MSG_WAKEUP && msg->generic.seq == 0)
+			{
+				// new events in the ring
+				continue;
+			};
+			
 			if (size < sizeof(GWMMessage))
 			{
 				continue;
 			};
 		
-			GWMMessage *msg = (GWMMessage*) msgbuf;
 			if (msg->generic.seq != 0)
 			{
+				if (msg->generic.type == GWM_MSG_ATTACH_RING_RESP && msg->attachRingResp.status == 0)
+				{
+					// start reading the ring before the next read(), since events may
+					// already be in it
+					ring = pendingRing;
+				};
+				
 				pthread_mutex_lock(&waiterLock);
 				GWMWaiter *waiter;
 				for (waiter=waiters; waiter!=NULL; waiter=waiter->next)
@@ -167,24 +486,23 @@ static void* listenThreadFunc(void *ignore)
 			}
 			else if (msg->generic.type == GWM_MSG_EVENT)
 			{
-				EventBuffer *buf = (EventBuffer*) malloc(sizeof(EventBuffer));
-				memcpy(&buf->payload, &msg->event.payload, sizeof(GWMEvent));
-				
-				pthread_mutex_lock(&eventLock);
-				if (firstEvent == NULL)
+				if (r == NULL && ring == NULL)
 				{
-					buf->prev = buf->next = NULL;
-					firstEvent = lastEvent = buf;
+					nextEventSerial = msg->event.serial + 1;
+					gwmReceiveEvent(&msg->event.payload);
 				}
 				else
 				{
-					buf->prev = lastEvent;
+					// the ring was full; this event is delivered when its turn comes
+					EventBuffer *buf = (EventBuffer*) malloc(sizeof(EventBuffer));
+					memcpy(&buf->payload, &msg->event.payload, sizeof(GWMEvent));
+					buf->serial = msg->event.serial;
 					buf->next = NULL;
-					lastEvent->next = buf;
-					lastEvent = buf;
+					
+					if (lastOverflow == NULL) firstOverflow = buf;
+					else lastOverflow->next = buf;
+					lastOverflow = buf;
 				};
-				pthread_mutex_unlock(&eventLock);
-				sem_post(&semEventCounter);
 			};
 		}
 		else
@@ -198,6 +516,65 @@ static void* listenThreadFunc(void *ignore)
 	return NULL;
 };
 
+/**
+ * Create a ring in /run/gwmring and ask the window manager to use it. If this fails, we just keep
+ * using the socket for everything.
+ */
+static void gwmAttachRing()
+{
+	uint32_t id;
+	char path[256];
+	int fd;
+	
+	while (1)
+	{
+		id = _glidix_unique();
+		if (id == 0) continue;
+		
+		sprintf(path, "/run/gwmring/%08X", id);
+		fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if (fd != -1) break;
+		if (errno != EEXIST) return;
+	};
+	
+	if (ftruncate(fd, sizeof(GWMRing)) != 0)
+	{
+		close(fd);
+		unlink(path);
+		return;
+	};
+	
+	void *mem = mmap(NULL, sizeof(GWMRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (mem == MAP_FAILED)
+	{
+		unlink(path);
+		return;
+	};
+	
+	pendingRing = (GWMRing*) mem;
+	
+	GWMCommand cmd;
+	memset(&cmd, 0, sizeof(GWMCommand));
+	cmd.attachRing.cmd = GWM_CMD_ATTACH_RING;
+	cmd.attachRing.seq = __sync_fetch_and_add(&nextSeq, 1);
+	cmd.attachRing.ringID = id;
+	
+	GWMMessage resp;
+	gwmPostWaiter(cmd.attachRing.seq, &resp, &cmd);
+	
+	// the window manager has it mapped by now (or has given up on it)
+	unlink(path);
+	
+	if (resp.attachRingResp.status != 0)
+	{
+		munmap(mem, sizeof(GWMRing));
+	};
+	
+	pendingRing = NULL;
+};
+
 int gwmInit()
 {
 	fsInit();
@@ -220,6 +597,8 @@ int gwmInit()
 	
 	pthread_mutex_init(&waiterLock, NULL);
 	pthread_mutex_init(&eventLock, NULL);
+	pthread_mutex_init(&bufferLock, NULL);
+	pthread_mutex_init(&cmdLock, NULL);
 	
 	if (ddiInit("/run/gwmdisp", O_RDONLY) != 0)
 	{
@@ -282,6 +661,7 @@ int gwmInit()
 		return -1;
 	};
 	
+	gwmAttachRing();
 	gwmGetScreenFormat(&screenFormat);
 	
 	gwmColorSelectionP = (DDIColor*) gwmGetThemeProp("gwm.toolkit.selection", GWM_TYPE_COLOR, NULL);
@@ -427,6 +807,36 @@ static int gwmDefaultHandler(GWMEvent *ev, GWMWindow *win, void *context)
 	};
 };
 
+static GWMBufferState* gwmCreateBuffers(GWMWindow *win, int numBuffers)
+{
+	GWMBufferState *st = (GWMBufferState*) malloc(sizeof(GWMBufferState));
+	memset(st, 0, sizeof(GWMBufferState));
+	st->id = win->id;
+	st->numBuffers = numBuffers;
+	st->front = -1;
+	sem_init(&st->semRelease, 0, 0);
+	
+	// the first buffer is the existing canvas; the rest are out of date until first used
+	st->bufs[0] = win->canvas;
+	
+	int i;
+	for (i=1; i<numBuffers; i++)
+	{
+		st->bufs[i] = ddiCreateSurface(&win->canvas->format, win->canvas->width, win->canvas->height, NULL, DDI_SHARED);
+		if (st->bufs[i] == NULL)
+		{
+			while (--i) ddiDeleteSurface(st->bufs[i]);
+			sem_destroy(&st->semRelease);
+			free(st);
+			return NULL;
+		};
+		
+		st->numDamage[i] = -1;
+	};
+	
+	return st;
+};
+
 GWMWindow* gwmCreateWindow(
 	GWMWindow* parent,
 	const char *caption,
@@ -507,6 +917,22 @@ GWMWindow* gwmCreateWindow(
 		win->tabLastChild = NULL;
 		win->tabAccept = 0;
 		
+		win->buffering = NULL;
+		if ((flags & GWM_WINDOW_RENDER_TARGET) == 0)
+		{
+			if (flags & GWM_WINDOW_TRIPLE_BUFFER) win->buffering = gwmCreateBuffers(win, 3);
+			else if (flags & GWM_WINDOW_DOUBLE_BUFFER) win->buffering = gwmCreateBuffers(win, 2);
+		};
+		
+		if (win->buffering != NULL)
+		{
+			pthread_mutex_lock(&bufferLock);
+			win->buffering->next = bufferedWindows;
+			if (bufferedWindows != NULL) bufferedWindows->prev = win->buffering;
+			bufferedWindows = win->buffering;
+			pthread_mutex_unlock(&bufferLock);
+		};
+		
 		gwmPushEventHandler(win, gwmDefaultHandler, NULL);
 		return win;
 	};
@@ -548,15 +974,37 @@ static void gwmHandlerDecref(GWMHandlerInfo *info)
 
 void gwmDestroyWindow(GWMWindow *win)
 {
-	ddiDeleteSurface(win->canvas);
+	if (win->buffering != NULL)
+	{
+		GWMBufferState *st = win->buffering;
+		
+		pthread_mutex_lock(&bufferLock);
+		if (st->prev != NULL) st->prev->next = st->next;
+		if (st->next != NULL) st->next->prev = st->prev;
+		if (bufferedWindows == st) bufferedWindows = st->next;
+		pthread_mutex_unlock(&bufferLock);
+		
+		// this includes the canvas
+		int i;
+		for (i=0; i<st->numBuffers; i++)
+		{
+			ddiDeleteSurface(st->bufs[i]);
+		};
+		
+		sem_destroy(&st->semRelease);
+		free(st);
+	}
+	else
+	{
+		ddiDeleteSurface(win->canvas);
+	};
 	
 	GWMCommand cmd;
 	cmd.destroyWindow.cmd = GWM_CMD_DESTROY_WINDOW;
 	cmd.destroyWindow.id = win->id;
 	
-	if (write(queueFD, &cmd, sizeof(GWMCommand)) != sizeof(GWMCommand))
+	if (gwmSendCommand(&cmd) != 0)
 	{
-		perror("write(queueFD)");
 		return;
 	};
 
@@ -594,100 +1042,198 @@ void gwmDestroyWindow(GWMWindow *win)
 
 void gwmPostDirty(GWMWindow *win)
 {
-	uint64_t seq = __sync_fetch_and_add(&nextSeq, 1);
-	
-	GWMCommand cmd;
-	cmd.postDirty.cmd = GWM_CMD_POST_DIRTY;
-	cmd.postDirty.id = win->id;
-	cmd.postDirty.seq = seq;
-	write(queueFD, &cmd, sizeof(GWMCommand));
-	
-	GWMMessage resp;
-	gwmPostWaiter(seq, &resp, &cmd);
+	gwmPostDirtyRects(win, NULL, 0);
 };
 
-void gwmWaitEvent(GWMEvent *ev)
+static int gwmClipDamage(GWMWindow *win, const GWMDamageRect *rects, int count, GWMDamageRect *out)
 {
-	while (sem_wait(&semEventCounter) != 0);
-	
-	pthread_mutex_lock(&eventLock);
-	while (1)
+	DDISurface *canvas = win->canvas;
+	int numRects = 0;
+	int i;
+	for (i=0; i<count; i++)
 	{
-		memcpy(ev, &firstEvent->payload, sizeof(GWMEvent));
-		firstEvent = firstEvent->next;
-		if (firstEvent != NULL) firstEvent->prev = NULL;
+		// clip to the canvas and drop empty rectangles
+		int left = rects[i].x;
+		int top = rects[i].y;
+		int right = left + rects[i].width;
+		int bottom = top + rects[i].height;
 		
-		if (ev->type == GWM_EVENT_MOTION && firstEvent != NULL)
-		{
-			// aggregate motion events; if there are more motion events waiting,
-			// ignore this one
-			if (firstEvent->payload.type == GWM_EVENT_MOTION)
-			{
-				while (sem_wait(&semEventCounter) != 0);		// decrement count
-				continue;
-			};
-		};
-
-		if (ev->type == GWM_EVENT_UPDATE)
-		{
-			// aggregate update events; if there are more updates waiting, ignore this one
-			EventBuffer *buf;
-			int found = 0;
-			
-			for (buf=firstEvent; buf!=NULL; buf=buf->next)
-			{
-				if (firstEvent->payload.type == GWM_EVENT_UPDATE && firstEvent->payload.win == ev->win)
-				{
-					while (sem_wait(&semEventCounter) != 0);		// decrement count
-					found = 1;
-					break;
-				};
-			};
-			
-			if (found) continue;
-		};
+		if (left < 0) left = 0;
+		if (top < 0) top = 0;
+		if (right > canvas->width) right = canvas->width;
+		if (bottom > canvas->height) bottom = canvas->height;
 		
-		if (ev->type & GWM_EVENT_AGG)
+		if (left >= right || top >= bottom) continue;
+		
+		if (numRects == GWM_MAX_DAMAGE_RECTS)
 		{
-			// general aggregating events
-			EventBuffer *buf;
-			int found = 0;
+			// out of space; grow the last rectangle to cover this one as well
+			GWMDamageRect *last = &out[GWM_MAX_DAMAGE_RECTS-1];
+			int lastRight = last->x + last->width;
+			int lastBottom = last->y + last->height;
 			
-			for (buf=firstEvent; buf!=NULL; buf=buf->next)
-			{
-				if (firstEvent->payload.type == ev->type && firstEvent->payload.win == ev->win)
-				{
-					while (sem_wait(&semEventCounter) != 0);		// decrement count
-					found = 1;
-					break;
-				};
-			};
+			if (left > last->x) left = last->x;
+			if (top > last->y) top = last->y;
+			if (right < lastRight) right = lastRight;
+			if (bottom < lastBottom) bottom = lastBottom;
 			
-			if (found) continue;
+			numRects--;
 		};
+		
+		GWMDamageRect *rect = &out[numRects++];
+		rect->x = left;
+		rect->y = top;
+		rect->width = right - left;
+		rect->height = bottom - top;
+	};
+	
+	return numRects;
+};
+
+static void gwmAddDamage(GWMBufferState *st, int index, const GWMDamageRect *rects, int count)
+{
+	if (st->numDamage[index] == -1) return;
+	if (count == 0 || st->numDamage[index] + count > GWM_MAX_DAMAGE_RECTS)
+	{
+		st->numDamage[index] = -1;
+		return;
+	};
+	
+	memcpy(&st->damage[index][st->numDamage[index]], rects, sizeof(GWMDamageRect) * count);
+	st->numDamage[index] += count;
+};
 
-		if (ev->type == GWM_EVENT_RESIZE_REQUEST)
+static void gwmCommit(GWMWindow *win, const GWMDamageRect *rects, int count)
+{
+	GWMBufferState *st = win->buffering;
+	
+	GWMCommand cmd;
+	memset(&cmd, 0, sizeof(GWMCommand));
+	cmd.commit.cmd = GWM_CMD_COMMIT;
+	cmd.commit.id = win->id;
+	cmd.commit.numRects = count;
+	memcpy(cmd.commit.rects, rects, sizeof(GWMDamageRect) * count);
+	
+	pthread_mutex_lock(&bufferLock);
+	int committed = st->current;
+	cmd.commit.serial = st->nextSerial++;
+	cmd.commit.surfID = st->bufs[committed]->id;
+	
+	st->busy[committed] = 1;
+	st->queue[st->queueLen++] = committed;
+	
+	// every other buffer is now missing this frame
+	int i;
+	for (i=0; i<st->numBuffers; i++)
+	{
+		if (i != committed) gwmAddDamage(st, i, rects, count);
+	};
+	
+	st->numDamage[committed] = 0;
+	pthread_mutex_unlock(&bufferLock);
+	
+	gwmSendCommand(&cmd);
+	
+	// pick the next buffer to draw into, waiting for the server to release one if necessary
+	int next = -1;
+	pthread_mutex_lock(&bufferLock);
+	while (1)
+	{
+		for (i=0; i<st->numBuffers; i++)
 		{
-			// aggregate resize events; if there are more updates waiting, ignore this one
-			EventBuffer *buf;
-			int found = 0;
-			
-			for (buf=firstEvent; buf!=NULL; buf=buf->next)
+			if (!st->busy[i])
 			{
-				if (firstEvent->payload.type == GWM_EVENT_RESIZE_REQUEST && firstEvent->payload.win == ev->win)
-				{
-					while (sem_wait(&semEventCounter) != 0);		// decrement count
-					found = 1;
-					break;
-				};
+				next = i;
+				break;
 			};
-			
-			if (found) continue;
 		};
 		
-		pthread_mutex_unlock(&eventLock);
-		break;
+		if (next != -1) break;
+		
+		pthread_mutex_unlock(&bufferLock);
+		while (sem_wait(&st->semRelease) != 0);
+		pthread_mutex_lock(&bufferLock);
 	};
+	
+	GWMDamageRect damage[GWM_MAX_DAMAGE_RECTS];
+	int numDamage = st->numDamage[next];
+	if (numDamage > 0) memcpy(damage, st->damage[next], sizeof(GWMDamageRect) * numDamage);
+	st->numDamage[next] = 0;
+	st->current = next;
+	pthread_mutex_unlock(&bufferLock);
+	
+	// bring it up to date; the committed buffer is only being read by the server, so we can copy
+	// from it while it's being displayed
+	DDISurface *src = st->bufs[committed];
+	DDISurface *dest = st->bufs[next];
+	if (numDamage == -1)
+	{
+		ddiOverlay(src, 0, 0, dest, 0, 0, src->width, src->height);
+	}
+	else
+	{
+		for (i=0; i<numDamage; i++)
+		{
+			ddiOverlay(src, damage[i].x, damage[i].y, dest, damage[i].x, damage[i].y, damage[i].width, damage[i].height);
+		};
+	};
+	
+	win->canvas = dest;
+};
+
+void gwmPostDirtyRects(GWMWindow *win, const GWMDamageRect *rects, int count)
+{
+	GWMDamageRect clipped[GWM_MAX_DAMAGE_RECTS];
+	int numRects = gwmClipDamage(win, rects, count, clipped);
+	
+	if (count != 0 && numRects == 0)
+	{
+		// everything was clipped away; nothing changed on the screen
+		return;
+	};
+	
+	if (win->buffering != NULL)
+	{
+		gwmCommit(win, clipped, numRects);
+		return;
+	};
+	
+	uint64_t seq = __sync_fetch_and_add(&nextSeq, 1);
+	
+	GWMCommand cmd;
+	memset(&cmd, 0, sizeof(GWMCommand));
+	cmd.postDirty.cmd = GWM_CMD_POST_DIRTY;
+	cmd.postDirty.id = win->id;
+	cmd.postDirty.seq = seq;
+	cmd.postDirty.numRects = numRects;
+	memcpy(cmd.postDirty.rects, clipped, sizeof(GWMDamageRect) * numRects);
+	
+	GWMMessage resp;
+	gwmPostWaiter(seq, &resp, &cmd);
+};
+
+void gwmPostDirtyRect(GWMWindow *win, int x, int y, int width, int height)
+{
+	GWMDamageRect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.width = width;
+	rect.height = height;
+	gwmPostDirtyRects(win, &rect, 1);
+};
+
+void gwmWaitEvent(GWMEvent *ev)
+{
+	while (sem_wait(&semEventCounter) != 0);
+	
+	// events were aggregated as they were queued, so we just take the first one
+	pthread_mutex_lock(&eventLock);
+	EventBuffer *buf = firstEvent;
+	gwmUnqueueEvent(buf);
+	pthread_mutex_unlock(&eventLock);
+	
+	memcpy(ev, &buf->payload, sizeof(GWMEvent));
+	free(buf);
 };
 
 void gwmClearWindow(GWMWindow *win)
@@ -702,30 +1248,21 @@ void gwmPostUpdate(GWMWindow *win)
 
 void gwmPostUpdateEx(GWMWindow *win, int type, int value)
 {
-	EventBuffer *buf = (EventBuffer*) malloc(sizeof(EventBuffer));
-	buf->payload.type = type;
-	buf->payload.value = value;
-	buf->payload.win = 0;
+	GWMEvent ev;
+	memset(&ev, 0, sizeof(GWMEvent));
+	ev.type = type;
+	ev.value = value;
+	ev.win = 0;
 	if (win != NULL)
 	{
-		buf->payload.win = win->id;
+		ev.win = win->id;
 	};
 	
 	pthread_mutex_lock(&eventLock);
-	if (firstEvent == NULL)
-	{
-		buf->prev = buf->next = NULL;
-		firstEvent = lastEvent = buf;
-	}
-	else
-	{
-		buf->prev = lastEvent;
-		buf->next = NULL;
-		lastEvent->next = buf;
-		lastEvent = buf;
-	};
+	int added = gwmQueueEvent(&ev);
 	pthread_mutex_unlock(&eventLock);
-	sem_post(&semEventCounter);
+	
+	if (added) sem_post(&semEventCounter);
 };
 
 void gwmPushEventHandler(GWMWindow *win, GWMEventHandler handler, void *context)
@@ -1008,7 +1545,7 @@ void gwmSetListenWindow(GWMWindow *win)
 	cmd.setListenWindow.seq = seq;
 	cmd.setListenWindow.win = win->id;
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 };
 
 void gwmResizeWindow(GWMWindow *win, int width, int height)
@@ -1022,7 +1559,46 @@ void gwmResizeWindow(GWMWindow *win, int width, int height)
 	DDISurface *newCanvas = ddiCreateSurface(&format, width, height, NULL, surfFlags);
 	ddiFillRect(newCanvas, 0, 0, width, height, gwmBackColorP);
 	ddiBlit(win->canvas, 0, 0, newCanvas, 0, 0, win->canvas->width, win->canvas->height);
-	ddiDeleteSurface(win->canvas);
+	
+	if (win->buffering != NULL)
+	{
+		// all the old buffers go away, including any still held by the server (it switches to a
+		// private copy of the new canvas when it gets the configuration command); frames committed
+		// before now will be ignored when they complete
+		GWMBufferState *st = win->buffering;
+		DDISurface *oldBufs[GWM_MAX_BUFFERS];
+		memcpy(oldBufs, st->bufs, sizeof(DDISurface*) * st->numBuffers);
+		
+		pthread_mutex_lock(&bufferLock);
+		st->bufs[0] = newCanvas;
+		st->numDamage[0] = 0;
+		st->busy[0] = 0;
+		
+		int i;
+		for (i=1; i<st->numBuffers; i++)
+		{
+			st->bufs[i] = ddiCreateSurface(&format, width, height, NULL, surfFlags);
+			assert(st->bufs[i] != NULL);
+			st->numDamage[i] = -1;
+			st->busy[i] = 0;
+		};
+		
+		st->current = 0;
+		st->front = -1;
+		st->queueLen = 0;
+		st->firstSerial = st->nextSerial;
+		pthread_mutex_unlock(&bufferLock);
+		
+		for (i=0; i<st->numBuffers; i++)
+		{
+			ddiDeleteSurface(oldBufs[i]);
+		};
+	}
+	else
+	{
+		ddiDeleteSurface(win->canvas);
+	};
+	
 	win->canvas = newCanvas;
 	
 	// send the configuration command
@@ -1036,7 +1612,7 @@ void gwmResizeWindow(GWMWindow *win, int width, int height)
 	cmd.atomicConfig.height = height;
 	cmd.atomicConfig.canvasID = newCanvas->id;
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 	
 	GWMEvent ev;
 	memset(&ev, 0, sizeof(GWMEvent));
@@ -1054,7 +1630,7 @@ void gwmSetWindowCaption(GWMWindow *win, const char *caption)
 	cmd.atomicConfig.which = GWM_AC_CAPTION;
 	strcpy(cmd.atomicConfig.caption, caption);
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 	win->caption = strdup(caption);
 };
 
@@ -1075,7 +1651,7 @@ void gwmMoveWindow(GWMWindow *win, int x, int y)
 	cmd.atomicConfig.x = x;
 	cmd.atomicConfig.y = y;
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 };
 
 void gwmRelToAbs(GWMWindow *win, int relX, int relY, int *absX, int *absY)
@@ -1139,7 +1715,7 @@ void gwmRedrawScreen()
 	GWMCommand cmd;
 	cmd.cmd = GWM_CMD_REDRAW_SCREEN;
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 };
 
 void gwmGetGlobRef(GWMWindow *win, GWMGlobWinRef *ref)
@@ -1268,7 +1844,7 @@ void gwmRetheme()
 	GWMCommand cmd;
 	cmd.cmd = GWM_CMD_RETHEME;
 	
-	write(queueFD, &cmd, sizeof(GWMCommand));
+	gwmSendCommand(&cmd);
 };
 
 void* gwmGetData(GWMWindow *win, GWMEventHandler handler)
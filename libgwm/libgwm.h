@@ -46,6 +46,15 @@
 #define	GWM_WINDOW_NOICON			(1 << 6)
 #define	GWM_WINDOW_NORESTACK			(1 << 7)
 #define	GWM_WINDOW_RENDER_TARGET		(1 << 8)
+#define	GWM_WINDOW_DOUBLE_BUFFER		(1 << 9)
+#define	GWM_WINDOW_TRIPLE_BUFFER		(1 << 10)
+#define	GWM_WINDOW_OPAQUE			(1 << 11)	/* every pixel of the canvas has full alpha */
+
+/**
+ * Maximum number of canvas buffers of a window (see GWM_WINDOW_DOUBLE_BUFFER and GWM_WINDOW_TRIPLE_BUFFER,
+ * which are ignored for render targets).
+ */
+#define	GWM_MAX_BUFFERS				3
 
 /**
  * Error codes.
@@ -822,6 +831,7 @@ typedef struct GWMDataColumn_ GWMDataColumn;
 #define	GWM_EVENT_SPIN_DECR			14
 #define	GWM_EVENT_SPIN_INCR			15
 #define	GWM_EVENT_SPIN_SET			16
+#define	GWM_EVENT_FRAME_DONE			17		/* 'value' is the serial number of the frame */
 
 /**
  * Cascading events.
@@ -912,6 +922,23 @@ typedef struct
 	int					fd;
 } GWMGlobWinRef;
 
+/**
+ * A rectangle within a window canvas which was changed by the client (a "damage rectangle").
+ */
+typedef struct
+{
+	int					x;
+	int					y;
+	int					width;
+	int					height;
+} GWMDamageRect;
+
+/**
+ * Maximum number of damage rectangles in a single GWM_CMD_POST_DIRTY command. If a client has
+ * more than that, libgwm merges the excess into the bounding box of the last rectangle.
+ */
+#define	GWM_MAX_DAMAGE_RECTS			16
+
 /**
  * Flags for the 'which' parameter for the "atomic config" command.
  */
@@ -946,6 +973,9 @@ typedef struct
 #define	GWM_CMD_REDRAW_SCREEN			16
 #define	GWM_CMD_SCREENSHOT_WINDOW		17
 #define	GWM_CMD_GET_GLOB_ICON			18
+#define	GWM_CMD_COMMIT				19
+#define	GWM_CMD_ATTACH_RING			20
+#define	GWM_CMD_WAKEUP				21
 typedef union
 {
 	int					cmd;
@@ -965,6 +995,8 @@ typedef union
 		int				cmd;	// GWM_CMD_POST_DIRTY
 		uint64_t			id;
 		uint64_t			seq;
+		int				numRects;	// 0 = the whole window
+		GWMDamageRect			rects[GWM_MAX_DAMAGE_RECTS];
 	} postDirty;
 	
 	struct
@@ -1089,6 +1121,28 @@ typedef union
 		uint32_t			seq;
 		GWMGlobWinRef			ref;
 	} getGlobIcon;
+	
+	struct
+	{
+		int				cmd;	// GWM_CMD_COMMIT
+		uint64_t			id;
+		uint32_t			serial;	// frame serial number, reported back in GWM_EVENT_FRAME_DONE
+		uint32_t			surfID;	// the buffer to display from now on
+		int				numRects;	// 0 = the whole window
+		GWMDamageRect			rects[GWM_MAX_DAMAGE_RECTS];
+	} commit;
+	
+	struct
+	{
+		int				cmd;	// GWM_CMD_ATTACH_RING
+		uint64_t			seq;
+		uint32_t			ringID;	// name of the ring file in /run/gwmring
+	} attachRing;
+	
+	struct
+	{
+		int				cmd;	// GWM_CMD_WAKEUP
+	} wakeup;
 } GWMCommand;
 
 /**
@@ -1110,6 +1164,8 @@ typedef union
 #define	GWM_MSG_SCREENSHOT_WINDOW_RESP		13
 #define	GWM_MSG_POST_DIRTY_RESP			14
 #define	GWM_MSG_GET_GLOB_ICON_RESP		15
+#define	GWM_MSG_ATTACH_RING_RESP		16
+#define	GWM_MSG_WAKEUP				17
 typedef union
 {
 	struct
@@ -1133,6 +1189,7 @@ typedef union
 		int				type;	// GWM_MSG_EVENT
 		uint64_t			seq;	// always zero for events
 		GWMEvent			payload;
+		uint32_t			serial;	// position in the event stream (see GWMRing)
 	} event;
 	
 	struct
@@ -1239,8 +1296,73 @@ typedef union
 		int				status;
 		uint32_t			surfID;	// of the icon
 	} getGlobIconResp;
+	
+	struct
+	{
+		int				type;	// GWM_MSG_ATTACH_RING_RESP
+		uint64_t			seq;
+		int				status;
+	} attachRingResp;
+	
+	struct
+	{
+		int				type;	// GWM_MSG_WAKEUP
+		uint64_t			seq;	// always zero
+	} wakeup;
 } GWMMessage;
 
+/**
+ * Number of slots in each direction of a GWMRing.
+ */
+#define	GWM_RING_EVENTS				256
+#define	GWM_RING_COMMANDS			64
+
+/**
+ * Values of GWMEventSlot.claim.
+ */
+#define	GWM_SLOT_FREE				0
+#define	GWM_SLOT_READER				1
+#define	GWM_SLOT_WRITER				2
+
+/**
+ * An event in the event ring. The window manager may overwrite the newest unread slot in place
+ * (to compress motion events), so both sides must claim a slot before accessing it; the window manager
+ * never waits for a claim, it just appends a new event instead.
+ */
+typedef struct
+{
+	volatile uint32_t			claim;
+	uint32_t				serial;
+	GWMEvent				ev;
+} GWMEventSlot;
+
+/**
+ * Shared memory between the window manager and a client, created by the client in /run/gwmring and
+ * attached with GWM_CMD_ATTACH_RING. Events and commands are passed through the rings instead of the
+ * socket; the socket only carries wakeups (GWM_CMD_WAKEUP, GWM_MSG_WAKEUP), command responses, and
+ * events which didn't fit in the event ring.
+ *
+ * Events are numbered with consecutive serial numbers, and events sent over the socket carry their
+ * serial too, so the client can deliver them in order.
+ *
+ * Each side sets its "sleeping" flag before blocking on the socket, and the other side sends a wakeup
+ * only if it manages to clear that flag, so there is at most one wakeup per sleep no matter how many
+ * events or commands are queued.
+ */
+typedef struct
+{
+	volatile uint32_t			evHead;			// next slot to be read; written by the client
+	volatile uint32_t			evTail;			// next slot to be written; written by the server
+	volatile uint32_t			clientSleeping;
+	uint32_t				resv1[13];
+	volatile uint32_t			cmdHead;		// written by the server
+	volatile uint32_t			cmdTail;		// written by the client
+	volatile uint32_t			serverSleeping;
+	uint32_t				resv2[13];
+	GWMEventSlot				events[GWM_RING_EVENTS];
+	GWMCommand				commands[GWM_RING_COMMANDS];
+} GWMRing;
+
 struct GWMWindow_;
 
 /**
@@ -1370,6 +1492,12 @@ typedef struct GWMWindow_
 	 * Does this window accept tabs?
 	 */
 	int					tabAccept;
+	
+	/**
+	 * Buffer state of a double- or triple-buffered window; NULL for all other windows. Opaque;
+	 * defined in libgwm.c.
+	 */
+	struct GWMBufferState_*			buffering;
 } GWMObject;
 
 /**
@@ -1647,9 +1775,28 @@ const char* gwmGetWindowCaption(GWMWindow *win);
 
 /**
  * Tell the window manager that a window needs re-drawing.
+ *
+ * For windows created with GWM_WINDOW_DOUBLE_BUFFER or GWM_WINDOW_TRIPLE_BUFFER, this does not wait for
+ * the window manager. The canvas is handed over to the window manager as-is (without being copied), and
+ * the window gets a fresh canvas to draw the next frame into, with the same contents; a GWM_EVENT_FRAME_DONE
+ * event is delivered to the window once the frame is on the screen. Since the canvas changes, you must call
+ * gwmGetWindowCanvas() again after posting. This only blocks if all the buffers are still in use by the
+ * window manager.
  */
 void gwmPostDirty(GWMWindow *win);
 
+/**
+ * Tell the window manager that only the specified regions of the window canvas have changed. Only
+ * those regions are copied to the server and re-composited onto the screen. If 'count' is 0, the
+ * whole window is considered dirty, same as gwmPostDirty().
+ */
+void gwmPostDirtyRects(GWMWindow *win, const GWMDamageRect *rects, int count);
+
+/**
+ * Tell the window manager that a single rectangle of the window canvas has changed.
+ */
+void gwmPostDirtyRect(GWMWindow *win, int x, int y, int width, int height);
+
 /**
  * Wait until an event is received and store it in the event structure.
  */
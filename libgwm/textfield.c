@@ -117,6 +117,15 @@ typedef struct
 	 * List of text styles.
 	 */
 	TextStyle*		styles;
+	
+	/**
+	 * Cached copy of the field background (border, template and icon), and the state it was
+	 * drawn for. While the state stays the same, only the text area is redrawn (from this cache)
+	 * and reported to the window manager as damaged.
+	 */
+	DDISurface*		frame;
+	int			frameState;
+	DDISurface*		frameIcon;
 } GWMTextFieldData;
 
 static DDIFont *fntPlaceHolder;
@@ -137,8 +146,43 @@ void gwmRedrawTextField(GWMWindow *field)
 	};
 	
 	int penY = 0;
+	if ((data->flags & GWM_TXT_MULTILINE) == 0)
+	{
+		penX += 2;
+		penY = 6;
+	};
 	
+	// the region which may be touched by the text (including the cursor and placeholder)
+	GWMDamageRect textRect;
 	if (data->flags & GWM_TXT_MULTILINE)
+	{
+		textRect.x = 1;
+		textRect.y = 1;
+		textRect.width = canvas->width - 2;
+		textRect.height = canvas->height - 2;
+	}
+	else
+	{
+		textRect.x = penX - 2;
+		textRect.y = 0;
+		textRect.width = canvas->width - textRect.x;
+		textRect.height = canvas->height;
+	};
+	
+	int frameState = (data->flags << 1) | (data->focused != 0);
+	int redrawFrame = data->frame == NULL
+		|| data->frame->width != canvas->width
+		|| data->frame->height != canvas->height
+		|| data->frameState != frameState
+		|| data->frameIcon != data->icon
+		|| textRect.width <= 0
+		|| textRect.height <= 0;
+	
+	if (!redrawFrame)
+	{
+		ddiOverlay(data->frame, textRect.x, textRect.y, canvas, textRect.x, textRect.y, textRect.width, textRect.height);
+	}
+	else if (data->flags & GWM_TXT_MULTILINE)
 	{
 		DDIColor *color = GWM_COLOR_FAINT;
 		if (data->focused)
@@ -190,20 +234,30 @@ void gwmRedrawTextField(GWMWindow *field)
 		ddiBlit(scaled, 0, 0, canvas, 0, 0, canvas->width, canvas->height);
 		ddiDeleteSurface(scaled);
 		ddiDeleteSurface(temp);
-		
-		penX += 2;
-		penY = 6;
 	};
 
-	if (data->icon != NULL)
+	if (redrawFrame)
 	{
-		int iconX = 2;
-		if ((data->flags & GWM_TXT_MULTILINE) == 0)
+		if (data->icon != NULL)
+		{
+			int iconX = 2;
+			if ((data->flags & GWM_TXT_MULTILINE) == 0)
+			{
+				iconX = 5;
+			};
+			
+			ddiBlit(data->icon, 0, 0, canvas, iconX, (TXT_HEIGHT-16)/2, 16, 16);
+		};
+		
+		if (data->frame != NULL) ddiDeleteSurface(data->frame);
+		data->frame = ddiCreateSurface(&canvas->format, canvas->width, canvas->height, NULL, 0);
+		if (data->frame != NULL)
 		{
-			iconX = 5;
+			ddiOverlay(canvas, 0, 0, data->frame, 0, 0, canvas->width, canvas->height);
 		};
 		
-		ddiBlit(data->icon, 0, 0, canvas, iconX, (TXT_HEIGHT-16)/2, 16, 16);
+		data->frameState = frameState;
+		data->frameIcon = data->icon;
 	};
 	
 	if (data->pen != NULL) ddiDeletePen(data->pen);
@@ -342,7 +396,8 @@ void gwmRedrawTextField(GWMWindow *field)
 		ddiDeletePen(pen);
 	};
 	
-	gwmPostDirty(field);
+	if (redrawFrame) gwmPostDirty(field);
+	else gwmPostDirtyRects(field, &textRect, 1);
 };
 
 static void gwmTextFieldDeleteSelection(GWMWindow *field)
@@ -856,6 +911,8 @@ int gwmTextFieldHandler(GWMEvent *ev, GWMWindow *field, void *context)
 		};
 		return GWM_EVSTATUS_CONT;
 	case GWM_EVENT_RETHEME:
+		if (data->frame != NULL) ddiDeleteSurface(data->frame);
+		data->frame = NULL;
 		gwmPostUpdate(field);
 		return GWM_EVSTATUS_OK;
 	default:
@@ -905,6 +962,9 @@ GWMWindow *gwmCreateTextField(GWMWindow *parent, const char *text, int x, int y,
 	data->align = DDI_ALIGN_LEFT;
 	data->font = gwmGetDefaultFont();
 	data->styles = NULL;
+	data->frame = NULL;
+	data->frameState = 0;
+	data->frameIcon = NULL;
 	
 	field->getMinSize = field->getPrefSize = txtGetSize;
 	field->position = txtPosition;
@@ -940,10 +1000,11 @@ void gwmDestroyTextField(GWMWindow *field)
 	GWMTextFieldData *data = (GWMTextFieldData*) gwmGetData(field, gwmTextFieldHandler);
 	free(data->text);
 	free(data->placeholder);
-	free(data);
+	if (data->frame != NULL) ddiDeleteSurface(data->frame);
 	gwmDestroyScrollbar(data->sbarX);
 	gwmDestroyScrollbar(data->sbarY);
 	gwmDestroyMenu(data->menu);
+	free(data);
 	gwmDestroyWindow(field);
 };
 
@@ -146,6 +146,13 @@ make install || exit 1
 cd ..
 build-tools/mkmip mipdir $1/klogd.mip -i klogd $GLIDIX_VERSION -d libc $GLIDIX_VERSION
 
+# resolvd
+rm -rf mipdir || exit 1
+cd resolvd
+make install || exit 1
+cd ..
+build-tools/mkmip mipdir $1/resolvd.mip -i resolvd $GLIDIX_VERSION -d libc $GLIDIX_VERSION
+
 # sysinfo
 rm -rf mipdir || exit 1
 cd sysinfo
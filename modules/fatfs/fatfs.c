@@ -193,13 +193,14 @@ static FATInodeTable* getInodeInfoByCluster(Fatfs *fatfs, uint32_t cluster)
 	return itab;
 };
 
-static int fatfsTreeLoad(FileTree *ft, off_t offset, void *buffer)
+/**
+ * Read 'size' bytes of the file at the given offset, issuing one read for each run of consecutive
+ * clusters. Call with the filesystem lock held. Returns 0 on success, -1 on error.
+ */
+static int fatfsTreeRead(FATInodeTable *itab, off_t offset, void *buffer, size_t size)
 {
 	char *put = (char*) buffer;
-	size_t sizeLeft = 0x1000;
-	
-	FATInodeTable *itab = (FATInodeTable*) ft->data;
-	semWait(&itab->fatfs->lock);
+	size_t sizeLeft = size;
 	
 	while (sizeLeft)
 	{
@@ -210,7 +211,6 @@ static int fatfsTreeLoad(FileTree *ft, off_t offset, void *buffer)
 		{
 			if (expandClusterChain(itab) != 0)
 			{
-				semSignal(&itab->fatfs->lock);
 				return -1;
 			};
 		};
@@ -218,6 +218,16 @@ static int fatfsTreeLoad(FileTree *ft, off_t offset, void *buffer)
 		off_t clusterPos = itab->fatfs->clusterPos + (itab->clusters[clusterIndex]-2) * itab->fatfs->clusterSize
 					+ clusterOffset;
 		size_t willRead = itab->fatfs->clusterSize - clusterOffset;
+		
+		// extend the read over clusters which follow this one on disk
+		size_t nextIndex = clusterIndex + 1;
+		while (willRead < sizeLeft && nextIndex < itab->numClusters
+			&& itab->clusters[nextIndex] == itab->clusters[nextIndex-1]+1)
+		{
+			willRead += itab->fatfs->clusterSize;
+			nextIndex++;
+		};
+		
 		if (willRead > sizeLeft) willRead = sizeLeft;
 		
 		if (vfsPRead(itab->fatfs->fp, put, willRead, clusterPos) != willRead) return -1;
@@ -226,10 +236,29 @@ static int fatfsTreeLoad(FileTree *ft, off_t offset, void *buffer)
 		offset += willRead;
 	};
 	
-	semSignal(&itab->fatfs->lock);
 	return 0;
 };
 
+static int fatfsTreeLoad(FileTree *ft, off_t offset, void *buffer)
+{
+	FATInodeTable *itab = (FATInodeTable*) ft->data;
+	semWait(&itab->fatfs->lock);
+	int status = fatfsTreeRead(itab, offset, buffer, 0x1000);
+	semSignal(&itab->fatfs->lock);
+	return status;
+};
+
+static int fatfsTreeLoadPages(FileTree *ft, off_t offset, int count, void *buffer)
+{
+	FATInodeTable *itab = (FATInodeTable*) ft->data;
+	semWait(&itab->fatfs->lock);
+	int status = fatfsTreeRead(itab, offset, buffer, (size_t) count << 12);
+	semSignal(&itab->fatfs->lock);
+	
+	if (status != 0) return -1;
+	return count;
+};
+
 static int fatfsTreeFlush(FileTree *ft, off_t offset, const void *buffer)
 {
 	const char *scan = (const char*) buffer;
@@ -287,6 +316,7 @@ static void fatfsTreeUpdate(FileTree *ft)
 static void fatfsSetTreeOps(FileTree *ft)
 {
 	ft->load = fatfsTreeLoad;
+	ft->loadpages = fatfsTreeLoadPages;
 	ft->flush = fatfsTreeFlush;
 	ft->update = fatfsTreeUpdate;
 };
@@ -421,10 +421,12 @@ static void gxfsSetInodeCallbacks(Inode *inode)
 	inode->drop = gxfsDropInode;
 };
 
-static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
+/**
+ * Increase the depth of the tree until it can hold the specified offset. Returns 0 on success,
+ * -1 on error.
+ */
+static int gxfsTreeGrow(GXFS_Tree *data, off_t pos)
 {
-	GXFS_Tree *data = (GXFS_Tree*) ft->data;
-	
 	uint64_t sizeLimit = (1UL << 57) - 1;
 	if (pos > sizeLimit)
 	{
@@ -451,6 +453,16 @@ static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
 		data->depth++;
 	};
 	
+	return 0;
+};
+
+/**
+ * Follow 'levels' tables down from the head of the tree towards the specified offset, allocating
+ * missing blocks, and return the block reached; with 'levels' equal to the depth this is the data
+ * block. The tree must already be deep enough. Returns 0 on error.
+ */
+static uint64_t gxfsTreeWalk(GXFS_Tree *data, off_t pos, int levels)
+{
 	uint64_t lvl[5];
 	lvl[4] = (pos >> 12) & 0x1FF;
 	lvl[3] = (pos >> 21) & 0x1FF;
@@ -458,15 +470,14 @@ static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
 	lvl[1] = (pos >> 39) & 0x1FF;
 	lvl[0] = (pos >> 48) & 0x1FF;
 	
-	// get to the data block
 	uint64_t datablock = data->head;
 	int i;
-	for (i=(5-data->depth); i<5; i++)
+	for (i=(5-data->depth); i<(5-data->depth+levels); i++)
 	{
 		uint64_t table[512];
 		if (gxfsReadBlock((GXFS*) data->fs->fsdata, datablock, table) != 0)
 		{
-			return -1;
+			return 0;
 		};
 		
 		if (table[lvl[i]] == 0)
@@ -474,14 +485,14 @@ static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
 			uint64_t newblock = gxfsAllocZeroBlock(data->fs);
 			if (newblock == 0)
 			{
-				return -1;
+				return 0;
 			};
 			
 			table[lvl[i]] = newblock;
 			if (gxfsWriteBlock((GXFS*) data->fs->fsdata, datablock, table) != 0)
 			{
 				gxfsFreeBlock(data->fs, newblock);
-				return -1;
+				return 0;
 			};
 
 			datablock = newblock;
@@ -492,6 +503,25 @@ static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
 		};
 	};
 	
+	return datablock;
+};
+
+static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
+{
+	GXFS_Tree *data = (GXFS_Tree*) ft->data;
+	
+	if (gxfsTreeGrow(data, pos) != 0)
+	{
+		return -1;
+	};
+	
+	// get to the data block
+	uint64_t datablock = gxfsTreeWalk(data, pos, data->depth);
+	if (datablock == 0)
+	{
+		return -1;
+	};
+	
 	// finally, load the data
 	if (gxfsReadBlock((GXFS*) data->fs->fsdata, datablock, buffer) != 0)
 	{
@@ -501,6 +531,87 @@ static int gxfsTreeLoad(FileTree *ft, off_t pos, void *buffer)
 	return 0;
 };
 
+static int gxfsTreeLoadPages(FileTree *ft, off_t pos, int count, void *buffer)
+{
+	GXFS_Tree *data = (GXFS_Tree*) ft->data;
+	GXFS *gxfs = (GXFS*) data->fs->fsdata;
+	
+	uint64_t blocks[64];
+	if (count > 64) count = 64;
+	
+	if (gxfsTreeGrow(data, pos + ((off_t) (count-1) << 12)) != 0)
+	{
+		return -1;
+	};
+	
+	if (data->depth == 0)
+	{
+		// a single page
+		if (gxfsTreeLoad(ft, pos, buffer) != 0) return -1;
+		return 1;
+	};
+	
+	// look up the data blocks, reading each bottom-level table only once
+	uint64_t table[512];
+	uint64_t tableBlock = 0;
+	int i;
+	for (i=0; i<count; i++)
+	{
+		off_t pagePos = pos + ((off_t) i << 12);
+		uint64_t index = (pagePos >> 12) & 0x1FF;
+		
+		if (tableBlock == 0 || index == 0)
+		{
+			tableBlock = gxfsTreeWalk(data, pagePos, data->depth-1);
+			if (tableBlock == 0) break;
+			if (gxfsReadBlock(gxfs, tableBlock, table) != 0) break;
+		};
+		
+		if (table[index] == 0)
+		{
+			uint64_t newblock = gxfsAllocZeroBlock(data->fs);
+			if (newblock == 0) break;
+			
+			table[index] = newblock;
+			if (gxfsWriteBlock(gxfs, tableBlock, table) != 0)
+			{
+				gxfsFreeBlock(data->fs, newblock);
+				break;
+			};
+		};
+		
+		blocks[i] = table[index];
+	};
+	
+	if (i == 0)
+	{
+		return -1;
+	};
+	
+	count = i;
+	
+	// read each run of consecutive blocks with a single request
+	int start = 0;
+	while (start < count)
+	{
+		int end = start + 1;
+		while (end < count && blocks[end] == blocks[end-1]+1) end++;
+		
+		size_t size = (size_t) (end - start) << 12;
+		uint64_t off = 0x200000 + (blocks[start] << 12);
+		if (vfsPRead(gxfs->fp, (char*) buffer + (start << 12), size, off) != size)
+		{
+			kprintf("gxfs: block read failure: errno=%d\n", ERRNO);
+			if (start == 0) return -1;
+			return start;
+		};
+		
+		start = end;
+	};
+	
+	return count;
+};
+
 static int gxfsTreeFlush(FileTree *ft, off_t pos, const void *buffer)
 {
 	GXFS_Tree *data = (GXFS_Tree*) ft->data;
@@ -631,6 +742,7 @@ static FileTree* gxfsTree(FileSystem *fs, uint64_t depth, uint64_t head, size_t
 	ft->size = size;
 	ft->data = data;
 	ft->load = gxfsTreeLoad;
+	ft->loadpages = gxfsTreeLoadPages;
 	ft->flush = gxfsTreeFlush;
 	ft->update = gxfsTreeUpdate;
 	ftDown(ft);
@@ -58,7 +58,7 @@ static int checkPVD(ISOPrimaryVolumeDescriptor *pvd)
 	return 1;
 };
 
-static int isoLoad(FileTree *ft, off_t pos, void *buffer)
+static int isoLoadPages(FileTree *ft, off_t pos, int count, void *buffer)
 {
 	Inode *inode = (Inode*) ft->data;
 	Isofs *isofs = (Isofs*) inode->fs->fsdata;
@@ -69,8 +69,15 @@ static int isoLoad(FileTree *ft, off_t pos, void *buffer)
 		return -1;
 	};
 	
+	if (pos >= head.fileSize)
+	{
+		// nothing to read; leave zeroed out
+		return count;
+	};
+	
+	// files are contiguous on the disc, so this is a single read
 	uint64_t start = (uint64_t) head.startLBA * isofs->blockSize;
-	uint64_t size = 0x1000;
+	uint64_t size = (uint64_t) count << 12;
 	if ((pos+size) > head.fileSize)
 	{
 		size = head.fileSize - pos;
@@ -81,6 +88,16 @@ static int isoLoad(FileTree *ft, off_t pos, void *buffer)
 		return -1;
 	};
 	
+	return count;
+};
+
+static int isoLoad(FileTree *ft, off_t pos, void *buffer)
+{
+	if (isoLoadPages(ft, pos, 1, buffer) != 1)
+	{
+		return -1;
+	};
+	
 	return 0;
 };
 
@@ -200,6 +217,7 @@ static int isoLoadInode(FileSystem *fs, Inode *inode)
 		ftDown(inode->ft);
 		inode->ft->data = inode;
 		inode->ft->load = isoLoad;
+		inode->ft->loadpages = isoLoadPages;
 		inode->ft->size = head.fileSize;
 	};
 	
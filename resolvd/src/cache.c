@@ -0,0 +1,292 @@
+/*
+	Glidix Resolver Daemon
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resolvd.h"
+
+#define	SPACES					" \t"
+#define	CACHE_BUCKETS				256
+#define	CACHE_MAX				1024
+
+typedef struct CacheEntry_
+{
+	struct CacheEntry_*			next;
+	char					name[256];
+	clock_t					expires;	/* 0 = never (from /etc/hosts) */
+	_glidix_resolvd_resp			resp;
+} CacheEntry;
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static CacheEntry *cache[CACHE_BUCKETS];
+static size_t cacheCount;
+
+static pthread_mutex_t hostsLock = PTHREAD_MUTEX_INITIALIZER;
+static CacheEntry *hosts[CACHE_BUCKETS];
+static time_t hostsMtime = -1;
+
+static unsigned int nameHash(const char *name)
+{
+	unsigned int h = 5381;
+	for (; *name!=0; name++)
+	{
+		h = (h << 5) + h + (unsigned char) *name;
+	};
+	
+	return h % CACHE_BUCKETS;
+};
+
+static CacheEntry* findEntry(CacheEntry **table, const char *name)
+{
+	CacheEntry *ent;
+	for (ent=table[nameHash(name)]; ent!=NULL; ent=ent->next)
+	{
+		if (strcmp(ent->name, name) == 0) return ent;
+	};
+	
+	return NULL;
+};
+
+static void clearTable(CacheEntry **table)
+{
+	int i;
+	for (i=0; i<CACHE_BUCKETS; i++)
+	{
+		while (table[i] != NULL)
+		{
+			CacheEntry *ent = table[i];
+			table[i] = ent->next;
+			free(ent);
+		};
+	};
+};
+
+static void hostsAdd(int family, const char *nodename, const void *addrbuf)
+{
+	CacheEntry *ent = findEntry(hosts, nodename);
+	if (ent == NULL)
+	{
+		ent = (CacheEntry*) malloc(sizeof(CacheEntry));
+		memset(ent, 0, sizeof(CacheEntry));
+		strcpy(ent->name, nodename);
+		ent->resp.status = RESOLVD_OK;
+		
+		unsigned int bucket = nameHash(nodename);
+		ent->next = hosts[bucket];
+		hosts[bucket] = ent;
+	};
+	
+	if (family == AF_INET)
+	{
+		if (ent->resp.count4 < RESOLVD_MAX_ADDR)
+		{
+			memcpy(&ent->resp.addr4[ent->resp.count4++], addrbuf, 4);
+		};
+	}
+	else
+	{
+		if (ent->resp.count6 < RESOLVD_MAX_ADDR)
+		{
+			memcpy(&ent->resp.addr6[ent->resp.count6++], addrbuf, 16);
+		};
+	};
+};
+
+// call with hostsLock held
+static void hostsReload()
+{
+	struct stat st;
+	time_t mtime = 0;
+	if (stat("/etc/hosts", &st) == 0)
+	{
+		mtime = st.st_mtime;
+	};
+	
+	if (mtime == hostsMtime)
+	{
+		return;
+	};
+	
+	hostsMtime = mtime;
+	clearTable(hosts);
+	
+	FILE *fp = fopen("/etc/hosts", "r");
+	if (fp == NULL)
+	{
+		return;
+	};
+	
+	char line[4096];
+	char *saveptr;
+	while (fgets(line, 4096, fp) != NULL)
+	{
+		char *endline = strchr(line, '\n');
+		if (endline == NULL)
+		{
+			// line too long; ignore
+			continue;
+		};
+		
+		*endline = 0;
+		
+		char *addrstr = strtok_r(line, SPACES, &saveptr);
+		if (addrstr == NULL || addrstr[0] == '#')
+		{
+			continue;
+		};
+		
+		int family;
+		char addrbuf[16];
+		
+		if (inet_pton(AF_INET, addrstr, addrbuf))
+		{
+			family = AF_INET;
+		}
+		else if (inet_pton(AF_INET6, addrstr, addrbuf))
+		{
+			family = AF_INET6;
+		}
+		else
+		{
+			fprintf(stderr, "resolvd: invalid address '%s' in /etc/hosts\n", addrstr);
+			continue;
+		};
+		
+		char *nodename;
+		while ((nodename = strtok_r(NULL, SPACES, &saveptr)) != NULL)
+		{
+			if (strlen(nodename) < 256)
+			{
+				hostsAdd(family, nodename, addrbuf);
+			};
+		};
+	};
+	
+	fclose(fp);
+};
+
+int hostsLookup(const char *name, _glidix_resolvd_resp *resp)
+{
+	pthread_mutex_lock(&hostsLock);
+	hostsReload();
+	
+	CacheEntry *ent = findEntry(hosts, name);
+	if (ent != NULL)
+	{
+		memcpy(resp, &ent->resp, sizeof(_glidix_resolvd_resp));
+		resp->ttl = 0;
+	};
+	
+	pthread_mutex_unlock(&hostsLock);
+	return ent == NULL ? -1 : 0;
+};
+
+int cacheLookup(const char *name, _glidix_resolvd_resp *resp)
+{
+	pthread_mutex_lock(&cacheLock);
+	
+	clock_t now = clock();
+	CacheEntry *ent = findEntry(cache, name);
+	if (ent == NULL || ent->expires <= now)
+	{
+		pthread_mutex_unlock(&cacheLock);
+		return -1;
+	};
+	
+	memcpy(resp, &ent->resp, sizeof(_glidix_resolvd_resp));
+	resp->ttl = (uint32_t) ((ent->expires - now) / CLOCKS_PER_SEC);
+	
+	pthread_mutex_unlock(&cacheLock);
+	return 0;
+};
+
+// call with cacheLock held
+static void cacheExpire(clock_t now)
+{
+	int i;
+	for (i=0; i<CACHE_BUCKETS; i++)
+	{
+		CacheEntry **link = &cache[i];
+		while (*link != NULL)
+		{
+			CacheEntry *ent = *link;
+			if (ent->expires <= now)
+			{
+				*link = ent->next;
+				free(ent);
+				cacheCount--;
+			}
+			else
+			{
+				link = &ent->next;
+			};
+		};
+	};
+};
+
+void cacheStore(const char *name, const _glidix_resolvd_resp *resp)
+{
+	if (resp->ttl == 0) return;
+	
+	pthread_mutex_lock(&cacheLock);
+	
+	clock_t now = clock();
+	CacheEntry *ent = findEntry(cache, name);
+	if (ent == NULL)
+	{
+		if (cacheCount >= CACHE_MAX)
+		{
+			cacheExpire(now);
+		};
+		
+		if (cacheCount >= CACHE_MAX)
+		{
+			// everything is still live; forget all of it rather than grow without bound
+			clearTable(cache);
+			cacheCount = 0;
+		};
+		
+		ent = (CacheEntry*) malloc(sizeof(CacheEntry));
+		strcpy(ent->name, name);
+		
+		unsigned int bucket = nameHash(name);
+		ent->next = cache[bucket];
+		cache[bucket] = ent;
+		cacheCount++;
+	};
+	
+	memcpy(&ent->resp, resp, sizeof(_glidix_resolvd_resp));
+	ent->expires = now + (clock_t) resp->ttl * CLOCKS_PER_SEC;
+	
+	pthread_mutex_unlock(&cacheLock);
+};
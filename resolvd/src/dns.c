@@ -0,0 +1,544 @@
+/*
+	Glidix Resolver Daemon
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "resolvd.h"
+
+#define	TYPE_A					1
+#define	TYPE_AAAA				28
+#define	CLASS_IN				1
+
+/**
+ * Total time to wait for an answer, and time between retransmissions (in clock ticks).
+ */
+#define	QUERY_TIMEOUT				(5 * CLOCKS_PER_SEC)
+#define	QUERY_RETRANSMIT			(1 * CLOCKS_PER_SEC)
+
+#define	MAX_SERVERS				16
+#define	MAX_QUERY				512
+
+typedef struct
+{
+	uint16_t				id;
+	uint16_t				flags;
+	uint16_t				numQuestions;
+	uint16_t				numAnswers;
+	uint16_t				numServers;
+	uint16_t				numAdditional;
+} DNSHeader;
+
+typedef struct
+{
+	uint16_t				type;
+	uint16_t				qclass;
+	uint32_t				ttl;
+	uint16_t				rdlen;
+} __attribute__ ((packed)) RRBody;
+
+/**
+ * An outstanding query; the A and AAAA questions are sent at the same time, with independent random
+ * IDs, and the query completes when both are answered or it times out. Every query uses its own
+ * socket, and so its own ephemeral source port, so that a spoofed answer has to guess both the port
+ * and the ID, and must also echo the question that was asked.
+ */
+typedef struct
+{
+	int					sockfd;
+	uint16_t				id4;
+	uint16_t				id6;
+	int					got4;
+	int					got6;
+	int					nxdomain;
+	
+	uint8_t					pkt4[MAX_QUERY];
+	uint8_t					pkt6[MAX_QUERY];
+	size_t					pktSize;
+	
+	struct in6_addr				servers[MAX_SERVERS];
+	int					numServers;
+	
+	_glidix_resolvd_resp*			resp;
+} Query;
+
+static int randfd;
+static void readServerFile(const char *filename, Query *query)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		return;
+	};
+	
+	char line[64];
+	while (fgets(line, 64, fp) != NULL && query->numServers < MAX_SERVERS)
+	{
+		if (line[0] == '#')
+		{
+			continue;
+		};
+		
+		char *endline = strchr(line, '\n');
+		if (endline != NULL) *endline = 0;
+		
+		if (inet_pton(AF_INET6, line, &query->servers[query->numServers]))
+		{
+			query->numServers++;
+		};
+	};
+	
+	fclose(fp);
+};
+
+static void readServers(const char *dirname, Query *query)
+{
+	char filename[256];
+	
+	DIR *dirp = opendir(dirname);
+	if (dirp == NULL) return;
+	
+	struct dirent *ent;
+	while ((ent = readdir(dirp)) != NULL)
+	{
+		if (ent->d_name[0] != '.')
+		{
+			sprintf(filename, "%s/%s", dirname, ent->d_name);
+			readServerFile(filename, query);
+		};
+	};
+	
+	closedir(dirp);
+};
+
+static void sendQuery(Query *query)
+{
+	struct sockaddr_in6 daddr;
+	memset(&daddr, 0, sizeof(struct sockaddr_in6));
+	daddr.sin6_family = AF_INET6;
+	daddr.sin6_port = htons(53);
+	
+	int i;
+	for (i=0; i<query->numServers; i++)
+	{
+		memcpy(&daddr.sin6_addr, &query->servers[i], 16);
+		if (!query->got4) sendto(query->sockfd, query->pkt4, query->pktSize, 0, (struct sockaddr*)&daddr, sizeof(struct sockaddr_in6));
+		if (!query->got6) sendto(query->sockfd, query->pkt6, query->pktSize, 0, (struct sockaddr*)&daddr, sizeof(struct sockaddr_in6));
+	};
+};
+
+/**
+ * Skip over a (possibly compressed) domain name starting at 'pos'. Returns the position after it,
+ * or -1 if the packet is malformed.
+ */
+static ssize_t skipName(const uint8_t *pkt, size_t size, size_t pos)
+{
+	while (pos < size)
+	{
+		uint8_t len = pkt[pos];
+		if (len == 0)
+		{
+			return pos + 1;
+		}
+		else if ((len & 0xC0) == 0xC0)
+		{
+			// a pointer ends the name
+			if (pos + 2 > size) return -1;
+			return pos + 2;
+		}
+		else if ((len & 0xC0) != 0)
+		{
+			return -1;
+		};
+		
+		pos += len + 1;
+	};
+	
+	return -1;
+};
+
+/**
+ * Check that a response has exactly one question, and that it is the one we sent in 'sent' (name
+ * compared case-insensitively, then QTYPE and QCLASS). Returns the position after the question, or -1
+ * if it does not match.
+ */
+static ssize_t matchQuestion(const uint8_t *pkt, size_t size, const uint8_t *sent, size_t sentSize)
+{
+	const DNSHeader *hdr = (const DNSHeader*) pkt;
+	if (ntohs(hdr->numQuestions) != 1) return -1;
+	
+	// the question is echoed uncompressed right after the header; label lengths must match
+	// exactly, label contents in any case
+	if (size < sentSize) return -1;
+	size_t pos = sizeof(DNSHeader);
+	while (sent[pos] != 0)
+	{
+		uint8_t len = sent[pos];
+		if (pkt[pos++] != len) return -1;
+		
+		while (len--)
+		{
+			uint8_t a = pkt[pos];
+			uint8_t b = sent[pos];
+			if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+			if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+			if (a != b) return -1;
+			pos++;
+		};
+	};
+	
+	// the terminating zero, QTYPE and QCLASS
+	if (memcmp(&pkt[pos], &sent[pos], 5) != 0) return -1;
+	return sentSize;
+};
+
+static void parseResponse(Query *query, const uint8_t *pkt, size_t size)
+{
+	const DNSHeader *hdr = (const DNSHeader*) pkt;
+	uint16_t flags = ntohs(hdr->flags);
+	uint16_t id = ntohs(hdr->id);
+	
+	const uint8_t *sent;
+	int *got;
+	if (id == query->id4)
+	{
+		sent = query->pkt4;
+		got = &query->got4;
+	}
+	else if (id == query->id6)
+	{
+		sent = query->pkt6;
+		got = &query->got6;
+	}
+	else
+	{
+		return;
+	};
+	
+	if (*got) return;
+	
+	ssize_t qend = matchQuestion(pkt, size, sent, query->pktSize);
+	if (qend == -1) return;
+	*got = 1;
+	
+	if ((flags & 0xF) == 3)
+	{
+		// NXDOMAIN
+		query->nxdomain = 1;
+		return;
+	};
+	
+	size_t pos = (size_t) qend;
+	uint16_t numAnswers = ntohs(hdr->numAnswers);
+	
+	_glidix_resolvd_resp *resp = query->resp;
+	while (numAnswers--)
+	{
+		ssize_t next = skipName(pkt, size, pos);
+		if (next == -1 || (size_t) next + sizeof(RRBody) > size) return;
+		pos = next;
+		
+		RRBody body;
+		memcpy(&body, &pkt[pos], sizeof(RRBody));
+		pos += sizeof(RRBody);
+		
+		size_t rdlen = ntohs(body.rdlen);
+		if (pos + rdlen > size) return;
+		
+		// we accept addresses whatever name they are for, so that CNAME chains included
+		// in the answer are followed
+		uint16_t type = ntohs(body.type);
+		uint32_t ttl = ntohl(body.ttl);
+		if (ntohs(body.qclass) == CLASS_IN)
+		{
+			if (type == TYPE_A && rdlen == 4 && resp->count4 < RESOLVD_MAX_ADDR)
+			{
+				memcpy(&resp->addr4[resp->count4++], &pkt[pos], 4);
+				if (ttl < resp->ttl) resp->ttl = ttl;
+			}
+			else if (type == TYPE_AAAA && rdlen == 16 && resp->count6 < RESOLVD_MAX_ADDR)
+			{
+				memcpy(&resp->addr6[resp->count6++], &pkt[pos], 16);
+				if (ttl < resp->ttl) resp->ttl = ttl;
+			};
+		};
+		
+		pos += rdlen;
+	};
+};
+
+/**
+ * Returns a random 16-bit query ID, or -1 if the random device could not be read.
+ */
+static int randomID()
+{
+	uint16_t id;
+	if (read(randfd, &id, 2) != 2) return -1;
+	return id;
+};
+
+/**
+ * Receive and handle answers on the query's socket, retransmitting regularly, until both questions
+ * are answered, the name is found not to exist, or the query times out.
+ */
+static void waitForAnswers(Query *query)
+{
+	uint8_t *rcvbuf = (uint8_t*) malloc(65536);
+	if (rcvbuf == NULL) return;
+	
+	clock_t now = clock();
+	clock_t deadline = now + QUERY_TIMEOUT;
+	clock_t retransmit = now + QUERY_RETRANSMIT;
+	sendQuery(query);
+	
+	while (!((query->got4 && query->got6) || query->nxdomain))
+	{
+		struct sockaddr_in6 saddr;
+		socklen_t addrlen = sizeof(struct sockaddr_in6);
+		ssize_t size = recvfrom(query->sockfd, rcvbuf, 65536, 0, (struct sockaddr*)&saddr, &addrlen);
+		
+		// it must be a response, from port 53 of one of the servers we asked
+		if (size >= (ssize_t) sizeof(DNSHeader) && saddr.sin6_port == htons(53))
+		{
+			DNSHeader *hdr = (DNSHeader*) rcvbuf;
+			if (ntohs(hdr->flags) & (1 << 15))
+			{
+				int i;
+				for (i=0; i<query->numServers; i++)
+				{
+					if (memcmp(&saddr.sin6_addr, &query->servers[i], 16) == 0)
+					{
+						parseResponse(query, rcvbuf, (size_t) size);
+						break;
+					};
+				};
+			};
+		};
+		
+		// retransmit or give up if we have been waiting too long
+		now = clock();
+		if (now >= deadline)
+		{
+			break;
+		}
+		else if (now >= retransmit)
+		{
+			retransmit = now + QUERY_RETRANSMIT;
+			sendQuery(query);
+		};
+	};
+	
+	free(rcvbuf);
+};
+
+/**
+ * Create the socket for a single query, bound to an ephemeral port. Returns the socket, or -1 on error.
+ */
+static int openQuerySocket()
+{
+	int sockfd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sockfd == -1)
+	{
+		fprintf(stderr, "resolvd: failed to create socket: %s\n", strerror(errno));
+		return -1;
+	};
+	
+	// wake up regularly to handle retransmissions and timeouts
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = 250000;
+	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval)) != 0)
+	{
+		fprintf(stderr, "resolvd: failed to set socket timeout: %s\n", strerror(errno));
+		close(sockfd);
+		return -1;
+	};
+	
+	// bind to the IPv6 unspecified address, so that the socket can talk to both IPv4 and
+	// IPv6 nameservers
+	struct sockaddr_in6 laddr;
+	memset(&laddr, 0, sizeof(struct sockaddr_in6));
+	laddr.sin6_family = AF_INET6;
+	
+	if (bind(sockfd, (struct sockaddr*)&laddr, sizeof(struct sockaddr_in6)) != 0)
+	{
+		fprintf(stderr, "resolvd: failed to bind socket: %s\n", strerror(errno));
+		close(sockfd);
+		return -1;
+	};
+	
+	return sockfd;
+};
+
+int dnsInit()
+{
+	randfd = open("/dev/urandom", O_RDONLY);
+	if (randfd == -1)
+	{
+		fprintf(stderr, "resolvd: failed to open /dev/urandom: %s\n", strerror(errno));
+		return -1;
+	};
+	
+	return 0;
+};
+
+static size_t buildQuery(uint8_t *pkt, const char *name, uint16_t id, uint16_t type)
+{
+	DNSHeader header;
+	header.id = htons(id);
+	header.flags = htons(0x0100);				// standard, recursive query
+	header.numQuestions = htons(1);
+	header.numAnswers = 0;
+	header.numServers = 0;
+	header.numAdditional = 0;
+	memcpy(pkt, &header, sizeof(DNSHeader));
+	
+	size_t pos = sizeof(DNSHeader);
+	const char *scan = name;
+	while (*scan != 0)
+	{
+		const char *dot = strchr(scan, '.');
+		size_t len = (dot == NULL) ? strlen(scan) : (size_t) (dot - scan);
+		if (len == 0 || len > 63)
+		{
+			// not a valid domain name
+			return 0;
+		};
+		
+		pkt[pos++] = (uint8_t) len;
+		memcpy(&pkt[pos], scan, len);
+		pos += len;
+		
+		scan += len;
+		if (*scan == '.') scan++;
+	};
+	
+	pkt[pos++] = 0;
+	
+	uint16_t qtype = htons(type);
+	uint16_t qclass = htons(CLASS_IN);
+	memcpy(&pkt[pos], &qtype, 2);
+	memcpy(&pkt[pos+2], &qclass, 2);
+	return pos + 4;
+};
+
+void dnsResolve(const char *name, _glidix_resolvd_resp *resp)
+{
+	memset(resp, 0, sizeof(_glidix_resolvd_resp));
+	resp->ttl = MAX_TTL;
+	
+	if (strlen(name) > 253)
+	{
+		resp->status = RESOLVD_NONAME;
+		resp->ttl = NEGATIVE_TTL;
+		return;
+	};
+	
+	Query *query = (Query*) malloc(sizeof(Query));
+	memset(query, 0, sizeof(Query));
+	query->resp = resp;
+	
+	// the server list is re-read for every query, since netman changes it as interfaces come
+	// and go; IPv6 servers are preferred
+	readServers("/run/dns/ipv6", query);
+	readServers("/run/dns/ipv4", query);
+	
+	int id4 = randomID();
+	int id6 = randomID();
+	if (query->numServers == 0 || id4 == -1 || id6 == -1)
+	{
+		resp->status = RESOLVD_FAIL;
+		resp->ttl = 0;
+		free(query);
+		return;
+	};
+	
+	// the IDs must differ so that answers can be told apart
+	if (id6 == id4) id6 ^= 1;
+	query->id4 = (uint16_t) id4;
+	query->id6 = (uint16_t) id6;
+	
+	query->pktSize = buildQuery(query->pkt4, name, query->id4, TYPE_A);
+	buildQuery(query->pkt6, name, query->id6, TYPE_AAAA);
+	
+	if (query->pktSize == 0)
+	{
+		resp->status = RESOLVD_NONAME;
+		resp->ttl = NEGATIVE_TTL;
+		free(query);
+		return;
+	};
+	
+	query->sockfd = openQuerySocket();
+	if (query->sockfd == -1)
+	{
+		resp->status = RESOLVD_FAIL;
+		resp->ttl = 0;
+		free(query);
+		return;
+	};
+	
+	waitForAnswers(query);
+	close(query->sockfd);
+	
+	if (query->nxdomain)
+	{
+		resp->status = RESOLVD_NONAME;
+		resp->count4 = resp->count6 = 0;
+		resp->ttl = NEGATIVE_TTL;
+	}
+	else if (!query->got4 && !query->got6)
+	{
+		// no server answered at all; don't cache
+		resp->status = RESOLVD_FAIL;
+		resp->ttl = 0;
+	}
+	else
+	{
+		resp->status = RESOLVD_OK;
+		if (resp->count4 == 0 && resp->count6 == 0)
+		{
+			resp->ttl = NEGATIVE_TTL;
+		}
+		else if (!query->got4 || !query->got6)
+		{
+			// only part of the answer; let the client use it, but ask again next time
+			resp->ttl = 0;
+		};
+	};
+	
+	free(query);
+};
@@ -0,0 +1,179 @@
+/*
+	Glidix Resolver Daemon
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "resolvd.h"
+
+static void resolve(const char *name, _glidix_resolvd_resp *resp)
+{
+	if (hostsLookup(name, resp) == 0)
+	{
+		return;
+	};
+	
+	if (cacheLookup(name, resp) == 0)
+	{
+		return;
+	};
+	
+	dnsResolve(name, resp);
+	cacheStore(name, resp);
+};
+
+static void* clientThread(void *context)
+{
+	int fd = (int) (uintptr_t) context;
+	
+	// a client may send any number of requests on one connection
+	_glidix_resolvd_req req;
+	while (recv(fd, &req, sizeof(_glidix_resolvd_req), 0) == sizeof(_glidix_resolvd_req))
+	{
+		req.name[255] = 0;
+		
+		_glidix_resolvd_resp resp;
+		resolve(req.name, &resp);
+		
+		if (send(fd, &resp, sizeof(_glidix_resolvd_resp), 0) != sizeof(_glidix_resolvd_resp))
+		{
+			break;
+		};
+	};
+	
+	close(fd);
+	return NULL;
+};
+
+void daemon()
+{
+	int fd = open("/run/resolvd.pid", O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, 0600);
+	if (fd == -1) return;
+	char buf[64];
+	sprintf(buf, "%d", getpid());
+	write(fd, buf, strlen(buf));
+	close(fd);
+	
+	if (dnsInit() != 0)
+	{
+		unlink("/run/resolvd.pid");
+		return;
+	};
+	
+	int sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (sockfd == -1)
+	{
+		fprintf(stderr, "resolvd: cannot create socket: %s\n", strerror(errno));
+		unlink("/run/resolvd.pid");
+		return;
+	};
+	
+	// a stale socket may be left behind if we were killed
+	unlink(RESOLVD_SOCKET);
+	
+	struct sockaddr_un srvaddr;
+	memset(&srvaddr, 0, sizeof(struct sockaddr_un));
+	srvaddr.sun_family = AF_UNIX;
+	strcpy(srvaddr.sun_path, RESOLVD_SOCKET);
+	
+	if (bind(sockfd, (struct sockaddr*) &srvaddr, sizeof(struct sockaddr_un)) != 0)
+	{
+		fprintf(stderr, "resolvd: cannot bind to %s: %s\n", RESOLVD_SOCKET, strerror(errno));
+		unlink("/run/resolvd.pid");
+		return;
+	};
+	
+	// everyone may resolve names
+	chmod(RESOLVD_SOCKET, 0666);
+	
+	if (listen(sockfd, 16) != 0)
+	{
+		fprintf(stderr, "resolvd: cannot listen: %s\n", strerror(errno));
+		unlink("/run/resolvd.pid");
+		return;
+	};
+	
+	while (1)
+	{
+		int clientfd = accept(sockfd, NULL, NULL);
+		if (clientfd == -1) continue;
+		
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, clientThread, (void*) (uintptr_t) clientfd) != 0)
+		{
+			close(clientfd);
+			continue;
+		};
+		
+		pthread_detach(thread);
+	};
+};
+
+int main()
+{
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		return 1;
+	}
+	else if (pid == 0)
+	{
+		setsid();
+		pid = fork();
+		
+		if (pid == -1)
+		{
+			return 1;
+		}
+		else if (pid == 0)
+		{
+			daemon();
+			_exit(0);
+		}
+		else
+		{
+			_exit(1);
+		};
+	}
+	else
+	{
+		waitpid(pid, NULL, 0);
+	};
+	
+	return 0;
+};
@@ -0,0 +1,74 @@
+/*
+	Glidix Resolver Daemon
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RESOLVD_H_
+#define RESOLVD_H_
+
+#include <sys/resolvd.h>
+#include <time.h>
+
+/**
+ * How long to cache a name that does not exist, or has no addresses (seconds).
+ */
+#define	NEGATIVE_TTL				30
+
+/**
+ * Upper bound on how long any answer is cached (seconds).
+ */
+#define	MAX_TTL					86400
+
+/**
+ * Look up a name in /etc/hosts (reloading it if it changed). Returns 0 and fills in 'resp' if found,
+ * or -1 if not.
+ */
+int hostsLookup(const char *name, _glidix_resolvd_resp *resp);
+
+/**
+ * Look up a name in the cache. Returns 0 and fills in 'resp' (with the remaining TTL) if a live entry
+ * is present, or -1 if not.
+ */
+int cacheLookup(const char *name, _glidix_resolvd_resp *resp);
+
+/**
+ * Add the result of a resolution to the cache, for 'resp->ttl' seconds.
+ */
+void cacheStore(const char *name, const _glidix_resolvd_resp *resp);
+
+/**
+ * Initialize the upstream DNS client (opens the random device used for query IDs). Returns 0 on
+ * success, -1 on error.
+ */
+int dnsInit();
+
+/**
+ * Resolve a name using the configured nameservers, querying A and AAAA records in parallel. Blocks
+ * until both answers arrived or the query timed out, and fills in 'resp'.
+ */
+void dnsResolve(const char *name, _glidix_resolvd_resp *resp);
+
+#endif
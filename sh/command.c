@@ -26,6 +26,7 @@
 	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _GLIDIX_SOURCE
 #include <sys/wait.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 #include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
+#include <spawn.h>
 
 #include "command.h"
 #include "strops.h"
@@ -407,82 +409,89 @@ static int executeGroup(CmdGroup *group)
 				pipe(pipefd);
 			};
 			
-			childrenLeft = 1;
-			member->pid = fork();
-			if (member->pid == 0)
+			// the first member leads the process group, and the rest join it
+			posix_spawnattr_t attr;
+			posix_spawnattr_init(&attr);
+			posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+			if (member == group->firstMember)
 			{
-				member->pid = getpid();
-				setpgid(0, group->firstMember->pid);
-				
-				int i;
-				for (i=0; i<3; i++)
-				{
-					if (isatty(i))
-					{
-						tcsetpgrp(i, group->firstMember->pid);
-					};
-				};
-				
-				if (member->prev != NULL)
+				posix_spawnattr_setpgroup(&attr, 0);
+			}
+			else
+			{
+				posix_spawnattr_setpgroup(&attr, group->firstMember->pid);
+			};
+			
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			
+			int i;
+			for (i=0; i<3; i++)
+			{
+				if (isatty(i))
 				{
-					close(1);
-					dup2(prevInput, 1);
-					close(prevInput);
+					posix_spawn_file_actions_addtcsetpgrp_np(&actions, i);
 				};
-				
-				if (member->next != NULL)
+			};
+			
+			if (member->prev != NULL)
+			{
+				posix_spawn_file_actions_adddup2(&actions, prevInput, 1);
+				posix_spawn_file_actions_addclose(&actions, prevInput);
+			};
+			
+			if (member->next != NULL)
+			{
+				posix_spawn_file_actions_addclose(&actions, pipefd[1]);
+				posix_spawn_file_actions_adddup2(&actions, pipefd[0], 0);
+				posix_spawn_file_actions_addclose(&actions, pipefd[0]);
+			};
+			
+			CmdRedir *redir;
+			for (redir=member->redir; redir!=NULL; redir=redir->next)
+			{
+				if (redir->targetName[0] == '&')
 				{
-					close(pipefd[1]);
-					close(0);
-					dup2(pipefd[0], 0);
-					close(pipefd[0]);
-				};
-				
-				CmdRedir *redir;
-				for (redir=member->redir; redir!=NULL; redir=redir->next)
-				{	
-					if (redir->targetName[0] == '&')
+					int fd = 1;
+					sscanf(redir->targetName, "&%d", &fd);
+					if (fd != redir->fd)
 					{
-						int fd = 1;
-						sscanf(redir->targetName, "&%d", &fd);
-						if (fd != redir->fd)
-						{
-							close(redir->fd);
-							dup2(fd, redir->fd);
-							
-							// we do NOT close the target descriptor in this case
-						};
-					}
-					else
-					{
-						int fd = open(redir->targetName, redir->oflag, 0644);
-						if (fd != redir->fd)
-						{
-							close(redir->fd);
-							dup2(fd, redir->fd);
-							close(fd);
-						};
+						// we do NOT close the target descriptor in this case
+						posix_spawn_file_actions_adddup2(&actions, fd, redir->fd);
 					};
+				}
+				else
+				{
+					posix_spawn_file_actions_addopen(&actions, redir->fd, redir->targetName, redir->oflag, 0644);
 				};
-				
-				execve(execPath, ptr, localEnviron.list);
-				fprintf(stderr, "%s: cannot exec %s: %s\n", *ptr, execPath, strerror(errno));
-				_exit(1);
+			};
+			
+			int error = posix_spawn(&member->pid, execPath, &actions, &attr, ptr, localEnviron.list);
+			posix_spawn_file_actions_destroy(&actions);
+			posix_spawnattr_destroy(&attr);
+			
+			if (error != 0)
+			{
+				fprintf(stderr, "%s: cannot exec %s: %s\n", *ptr, execPath, strerror(error));
+				member->pid = -1;
+				member->status = 0x0100;
 			}
 			else
 			{
-				if (member->next != NULL)
-				{
-					// (only then did we create a pipe)
-					close(pipefd[0]);
-				};
-				
-				if (member->prev != NULL)
-				{
-					close(prevInput);
-				};
-				prevInput = pipefd[1];
+				childrenLeft = 1;
+			};
+			
+			if (member->next != NULL)
+			{
+				// (only then did we create a pipe)
+				close(pipefd[0]);
+			};
+			
+			if (member->prev != NULL)
+			{
+				close(prevInput);
 			};
+			prevInput = pipefd[1];
 		};
 	};
 	
@@ -196,6 +196,7 @@ static char *shGetLine(int cont)
 		
 		while (1)
 		{	
+			fflush(stdout);
 			ssize_t retval = read(0, &c, 1);
 			
 			if(retval == -1)
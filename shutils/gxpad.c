@@ -196,6 +196,7 @@ const char *quitEditor()
 	while (1)
 	{
 		char c;
+		fflush(stdout);
 		read(0, &c, 1);
 		
 		const char *state = "";
@@ -250,6 +251,7 @@ void gotoMenu()
 	while (1)
 	{
 		char c = 0;
+		fflush(stdout);
 		read(0, &c, 1);
 	
 		switch (c)
@@ -345,6 +347,7 @@ int main(int argc, char *argv[])
 	while (1)
 	{
 		char c;
+		fflush(stdout);
 		int state = read(0, &c, 1);
 		
 		if (ctrlc)
@@ -45,6 +45,7 @@ char shname[128];
 
 void getline(char *buffer)
 {
+	fflush(stdout);
 	ssize_t count = read(0, buffer, 128);
 	if (count == -1)
 	{
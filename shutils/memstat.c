@@ -52,6 +52,115 @@ void printFrames(const char *label, size_t frames)
 	printf("%-40s %-20lu %-10lu MB\n", label, frames, frames/256);
 };
 
+void printBytes(const char *label, unsigned long bytes, unsigned long blocks)
+{
+	printf("%-40s %-20lu %-10lu KB\n", label, blocks, bytes/1024);
+};
+
+typedef struct
+{
+	char name[64];
+	unsigned long bytes;
+	unsigned long blocks;
+} Consumer;
+
+int compareConsumers(const void *a_, const void *b_)
+{
+	const Consumer *a = (const Consumer*) a_;
+	const Consumer *b = (const Consumer*) b_;
+	
+	if (a->bytes < b->bytes) return 1;
+	if (a->bytes > b->bytes) return -1;
+	return 0;
+};
+
+/**
+ * Print the breakdown of kernel memory from /proc/kmemstat, if the kernel exports it. 'cachePages' is the
+ * number of pages in the page cache, and 'usedFrames' the number of frames in use (including caches).
+ */
+void printKernelMemory(unsigned long cachePages, unsigned long usedFrames)
+{
+	FILE *fp = fopen("/proc/kmemstat", "r");
+	if (fp == NULL) return;
+	
+	unsigned long heapFrames = 0, heapAllocated = 0, heapRequested = 0, heapBlocks = 0, blockCache = 0;
+	unsigned long smallFree = 0, smallFreeBlocks = 0;
+	Consumer subsys[64];
+	Consumer sites[64];
+	int numSubsys = 0, numSites = 0;
+	
+	char line[256];
+	while (fgets(line, 256, fp) != NULL)
+	{
+		char name[64];
+		unsigned long a, b, c;
+		
+		if (sscanf(line, "heap_frames %lu", &a) == 1) heapFrames = a;
+		else if (sscanf(line, "heap_allocated %lu", &a) == 1) heapAllocated = a;
+		else if (sscanf(line, "heap_requested %lu", &a) == 1) heapRequested = a;
+		else if (sscanf(line, "heap_blocks %lu", &a) == 1) heapBlocks = a;
+		else if (sscanf(line, "block_cache_frames %lu", &a) == 1) blockCache = a;
+		else if (sscanf(line, "class %lu %lu %lu", &a, &b, &c) == 3)
+		{
+			// free blocks smaller than a page cannot be used for anything bigger until their
+			// neighbours are freed, so count them as fragmentation
+			if (a < 4096)
+			{
+				smallFree += a * c;
+				smallFreeBlocks += c;
+			};
+		}
+		else if (sscanf(line, "subsys %63s %lu %lu", name, &a, &b) == 3 && numSubsys < 64)
+		{
+			strcpy(subsys[numSubsys].name, name);
+			subsys[numSubsys].bytes = a;
+			subsys[numSubsys].blocks = b;
+			numSubsys++;
+		}
+		else if (sscanf(line, "site %63s %lu %lu", name, &a, &b) == 3 && numSites < 64)
+		{
+			strcpy(sites[numSites].name, name);
+			sites[numSites].bytes = a;
+			sites[numSites].blocks = b;
+			numSites++;
+		};
+	};
+	
+	fclose(fp);
+	
+	unsigned long known = heapFrames + blockCache + cachePages;
+	printf("\n%-40s %-20s %-10s\n", "KERNEL MEMORY", "FRAMES", "SIZE");
+	printFrames("Kernel heap:", heapFrames);
+	printFrames("Block cache:", blockCache);
+	printFrames("Page cache:", cachePages);
+	printFrames("Other (processes, page tables):", usedFrames > known ? usedFrames - known : 0);
+	
+	printf("\n%-40s %-20s %-10s\n", "HEAP FRAGMENTATION", "BLOCKS", "SIZE");
+	printBytes("Requested:", heapRequested, heapBlocks);
+	printBytes("Allocated (incl. headers, rounding):", heapAllocated, heapBlocks);
+	printBytes("Internal (rounding) waste:", heapAllocated - heapRequested, heapBlocks);
+	printBytes("Free blocks under 4 KB:", smallFree, smallFreeBlocks);
+	if (heapFrames != 0)
+	{
+		unsigned long mapped = heapFrames * 4096;
+		printf("%-40s %lu%%\n", "Heap memory in use:", mapped > heapRequested ? heapRequested * 100 / mapped : 100);
+	};
+	
+	qsort(subsys, numSubsys, sizeof(Consumer), compareConsumers);
+	printf("\n%-40s %-20s %-10s\n", "HEAP BY SUBSYSTEM", "BLOCKS", "SIZE");
+	int i;
+	for (i=0; i<numSubsys; i++)
+	{
+		printBytes(subsys[i].name, subsys[i].bytes, subsys[i].blocks);
+	};
+	
+	printf("\n%-40s %-20s %-10s\n", "TOP ALLOCATION SITES", "BLOCKS", "SIZE");
+	for (i=0; i<numSites; i++)
+	{
+		printBytes(sites[i].name, sites[i].bytes, sites[i].blocks);
+	};
+};
+
 int main(int argc, char *argv[])
 {
 	struct system_state sst;
@@ -68,5 +177,32 @@ int main(int argc, char *argv[])
 	printFrames("Available memory:", sst.sst_frames_total - sst.sst_frames_used + sst.sst_frames_cached);
 	printFrames("Unallocated memory:", sst.sst_frames_total - sst.sst_frames_used);
 	
+	// page cache reclaim statistics, if the kernel exports them
+	unsigned long cachePages = 0;
+	FILE *fp = fopen("/proc/memstat", "r");
+	if (fp != NULL)
+	{
+		printf("\n%-40s %-20s\n", "PAGE CACHE", "COUNT");
+		
+		char name[64];
+		unsigned long value;
+		while (fscanf(fp, "%63s %lu", name, &value) == 2)
+		{
+			if (strcmp(name, "cache_active") == 0 || strcmp(name, "cache_inactive") == 0)
+			{
+				cachePages += value;
+			};
+			
+			if (memcmp(name, "cache_", 6) == 0 || memcmp(name, "reclaim_", 8) == 0
+				|| memcmp(name, "kswapd_", 7) == 0 || memcmp(name, "watermark_", 10) == 0)
+			{
+				printf("%-40s %-20lu\n", name, value);
+			};
+		};
+		
+		fclose(fp);
+	};
+	
+	printKernelMemory(cachePages, sst.sst_frames_used);
 	return 0;
 };
@@ -180,6 +180,10 @@ int parsePartType(const char *type, uint8_t *buffer)
 	{
 		return parseGUID("C12A7328-F81F-11D2-BA4B-00A0C93EC93B", buffer);
 	}
+	else if (strcmp(type, "swap") == 0)
+	{
+		return parseGUID("0657FD6D-A4AB-43C4-84E5-0933C84B4F4F", buffer);
+	}
 	else
 	{
 		return parseGUID(type, buffer);
@@ -132,6 +132,7 @@ int main(int argc, char *argv[])
 		if (argc == 1)
 		{
 			fprintf(cmdout, "gethash %s\n", currentUserName);
+			fflush(cmdout);
 			char hash[1024];
 			if (fgets(hash, 1024, resin) == NULL)
 			{
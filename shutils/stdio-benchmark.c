@@ -0,0 +1,132 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#define	TOTAL_SIZE			(100UL*1024*1024)
+#define	RECORD_SIZE			64
+
+static unsigned long msSince(clock_t start)
+{
+	return (clock()-start)*1000/CLOCKS_PER_SEC;
+};
+
+static void report(const char *what, unsigned long ms)
+{
+	if (ms == 0) ms = 1;
+	printf("%-24s %6lu ms  %6lu MB/s\n", what, ms, (TOTAL_SIZE/(1024*1024))*1000/ms);
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "USAGE:\t%s scratch-file\n", argv[0]);
+		fprintf(stderr, "\tBenchmark buffered stdio by writing and reading back 100 MB in\n");
+		fprintf(stderr, "\t%d-byte records. The scratch file is overwritten and then deleted.\n", RECORD_SIZE);
+		return 1;
+	};
+	
+	char record[RECORD_SIZE];
+	size_t i;
+	for (i=0; i<RECORD_SIZE; i++)
+	{
+		record[i] = 'a' + (i % 26);
+	};
+	record[RECORD_SIZE-1] = '\n';
+	
+	FILE *fp = fopen(argv[1], "w");
+	if (fp == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	};
+	
+	clock_t start = clock();
+	for (i=0; i<TOTAL_SIZE/RECORD_SIZE; i++)
+	{
+		if (fwrite(record, RECORD_SIZE, 1, fp) != 1)
+		{
+			fprintf(stderr, "%s: fwrite failed\n", argv[0]);
+			return 1;
+		};
+	};
+	fclose(fp);
+	report("fwrite (records)", msSince(start));
+	
+	fp = fopen(argv[1], "r");
+	if (fp == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	};
+	
+	uint64_t sum = 0;
+	start = clock();
+	while (fread(record, RECORD_SIZE, 1, fp) == 1)
+	{
+		sum += (uint8_t) record[0];
+	};
+	report("fread (records)", msSince(start));
+	
+	rewind(fp);
+	start = clock();
+	char line[RECORD_SIZE+1];
+	while (fgets(line, RECORD_SIZE+1, fp) != NULL)
+	{
+		sum += (uint8_t) line[1];
+	};
+	report("fgets (lines)", msSince(start));
+	
+	rewind(fp);
+	start = clock();
+	int c;
+	while ((c = getc(fp)) != EOF)
+	{
+		sum += (uint8_t) c;
+	};
+	report("getc (bytes)", msSince(start));
+	fclose(fp);
+	
+	fp = fopen(argv[1], "w");
+	start = clock();
+	for (i=0; i<TOTAL_SIZE; i++)
+	{
+		putc(record[i % RECORD_SIZE], fp);
+	};
+	fclose(fp);
+	report("putc (bytes)", msSince(start));
+	
+	remove(argv[1]);
+	printf("checksum: 0x%016" PRIX64 "\n", sum);
+	return 0;
+};
@@ -148,6 +148,7 @@ int canSudo()
 
 void getline(char *buffer)
 {
+	fflush(stdout);
 	ssize_t count = read(0, buffer, 128);
 	if (count == -1)
 	{
@@ -0,0 +1,76 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/swap.h>
+
+int main(int argc, char *argv[])
+{
+	if (argc == 1)
+	{
+		// list the swap areas in use
+		FILE *fp = fopen("/proc/swaps", "r");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "%s: cannot open /proc/swaps: %s\n", argv[0], strerror(errno));
+			return 1;
+		};
+		
+		char line[512];
+		while (fgets(line, 512, fp) != NULL)
+		{
+			fputs(line, stdout);
+		};
+		
+		fclose(fp);
+		return 0;
+	};
+	
+	if (argv[1][0] == '-')
+	{
+		fprintf(stderr, "USAGE:\t%s [<device>...]\n", argv[0]);
+		fprintf(stderr, "\tStart paging to the specified swap partitions, or list the ones in use.\n");
+		return 1;
+	};
+	
+	int status = 0;
+	int i;
+	for (i=1; i<argc; i++)
+	{
+		if (swapon(argv[i], 0) != 0)
+		{
+			fprintf(stderr, "%s: cannot enable swap on %s: %s\n", argv[0], argv[i], strerror(errno));
+			status = 1;
+		};
+	};
+	
+	return status;
+};
@@ -647,6 +647,7 @@ int main(int argc, char *argv[])
 				if (strcmp(ent->username, username) == 0)
 				{
 					printf("%s\n", ent->hash);
+					fflush(stdout);
 					found = 1;
 					break;
 				};
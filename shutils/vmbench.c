@@ -0,0 +1,210 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * Microbenchmark for address space switching and unmapping costs:
+ *
+ *  - process switch: two processes bounce a byte between them over pipes, so every hop switches address
+ *    space (this is where keeping TLB entries across switches pays off).
+ *  - thread switch: the same between two threads, which share an address space.
+ *  - munmap: map, touch and unmap a range of pages; once on its own, and once while another thread of the
+ *    process keeps running (on another CPU, if there is one), so that unmapping has to shoot down its TLB.
+ */
+
+#define	SWITCH_ROUNDS				20000
+#define	UNMAP_ROUNDS				2000
+#define	UNMAP_PAGES				64
+
+static int pipeTo[2];
+static int pipeFrom[2];
+static volatile int spinning;
+
+static void bounce(int rfd, int wfd, int rounds)
+{
+	char c = 0;
+	int i;
+	for (i=0; i<rounds; i++)
+	{
+		if (read(rfd, &c, 1) != 1) break;
+		if (write(wfd, &c, 1) != 1) break;
+	};
+};
+
+static void* bounceThread(void *arg)
+{
+	bounce(pipeTo[0], pipeFrom[1], SWITCH_ROUNDS);
+	return NULL;
+};
+
+static void* spinThread(void *arg)
+{
+	while (spinning);
+	return NULL;
+};
+
+/**
+ * Send SWITCH_ROUNDS bytes around the pipes and return the time per switch, in nanoseconds.
+ */
+static uint64_t pingPong()
+{
+	char c = 0;
+	uint64_t start = _glidix_nanotime();
+	
+	int i;
+	for (i=0; i<SWITCH_ROUNDS; i++)
+	{
+		if (write(pipeTo[1], &c, 1) != 1 || read(pipeFrom[0], &c, 1) != 1)
+		{
+			fprintf(stderr, "vmbench: pipe failed: %s\n", strerror(errno));
+			exit(1);
+		};
+	};
+	
+	return (_glidix_nanotime() - start) / (SWITCH_ROUNDS * 2);
+};
+
+static void openPipes()
+{
+	if (pipe(pipeTo) != 0 || pipe(pipeFrom) != 0)
+	{
+		fprintf(stderr, "vmbench: cannot create pipes: %s\n", strerror(errno));
+		exit(1);
+	};
+};
+
+static void closePipes()
+{
+	close(pipeTo[0]);
+	close(pipeTo[1]);
+	close(pipeFrom[0]);
+	close(pipeFrom[1]);
+};
+
+/**
+ * Map, touch and unmap UNMAP_PAGES pages UNMAP_ROUNDS times, and return the average time taken by munmap(),
+ * in nanoseconds.
+ */
+static uint64_t unmapCost()
+{
+	uint64_t total = 0;
+	size_t size = UNMAP_PAGES * 0x1000;
+	
+	int i;
+	for (i=0; i<UNMAP_ROUNDS; i++)
+	{
+		char *ptr = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+		{
+			fprintf(stderr, "vmbench: mmap failed: %s\n", strerror(errno));
+			exit(1);
+		};
+		
+		size_t off;
+		for (off=0; off<size; off+=0x1000)
+		{
+			ptr[off] = 1;
+		};
+		
+		uint64_t start = _glidix_nanotime();
+		munmap(ptr, size);
+		total += _glidix_nanotime() - start;
+	};
+	
+	return total / UNMAP_ROUNDS;
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc != 1)
+	{
+		fprintf(stderr, "USAGE:\t%s\n", argv[0]);
+		fprintf(stderr, "\tMeasure the cost of context switches and munmap().\n");
+		return 1;
+	};
+	
+	// process switches
+	openPipes();
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		fprintf(stderr, "%s: fork failed: %s\n", argv[0], strerror(errno));
+		return 1;
+	}
+	else if (pid == 0)
+	{
+		bounce(pipeTo[0], pipeFrom[1], SWITCH_ROUNDS);
+		_exit(0);
+	};
+	
+	uint64_t procSwitch = pingPong();
+	waitpid(pid, NULL, 0);
+	closePipes();
+	
+	// thread switches
+	openPipes();
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, bounceThread, NULL) != 0)
+	{
+		fprintf(stderr, "%s: cannot create thread\n", argv[0]);
+		return 1;
+	};
+	
+	uint64_t threadSwitch = pingPong();
+	pthread_join(thread, NULL);
+	closePipes();
+	
+	// unmapping, with and without another thread running
+	uint64_t unmapAlone = unmapCost();
+	
+	spinning = 1;
+	if (pthread_create(&thread, NULL, spinThread, NULL) != 0)
+	{
+		fprintf(stderr, "%s: cannot create thread\n", argv[0]);
+		return 1;
+	};
+	
+	uint64_t unmapShared = unmapCost();
+	spinning = 0;
+	pthread_join(thread, NULL);
+	
+	printf("%-40s %lu ns\n", "Process switch:", procSwitch);
+	printf("%-40s %lu ns\n", "Thread switch:", threadSwitch);
+	printf("%-40s %lu ns (%lu ns/page)\n", "munmap() of 64 pages:", unmapAlone, unmapAlone / UNMAP_PAGES);
+	printf("%-40s %lu ns (%lu ns/page)\n", "munmap() with another thread running:", unmapShared, unmapShared / UNMAP_PAGES);
+	return 0;
+};
@@ -408,6 +408,7 @@ int main(int argc, char *argv[])
 				
 				printf("] %3ld%%", percent);
 			};
+			fflush(stdout);
 			
 			char buf[4096];
 			ssize_t sz = read(sockfd, buf, 4096);
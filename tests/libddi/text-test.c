@@ -0,0 +1,231 @@
+/**
+ * libddi text rendering unit test.
+ * Renders a set of strings on one font from a single thread to get reference images, then renders them
+ * again from several threads at once, in different orders, and checks that every image matches its
+ * reference. There are more distinct strings and codepoints than the run and glyph caches hold, so the
+ * threads keep evicting entries from both caches while the others are using them.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libddi.h"
+
+#define	NUM_STRINGS			700
+#define	STRING_CHARS			16
+#define	NUM_THREADS			8
+#define	NUM_PASSES			3
+
+static DDIPixelFormat format = {
+	.bpp = 4,
+	.redMask = 0xFF0000,
+	.greenMask = 0x00FF00,
+	.blueMask = 0x0000FF,
+	.alphaMask = 0xFF000000,
+};
+
+static DDIFont *font;
+static char strings[NUM_STRINGS][STRING_CHARS * 4 + 1];
+static DDISurface *refs[NUM_STRINGS];
+static volatile int failed;
+
+/**
+ * A minimal driver which keeps surfaces in ordinary memory; good enough for text rendering, which only
+ * creates surfaces, fills rectangles and copies pixels.
+ */
+static int testCreateSurface(void *drvctx, DDISurface *surface, char *data)
+{
+	size_t size = (size_t) surface->width * surface->height * 4;
+	surface->data = (uint8_t*) malloc(size + 1);
+	if (surface->data == NULL) return -1;
+	if (data != NULL) memcpy(surface->data, data, size);
+	return 0;
+};
+
+static void testDeleteSurface(void *drvctx, DDISurface *surface)
+{
+	free(surface->data);
+};
+
+static void testRect(void *drvctx, DDISurface *surf, int x, int y, int width, int height, DDIColor *color)
+{
+	uint32_t pixel;
+	ddiColorToPixel(&pixel, &surf->format, color);
+
+	int i, j;
+	for (j=y; j<y+height; j++)
+	{
+		for (i=x; i<x+width; i++)
+		{
+			if (i >= 0 && j >= 0 && i < (int) surf->width && j < (int) surf->height)
+			{
+				((uint32_t*) surf->data)[j * surf->width + i] = pixel;
+			};
+		};
+	};
+};
+
+static void testCopy(void *drvctx, DDISurface *src, int srcX, int srcY, DDISurface *dest, int destX, int destY,
+			int width, int height)
+{
+	int i, j;
+	for (j=0; j<height; j++)
+	{
+		for (i=0; i<width; i++)
+		{
+			int sx = srcX + i, sy = srcY + j;
+			int dx = destX + i, dy = destY + j;
+			if (sx < 0 || sy < 0 || sx >= (int) src->width || sy >= (int) src->height) continue;
+			if (dx < 0 || dy < 0 || dx >= (int) dest->width || dy >= (int) dest->height) continue;
+			((uint32_t*) dest->data)[dy * dest->width + dx] = ((uint32_t*) src->data)[sy * src->width + sx];
+		};
+	};
+};
+
+static DDIDriver testDriver = {
+	.size = sizeof(DDIDriver),
+	.renderString = "text-test",
+	.createSurface = testCreateSurface,
+	.blit = testCopy,
+	.overlay = testCopy,
+	.rect = testRect,
+	.delsurf = testDeleteSurface,
+};
+
+static char* putUTF8(char *put, long point)
+{
+	if (point < 0x80)
+	{
+		*put++ = (char) point;
+	}
+	else if (point < 0x800)
+	{
+		*put++ = (char) (0xC0 | (point >> 6));
+		*put++ = (char) (0x80 | (point & 0x3F));
+	}
+	else
+	{
+		*put++ = (char) (0xE0 | (point >> 12));
+		*put++ = (char) (0x80 | ((point >> 6) & 0x3F));
+		*put++ = (char) (0x80 | (point & 0x3F));
+	};
+
+	return put;
+};
+
+/**
+ * Fill in the test strings with codepoints from a few Latin, Greek and Cyrillic ranges.
+ */
+static void makeStrings()
+{
+	static const long ranges[][2] = {
+		{0x21, 0x7E},
+		{0xA1, 0x17F},
+		{0x391, 0x3C9},
+		{0x410, 0x44F},
+		{0x1E00, 0x1EFF},
+	};
+
+	static long points[1024];
+	int numPoints = 0;
+	size_t r;
+	for (r=0; r<sizeof(ranges)/sizeof(ranges[0]); r++)
+	{
+		long point;
+		for (point=ranges[r][0]; point<=ranges[r][1]; point++) points[numPoints++] = point;
+	};
+
+	int i, j;
+	for (i=0; i<NUM_STRINGS; i++)
+	{
+		char *put = strings[i];
+		for (j=0; j<STRING_CHARS; j++)
+		{
+			long point = (j % 5 == 4) ? ' ' : points[(i * 37 + j * 101) % numPoints];
+			put = putUTF8(put, point);
+		};
+
+		*put = 0;
+	};
+};
+
+static int sameImage(DDISurface *a, DDISurface *b)
+{
+	if (a->width != b->width || a->height != b->height) return 0;
+	return memcmp(a->data, b->data, (size_t) a->width * a->height * 4) == 0;
+};
+
+static void* renderThread(void *context)
+{
+	int index = (int) (intptr_t) context;
+	static DDIColor black = {0x00, 0x00, 0x00, 0xFF};
+
+	int pass, i;
+	for (pass=0; pass<NUM_PASSES; pass++)
+	{
+		for (i=0; i<NUM_STRINGS; i++)
+		{
+			// each thread walks the strings in a different order
+			int which = (i * (2 * index + 1) + index * 53) % NUM_STRINGS;
+			DDISurface *surface = ddiRenderText(&format, font, &black, strings[which], NULL);
+			if (surface == NULL || !sameImage(surface, refs[which]))
+			{
+				fprintf(stderr, "thread %d: string %d rendered differently\n", index, which);
+				failed = 1;
+			};
+
+			if (surface != NULL) ddiDeleteSurface(surface);
+		};
+	};
+
+	return NULL;
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "USAGE: %s <font-file>\n", argv[0]);
+		return 1;
+	};
+
+	ddiDriver = &testDriver;
+	font = ddiOpenFont(argv[1], 14, NULL);
+	if (font == NULL)
+	{
+		fprintf(stderr, "cannot open font %s\n", argv[1]);
+		return 1;
+	};
+
+	makeStrings();
+
+	static DDIColor black = {0x00, 0x00, 0x00, 0xFF};
+	int i;
+	for (i=0; i<NUM_STRINGS; i++)
+	{
+		refs[i] = ddiRenderText(&format, font, &black, strings[i], NULL);
+		if (refs[i] == NULL)
+		{
+			fprintf(stderr, "failed to render string %d\n", i);
+			return 1;
+		};
+	};
+
+	pthread_t threads[NUM_THREADS];
+	for (i=0; i<NUM_THREADS; i++)
+	{
+		if (pthread_create(&threads[i], NULL, renderThread, (void*) (intptr_t) i) != 0)
+		{
+			fprintf(stderr, "failed to create thread %d\n", i);
+			return 1;
+		};
+	};
+
+	for (i=0; i<NUM_THREADS; i++) pthread_join(threads[i], NULL);
+
+	if (failed) return 1;
+	printf("all tests passed\n");
+	return 0;
+};
@@ -0,0 +1,20 @@
+# text.sh
+# Check that text rendered on one font from several threads at once matches single-threaded output
+testdir="`dirname $0`"
+srcdir="$testdir/../.."
+
+# libddi.h wants <sys/glidix.h> for the ioctl numbers, which are never used here
+mkdir -p text-include/sys
+echo '#define _GLIDIX_IOCTL_ARG(type, intf, cmd) (cmd)' > text-include/sys/glidix.h
+echo '#define _GLIDIX_IOCTL_INT_VIDEO 0' >> text-include/sys/glidix.h
+
+# Attempt to compile the test
+command="cc -O2 -Itext-include -I$srcdir/libddi `pkg-config --cflags freetype2` $srcdir/libddi/libddi.c $srcdir/libddi/scale.c $testdir/text-test.c -o text-test -lfreetype -lpng -ldl -lpthread $TEST_CFLAGS -ggdb -w"
+echo "Compiling libddi text unit test using: $command"
+$command || exit 1
+
+# Now run it
+echo "Running libddi text unit test:"
+./text-test "$srcdir/libgwm/fonts/regular/OpenSans.ttf" || exit 1
+
+echo "libddi text unit test is OK"
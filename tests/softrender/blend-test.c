@@ -0,0 +1,179 @@
+/**
+ * Softrender pixel kernel unit test.
+ * Runs every vector implementation supported by this machine against the scalar one, and fails if
+ * any pixel differs.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "blend.h"
+
+#define	ROW_LEN			1027
+
+static uint32_t srcRow[ROW_LEN + 8];
+static uint32_t expectRow[ROW_LEN + 8];
+static uint32_t actualRow[ROW_LEN + 8];
+
+static int failed = 0;
+
+static uint32_t nextRandom()
+{
+	static uint64_t state = 0x2545F4914F6CDD1DUL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (uint32_t) state;
+};
+
+static uint32_t withAlpha(uint32_t pixel, int alphaShift, uint32_t alpha)
+{
+	return (pixel & ~(0xFFU << alphaShift)) | (alpha << alphaShift);
+};
+
+static void compareBlend(SRKernels *kernels, const uint32_t *src, const uint32_t *dst, size_t count, int alphaShift)
+{
+	memcpy(expectRow, dst, 4 * count);
+	memcpy(actualRow, dst, 4 * count);
+	srKernelsScalar.blend(expectRow, src, count, alphaShift);
+	kernels->blend(actualRow, src, count, alphaShift);
+	
+	size_t i;
+	for (i=0; i<count; i++)
+	{
+		if (expectRow[i] != actualRow[i])
+		{
+			printf("%s: blend mismatch (alpha shift %d): src=%08X dst=%08X expected %08X, got %08X\n",
+				kernels->name, alphaShift, src[i], dst[i], expectRow[i], actualRow[i]);
+			failed = 1;
+			return;
+		};
+	};
+};
+
+static void testBlend(SRKernels *kernels)
+{
+	static uint32_t dstRow[ROW_LEN + 8];
+	int alphaShift;
+	
+	for (alphaShift=0; alphaShift<32; alphaShift+=8)
+	{
+		// every combination of source alpha, destination alpha and source channel value
+		int srcAlpha, dstAlpha, i;
+		for (srcAlpha=0; srcAlpha<256; srcAlpha++)
+		{
+			for (dstAlpha=0; dstAlpha<256; dstAlpha++)
+			{
+				for (i=0; i<256; i++)
+				{
+					uint32_t d = (uint32_t) ((i * 7 + srcAlpha + dstAlpha * 3) & 0xFF);
+					srcRow[i] = withAlpha(0x01010101U * i, alphaShift, srcAlpha);
+					dstRow[i] = withAlpha(0x01010101U * d ^ 0x00FF00FF, alphaShift, dstAlpha);
+				};
+				
+				compareBlend(kernels, srcRow, dstRow, 256, alphaShift);
+				if (failed) return;
+			};
+		};
+		
+		// random rows mixing runs of opaque and translucent pixels, with odd lengths and offsets
+		int trial;
+		for (trial=0; trial<2000; trial++)
+		{
+			for (i=0; i<ROW_LEN; i++)
+			{
+				srcRow[i] = nextRandom();
+				dstRow[i] = nextRandom();
+			};
+			
+			for (i=0; i<ROW_LEN; i+=8)
+			{
+				int j;
+				int mode = nextRandom() % 4;
+				for (j=i; j<i+8 && j<ROW_LEN; j++)
+				{
+					if (mode == 1) srcRow[j] = withAlpha(srcRow[j], alphaShift, 0xFF);
+					if (mode == 2) dstRow[j] = withAlpha(dstRow[j], alphaShift, 0xFF);
+					if (mode == 3) srcRow[j] = withAlpha(srcRow[j], alphaShift, 0);
+				};
+			};
+			
+			size_t offset = nextRandom() % 8;
+			size_t count = nextRandom() % (ROW_LEN - offset);
+			compareBlend(kernels, srcRow + offset, dstRow + offset, count, alphaShift);
+			if (failed) return;
+		};
+	};
+};
+
+static void testCopyFill(SRKernels *kernels)
+{
+	static uint8_t src[4096 + 64];
+	static uint8_t expect[4096 + 64];
+	static uint8_t actual[4096 + 64];
+	
+	int trial;
+	for (trial=0; trial<10000; trial++)
+	{
+		size_t i;
+		for (i=0; i<sizeof(src); i++)
+		{
+			src[i] = (uint8_t) nextRandom();
+			expect[i] = actual[i] = (uint8_t) nextRandom();
+		};
+		
+		size_t srcOffset = nextRandom() % 64;
+		size_t destOffset = nextRandom() % 64;
+		size_t size = nextRandom() % 4096;
+		
+		memcpy(expect + destOffset, src + srcOffset, size);
+		kernels->copy(actual + destOffset, src + srcOffset, size);
+		if (memcmp(expect, actual, sizeof(expect)) != 0)
+		{
+			printf("%s: copy mismatch (size %lu, offsets %lu, %lu)\n", kernels->name,
+				(unsigned long) size, (unsigned long) srcOffset, (unsigned long) destOffset);
+			failed = 1;
+			return;
+		};
+		
+		uint32_t pixel = nextRandom();
+		size_t count = nextRandom() % 1000;
+		destOffset = 4 * (nextRandom() % 16);
+		srKernelsScalar.fill((uint32_t*) (expect + destOffset), pixel, count);
+		kernels->fill((uint32_t*) (actual + destOffset), pixel, count);
+		if (memcmp(expect, actual, sizeof(expect)) != 0)
+		{
+			printf("%s: fill mismatch (count %lu, offset %lu)\n", kernels->name,
+				(unsigned long) count, (unsigned long) destOffset);
+			failed = 1;
+			return;
+		};
+	};
+};
+
+int main()
+{
+	SRKernels *all[] = {&srKernelsSSE2, &srKernelsAVX2};
+	
+	int i;
+	for (i=0; i<2; i++)
+	{
+		if (!srKernelsSupported(all[i]))
+		{
+			printf("%s: not supported on this machine, skipping\n", all[i]->name);
+			continue;
+		};
+		
+		printf("%s: testing blend...\n", all[i]->name);
+		testBlend(all[i]);
+		if (failed) return 1;
+		
+		printf("%s: testing copy and fill...\n", all[i]->name);
+		testCopyFill(all[i]);
+		if (failed) return 1;
+	};
+	
+	printf("All kernels match the scalar implementation\n");
+	return 0;
+};
@@ -0,0 +1,15 @@
+# blend.sh
+# Check that the vector pixel kernels of softrender match the scalar ones exactly
+testdir="`dirname $0`"
+srcdir="$testdir/../.."
+
+# Attempt to compile the test
+command="cc -O2 -I$srcdir/ddi-drivers/softrender $srcdir/ddi-drivers/softrender/blend.c $testdir/blend-test.c -o blend-test $TEST_CFLAGS -ggdb -w"
+echo "Compiling softrender blend unit test using: $command"
+$command || exit 1
+
+# Now run it
+echo "Running softrender blend unit test:"
+./blend-test || exit 1
+
+echo "Softrender blend unit test is OK"
@@ -0,0 +1,311 @@
+/**
+ * Softrender rasterizer unit test.
+ * Draws a jittered mesh covering the whole framebuffer and checks that every pixel is shaded exactly
+ * once (no gaps or double-drawn shared edges), both with glDrawArrays() and glDrawElements(), then
+ * checks depth testing with overlapping quads and the vector pixel packing functions.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "context.h"
+#include "draw.h"
+#include "vao.h"
+#include "buffer.h"
+#include "pipeline.h"
+#include "specialize.h"
+
+#define	WIDTH				203
+#define	HEIGHT				149
+#define	GRID				23
+
+static uint32_t colorData[WIDTH * HEIGHT];
+static uint16_t depthData[WIDTH * HEIGHT];
+static volatile int fragCount;
+static int failed;
+
+/**
+ * Vertex input and output: position and flat color.
+ */
+typedef struct
+{
+	SRVector pos;
+	SRVector color;
+} TestVertex;
+
+static SRVector testVertexShader(const void *uniforms, const void *inputs, void *outputs)
+{
+	const TestVertex *vin = (const TestVertex*) inputs;
+	*((SRVector*) outputs) = vin->color;
+	return vin->pos;
+};
+
+static void testFragmentShader(const void *uniforms, const void *inputs1, const void *inputs2, const void *inputs3, SRVector *outputs, SRVector bary)
+{
+	__sync_fetch_and_add(&fragCount, 1);
+	outputs[0] = *((const SRVector*) inputs1);
+};
+
+static DDIGL_Pipeline testPipeline = {
+	.szVertex = sizeof(TestVertex),
+	.szVertexFragment = sizeof(SRVector),
+	.vertexShader = testVertexShader,
+	.fragmentShader = testFragmentShader,
+	.attribs = {
+		{GL_FLOAT, 4, 0},
+		{GL_FLOAT, 4, 16},
+	},
+};
+
+static DDIGL_Context ctx;
+static SRContext *srctx;
+static DDIGL_Buffer buffer;
+static DDIGL_VertexArray vao;
+
+static void setupContext()
+{
+	DDIPixelFormat format;
+	memset(&format, 0, sizeof(format));
+	format.bpp = 4;
+	format.redMask = 0xFF0000;
+	format.greenMask = 0x00FF00;
+	format.blueMask = 0x0000FF;
+	format.alphaMask = 0xFF000000;
+	
+	DDIGL_ContextParams params = {8, 16};
+	if (srInitGL(NULL, &format, &params, &ctx) != GL_NO_ERROR)
+	{
+		printf("srInitGL failed\n");
+		exit(1);
+	};
+	
+	srctx = (SRContext*) ctx.drvdata;
+	srctx->currentPipeline = &testPipeline;
+	srctx->currentBuffer->color[0]->width = WIDTH;
+	srctx->currentBuffer->color[0]->height = HEIGHT;
+	srctx->currentBuffer->color[0]->data = colorData;
+	srctx->currentBuffer->depth->width = WIDTH;
+	srctx->currentBuffer->depth->height = HEIGHT;
+	srctx->currentBuffer->depth->data = depthData;
+	ctx.viewport(&ctx, 0, 0, WIDTH, HEIGHT);
+	
+	vao.enable = 3;
+	vao.attribs[0].buffer = &buffer;
+	vao.attribs[0].size = 4;
+	vao.attribs[0].type = GL_FLOAT;
+	vao.attribs[0].stride = sizeof(TestVertex);
+	vao.attribs[0].offset = 0;
+	vao.attribs[1] = vao.attribs[0];
+	vao.attribs[1].offset = 16;
+	ctx.vaoCurrent = &vao;
+};
+
+static void draw(TestVertex *verts, int count)
+{
+	buffer.data = verts;
+	buffer.size = sizeof(TestVertex) * count;
+	if (srDrawArrays(&ctx, GL_TRIANGLES, 0, count) != GL_NO_ERROR)
+	{
+		printf("srDrawArrays failed\n");
+		exit(1);
+	};
+};
+
+static void drawIndexed(TestVertex *verts, int numVerts, GLushort *indices, int count)
+{
+	buffer.data = verts;
+	buffer.size = sizeof(TestVertex) * numVerts;
+	if (srDrawElements(&ctx, GL_TRIANGLES, count, GL_UNSIGNED_SHORT, indices) != GL_NO_ERROR)
+	{
+		printf("srDrawElements failed\n");
+		exit(1);
+	};
+};
+
+static void testCoverage(int indexed)
+{
+	// jittered grid of points; the outer ones lie exactly on the framebuffer border
+	static SRVector points[GRID+1][GRID+1];
+	int i, j;
+	for (i=0; i<=GRID; i++)
+	{
+		for (j=0; j<=GRID; j++)
+		{
+			float x = (float) j / GRID;
+			float y = (float) i / GRID;
+			if (i != 0 && i != GRID && j != 0 && j != GRID)
+			{
+				x += ((rand() % 1000) - 500) / (2500.0f * GRID);
+				y += ((rand() % 1000) - 500) / (2500.0f * GRID);
+			};
+			
+			SRVector point = {2.0f * x - 1.0f, 2.0f * y - 1.0f, 0.0f, 1.0f};
+			points[i][j] = point;
+		};
+	};
+	
+	// two triangles per cell, alternating the diagonal and the winding
+	static TestVertex verts[GRID * GRID * 6];
+	static TestVertex sharedVerts[(GRID+1) * (GRID+1)];
+	static GLushort indices[GRID * GRID * 6];
+	SRVector white = {1.0f, 1.0f, 1.0f, 1.0f};
+	int count = 0;
+	
+	for (i=0; i<=GRID; i++)
+	{
+		for (j=0; j<=GRID; j++)
+		{
+			sharedVerts[i * (GRID+1) + j].pos = points[i][j];
+			sharedVerts[i * (GRID+1) + j].color = white;
+		};
+	};
+	
+	for (i=0; i<GRID; i++)
+	{
+		for (j=0; j<GRID; j++)
+		{
+			SRVector *quad[4] = {&points[i][j], &points[i][j+1], &points[i+1][j+1], &points[i+1][j]};
+			int quadIndices[4] = {i * (GRID+1) + j, i * (GRID+1) + j + 1, (i+1) * (GRID+1) + j + 1, (i+1) * (GRID+1) + j};
+			static const int orders[2][6] = {{0, 1, 2, 0, 3, 2}, {1, 2, 3, 3, 0, 1}};
+			const int *order = orders[(i + j) & 1];
+			
+			int k;
+			for (k=0; k<6; k++)
+			{
+				verts[count].pos = *quad[order[k]];
+				verts[count].color = white;
+				indices[count] = quadIndices[order[k]];
+				count++;
+			};
+		};
+	};
+	
+	memset(colorData, 0, sizeof(colorData));
+	fragCount = 0;
+	if (indexed) drawIndexed(sharedVerts, (GRID+1) * (GRID+1), indices, count);
+	else draw(verts, count);
+	
+	int unshaded = 0;
+	for (i=0; i<WIDTH*HEIGHT; i++)
+	{
+		if (colorData[i] == 0) unshaded++;
+	};
+	
+	if (unshaded != 0 || fragCount != WIDTH * HEIGHT)
+	{
+		printf("coverage (%s): %d pixels unshaded, %d fragments shaded (expected %d)\n", indexed ? "indexed" : "arrays", unshaded, fragCount, WIDTH * HEIGHT);
+		failed = 1;
+	};
+};
+
+static void makeQuad(TestVertex *verts, float x0, float y0, float x1, float y1, float z, SRVector color)
+{
+	SRVector corners[4] = {
+		{x0, y0, z, 1.0f},
+		{x1, y0, z, 1.0f},
+		{x1, y1, z, 1.0f},
+		{x0, y1, z, 1.0f},
+	};
+	static const int order[6] = {0, 1, 2, 0, 2, 3};
+	
+	int i;
+	for (i=0; i<6; i++)
+	{
+		verts[i].pos = corners[order[i]];
+		verts[i].color = color;
+	};
+};
+
+static void testDepth(int nearFirst)
+{
+	SRVector red = {1.0f, 0.0f, 0.0f, 1.0f};
+	SRVector green = {0.0f, 1.0f, 0.0f, 1.0f};
+	TestVertex verts[12];
+	
+	// far red quad on the left, near green quad on the right; they overlap in the middle
+	makeQuad(&verts[nearFirst ? 6 : 0], -1.0f, -1.0f, 0.5f, 1.0f, 0.5f, red);
+	makeQuad(&verts[nearFirst ? 0 : 6], -0.5f, -1.0f, 1.0f, 1.0f, -0.5f, green);
+	
+	memset(colorData, 0, sizeof(colorData));
+	ctx.clearDepth(&ctx, 1.0);
+	ctx.clear(&ctx, GL_DEPTH_BUFFER_BIT);
+	ctx.setCapability(&ctx, GL_DEPTH_TEST, GL_TRUE);
+	ctx.depthFunc(&ctx, GL_LESS);
+	draw(verts, 12);
+	ctx.setCapability(&ctx, GL_DEPTH_TEST, GL_FALSE);
+	
+	int x;
+	for (x=0; x<WIDTH; x++)
+	{
+		// pixel centers in normalized device coordinates
+		float ndc = 2.0f * (x + 0.5f) / WIDTH - 1.0f;
+		uint32_t expected = ndc > -0.5f ? 0xFF00FF00 : 0xFFFF0000;
+		uint32_t actual = colorData[(HEIGHT/2) * WIDTH + x];
+		
+		if (actual != expected)
+		{
+			printf("depth (near quad %s): pixel %d is %08X, expected %08X\n", nearFirst ? "first" : "last", x, actual, expected);
+			failed = 1;
+			return;
+		};
+	};
+};
+
+static void testPack(SRPackFunc pack, const char *name, int redShift, int blueShift)
+{
+	srctx->redShift = redShift;
+	srctx->greenShift = 8;
+	srctx->blueShift = blueShift;
+	srctx->alphaShift = 24;
+	
+	SRVector colors[7];
+	uint32_t expected[7];
+	uint32_t actual[7];
+	
+	int iter;
+	for (iter=0; iter<10000; iter++)
+	{
+		int i, j;
+		for (i=0; i<7; i++)
+		{
+			for (j=0; j<4; j++) colors[i][j] = (rand() % 3000) / 2000.0f - 0.25f;
+		};
+		
+		srPackScalar(expected, colors, 7, srctx);
+		pack(actual, colors, 7, srctx);
+		
+		for (i=0; i<7; i++)
+		{
+			if (expected[i] != actual[i])
+			{
+				printf("%s: packed %08X, expected %08X\n", name, actual[i], expected[i]);
+				failed = 1;
+				return;
+			};
+		};
+	};
+};
+
+int main()
+{
+	setupContext();
+	
+	srand(1234);
+	int i;
+	for (i=0; i<20; i++)
+	{
+		testCoverage(0);
+		testCoverage(1);
+	};
+	
+	testDepth(0);
+	testDepth(1);
+	
+	testPack(srPackBGRA, "BGRA", 16, 0);
+	testPack(srPackRGBA, "RGBA", 0, 16);
+	
+	if (failed) return 1;
+	printf("all tests passed\n");
+	return 0;
+};
@@ -0,0 +1,21 @@
+# raster.sh
+# Check coverage rules, depth testing and pixel packing of the softrender rasterizer
+testdir="`dirname $0`"
+srcdir="$testdir/../.."
+sr="$srcdir/ddi-drivers/softrender"
+
+# libddi.h wants <sys/glidix.h>, which nothing here actually needs
+mkdir -p raster-include/sys
+touch raster-include/sys/glidix.h
+
+# Attempt to compile the test
+command="cc -O2 -Iraster-include -I$sr -I$srcdir/libddi -I$srcdir/libgl/include $sr/draw.c $sr/specialize.c $sr/context.c $sr/pipeline.c $sr/vao.c $sr/buffer.c $testdir/raster-test.c -o raster-test -lpthread $TEST_CFLAGS -ggdb -w"
+echo "Compiling softrender rasterizer unit test using: $command"
+$command || exit 1
+
+# Now run it, once on the drawing thread only and once with workers
+echo "Running softrender rasterizer unit test:"
+SOFTRENDER_THREADS=1 ./raster-test || exit 1
+SOFTRENDER_THREADS=4 ./raster-test || exit 1
+
+echo "Softrender rasterizer unit test is OK"